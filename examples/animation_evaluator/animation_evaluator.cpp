@@ -0,0 +1,422 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "animation_evaluator.h"
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/KeyframeAnimation.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_EVALUATOR_SSE 1
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+// Channels claimed by a thread at a time. Large enough to amortize the atomic, small enough to balance the threads.
+static const uint32_t c_ChannelsPerBatch = 64;
+static const size_t c_Lanes = 4;
+
+// Keyframes walked forward from the cached cursor before falling back to a binary search
+static const uint32_t c_MaxCursorSteps = 4;
+
+AnimationEvaluator::AnimationEvaluator(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+
+    for (uint32_t i = 1; i < threadCount; i++)
+        m_Threads.emplace_back(&AnimationEvaluator::WorkerThread, this);
+}
+
+AnimationEvaluator::~AnimationEvaluator()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+    }
+    m_WorkAvailable.notify_all();
+
+    for (std::thread& thread : m_Threads)
+        thread.join();
+}
+
+void AnimationEvaluator::SetAnimations(const std::vector<std::shared_ptr<engine::SceneGraphAnimation>>& animations)
+{
+    m_Animations = animations;
+    m_Channels.clear();
+    m_FallbackChannels.clear();
+    m_KeyTimes.clear();
+    for (std::vector<float>& values : m_KeyValues)
+        values.clear();
+
+    std::vector<Channel> rotationChannels;
+
+    for (uint32_t animationIndex = 0; animationIndex < uint32_t(animations.size()); ++animationIndex)
+    {
+        for (const auto& animationChannel : animations[animationIndex]->GetChannels())
+        {
+            const auto& sampler = animationChannel->GetSampler();
+            auto node = animationChannel->GetTargetNode();
+            if (!sampler || !node || sampler->GetKeyframes().empty())
+                continue;
+
+            const engine::animation::InterpolationMode mode = sampler->GetInterpolationMode();
+            const engine::AnimationAttribute attribute = animationChannel->GetAttribute();
+
+            const bool supportedMode = mode == engine::animation::InterpolationMode::Step
+                || mode == engine::animation::InterpolationMode::Linear
+                || mode == engine::animation::InterpolationMode::Slerp;
+            const bool supportedAttribute = attribute == engine::AnimationAttribute::Translation
+                || attribute == engine::AnimationAttribute::Scaling
+                || attribute == engine::AnimationAttribute::Rotation;
+
+            if (!supportedMode || !supportedAttribute)
+            {
+                m_FallbackChannels.push_back({ animationChannel, animationIndex });
+                continue;
+            }
+
+            const auto& keyframes = sampler->GetKeyframes();
+
+            Channel channel;
+            channel.node = node;
+            channel.animationIndex = animationIndex;
+            channel.firstKey = uint32_t(m_KeyTimes.size());
+            channel.keyCount = uint32_t(keyframes.size());
+            channel.step = mode == engine::animation::InterpolationMode::Step;
+            channel.kind = (attribute == engine::AnimationAttribute::Rotation) ? ChannelKind::Rotation
+                : (attribute == engine::AnimationAttribute::Scaling) ? ChannelKind::Scaling
+                : ChannelKind::Translation;
+
+            for (const engine::animation::Keyframe& keyframe : keyframes)
+            {
+                m_KeyTimes.push_back(keyframe.time);
+                for (int component = 0; component < 4; ++component)
+                    m_KeyValues[component].push_back(keyframe.value[component]);
+            }
+
+            if (channel.kind == ChannelKind::Rotation)
+                rotationChannels.push_back(std::move(channel));
+            else
+                m_Channels.push_back(std::move(channel));
+        }
+    }
+
+    m_FirstRotation = m_Channels.size();
+    m_Channels.insert(m_Channels.end(), std::make_move_iterator(rotationChannels.begin()), std::make_move_iterator(rotationChannels.end()));
+
+    for (std::vector<float>& results : m_Results)
+        results.resize(m_Channels.size());
+
+    // NaN never compares equal, so that the first evaluation writes every channel
+    for (std::vector<float>& written : m_Written)
+        written.assign(m_Channels.size(), std::numeric_limits<float>::quiet_NaN());
+}
+
+void AnimationEvaluator::Evaluate(const std::vector<float>& animationTimes)
+{
+    assert(animationTimes.size() >= m_Animations.size());
+
+    m_AnimationTimes = animationTimes.data();
+    m_BatchCount = uint32_t((m_Channels.size() + c_ChannelsPerBatch - 1) / c_ChannelsPerBatch);
+    m_NextBatch = 0;
+
+    // Wake up the workers only when there is more than one batch, otherwise the handoff costs more than the work
+    const bool useWorkers = !m_Threads.empty() && m_BatchCount > 1;
+    if (useWorkers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_BusyWorkers = uint32_t(m_Threads.size());
+            ++m_WorkGeneration;
+        }
+        m_WorkAvailable.notify_all();
+    }
+
+    ProcessBatches();
+
+    if (useWorkers)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_WorkDone.wait(lock, [this]() { return m_BusyWorkers == 0; });
+    }
+
+    WriteResults();
+
+    for (const FallbackChannel& fallback : m_FallbackChannels)
+    {
+        if (fallback.channel->Apply(animationTimes[fallback.animationIndex]))
+        {
+            if (auto node = fallback.channel->GetTargetNode())
+                m_WrittenNodes.push_back(node.get());
+        }
+    }
+
+    m_AnimationTimes = nullptr;
+}
+
+void AnimationEvaluator::WorkerThread()
+{
+    uint64_t lastGeneration = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkAvailable.wait(lock, [this, lastGeneration]() { return m_Exit || m_WorkGeneration != lastGeneration; });
+            if (m_Exit)
+                return;
+            lastGeneration = m_WorkGeneration;
+        }
+
+        ProcessBatches();
+
+        bool lastWorker;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            lastWorker = --m_BusyWorkers == 0;
+        }
+        if (lastWorker)
+            m_WorkDone.notify_one();
+    }
+}
+
+void AnimationEvaluator::ProcessBatches()
+{
+    for (uint32_t batch = m_NextBatch++; batch < m_BatchCount; batch = m_NextBatch++)
+    {
+        const size_t first = size_t(batch) * c_ChannelsPerBatch;
+        const size_t end = std::min(first + c_ChannelsPerBatch, m_Channels.size());
+
+        // Keep the linearly and spherically interpolated channels in separate runs
+        if (first < m_FirstRotation && end > m_FirstRotation)
+        {
+            SampleBatch(first, m_FirstRotation - first);
+            SampleBatch(m_FirstRotation, end - m_FirstRotation);
+        }
+        else
+            SampleBatch(first, end - first);
+    }
+}
+
+void ApproximateSlerp4(const float a[4][4], const float b[4][4], const float t[4], float result[4][4])
+{
+    // Nlerp with a corrected interpolation factor, which needs no trigonometry.
+    // See https://zeux.io/2015/07/23/approximating-slerp/
+#if ANIMATION_EVALUATOR_SSE
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 signMask = _mm_set1_ps(-0.f);
+
+    const __m128 vt = _mm_loadu_ps(t);
+    __m128 va[4], vb[4];
+    for (int component = 0; component < 4; ++component)
+    {
+        va[component] = _mm_loadu_ps(a[component]);
+        vb[component] = _mm_loadu_ps(b[component]);
+    }
+
+    __m128 cosAngle = _mm_mul_ps(va[0], vb[0]);
+    for (int component = 1; component < 4; ++component)
+        cosAngle = _mm_add_ps(cosAngle, _mm_mul_ps(va[component], vb[component]));
+
+    const __m128 d = _mm_andnot_ps(signMask, cosAngle);
+    const __m128 A = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-3.2452f),
+        _mm_mul_ps(d, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(1.43519f)))))));
+    const __m128 B = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-1.06021f),
+        _mm_mul_ps(d, _mm_set1_ps(0.215638f)))));
+    const __m128 tHalf = _mm_sub_ps(vt, half);
+    const __m128 k = _mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(tHalf, tHalf)), B);
+    const __m128 ot = _mm_add_ps(vt, _mm_mul_ps(_mm_mul_ps(vt, tHalf), _mm_mul_ps(_mm_sub_ps(vt, one), k)));
+
+    // Take the shorter arc by flipping the second quaternion when the two are on opposite hemispheres
+    const __m128 weightA = _mm_sub_ps(one, ot);
+    const __m128 weightB = _mm_xor_ps(ot, _mm_and_ps(cosAngle, signMask));
+
+    __m128 lengthSquared = _mm_setzero_ps();
+    for (int component = 0; component < 4; ++component)
+    {
+        va[component] = _mm_add_ps(_mm_mul_ps(va[component], weightA), _mm_mul_ps(vb[component], weightB));
+        lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(va[component], va[component]));
+    }
+
+    const __m128 length = _mm_sqrt_ps(_mm_max_ps(lengthSquared, _mm_set1_ps(1e-30f)));
+    for (int component = 0; component < 4; ++component)
+        _mm_storeu_ps(result[component], _mm_div_ps(va[component], length));
+#else
+    for (size_t lane = 0; lane < c_Lanes; ++lane)
+    {
+        float cosAngle = 0.f;
+        for (int component = 0; component < 4; ++component)
+            cosAngle += a[component][lane] * b[component][lane];
+
+        const float d = std::abs(cosAngle);
+        const float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+        const float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+        const float tHalf = t[lane] - 0.5f;
+        const float k = A * tHalf * tHalf + B;
+        const float ot = t[lane] + t[lane] * tHalf * (t[lane] - 1.f) * k;
+
+        const float weightA = 1.f - ot;
+        const float weightB = (cosAngle < 0.f) ? -ot : ot;
+
+        float lengthSquared = 0.f;
+        for (int component = 0; component < 4; ++component)
+        {
+            result[component][lane] = a[component][lane] * weightA + b[component][lane] * weightB;
+            lengthSquared += result[component][lane] * result[component][lane];
+        }
+
+        const float length = std::sqrt(std::max(lengthSquared, 1e-30f));
+        for (int component = 0; component < 4; ++component)
+            result[component][lane] /= length;
+    }
+#endif
+}
+
+// Returns the keyframe k of a channel such that times[k] <= time < times[k + 1], starting from the cached cursor.
+// Time usually advances by less than a keyframe per frame, so the search rarely goes beyond a step or two.
+static uint32_t FindKeyframe(const float* times, uint32_t keyCount, uint32_t cursor, float time)
+{
+    if (time < times[cursor])
+        return uint32_t(std::upper_bound(times, times + cursor, time) - times) - 1;
+
+    for (uint32_t step = 0; step < c_MaxCursorSteps; ++step)
+    {
+        if (time < times[cursor + 1])
+            return cursor;
+        ++cursor;
+    }
+
+    return uint32_t(std::upper_bound(times + cursor, times + keyCount, time) - times) - 1;
+}
+
+void AnimationEvaluator::SampleBatch(size_t firstChannel, size_t channelCount)
+{
+    const bool spherical = firstChannel >= m_FirstRotation;
+
+    for (size_t group = 0; group < channelCount; group += c_Lanes)
+    {
+        // Gather the two keyframes and the interpolation factor of each lane
+        alignas(16) float a[4][c_Lanes] = {};
+        alignas(16) float b[4][c_Lanes] = {};
+        alignas(16) float t[c_Lanes] = {};
+
+        const size_t lanes = std::min(c_Lanes, channelCount - group);
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+            Channel& channel = m_Channels[firstChannel + group + lane];
+            const float* times = m_KeyTimes.data() + channel.firstKey;
+            const float time = m_AnimationTimes[channel.animationIndex];
+
+            // Clamp to the first and last keyframes, like Sampler::Evaluate with extrapolateLastValues
+            uint32_t keyA, keyB;
+            if (channel.keyCount == 1 || time <= times[0])
+                keyA = keyB = 0;
+            else if (time >= times[channel.keyCount - 1])
+                keyA = keyB = channel.keyCount - 1;
+            else
+            {
+                keyA = channel.cursor = FindKeyframe(times, channel.keyCount, std::min(channel.cursor, channel.keyCount - 2), time);
+                keyB = keyA + 1;
+                if (!channel.step)
+                    t[lane] = (time - times[keyA]) / (times[keyB] - times[keyA]);
+            }
+
+            for (int component = 0; component < 4; ++component)
+            {
+                a[component][lane] = m_KeyValues[component][channel.firstKey + keyA];
+                b[component][lane] = m_KeyValues[component][channel.firstKey + keyB];
+            }
+        }
+
+        // Unused lanes are zero, and are interpolated but never stored
+        alignas(16) float result[4][c_Lanes];
+
+        if (spherical)
+            ApproximateSlerp4(a, b, t, result);
+        else
+        {
+#if ANIMATION_EVALUATOR_SSE
+            const __m128 vt = _mm_load_ps(t);
+            for (int component = 0; component < 4; ++component)
+            {
+                const __m128 va = _mm_load_ps(a[component]);
+                const __m128 vb = _mm_load_ps(b[component]);
+                _mm_store_ps(result[component], _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+            }
+#else
+            for (int component = 0; component < 4; ++component)
+                for (size_t lane = 0; lane < c_Lanes; ++lane)
+                    result[component][lane] = a[component][lane] + (b[component][lane] - a[component][lane]) * t[lane];
+#endif
+        }
+
+        for (int component = 0; component < 4; ++component)
+            std::copy(result[component], result[component] + lanes, m_Results[component].data() + firstChannel + group);
+    }
+}
+
+void AnimationEvaluator::WriteResults()
+{
+    m_LastWrittenChannelCount = 0;
+    m_WrittenNodes.clear();
+
+    for (size_t index = 0; index < m_Channels.size(); ++index)
+    {
+        // Writing a node marks its subtree dirty, which makes the scene refresh its transforms and rewrite the
+        // instance buffer, so channels that hold their value (constant keys, or past the last keyframe) are skipped.
+        if (m_Results[0][index] == m_Written[0][index] && m_Results[1][index] == m_Written[1][index] &&
+            m_Results[2][index] == m_Written[2][index] && m_Results[3][index] == m_Written[3][index])
+            continue;
+
+        auto node = m_Channels[index].node.lock();
+        if (!node)
+            continue;
+
+        for (int component = 0; component < 4; ++component)
+            m_Written[component][index] = m_Results[component][index];
+        ++m_LastWrittenChannelCount;
+        m_WrittenNodes.push_back(node.get());
+
+        const double4 value = double4(m_Results[0][index], m_Results[1][index], m_Results[2][index], m_Results[3][index]);
+
+        switch (m_Channels[index].kind)
+        {
+        case ChannelKind::Translation:
+            node->SetTranslation(value.xyz());
+            break;
+        case ChannelKind::Scaling:
+            node->SetScaling(value.xyz());
+            break;
+        case ChannelKind::Rotation:
+            node->SetRotation(dquat::fromXYZW(value));
+            break;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraphAnimation;
+    class SceneGraphAnimationChannel;
+    class SceneGraphNode;
+}
+
+// Interpolates four pairs of unit quaternions, stored one array per component, along the shorter arc. This is the
+// approximation of slerp used for rotation channels: the rotation it returns is within 1e-3 radians of slerp, with the
+// largest error for keyframes half a turn apart, and it is exact at t = 0, 0.5 and 1. test_slerp checks the bound.
+void ApproximateSlerp4(const float a[4][4], const float b[4][4], const float t[4], float result[4][4]);
+
+// Samples the keyframe animations of a scene graph, as SceneGraphAnimation::Apply does, but for all animations at once.
+//
+// The channels are flattened into arrays of keyframe times and values, one array per component, and each channel caches
+// the keyframe it used last so that advancing time does not search from the start. The channels are sampled in batches
+// of four with SSE on worker threads, and the results are written to the scene graph nodes in one pass at the end, on the
+// calling thread, because the nodes are not thread safe.
+//
+// Linear, slerp and step channels of node transforms take this path. Spline channels and leaf property channels
+// are rare, and are applied through SceneGraphAnimationChannel::Apply.
+class AnimationEvaluator
+{
+public:
+    // Uses up to threadCount threads, including the calling thread. 0 uses all hardware threads.
+    explicit AnimationEvaluator(uint32_t threadCount = 0);
+    ~AnimationEvaluator();
+
+    // Flattens the channels of the animations. Must be called again when the animations or their target nodes change.
+    void SetAnimations(const std::vector<std::shared_ptr<donut::engine::SceneGraphAnimation>>& animations);
+
+    // Samples every animation at animationTimes[i], where i is the index of the animation passed to SetAnimations,
+    // and updates the target nodes. Nodes whose sampled value did not change since the last evaluation are not written,
+    // so that a paused or finished animation leaves the scene graph clean.
+    void Evaluate(const std::vector<float>& animationTimes);
+
+    size_t GetAnimationCount() const { return m_Animations.size(); }
+
+    // Number of batched channels that wrote a new value to their node in the last evaluation
+    size_t GetLastWrittenChannelCount() const { return m_LastWrittenChannelCount; }
+
+    // Nodes written by the last evaluation, which includes the targets of the channels applied through
+    // SceneGraphAnimationChannel::Apply. A node with several channels may be listed more than once.
+    const std::vector<donut::engine::SceneGraphNode*>& GetLastWrittenNodes() const { return m_WrittenNodes; }
+
+private:
+    enum class ChannelKind : uint8_t
+    {
+        Translation,
+        Scaling,
+        Rotation
+    };
+
+    // A channel sampled by the batched path. Its keyframes are m_KeyTimes[firstKey, firstKey + keyCount).
+    struct Channel
+    {
+        std::weak_ptr<donut::engine::SceneGraphNode> node;
+        uint32_t animationIndex = 0;
+        uint32_t firstKey = 0;
+        uint32_t keyCount = 0;
+        uint32_t cursor = 0; // Keyframe used by the last evaluation, relative to firstKey
+        ChannelKind kind = ChannelKind::Translation;
+        bool step = false;
+    };
+
+    struct FallbackChannel
+    {
+        std::shared_ptr<donut::engine::SceneGraphAnimationChannel> channel;
+        uint32_t animationIndex = 0;
+    };
+
+    std::vector<std::shared_ptr<donut::engine::SceneGraphAnimation>> m_Animations;
+
+    // The translation and scaling channels come first, followed by the rotation channels starting at m_FirstRotation,
+    // so that every batch of four is either interpolated linearly or spherically.
+    std::vector<Channel> m_Channels;
+    size_t m_FirstRotation = 0;
+    std::vector<FallbackChannel> m_FallbackChannels;
+
+    std::vector<float> m_KeyTimes;
+    std::vector<float> m_KeyValues[4];
+    std::vector<float> m_Results[4]; // Sampled value of each channel, one array per component
+    std::vector<float> m_Written[4]; // Value last written to the node of each channel
+    size_t m_LastWrittenChannelCount = 0;
+    std::vector<donut::engine::SceneGraphNode*> m_WrittenNodes;
+
+    const float* m_AnimationTimes = nullptr;
+
+    // Persistent worker threads, woken up for every evaluation
+    std::vector<std::thread> m_Threads;
+    std::mutex m_Mutex;
+    std::condition_variable m_WorkAvailable;
+    std::condition_variable m_WorkDone;
+    uint64_t m_WorkGeneration = 0;
+    uint32_t m_BusyWorkers = 0;
+    bool m_Exit = false;
+    std::atomic<uint32_t> m_NextBatch = 0;
+    uint32_t m_BatchCount = 0;
+
+    void WorkerThread();
+    void ProcessBatches();
+    void SampleBatch(size_t firstChannel, size_t channelCount);
+    void WriteResults();
+};
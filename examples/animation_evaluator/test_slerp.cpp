@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+// Compares ApproximateSlerp4 with a double precision slerp over the full range of angles between two rotations,
+// on both hemispheres, and fails if the rotations differ by more than the bound stated in animation_evaluator.h.
+
+#include "animation_evaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static const double c_MaxErrorRadians = 1e-3;
+static const double c_Pi = 3.14159265358979323846;
+static const int c_AngleSteps = 2000;
+static const int c_TimeSteps = 200;
+
+// Angle of the rotation between the orientations of two unit quaternions, accurate for nearly equal quaternions
+static double RotationAngle(const double p[4], const float q[4])
+{
+    double dot = 0.0;
+    for (int component = 0; component < 4; ++component)
+        dot += p[component] * q[component];
+    const double sign = (dot < 0.0) ? -1.0 : 1.0;
+
+    double differenceSquared = 0.0, sumSquared = 0.0;
+    for (int component = 0; component < 4; ++component)
+    {
+        const double difference = q[component] - sign * p[component];
+        const double sum = q[component] + sign * p[component];
+        differenceSquared += difference * difference;
+        sumSquared += sum * sum;
+    }
+
+    return 4.0 * std::atan2(std::sqrt(differenceSquared), std::sqrt(sumSquared));
+}
+
+// Shorter arc slerp, in double precision
+static void ReferenceSlerp(const double p[4], const double q[4], double t, double result[4])
+{
+    double cosAngle = 0.0;
+    for (int component = 0; component < 4; ++component)
+        cosAngle += p[component] * q[component];
+    const double sign = (cosAngle < 0.0) ? -1.0 : 1.0;
+
+    const double angle = std::acos(std::min(std::abs(cosAngle), 1.0));
+    const double sinAngle = std::sin(angle);
+    const double weightP = (sinAngle > 1e-12) ? std::sin((1.0 - t) * angle) / sinAngle : 1.0 - t;
+    const double weightQ = (sinAngle > 1e-12) ? std::sin(t * angle) / sinAngle : t;
+
+    for (int component = 0; component < 4; ++component)
+        result[component] = p[component] * weightP + sign * q[component] * weightQ;
+}
+
+int main()
+{
+    double maxError = 0.0;
+    double maxErrorAngle = 0.0;
+    double maxErrorTime = 0.0;
+
+    // The angle between the quaternions goes from 0 to pi, which covers every rotation on both hemispheres.
+    // The axes are not axis aligned so that every component is exercised.
+    const double axisP[3] = { 0.267261, 0.534522, 0.801784 };
+    const double axisQ[3] = { -0.816497, 0.408248, 0.408248 };
+
+    for (int angleStep = 0; angleStep <= c_AngleSteps; ++angleStep)
+    {
+        const double angle = c_Pi * angleStep / c_AngleSteps;
+
+        // p is an arbitrary rotation, and q is at the given angle from p in the plane of p and an orthogonal direction
+        const double p[4] = { axisP[0] * 0.6, axisP[1] * 0.6, axisP[2] * 0.6, 0.8 };
+        double orthogonal[4] = { axisQ[0], axisQ[1], axisQ[2], 0.0 };
+        double projection = 0.0;
+        for (int component = 0; component < 4; ++component)
+            projection += orthogonal[component] * p[component];
+        double length = 0.0;
+        for (int component = 0; component < 4; ++component)
+        {
+            orthogonal[component] -= projection * p[component];
+            length += orthogonal[component] * orthogonal[component];
+        }
+        length = std::sqrt(length);
+
+        double q[4];
+        for (int component = 0; component < 4; ++component)
+            q[component] = p[component] * std::cos(angle) + orthogonal[component] / length * std::sin(angle);
+
+        for (int timeStep = 0; timeStep <= c_TimeSteps; timeStep += 4)
+        {
+            float a[4][4], b[4][4], t[4], result[4][4];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                t[lane] = float(std::min(timeStep + lane, c_TimeSteps)) / float(c_TimeSteps);
+                for (int component = 0; component < 4; ++component)
+                {
+                    a[component][lane] = float(p[component]);
+                    b[component][lane] = float(q[component]);
+                }
+            }
+
+            ApproximateSlerp4(a, b, t, result);
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                double expected[4];
+                ReferenceSlerp(p, q, t[lane], expected);
+
+                const float actual[4] = { result[0][lane], result[1][lane], result[2][lane], result[3][lane] };
+                const double error = RotationAngle(expected, actual);
+                if (error > maxError)
+                {
+                    maxError = error;
+                    maxErrorAngle = angle;
+                    maxErrorTime = t[lane];
+                }
+            }
+        }
+    }
+
+    printf("Largest difference from slerp: %.3g radians, for quaternions %.4f radians apart at t = %.3f\n",
+        maxError, maxErrorAngle, maxErrorTime);
+
+    if (maxError > c_MaxErrorRadians)
+    {
+        printf("FAILED: the difference exceeds %.3g radians\n", c_MaxErrorRadians);
+        return 1;
+    }
+
+    return 0;
+}
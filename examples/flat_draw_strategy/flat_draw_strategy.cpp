@@ -0,0 +1,271 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "flat_draw_strategy.h"
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace donut;
+using namespace donut::math;
+
+static bool IsOpaqueDomain(engine::MaterialDomain domain)
+{
+    return domain == engine::MaterialDomain::Opaque || domain == engine::MaterialDomain::AlphaTested;
+}
+
+static box3 GetItemBounds(const render::DrawItem& item)
+{
+    const auto* node = item.instance->GetNode();
+
+    // Geometries without bounds are culled with their whole node
+    if (item.geometry->objectSpaceBounds.isempty())
+        return node->GetGlobalBoundingBox();
+
+    return item.geometry->objectSpaceBounds * node->GetLocalToWorldTransformFloat();
+}
+
+void FlatDrawList::Build(engine::SceneGraphNode* rootNode)
+{
+    Clear();
+
+    if (!rootNode)
+        return;
+
+    const engine::SceneContentFlags relevantContentFlags = engine::SceneContentFlags::OpaqueMeshes | engine::SceneContentFlags::AlphaTestedMeshes;
+
+    std::vector<render::DrawItem> items;
+
+    engine::SceneGraphWalker walker(rootNode);
+    while (walker)
+    {
+        const bool subgraphContentRelevant = (walker->GetSubgraphContentFlags() & relevantContentFlags) != 0;
+
+        if ((walker->GetLeafContentFlags() & relevantContentFlags) != 0)
+        {
+            if (auto meshInstance = dynamic_cast<const engine::MeshInstance*>(walker->GetLeaf().get()))
+            {
+                const engine::MeshInfo* mesh = meshInstance->GetMesh().get();
+
+                for (const auto& geometry : mesh->geometries)
+                {
+                    const engine::Material* material = geometry->material.get();
+                    if (!material || !IsOpaqueDomain(material->domain))
+                        continue;
+
+                    render::DrawItem item;
+                    item.instance = meshInstance;
+                    item.mesh = mesh;
+                    item.geometry = geometry.get();
+                    item.material = material;
+                    item.buffers = mesh->buffers.get();
+                    item.distanceToCamera = 0.f;
+                    item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+                    items.push_back(item);
+                }
+            }
+        }
+
+        walker.Next(subgraphContentRelevant);
+    }
+
+    // Opaque before alpha tested, so that each domain's pipeline is bound once, then grouped by material and buffers
+    // to minimize binding changes, and by geometry and instance so that instances of a geometry are adjacent.
+    std::sort(items.begin(), items.end(), [](const render::DrawItem& a, const render::DrawItem& b)
+    {
+        if (a.material->domain != b.material->domain)
+            return a.material->domain < b.material->domain;
+        if (a.material != b.material)
+            return a.material < b.material;
+        if (a.buffers != b.buffers)
+            return a.buffers < b.buffers;
+        if (a.geometry != b.geometry)
+            return a.geometry < b.geometry;
+        return a.instance->GetInstanceIndex() < b.instance->GetInstanceIndex();
+    });
+
+    m_Items = std::move(items);
+
+    // Index the items by mesh instance, so that moving an instance only updates the bounds of its own items
+    uint32_t instanceCount = 0;
+    for (const render::DrawItem& item : m_Items)
+        instanceCount = std::max(instanceCount, uint32_t(item.instance->GetInstanceIndex()) + 1);
+
+    m_InstanceItemOffsets.assign(instanceCount + 1, 0);
+    for (const render::DrawItem& item : m_Items)
+        ++m_InstanceItemOffsets[item.instance->GetInstanceIndex() + 1];
+    for (uint32_t instanceIndex = 0; instanceIndex < instanceCount; ++instanceIndex)
+        m_InstanceItemOffsets[instanceIndex + 1] += m_InstanceItemOffsets[instanceIndex];
+
+    std::vector<uint32_t> cursors(m_InstanceItemOffsets.begin(), m_InstanceItemOffsets.end() - 1);
+    m_InstanceItems.resize(m_Items.size());
+    for (size_t index = 0; index < m_Items.size(); ++index)
+        m_InstanceItems[cursors[m_Items[index].instance->GetInstanceIndex()]++] = uint32_t(index);
+
+    UpdateBounds();
+}
+
+void FlatDrawList::UpdateBounds()
+{
+    m_Bounds.resize(m_Items.size());
+
+    for (size_t index = 0; index < m_Items.size(); ++index)
+        m_Bounds[index] = GetItemBounds(m_Items[index]);
+
+    m_DirtyInstances.clear();
+    m_LastVisitedNodeCount = 0;
+    m_LastUpdatedItemCount = m_Items.size();
+}
+
+void FlatDrawList::UpdateBounds(const std::vector<engine::SceneGraphNode*>& dirtyNodes)
+{
+    m_DirtyInstances.clear();
+    m_VisitedNodes.clear();
+    m_LastVisitedNodeCount = 0;
+    m_LastUpdatedItemCount = 0;
+
+    for (engine::SceneGraphNode* dirtyNode : dirtyNodes)
+    {
+        if (m_VisitedNodes.count(dirtyNode) != 0)
+            continue;
+
+        // The walker stays within the subtree of the node it starts from
+        engine::SceneGraphWalker walker(dirtyNode);
+        while (walker)
+        {
+            ++m_LastVisitedNodeCount;
+
+            // A node walked from an earlier dirty node had its whole subtree walked then
+            const bool firstVisit = m_VisitedNodes.insert(walker.Get()).second;
+            if (firstVisit)
+            {
+                if (auto meshInstance = dynamic_cast<const engine::MeshInstance*>(walker->GetLeaf().get()))
+                    m_DirtyInstances.push_back(meshInstance);
+            }
+
+            walker.Next(firstVisit);
+        }
+    }
+
+    for (const engine::MeshInstance* instance : m_DirtyInstances)
+    {
+        const size_t instanceIndex = size_t(instance->GetInstanceIndex());
+        if (instanceIndex + 1 >= m_InstanceItemOffsets.size())
+            continue;
+
+        for (uint32_t offset = m_InstanceItemOffsets[instanceIndex]; offset < m_InstanceItemOffsets[instanceIndex + 1]; ++offset)
+        {
+            const uint32_t index = m_InstanceItems[offset];
+            m_Bounds[index] = GetItemBounds(m_Items[index]);
+            ++m_LastUpdatedItemCount;
+        }
+    }
+}
+
+void FlatDrawList::Clear()
+{
+    m_Items.clear();
+    m_Bounds.clear();
+    m_InstanceItemOffsets.clear();
+    m_InstanceItems.clear();
+    m_DirtyInstances.clear();
+}
+
+FlatOpaqueDrawStrategy::FlatOpaqueDrawStrategy(std::shared_ptr<const FlatDrawList> drawList)
+    : m_DrawList(std::move(drawList))
+{
+}
+
+void FlatOpaqueDrawStrategy::CullForViews(const engine::ICompositeView& compositeView)
+{
+    m_SharedViews.clear();
+    m_SharedVisibleItems.clear();
+    m_SharedViewMasks.clear();
+
+    if (!m_DrawList)
+        return;
+
+    const uint32_t viewCount = compositeView.GetNumChildViews(engine::ViewType::PLANAR);
+    assert(viewCount <= 32);
+
+    std::vector<frustum> frustums;
+    for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+    {
+        const engine::IView* view = compositeView.GetChildView(engine::ViewType::PLANAR, viewIndex);
+        m_SharedViews.push_back(view);
+        frustums.push_back(view->GetViewFrustum());
+    }
+
+    const std::vector<box3>& bounds = m_DrawList->GetBounds();
+
+    for (size_t index = 0; index < bounds.size(); index++)
+    {
+        uint32_t viewMask = 0;
+        for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+        {
+            if (frustums[viewIndex].intersectsWith(bounds[index]))
+                viewMask |= 1u << viewIndex;
+        }
+
+        if (viewMask != 0)
+        {
+            m_SharedVisibleItems.push_back(uint32_t(index));
+            m_SharedViewMasks.push_back(viewMask);
+        }
+    }
+}
+
+void FlatOpaqueDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
+{
+    m_UseSharedVisibility = std::find(m_SharedViews.begin(), m_SharedViews.end(), &view) != m_SharedViews.end();
+    m_ViewFrustum = view.GetViewFrustum();
+    m_NextItem = 0;
+}
+
+const render::DrawItem* FlatOpaqueDrawStrategy::GetNextItem()
+{
+    if (!m_DrawList)
+        return nullptr;
+
+    const std::vector<render::DrawItem>& items = m_DrawList->GetItems();
+
+    if (m_UseSharedVisibility)
+    {
+        if (m_NextItem < m_SharedVisibleItems.size())
+            return &items[m_SharedVisibleItems[m_NextItem++]];
+
+        return nullptr;
+    }
+    const std::vector<box3>& bounds = m_DrawList->GetBounds();
+
+    while (m_NextItem < items.size())
+    {
+        const size_t index = m_NextItem++;
+
+        if (m_ViewFrustum.intersectsWith(bounds[index]))
+            return &items[index];
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/DrawStrategy.h>
+#include <donut/core/math/math.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraphNode;
+    class MeshInstance;
+}
+
+// The opaque and alpha tested geometry instances of a scene graph, flattened into arrays and sorted by material domain,
+// material, buffers and geometry, so that consecutive items batch into the fewest pipeline and binding changes.
+//
+// Building the list walks the node hierarchy once. It only needs to be built again when the structure of the scene
+// or the materials' domains change, and its bounds updated when transforms change. All views of a frame share it
+// through FlatOpaqueDrawStrategy, so culling a view is a linear pass over the bounds array.
+class FlatDrawList
+{
+public:
+    void Build(donut::engine::SceneGraphNode* rootNode);
+
+    // Recomputes the world space bounds of the items from their nodes' transforms.
+    void UpdateBounds();
+
+    // Recomputes the bounds of the items under dirtyNodes only, for frames where only the transforms of these nodes
+    // changed. Only their subtrees are walked, and a node that is listed twice or lies under another listed node
+    // is walked once.
+    void UpdateBounds(const std::vector<donut::engine::SceneGraphNode*>& dirtyNodes);
+
+    // Work done by the last UpdateBounds: the nodes walked, the mesh instances found under the dirty nodes, and the
+    // items whose bounds were recomputed. Updating all bounds walks no nodes.
+    size_t GetLastVisitedNodeCount() const { return m_LastVisitedNodeCount; }
+    const std::vector<const donut::engine::MeshInstance*>& GetLastDirtyInstances() const { return m_DirtyInstances; }
+    size_t GetLastUpdatedItemCount() const { return m_LastUpdatedItemCount; }
+
+    void Clear();
+
+    bool IsEmpty() const { return m_Items.empty(); }
+    size_t GetItemCount() const { return m_Items.size(); }
+    const std::vector<donut::render::DrawItem>& GetItems() const { return m_Items; }
+    const std::vector<donut::math::box3>& GetBounds() const { return m_Bounds; }
+
+private:
+    std::vector<donut::render::DrawItem> m_Items;
+    std::vector<donut::math::box3> m_Bounds; // World space bounds of each item, kept apart from the items for culling
+
+    // Items of the mesh instance with index i are m_InstanceItems[m_InstanceItemOffsets[i], m_InstanceItemOffsets[i + 1])
+    std::vector<uint32_t> m_InstanceItemOffsets;
+    std::vector<uint32_t> m_InstanceItems;
+
+    std::vector<const donut::engine::MeshInstance*> m_DirtyInstances;
+    std::unordered_set<const donut::engine::SceneGraphNode*> m_VisitedNodes;
+    size_t m_LastVisitedNodeCount = 0;
+    size_t m_LastUpdatedItemCount = 0;
+};
+
+// Returns the visible items of a FlatDrawList in the list's order. The strategy only keeps a cursor, so every view
+// or thread uses its own strategy on the same list. The root node passed to PrepareForView is ignored, the list
+// defines what is drawn.
+class FlatOpaqueDrawStrategy : public donut::render::IDrawStrategy
+{
+public:
+    explicit FlatOpaqueDrawStrategy(std::shared_ptr<const FlatDrawList> drawList);
+
+    // Culls the list once for all planar child views of compositeView, such as the two eyes of a stereo view, which
+    // see nearly the same items. Until the next call, PrepareForView with one of these views returns the items visible
+    // in any of them instead of culling again. The views must stay alive and unchanged until then.
+    // At most 32 child views are supported.
+    void CullForViews(const donut::engine::ICompositeView& compositeView);
+
+    // Number of items found visible by the last CullForViews
+    size_t GetSharedVisibleItemCount() const { return m_SharedVisibleItems.size(); }
+
+    // Indices into the list of the items found visible by the last CullForViews, and for each of them a mask of the
+    // child views that see it, with bit i set for child view i. Passes that draw all views at once use the masks to
+    // draw each item only into the views that see it.
+    const std::vector<uint32_t>& GetSharedVisibleItems() const { return m_SharedVisibleItems; }
+    const std::vector<uint32_t>& GetSharedViewMasks() const { return m_SharedViewMasks; }
+
+    void PrepareForView(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, const donut::engine::IView& view) override;
+    const donut::render::DrawItem* GetNextItem() override;
+
+private:
+    std::shared_ptr<const FlatDrawList> m_DrawList;
+    donut::math::frustum m_ViewFrustum;
+    size_t m_NextItem = 0;
+
+    std::vector<const donut::engine::IView*> m_SharedViews;
+    std::vector<uint32_t> m_SharedVisibleItems; // Indices of the items visible in any of m_SharedViews
+    std::vector<uint32_t> m_SharedViewMasks;
+    bool m_UseSharedVisibility = false;
+};
@@ -0,0 +1,105 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+
+struct GpuTimerNoPayload { };
+
+// A ring of GPU timer queries, one per frame in flight. Each frame uses the slot of its frame index, and reads back the
+// time that the slot measured c_SlotCount frames earlier, when the GPU is done with it, so that reading does not stall.
+//
+// The payload records what was measured, such as the mode that a pass ran in, and is returned with the time.
+// Per-frame readbacks that go with the time can be indexed with GetSlot().
+template<typename Payload = GpuTimerNoPayload>
+class GpuTimerRing
+{
+public:
+    static const uint32_t c_SlotCount = 4;
+
+    void Init(nvrhi::IDevice* device)
+    {
+        m_Device = device;
+        for (Slot& slot : m_Slots)
+        {
+            slot.query = device->createTimerQuery();
+            slot.used = false;
+        }
+    }
+
+    // Moves to the slot of the frame, and reads back its time in milliseconds along with the payload it was ended with.
+    // Returns false if the slot was not used since it was last harvested, or if its query has not completed.
+    bool Harvest(uint32_t frameIndex, float& milliseconds, Payload& payload)
+    {
+        m_Slot = frameIndex % c_SlotCount;
+        Slot& slot = m_Slots[m_Slot];
+        if (!slot.used)
+            return false;
+        slot.used = false;
+
+        const bool completed = m_Device->pollTimerQuery(slot.query);
+        if (completed)
+        {
+            milliseconds = m_Device->getTimerQueryTime(slot.query) * 1000.f;
+            payload = slot.payload;
+        }
+        m_Device->resetTimerQuery(slot.query);
+        return completed;
+    }
+
+    bool Harvest(uint32_t frameIndex, float& milliseconds)
+    {
+        Payload payload;
+        return Harvest(frameIndex, milliseconds, payload);
+    }
+
+    // Begins timing in the slot selected by the last Harvest
+    void Begin(nvrhi::ICommandList* commandList)
+    {
+        commandList->beginTimerQuery(m_Slots[m_Slot].query);
+    }
+
+    void End(nvrhi::ICommandList* commandList, const Payload& payload = Payload())
+    {
+        Slot& slot = m_Slots[m_Slot];
+        commandList->endTimerQuery(slot.query);
+        slot.payload = payload;
+        slot.used = true;
+    }
+
+    uint32_t GetSlot() const { return m_Slot; }
+
+private:
+    struct Slot
+    {
+        nvrhi::TimerQueryHandle query;
+        Payload payload = Payload();
+        bool used = false;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    Slot m_Slots[c_SlotCount];
+    uint32_t m_Slot = 0;
+};
@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "instanced_views.h"
+#include "flat_draw_strategy.h"
+
+#include <donut/engine/Scene.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/render/DrawStrategy.h>
+#include <cassert>
+
+using namespace donut;
+using namespace donut::math;
+
+#include "instanced_views_cb.h"
+
+nvrhi::BindingLayoutDesc GetInstancedViewsBindingLayoutDesc()
+{
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::All;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::PushConstants(1, sizeof(InstancedViewsDrawConstants)),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
+        nvrhi::BindingLayoutItem::Sampler(0)
+    };
+    return layoutDesc;
+}
+
+nvrhi::BindingSetDesc GetInstancedViewsBindingSetDesc(
+    nvrhi::IBuffer* passConstants,
+    const engine::Scene& scene,
+    nvrhi::ISampler* materialSampler)
+{
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, passConstants),
+        nvrhi::BindingSetItem::PushConstants(1, sizeof(InstancedViewsDrawConstants)),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(0, scene.GetInstanceBuffer()),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(1, scene.GetGeometryBuffer()),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(2, scene.GetMaterialBuffer()),
+        nvrhi::BindingSetItem::Sampler(0, materialSampler)
+    };
+    return bindingSetDesc;
+}
+
+InstancedViewsDrawStats DrawInstancedViews(
+    nvrhi::ICommandList* commandList,
+    nvrhi::GraphicsState state,
+    const FlatDrawList& drawList,
+    const std::vector<uint32_t>& itemIndices,
+    const std::vector<uint32_t>& viewMasks,
+    const std::function<nvrhi::IGraphicsPipeline*(const render::DrawItem& item)>& getPipeline)
+{
+    assert(itemIndices.size() == viewMasks.size());
+
+    const std::vector<render::DrawItem>& items = drawList.GetItems();
+
+    InstancedViewsDrawStats stats;
+
+    for (size_t index = 0; index < itemIndices.size(); index++)
+    {
+        assert((viewMasks[index] >> INSTANCED_VIEWS_MAX_VIEWS) == 0);
+
+        // Instance i of the draw is rendered into the i-th view set in the mask
+        uint32_t viewList = 0;
+        uint32_t viewCount = 0;
+        for (uint32_t view = 0; view < INSTANCED_VIEWS_MAX_VIEWS; view++)
+        {
+            if (viewMasks[index] & (1u << view))
+            {
+                viewList |= view << (viewCount * INSTANCED_VIEWS_LIST_BITS);
+                ++viewCount;
+            }
+        }
+
+        if (viewCount == 0)
+            continue;
+
+        const render::DrawItem& item = items[itemIndices[index]];
+
+        nvrhi::IGraphicsPipeline* pipeline = getPipeline(item);
+        if (state.pipeline != pipeline)
+        {
+            state.pipeline = pipeline;
+            commandList->setGraphicsState(state);
+        }
+
+        InstancedViewsDrawConstants drawConstants = {};
+        drawConstants.instance = uint32_t(item.instance->GetInstanceIndex());
+        drawConstants.geometryInMesh = uint32_t(item.geometry->globalGeometryIndex - item.mesh->geometries[0]->globalGeometryIndex);
+        drawConstants.viewList = viewList;
+        commandList->setPushConstants(&drawConstants, sizeof(drawConstants));
+
+        nvrhi::DrawArguments args;
+        args.vertexCount = item.geometry->numIndices;
+        args.instanceCount = viewCount;
+        commandList->draw(args);
+
+        ++stats.drawCount;
+        stats.viewDrawCount += viewCount;
+    }
+
+    return stats;
+}
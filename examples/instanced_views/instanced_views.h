@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <functional>
+#include <vector>
+
+namespace donut::engine
+{
+    class Scene;
+}
+
+namespace donut::render
+{
+    struct DrawItem;
+}
+
+class FlatDrawList;
+
+// Draws the items of a FlatDrawList into several views at once, such as the faces of a cube map or the eyes of a
+// stereo view. Each item is drawn once, with one instance per view that sees it, and the shaders of the pass include
+// instanced_views.hlsli to route every instance to its view. The scene is read through bindless descriptors, so the
+// scene must be loaded with a descriptor table, and these passes are not available on D3D11.
+
+// Layout of the pass bindings, binding set 0: the pass constants at b0, the per-draw push constants at b1,
+// the scene instance, geometry and material buffers at t0-t2 and the material sampler at s0.
+// The bindless layout of the descriptor table is binding set 1.
+nvrhi::BindingLayoutDesc GetInstancedViewsBindingLayoutDesc();
+
+// Binding set for GetInstancedViewsBindingLayoutDesc. The scene buffers are recreated when they grow, so the set must
+// be recreated when their handles change.
+nvrhi::BindingSetDesc GetInstancedViewsBindingSetDesc(
+    nvrhi::IBuffer* passConstants,
+    const donut::engine::Scene& scene,
+    nvrhi::ISampler* materialSampler);
+
+struct InstancedViewsDrawStats
+{
+    // Number of draws, and the number of views they were drawn into
+    uint32_t drawCount = 0;
+    uint32_t viewDrawCount = 0;
+};
+
+// Draws the items of drawList listed in itemIndices, each into the views set in its entry of viewMasks, with bit i
+// for view i, like the shared visibility of FlatOpaqueDrawStrategy::CullForViews. At most INSTANCED_VIEWS_MAX_VIEWS
+// views are supported. state provides the framebuffer, viewports and bindings, and getPipeline selects the pipeline
+// of each item. The list is sorted by material, so the pipeline rarely changes.
+InstancedViewsDrawStats DrawInstancedViews(
+    nvrhi::ICommandList* commandList,
+    nvrhi::GraphicsState state,
+    const FlatDrawList& drawList,
+    const std::vector<uint32_t>& itemIndices,
+    const std::vector<uint32_t>& viewMasks,
+    const std::function<nvrhi::IGraphicsPipeline*(const donut::render::DrawItem& item)>& getPipeline);
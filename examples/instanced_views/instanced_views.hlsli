@@ -0,0 +1,108 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+// Shared by the passes that draw a FlatDrawList into several views at once with DrawInstancedViews. Every instance of
+// a draw is the same geometry instance, seen by the next view in the draw's view list. The vertex shader of the pass
+// loads the vertex with LoadInstancedViewVertex and transforms it with the matrix of its view, and gs_main routes each
+// triangle to the render target array slice of its view, or to its viewport with INSTANCED_VIEWS_VIEWPORTS.
+//
+// The including shader declares its pass constants at b0.
+
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/binding_helpers.hlsli>
+#include <donut/shaders/packing.hlsli>
+#include "instanced_views_cb.h"
+
+VK_PUSH_CONSTANT ConstantBuffer<InstancedViewsDrawConstants> g_Draw : register(b1);
+StructuredBuffer<InstanceData> t_InstanceData : register(t0);
+StructuredBuffer<GeometryData> t_GeometryData : register(t1);
+StructuredBuffer<MaterialConstants> t_MaterialConstants : register(t2);
+SamplerState s_MaterialSampler : register(s0);
+
+VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
+VK_BINDING(1, 1) Texture2D t_BindlessTextures[] : register(t0, space2);
+
+struct InstancedViewVertex
+{
+    float4 position : SV_Position;
+    float3 prevWorldPosition : PREV_WORLD_POSITION;
+    float2 uv : TEXCOORD;
+    float3 normal : NORMAL;
+    float4 tangent : TANGENT;
+    nointerpolation uint material : MATERIAL;
+    nointerpolation uint view : VIEW;
+};
+
+struct InstancedViewGSOutput
+{
+    InstancedViewVertex vertex;
+#if INSTANCED_VIEWS_VIEWPORTS
+    uint view : SV_ViewportArrayIndex;
+#else
+    uint view : SV_RenderTargetArrayIndex;
+#endif
+};
+
+// Fills everything but the position of the vertex, and returns its world space position
+float3 LoadInstancedViewVertex(uint vertexID, uint instanceID, out InstancedViewVertex o_vertex)
+{
+    InstanceData instance = t_InstanceData[g_Draw.instance];
+    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Draw.geometryInMesh];
+
+    ByteAddressBuffer indexBuffer = t_BindlessBuffers[geometry.indexBufferIndex];
+    ByteAddressBuffer vertexBuffer = t_BindlessBuffers[geometry.vertexBufferIndex];
+
+    uint index = indexBuffer.Load(geometry.indexOffset + vertexID * 4);
+
+    float3 objectSpacePosition = asfloat(vertexBuffer.Load3(geometry.positionOffset + index * c_SizeOfPosition));
+    float3 prevObjectSpacePosition = geometry.prevPositionOffset == ~0u ? objectSpacePosition
+        : asfloat(vertexBuffer.Load3(geometry.prevPositionOffset + index * c_SizeOfPosition));
+    float2 texcoord = geometry.texCoord1Offset == ~0u ? 0 : asfloat(vertexBuffer.Load2(geometry.texCoord1Offset + index * c_SizeOfTexcoord));
+    float3 objectSpaceNormal = geometry.normalOffset == ~0u ? float3(0, 1, 0) : Unpack_RGB8_SNORM(vertexBuffer.Load(geometry.normalOffset + index * c_SizeOfNormal));
+    float4 objectSpaceTangent = geometry.tangentOffset == ~0u ? 0 : Unpack_RGBA8_SNORM(vertexBuffer.Load(geometry.tangentOffset + index * c_SizeOfNormal));
+
+    o_vertex.position = 0;
+    o_vertex.prevWorldPosition = mul(instance.prevTransform, float4(prevObjectSpacePosition, 1.0)).xyz;
+    o_vertex.uv = texcoord;
+    o_vertex.normal = mul(instance.transform, float4(objectSpaceNormal, 0.0)).xyz;
+    o_vertex.tangent = float4(mul(instance.transform, float4(objectSpaceTangent.xyz, 0.0)).xyz, objectSpaceTangent.w);
+    o_vertex.material = geometry.materialIndex;
+    o_vertex.view = (g_Draw.viewList >> (instanceID * INSTANCED_VIEWS_LIST_BITS)) & INSTANCED_VIEWS_LIST_MASK;
+
+    return mul(instance.transform, float4(objectSpacePosition, 1.0)).xyz;
+}
+
+// Vertex shaders cannot select the render target slice or the viewport on every device, so the geometry shader does it.
+[maxvertexcount(3)]
+void gs_main(
+    triangle InstancedViewVertex i_vertices[3],
+    inout TriangleStream<InstancedViewGSOutput> o_stream)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        InstancedViewGSOutput output;
+        output.vertex = i_vertices[i];
+        output.view = i_vertices[i].view;
+        o_stream.Append(output);
+    }
+}
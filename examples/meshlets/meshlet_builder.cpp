@@ -0,0 +1,309 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "meshlet_builder.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace donut::math;
+
+static const uint8_t c_NotInMeshlet = 0xff;
+
+// Computes the bounding sphere and normal cone of a finished meshlet.
+static void ComputeMeshletBounds(Meshlet& meshlet, const MeshletData& data, const float3* positions)
+{
+    // Bounding sphere: center of the bounding box, radius reaching the farthest vertex.
+    float3 boundsMin = positions[data.vertices[meshlet.vertexOffset]];
+    float3 boundsMax = boundsMin;
+    for (uint32_t i=1;i<meshlet.vertexCount;i++)
+    {
+        const float3& position = positions[data.vertices[meshlet.vertexOffset+i]];
+        boundsMin = min(boundsMin, position);
+        boundsMax = max(boundsMax, position);
+    }
+
+    const float3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i=0;i<meshlet.vertexCount;i++)
+        radius = std::max(radius, length(positions[data.vertices[meshlet.vertexOffset+i]] - center));
+
+    meshlet.boundingSphere = float4(center, radius);
+
+    // Full detail, until the meshlet goes through simplification.
+    meshlet.lodSphere = meshlet.boundingSphere;
+    meshlet.parentSphere = meshlet.boundingSphere;
+    meshlet.lodError = 0.0f;
+    meshlet.parentError = FLT_MAX;
+
+    // Normal cone: the axis is the average of the triangle normals, and the cone must contain all of them.
+    float3 normals[MeshletParam_MaxTriangles];
+    uint32_t normalCount = 0;
+    float3 axis = float3(0.0f);
+    for (uint32_t i=0;i<meshlet.triangleCount;i++)
+    {
+        const uint32_t packed = data.triangles[meshlet.triangleOffset+i];
+        const float3& p0 = positions[data.vertices[meshlet.vertexOffset + (packed & 0xff)]];
+        const float3& p1 = positions[data.vertices[meshlet.vertexOffset + ((packed >> 8) & 0xff)]];
+        const float3& p2 = positions[data.vertices[meshlet.vertexOffset + ((packed >> 16) & 0xff)]];
+
+        const float3 normal = cross(p1 - p0, p2 - p0);
+        const float area = length(normal);
+        if (area == 0.0f)
+            continue; // Zero area triangles are never visible, and do not affect the cone.
+
+        normals[normalCount] = normal / area;
+        axis += normals[normalCount];
+        normalCount++;
+    }
+
+    meshlet.coneAxisCutoff = float4(0.0f, 0.0f, 0.0f, 1.0f);
+    const float axisLength = length(axis);
+    if (normalCount == 0 || axisLength == 0.0f)
+        return;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (uint32_t i=0;i<normalCount;i++)
+        minDot = std::min(minDot, dot(normals[i], axis));
+
+    // A cone wider than a hemisphere (with some margin) is always partially front facing, so the meshlet can never be culled.
+    if (minDot <= 0.1f)
+        return;
+
+    // Stores the sine of the cone half-angle. The meshlet is backfacing when the view vector to its bounding sphere
+    // is inside the cone's dual, see IsMeshletVisible in shaders.hlsl.
+    meshlet.coneAxisCutoff = float4(axis, sqrtf(1.0f - minDot*minDot));
+}
+
+uint32_t BuildMeshlets(const uint32_t* indices, size_t indexCount, const float3* positions, size_t vertexCount, MeshletData& outData)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    // Triangles that never go into a meshlet are marked as emitted up front.
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t=0;t<triangleCount;t++)
+    {
+        const uint32_t a = indices[t*3+0], b = indices[t*3+1], c = indices[t*3+2];
+        if (a >= vertexCount || b >= vertexCount || c >= vertexCount || a == b || b == c || a == c)
+            emitted[t] = true;
+    }
+
+    // Vertex to triangle adjacency, used to find the neighbours of the meshlet being built.
+    std::vector<uint32_t> adjacencyOffsets(vertexCount+1, 0);
+    for (size_t t=0;t<triangleCount;t++)
+    {
+        if (emitted[t])
+            continue;
+        for (int k=0;k<3;k++)
+            adjacencyOffsets[indices[t*3+k]+1]++;
+    }
+    for (size_t v=0;v<vertexCount;v++)
+        adjacencyOffsets[v+1] += adjacencyOffsets[v];
+
+    std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+    {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end()-1);
+        for (size_t t=0;t<triangleCount;t++)
+        {
+            if (emitted[t])
+                continue;
+            for (int k=0;k<3;k++)
+                adjacency[cursor[indices[t*3+k]]++] = uint32_t(t);
+        }
+    }
+
+    std::vector<uint8_t> localIndex(vertexCount, c_NotInMeshlet);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> candidateMeshlet(triangleCount, ~0u); // Meshlet for which a triangle is in candidates, to add it only once.
+    size_t nextSeed = 0;
+    uint32_t meshletCount = 0;
+
+    Meshlet meshlet = {};
+    meshlet.vertexOffset = uint32_t(outData.vertices.size());
+    meshlet.triangleOffset = uint32_t(outData.triangles.size());
+    float3 centroidSum = float3(0.0f); // Sum of the positions of the meshlet's vertices.
+
+    auto countNewVertices = [&](size_t t)
+    {
+        uint32_t count = 0;
+        for (int k=0;k<3;k++)
+            count += (localIndex[indices[t*3+k]] == c_NotInMeshlet) ? 1 : 0;
+        return count;
+    };
+
+    auto finishMeshlet = [&]()
+    {
+        ComputeMeshletBounds(meshlet, outData, positions);
+        outData.meshlets.push_back(meshlet);
+        meshletCount++;
+
+        for (uint32_t i=0;i<meshlet.vertexCount;i++)
+            localIndex[outData.vertices[meshlet.vertexOffset+i]] = c_NotInMeshlet;
+
+        meshlet = {};
+        meshlet.vertexOffset = uint32_t(outData.vertices.size());
+        meshlet.triangleOffset = uint32_t(outData.triangles.size());
+        centroidSum = float3(0.0f);
+        candidates.clear();
+    };
+
+    for (;;)
+    {
+        // Pick the neighbouring triangle adding the fewest new vertices. Ties go to the triangle closest to the meshlet's
+        // centroid, which keeps meshlets round rather than growing them in strips, then to the lowest index.
+        size_t best = triangleCount;
+        uint32_t bestNewVertices = 4;
+        float bestDistance = 0.0f;
+        const float3 centroid = meshlet.vertexCount ? centroidSum / float(meshlet.vertexCount) : float3(0.0f);
+        for (size_t c=0;c<candidates.size();)
+        {
+            const size_t t = candidates[c];
+            if (emitted[t])
+            {
+                candidates[c] = candidates.back();
+                candidates.pop_back();
+                continue;
+            }
+            c++;
+
+            const uint32_t newVertices = countNewVertices(t);
+            if (newVertices > bestNewVertices)
+                continue;
+
+            const float3 offset = (positions[indices[t*3+0]] + positions[indices[t*3+1]] + positions[indices[t*3+2]]) / 3.0f - centroid;
+            const float distance = dot(offset, offset);
+            if (newVertices < bestNewVertices || distance < bestDistance || (distance == bestDistance && t < best))
+            {
+                best = t;
+                bestNewVertices = newVertices;
+                bestDistance = distance;
+            }
+        }
+
+        // No neighbours left, continue from the next triangle in index order.
+        if (best == triangleCount)
+        {
+            while (nextSeed < triangleCount && emitted[nextSeed])
+                nextSeed++;
+            if (nextSeed == triangleCount)
+                break;
+            best = nextSeed;
+            bestNewVertices = countNewVertices(best);
+        }
+
+        // The triangle does not fit, start a new meshlet with it.
+        if (meshlet.vertexCount + bestNewVertices > MeshletParam_MaxVertices || meshlet.triangleCount == MeshletParam_MaxTriangles)
+        {
+            finishMeshlet();
+            bestNewVertices = countNewVertices(best);
+        }
+
+        uint32_t packed = 0;
+        for (int k=0;k<3;k++)
+        {
+            const uint32_t vertex = indices[best*3+k];
+            if (localIndex[vertex] == c_NotInMeshlet)
+            {
+                localIndex[vertex] = uint8_t(meshlet.vertexCount++);
+                outData.vertices.push_back(vertex);
+                centroidSum += positions[vertex];
+            }
+            packed |= uint32_t(localIndex[vertex]) << (k*8);
+        }
+        outData.triangles.push_back(packed);
+        meshlet.triangleCount++;
+        emitted[best] = true;
+
+        // Triangles sharing a vertex with the new one become candidates.
+        for (int k=0;k<3;k++)
+        {
+            const uint32_t vertex = indices[best*3+k];
+            for (uint32_t a=adjacencyOffsets[vertex];a<adjacencyOffsets[vertex+1];a++)
+            {
+                const uint32_t t = adjacency[a];
+                if (!emitted[t] && candidateMeshlet[t] != meshletCount)
+                {
+                    candidateMeshlet[t] = meshletCount;
+                    candidates.push_back(t);
+                }
+            }
+        }
+    }
+
+    if (meshlet.triangleCount)
+        finishMeshlet();
+
+    return meshletCount;
+}
+
+void BuildMeshletHierarchies(const std::vector<MeshletGeometry>& geometries, MeshletData& outData, std::vector<MeshletRange>& outRanges, uint32_t threadCount)
+{
+    // Each geometry is built into its own data on any thread, and the results are appended in order,
+    // so the output is the same as building the geometries one after the other.
+    std::vector<MeshletData> geometryData(geometries.size());
+    ParallelFor(uint32_t(geometries.size()), threadCount, [&](uint32_t i)
+    {
+        const MeshletGeometry& geometry = geometries[i];
+        BuildMeshletHierarchy(geometry, geometryData[i]);
+    });
+
+    outRanges.resize(geometries.size());
+    for (size_t i=0;i<geometries.size();i++)
+    {
+        MeshletData& data = geometryData[i];
+        outRanges[i].firstMeshlet = uint32_t(outData.meshlets.size());
+        outRanges[i].meshletCount = uint32_t(data.meshlets.size());
+
+        const uint32_t vertexOffset = uint32_t(outData.vertices.size());
+        const uint32_t triangleOffset = uint32_t(outData.triangles.size());
+        for (Meshlet& meshlet : data.meshlets)
+        {
+            meshlet.vertexOffset += vertexOffset;
+            meshlet.triangleOffset += triangleOffset;
+        }
+
+        outData.meshlets.insert(outData.meshlets.end(), data.meshlets.begin(), data.meshlets.end());
+        outData.vertices.insert(outData.vertices.end(), data.vertices.begin(), data.vertices.end());
+        outData.triangles.insert(outData.triangles.end(), data.triangles.begin(), data.triangles.end());
+        data = MeshletData();
+    }
+}
+
+uint64_t HashMeshletGeometry(const MeshletGeometry& geometry)
+{
+    // 64-bit FNV-1a over the counts, indices and positions.
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto hashBytes = [&hash](const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i=0;i<size;i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    };
+
+    const uint64_t counts[2] = { geometry.indexCount, geometry.vertexCount };
+    hashBytes(counts, sizeof(counts));
+    hashBytes(geometry.indices, geometry.indexCount * sizeof(uint32_t));
+    hashBytes(geometry.positions, geometry.vertexCount * sizeof(donut::math::float3));
+    return hash;
+}
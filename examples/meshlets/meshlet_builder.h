@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <vector>
+
+// Meshlet size limits. If changed, make sure to also change MAX_VERTICES_PER_MESHLET and MAX_PRIMS_PER_MESHLET in shaders.hlsl.
+static const uint32_t MeshletParam_MaxVertices = 64;
+static const uint32_t MeshletParam_MaxTriangles = 124;
+
+// GPU layout of one meshlet. Ensure the layout is matched with the Meshlet struct in shaders.hlsl.
+struct Meshlet
+{
+    donut::math::float4 boundingSphere; // Object space center (xyz) and radius (w).
+    donut::math::float4 coneAxisCutoff; // Object space normal cone axis (xyz) and backface test cutoff (w). A cutoff of 1 means the meshlet is never backfacing.
+    donut::math::float4 lodSphere; // Bounds of the group this meshlet was simplified from, or of the meshlet itself at full detail.
+    donut::math::float4 parentSphere; // Bounds of the group this meshlet is simplified in, for the next coarser level.
+    float lodError; // Object space simplification error of this meshlet, 0 at full detail.
+    float parentError; // Error of the meshlets simplified from this one, FLT_MAX if there are none.
+    uint32_t vertexOffset; // First entry of this meshlet in MeshletData::vertices.
+    uint32_t triangleOffset; // First entry of this meshlet in MeshletData::triangles.
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Meshlets of one or more meshes, laid out as they are uploaded to the GPU.
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices; // Source vertex index of each meshlet vertex.
+    std::vector<uint32_t> triangles; // Meshlet-local vertex indices of each triangle, packed 8 bits each: x | y<<8 | z<<16.
+};
+
+// Source geometry of a meshlet build. Indices are relative to the positions array.
+struct MeshletGeometry
+{
+    const uint32_t* indices = nullptr;
+    size_t indexCount = 0;
+    const donut::math::float3* positions = nullptr;
+    size_t vertexCount = 0;
+};
+
+// Meshlets built from one geometry, in MeshletData::meshlets.
+struct MeshletRange
+{
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+};
+
+// Partitions an indexed triangle list into meshlets, and appends them to outData. Triangles are grouped greedily,
+// preferring the neighbours that add the fewest new vertices, so that meshlets are compact and reuse vertices well.
+// Degenerate triangles and triangles with out of range indices are skipped. Returns the number of meshlets appended.
+uint32_t BuildMeshlets(const uint32_t* indices, size_t indexCount, const donut::math::float3* positions, size_t vertexCount, MeshletData& outData);
+
+// Builds the full detail meshlets of a geometry with BuildMeshlets, then coarser levels of detail until the geometry
+// cannot be simplified further, and appends all levels to outData. Groups of neighbouring meshlets are simplified together
+// with their shared borders locked, and split again into meshlets, so that the levels form a DAG. A view draws the meshlets
+// whose own error is acceptable but whose parent error is not, which picks a crack-free cut through the DAG.
+// Simplified meshlets reference a subset of the source vertices. Returns the number of meshlets appended.
+uint32_t BuildMeshletHierarchy(const MeshletGeometry& geometry, MeshletData& outData);
+
+// Builds the meshlet hierarchies of several geometries on up to threadCount threads (0 uses all hardware threads), and appends them
+// to outData in the order of the geometries. The result does not depend on the number of threads.
+void BuildMeshletHierarchies(const std::vector<MeshletGeometry>& geometries, MeshletData& outData, std::vector<MeshletRange>& outRanges, uint32_t threadCount = 0);
+
+// Hash of the indices and positions of a geometry, used to match cached meshlets with scene geometry.
+uint64_t HashMeshletGeometry(const MeshletGeometry& geometry);
@@ -0,0 +1,311 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#include "meshlet_cache.h"
+#include <donut/engine/SceneTypes.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// Cache file layout, all values little-endian:
+//   header:   magic, version, max vertices, max triangles, entry count, meshlet count, vertex count, triangle count (uint32 each)
+//   entries:  hash (uint64), index count, vertex count, first meshlet, meshlet count (uint32 each)
+//   meshlets: bounding sphere, cone axis and cutoff, LOD sphere, parent sphere (16 floats), LOD error, parent error (float each),
+//             vertex offset, triangle offset (uint32 each), vertex count, triangle count (uint8 each)
+//   vertices: source vertex index (uint32)
+//   triangles: meshlet-local vertex indices (3 uint8)
+// Offsets and counts refer to the entries of the following arrays, like in MeshletData.
+static const uint32_t c_CacheMagic = 0x4C48534D; // "MSHL"
+static const uint32_t c_CacheVersion = 2;
+
+static const size_t c_HeaderSize = 8 * 4;
+static const size_t c_EntrySize = 8 + 4 * 4;
+static const size_t c_MeshletSize = 18 * 4 + 2 * 4 + 2; // 18 floats, 2 uint32, 2 uint8.
+
+static bool operator<(const MeshletCache::Entry& a, const MeshletCache::Entry& b)
+{
+    if (a.hash != b.hash)
+        return a.hash < b.hash;
+    if (a.indexCount != b.indexCount)
+        return a.indexCount < b.indexCount;
+    return a.vertexCount < b.vertexCount;
+}
+
+const MeshletCache::Entry* MeshletCache::Find(const MeshletGeometry& geometry) const
+{
+    Entry key;
+    key.hash = HashMeshletGeometry(geometry);
+    key.indexCount = uint32_t(geometry.indexCount);
+    key.vertexCount = uint32_t(geometry.vertexCount);
+
+    auto it = std::lower_bound(entries.begin(), entries.end(), key);
+    if (it == entries.end() || key < *it)
+        return nullptr;
+    return &*it;
+}
+
+void BuildMeshletCache(const std::vector<MeshletGeometry>& geometries, MeshletCache& outCache, uint32_t threadCount)
+{
+    // Unique geometries are built in hash order, so the cache does not depend on the order of the input either.
+    std::vector<std::pair<MeshletCache::Entry, size_t>> unique;
+    unique.reserve(geometries.size());
+    for (size_t i=0;i<geometries.size();i++)
+    {
+        MeshletCache::Entry entry;
+        entry.hash = HashMeshletGeometry(geometries[i]);
+        entry.indexCount = uint32_t(geometries[i].indexCount);
+        entry.vertexCount = uint32_t(geometries[i].vertexCount);
+        unique.emplace_back(entry, i);
+    }
+
+    std::sort(unique.begin(), unique.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    unique.erase(std::unique(unique.begin(), unique.end(), [](const auto& a, const auto& b) { return !(a.first < b.first) && !(b.first < a.first); }), unique.end());
+
+    std::vector<MeshletGeometry> uniqueGeometries;
+    uniqueGeometries.reserve(unique.size());
+    for (const auto& item : unique)
+        uniqueGeometries.push_back(geometries[item.second]);
+
+    outCache = MeshletCache();
+    std::vector<MeshletRange> ranges;
+    BuildMeshletHierarchies(uniqueGeometries, outCache.data, ranges, threadCount);
+
+    outCache.entries.resize(unique.size());
+    for (size_t i=0;i<unique.size();i++)
+    {
+        outCache.entries[i] = unique[i].first;
+        outCache.entries[i].range = ranges[i];
+    }
+}
+
+bool GetMeshletGeometry(const donut::engine::MeshInfo& mesh, const donut::engine::MeshGeometry& geometry, MeshletGeometry& outGeometry)
+{
+    const donut::engine::BufferGroup& buffers = *mesh.buffers;
+    const size_t indexOffset = mesh.indexOffset + geometry.indexOffsetInMesh;
+    const size_t vertexOffset = mesh.vertexOffset + geometry.vertexOffsetInMesh;
+    if (indexOffset + geometry.numIndices > buffers.indexData.size() || vertexOffset + geometry.numVertices > buffers.positionData.size())
+        return false;
+
+    outGeometry.indices = buffers.indexData.data() + indexOffset;
+    outGeometry.indexCount = geometry.numIndices;
+    outGeometry.positions = buffers.positionData.data() + vertexOffset;
+    outGeometry.vertexCount = geometry.numVertices;
+    return true;
+}
+
+std::filesystem::path GetMeshletCachePath(const std::filesystem::path& sceneFileName)
+{
+    std::filesystem::path fileName = sceneFileName;
+    return fileName.replace_extension(".meshlets");
+}
+
+template <typename T>
+static void Write(std::vector<uint8_t>& blob, T value)
+{
+    const size_t offset = blob.size();
+    blob.resize(offset + sizeof(T));
+    memcpy(blob.data() + offset, &value, sizeof(T));
+}
+
+bool WriteMeshletCache(const std::filesystem::path& fileName, const MeshletCache& cache)
+{
+    const MeshletData& data = cache.data;
+
+    std::vector<uint8_t> blob;
+    blob.reserve(c_HeaderSize + cache.entries.size() * c_EntrySize + data.meshlets.size() * c_MeshletSize + data.vertices.size() * 4 + data.triangles.size() * 3);
+
+    for (uint32_t value : { c_CacheMagic, c_CacheVersion, MeshletParam_MaxVertices, MeshletParam_MaxTriangles,
+        uint32_t(cache.entries.size()), uint32_t(data.meshlets.size()), uint32_t(data.vertices.size()), uint32_t(data.triangles.size()) })
+        Write(blob, value);
+
+    for (const MeshletCache::Entry& entry : cache.entries)
+    {
+        Write(blob, entry.hash);
+        Write(blob, entry.indexCount);
+        Write(blob, entry.vertexCount);
+        Write(blob, entry.range.firstMeshlet);
+        Write(blob, entry.range.meshletCount);
+    }
+
+    for (const Meshlet& meshlet : data.meshlets)
+    {
+        for (int i=0;i<4;i++)
+            Write(blob, meshlet.boundingSphere[i]);
+        for (int i=0;i<4;i++)
+            Write(blob, meshlet.coneAxisCutoff[i]);
+        for (int i=0;i<4;i++)
+            Write(blob, meshlet.lodSphere[i]);
+        for (int i=0;i<4;i++)
+            Write(blob, meshlet.parentSphere[i]);
+        Write(blob, meshlet.lodError);
+        Write(blob, meshlet.parentError);
+        Write(blob, meshlet.vertexOffset);
+        Write(blob, meshlet.triangleOffset);
+        Write(blob, uint8_t(meshlet.vertexCount));
+        Write(blob, uint8_t(meshlet.triangleCount));
+    }
+
+    for (uint32_t vertex : data.vertices)
+        Write(blob, vertex);
+
+    for (uint32_t triangle : data.triangles)
+    {
+        for (int k=0;k<3;k++)
+            Write(blob, uint8_t(triangle >> (k*8)));
+    }
+
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(blob.data()), std::streamsize(blob.size()));
+    return bool(file);
+}
+
+// Sequential reader over a loaded cache file, which fails on reads past the end.
+class BlobReader
+{
+public:
+    explicit BlobReader(const std::vector<uint8_t>& blob) : m_blob(blob) {}
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        if (m_offset + sizeof(T) > m_blob.size())
+            return false;
+        memcpy(&value, m_blob.data() + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    bool AtEnd() const { return m_offset == m_blob.size(); }
+
+private:
+    const std::vector<uint8_t>& m_blob;
+    size_t m_offset = 0;
+};
+
+bool ReadMeshletCache(const std::filesystem::path& fileName, MeshletCache& outCache)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<uint8_t> blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    BlobReader reader(blob);
+    uint32_t header[8];
+    for (uint32_t& value : header)
+    {
+        if (!reader.Read(value))
+            return false;
+    }
+    if (header[0] != c_CacheMagic || header[1] != c_CacheVersion || header[2] != MeshletParam_MaxVertices || header[3] != MeshletParam_MaxTriangles)
+        return false;
+
+    const uint32_t entryCount = header[4];
+    const uint32_t meshletCount = header[5];
+    const uint32_t vertexCount = header[6];
+    const uint32_t triangleCount = header[7];
+    if (size_t(entryCount) * c_EntrySize + size_t(meshletCount) * c_MeshletSize + size_t(vertexCount) * 4 + size_t(triangleCount) * 3 != blob.size() - c_HeaderSize)
+        return false;
+
+    MeshletCache cache;
+    cache.entries.resize(entryCount);
+    for (MeshletCache::Entry& entry : cache.entries)
+    {
+        reader.Read(entry.hash);
+        reader.Read(entry.indexCount);
+        reader.Read(entry.vertexCount);
+        reader.Read(entry.range.firstMeshlet);
+        reader.Read(entry.range.meshletCount);
+        if (uint64_t(entry.range.firstMeshlet) + entry.range.meshletCount > meshletCount)
+            return false;
+    }
+    if (!std::is_sorted(cache.entries.begin(), cache.entries.end()))
+        return false;
+
+    cache.data.meshlets.resize(meshletCount);
+    for (Meshlet& meshlet : cache.data.meshlets)
+    {
+        for (int i=0;i<4;i++)
+            reader.Read(meshlet.boundingSphere[i]);
+        for (int i=0;i<4;i++)
+            reader.Read(meshlet.coneAxisCutoff[i]);
+        for (int i=0;i<4;i++)
+            reader.Read(meshlet.lodSphere[i]);
+        for (int i=0;i<4;i++)
+            reader.Read(meshlet.parentSphere[i]);
+        reader.Read(meshlet.lodError);
+        reader.Read(meshlet.parentError);
+        reader.Read(meshlet.vertexOffset);
+        reader.Read(meshlet.triangleOffset);
+        uint8_t counts[2] = {};
+        reader.Read(counts[0]);
+        reader.Read(counts[1]);
+        meshlet.vertexCount = counts[0];
+        meshlet.triangleCount = counts[1];
+
+        if (meshlet.vertexCount > MeshletParam_MaxVertices || meshlet.triangleCount > MeshletParam_MaxTriangles ||
+            uint64_t(meshlet.vertexOffset) + meshlet.vertexCount > vertexCount || uint64_t(meshlet.triangleOffset) + meshlet.triangleCount > triangleCount)
+            return false;
+    }
+
+    cache.data.vertices.resize(vertexCount);
+    for (uint32_t& vertex : cache.data.vertices)
+        reader.Read(vertex);
+
+    cache.data.triangles.resize(triangleCount);
+    for (uint32_t& triangle : cache.data.triangles)
+    {
+        uint8_t local[3] = {};
+        for (uint8_t& index : local)
+            reader.Read(index);
+        triangle = uint32_t(local[0]) | (uint32_t(local[1]) << 8) | (uint32_t(local[2]) << 16);
+    }
+
+    // Indices must stay within their meshlet and source geometry, so that the mesh shader never reads past the vertices.
+    for (const MeshletCache::Entry& entry : cache.entries)
+    {
+        for (uint32_t m=entry.range.firstMeshlet;m<entry.range.firstMeshlet+entry.range.meshletCount;m++)
+        {
+            const Meshlet& meshlet = cache.data.meshlets[m];
+            for (uint32_t i=0;i<meshlet.vertexCount;i++)
+            {
+                if (cache.data.vertices[meshlet.vertexOffset + i] >= entry.vertexCount)
+                    return false;
+            }
+            for (uint32_t i=0;i<meshlet.triangleCount;i++)
+            {
+                const uint32_t triangle = cache.data.triangles[meshlet.triangleOffset + i];
+                for (int k=0;k<3;k++)
+                {
+                    if (((triangle >> (k*8)) & 0xff) >= meshlet.vertexCount)
+                        return false;
+                }
+            }
+        }
+    }
+
+    if (!reader.AtEnd())
+        return false;
+
+    outCache = std::move(cache);
+    return true;
+}
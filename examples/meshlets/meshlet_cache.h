@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "meshlet_builder.h"
+#include <filesystem>
+
+namespace donut::engine
+{
+    struct MeshInfo;
+    struct MeshGeometry;
+}
+
+// Meshlets of a set of geometries, as stored in a meshlet cache file.
+struct MeshletCache
+{
+    struct Entry
+    {
+        uint64_t hash = 0; // HashMeshletGeometry of the source geometry.
+        uint32_t indexCount = 0;
+        uint32_t vertexCount = 0;
+        MeshletRange range;
+    };
+
+    std::vector<Entry> entries; // Sorted by hash.
+    MeshletData data;
+
+    // Returns the cached meshlets of a geometry, or nullptr if the geometry is not in the cache.
+    const Entry* Find(const MeshletGeometry& geometry) const;
+};
+
+// Builds a cache from a set of geometries. Geometries with identical data share their meshlets.
+void BuildMeshletCache(const std::vector<MeshletGeometry>& geometries, MeshletCache& outCache, uint32_t threadCount = 0);
+
+// Cache files are little-endian binary blobs. Writing the same cache always produces the same bytes.
+bool WriteMeshletCache(const std::filesystem::path& fileName, const MeshletCache& cache);
+
+// Reads a cache file. Fails if the file is missing, damaged, or was written with different meshlet size limits.
+bool ReadMeshletCache(const std::filesystem::path& fileName, MeshletCache& outCache);
+
+// Returns the CPU copy of a scene geometry, or false if the mesh buffers do not have one.
+bool GetMeshletGeometry(const donut::engine::MeshInfo& mesh, const donut::engine::MeshGeometry& geometry, MeshletGeometry& outGeometry);
+
+// Cache files are stored next to the scene, with the .meshlets extension.
+std::filesystem::path GetMeshletCachePath(const std::filesystem::path& sceneFileName);
@@ -0,0 +1,460 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#include "meshlet_builder.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace donut::math;
+
+// Number of meshlets simplified together. Larger groups lock a smaller share of their vertices on the group borders.
+static const uint32_t MeshletParam_LodGroupSize = 8;
+
+// Each level aims at half of the triangles of the previous one. Groups that cannot lose this share of their triangles
+// are not simplified further, because the level would cost nearly as much to draw as the one it replaces.
+static const float MeshletParam_LodTriangleRatio = 0.5f;
+static const float MeshletParam_LodMinReduction = 0.15f;
+
+static const uint32_t MeshletParam_MaxLodLevels = 16;
+
+// Error quadric of a vertex: sum of the squared distances to the planes of its triangles, as a symmetric 4x4 matrix.
+struct Quadric
+{
+    double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+    void AddPlane(const float3& normal, float distance)
+    {
+        const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        xx += a*a; xy += a*b; xz += a*c; xw += a*d;
+        yy += b*b; yz += b*c; yw += b*d;
+        zz += c*c; zw += c*d;
+        ww += d*d;
+    }
+
+    void Add(const Quadric& other)
+    {
+        xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+        yy += other.yy; yz += other.yz; yw += other.yw;
+        zz += other.zz; zw += other.zw;
+        ww += other.ww;
+    }
+
+    double Evaluate(const float3& p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        return x*x*xx + y*y*yy + z*z*zz + 2.0*(x*y*xy + x*z*xz + y*z*yz + x*xw + y*yw + z*zw) + ww;
+    }
+};
+
+struct EdgeCollapse
+{
+    double cost;
+    uint32_t from;
+    uint32_t to;
+
+    bool operator<(const EdgeCollapse& other) const
+    {
+        if (cost != other.cost)
+            return cost < other.cost;
+        if (from != other.from)
+            return from < other.from;
+        return to < other.to;
+    }
+};
+
+// Simplifies a triangle list by collapsing edges onto one of their vertices, so that the result uses a subset of the
+// vertices and no new ones. Locked vertices never move. Stops at targetTriangleCount, or when no collapse is possible.
+// Returns the largest error introduced, as a distance in the space of the positions.
+static float SimplifyTriangles(std::vector<uint32_t>& indices, const std::vector<float3>& positions, const std::vector<bool>& locked, size_t targetTriangleCount)
+{
+    const uint32_t vertexCount = uint32_t(positions.size());
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t=0;t<indices.size();t+=3)
+    {
+        const float3& p0 = positions[indices[t+0]];
+        const float3 normal = cross(positions[indices[t+1]] - p0, positions[indices[t+2]] - p0);
+        const float area = length(normal);
+        if (area == 0.0f)
+            continue;
+        const float3 planeNormal = normal / area;
+        for (int k=0;k<3;k++)
+            quadrics[indices[t+k]].AddPlane(planeNormal, -dot(planeNormal, p0));
+    }
+
+    float maxError = 0.0f;
+    std::vector<EdgeCollapse> collapses;
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> neighbourStamp(vertexCount, 0);
+    uint32_t stamp = 0;
+    std::vector<uint32_t> candidateNeighbours;
+
+    // Each pass collapses the cheapest edges that do not share a neighbourhood, then rebuilds the adjacency.
+    while (indices.size() / 3 > targetTriangleCount)
+    {
+        const size_t triangleCount = indices.size() / 3;
+
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t index : indices)
+            triangleOffsets[index+1]++;
+        for (uint32_t v=0;v<vertexCount;v++)
+            triangleOffsets[v+1] += triangleOffsets[v];
+        vertexTriangles.resize(indices.size());
+        {
+            std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end()-1);
+            for (size_t i=0;i<indices.size();i++)
+                vertexTriangles[cursor[indices[i]]++] = uint32_t(i / 3);
+        }
+
+        collapses.clear();
+        for (size_t t=0;t<triangleCount;t++)
+        {
+            for (int k=0;k<3;k++)
+            {
+                const uint32_t a = indices[t*3+k];
+                const uint32_t b = indices[t*3+(k+1)%3];
+                for (const auto& [from, to] : { std::make_pair(a, b), std::make_pair(b, a) })
+                {
+                    if (locked[from])
+                        continue;
+                    Quadric quadric = quadrics[from];
+                    quadric.Add(quadrics[to]);
+                    collapses.push_back({ std::max(quadric.Evaluate(positions[to]), 0.0), from, to });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+        collapses.erase(std::unique(collapses.begin(), collapses.end(), [](const EdgeCollapse& x, const EdgeCollapse& y) { return x.from == y.from && x.to == y.to; }), collapses.end());
+
+        std::fill(touched.begin(), touched.end(), false);
+        size_t removedTriangles = 0;
+        bool collapsed = false;
+
+        for (const EdgeCollapse& collapse : collapses)
+        {
+            if (triangleCount - removedTriangles <= targetTriangleCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Reject collapses that flip a triangle around the moving vertex.
+            bool flips = false;
+            for (uint32_t i=triangleOffsets[collapse.from];i<triangleOffsets[collapse.from+1] && !flips;i++)
+            {
+                const uint32_t* triangle = &indices[vertexTriangles[i]*3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+
+                const int k = triangle[0] == collapse.from ? 0 : (triangle[1] == collapse.from ? 1 : 2);
+                const float3& p1 = positions[triangle[(k+1)%3]];
+                const float3& p2 = positions[triangle[(k+2)%3]];
+                const float3 oldNormal = cross(p1 - positions[collapse.from], p2 - positions[collapse.from]);
+                const float3 newNormal = cross(p1 - positions[collapse.to], p2 - positions[collapse.to]);
+                flips = dot(oldNormal, newNormal) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            // Reject collapses that would fold the surface onto itself: the only vertices neighbouring both ends of the edge
+            // must be those of the triangles on the edge.
+            uint32_t edgeTriangles = 0;
+            stamp++;
+            for (uint32_t i=triangleOffsets[collapse.to];i<triangleOffsets[collapse.to+1];i++)
+            {
+                const uint32_t* triangle = &indices[vertexTriangles[i]*3];
+                for (int k=0;k<3;k++)
+                    neighbourStamp[triangle[k]] = stamp;
+            }
+            std::vector<uint32_t>& commonNeighbours = candidateNeighbours;
+            commonNeighbours.clear();
+            for (uint32_t i=triangleOffsets[collapse.from];i<triangleOffsets[collapse.from+1];i++)
+            {
+                const uint32_t* triangle = &indices[vertexTriangles[i]*3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    edgeTriangles++;
+                for (int k=0;k<3;k++)
+                {
+                    if (triangle[k] != collapse.from && triangle[k] != collapse.to && neighbourStamp[triangle[k]] == stamp)
+                        commonNeighbours.push_back(triangle[k]);
+                }
+            }
+            std::sort(commonNeighbours.begin(), commonNeighbours.end());
+            if (size_t(std::unique(commonNeighbours.begin(), commonNeighbours.end()) - commonNeighbours.begin()) != edgeTriangles)
+                continue;
+
+            // The triangles around the moving vertex change, so their vertices wait for the next pass.
+            for (uint32_t i=triangleOffsets[collapse.from];i<triangleOffsets[collapse.from+1];i++)
+            {
+                uint32_t* triangle = &indices[vertexTriangles[i]*3];
+                const bool degenerate = triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to;
+                for (int k=0;k<3;k++)
+                {
+                    touched[triangle[k]] = true;
+                    if (triangle[k] == collapse.from)
+                        triangle[k] = collapse.to;
+                }
+                if (degenerate)
+                    removedTriangles++;
+            }
+
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            maxError = std::max(maxError, float(std::sqrt(collapse.cost)));
+            collapsed = true;
+        }
+
+        if (!collapsed)
+            break;
+
+        size_t writeIndex = 0;
+        for (size_t t=0;t<triangleCount;t++)
+        {
+            const uint32_t a = indices[t*3+0], b = indices[t*3+1], c = indices[t*3+2];
+            if (a == b || b == c || a == c)
+                continue;
+            indices[writeIndex++] = a;
+            indices[writeIndex++] = b;
+            indices[writeIndex++] = c;
+        }
+        indices.resize(writeIndex);
+    }
+
+    return maxError;
+}
+
+// Smallest sphere around the center of the spheres that contains all of them.
+static float4 MergeSpheres(const float4* spheres, size_t count)
+{
+    float3 center = float3(0.0f);
+    for (size_t i=0;i<count;i++)
+        center += spheres[i].xyz();
+    center /= float(count);
+
+    float radius = 0.0f;
+    for (size_t i=0;i<count;i++)
+        radius = std::max(radius, length(spheres[i].xyz() - center) + spheres[i].w);
+    return float4(center, radius);
+}
+
+// Groups the meshlets of one level, each with its neighbours sharing the most vertices.
+static std::vector<std::vector<uint32_t>> GroupMeshlets(const MeshletData& data, const std::vector<uint32_t>& level, size_t vertexCount)
+{
+    // Meshlets using each vertex, as positions in level.
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t m : level)
+    {
+        const Meshlet& meshlet = data.meshlets[m];
+        for (uint32_t i=0;i<meshlet.vertexCount;i++)
+            offsets[data.vertices[meshlet.vertexOffset+i]+1]++;
+    }
+    for (size_t v=0;v<vertexCount;v++)
+        offsets[v+1] += offsets[v];
+    std::vector<uint32_t> vertexMeshlets(offsets[vertexCount]);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end()-1);
+        for (uint32_t l=0;l<level.size();l++)
+        {
+            const Meshlet& meshlet = data.meshlets[level[l]];
+            for (uint32_t i=0;i<meshlet.vertexCount;i++)
+                vertexMeshlets[cursor[data.vertices[meshlet.vertexOffset+i]]++] = l;
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<bool> grouped(level.size(), false);
+    std::vector<uint32_t> sharedVertices(level.size(), 0);
+    std::vector<uint32_t> candidates;
+
+    for (uint32_t seed=0;seed<level.size();seed++)
+    {
+        if (grouped[seed])
+            continue;
+
+        std::vector<uint32_t> group;
+        uint32_t next = seed;
+        while (next != ~0u)
+        {
+            group.push_back(next);
+            grouped[next] = true;
+            if (group.size() == MeshletParam_LodGroupSize)
+                break;
+
+            // Count the vertices that each ungrouped meshlet shares with the new member, and pick the best neighbour of the group.
+            const Meshlet& meshlet = data.meshlets[level[next]];
+            for (uint32_t i=0;i<meshlet.vertexCount;i++)
+            {
+                const uint32_t vertex = data.vertices[meshlet.vertexOffset+i];
+                for (uint32_t j=offsets[vertex];j<offsets[vertex+1];j++)
+                {
+                    const uint32_t neighbour = vertexMeshlets[j];
+                    if (grouped[neighbour])
+                        continue;
+                    if (sharedVertices[neighbour]++ == 0)
+                        candidates.push_back(neighbour);
+                }
+            }
+
+            next = ~0u;
+            uint32_t bestShared = 0;
+            for (uint32_t candidate : candidates)
+            {
+                if (grouped[candidate])
+                    continue;
+                if (sharedVertices[candidate] > bestShared || (sharedVertices[candidate] == bestShared && candidate < next))
+                {
+                    next = candidate;
+                    bestShared = sharedVertices[candidate];
+                }
+            }
+        }
+
+        for (uint32_t candidate : candidates)
+            sharedVertices[candidate] = 0;
+        candidates.clear();
+
+        for (uint32_t& member : group)
+            member = level[member];
+        groups.push_back(std::move(group));
+    }
+
+    return groups;
+}
+
+uint32_t BuildMeshletHierarchy(const MeshletGeometry& geometry, MeshletData& outData)
+{
+    const uint32_t firstMeshlet = uint32_t(outData.meshlets.size());
+    BuildMeshlets(geometry.indices, geometry.indexCount, geometry.positions, geometry.vertexCount, outData);
+
+    std::vector<uint32_t> level;
+    for (uint32_t m=firstMeshlet;m<uint32_t(outData.meshlets.size());m++)
+        level.push_back(m);
+
+    // Group-local copies of the vertices, so that the cost of simplifying a group does not depend on the size of the geometry.
+    std::vector<uint32_t> localIndex(geometry.vertexCount, ~0u);
+    std::vector<uint32_t> groupVertices;
+    std::vector<float3> groupPositions;
+    std::vector<uint32_t> groupIndices;
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    std::vector<bool> locked;
+
+    for (uint32_t levelIndex=1;levelIndex<MeshletParam_MaxLodLevels && level.size() > 1;levelIndex++)
+    {
+        std::vector<uint32_t> nextLevel;
+
+        for (const std::vector<uint32_t>& group : GroupMeshlets(outData, level, geometry.vertexCount))
+        {
+            groupVertices.clear();
+            groupPositions.clear();
+            groupIndices.clear();
+            for (uint32_t m : group)
+            {
+                const Meshlet& meshlet = outData.meshlets[m];
+                for (uint32_t i=0;i<meshlet.triangleCount;i++)
+                {
+                    const uint32_t packed = outData.triangles[meshlet.triangleOffset+i];
+                    for (int k=0;k<3;k++)
+                    {
+                        const uint32_t vertex = outData.vertices[meshlet.vertexOffset + ((packed >> (k*8)) & 0xff)];
+                        if (localIndex[vertex] == ~0u)
+                        {
+                            localIndex[vertex] = uint32_t(groupVertices.size());
+                            groupVertices.push_back(vertex);
+                            groupPositions.push_back(geometry.positions[vertex]);
+                        }
+                        groupIndices.push_back(localIndex[vertex]);
+                    }
+                }
+            }
+            for (uint32_t vertex : groupVertices)
+                localIndex[vertex] = ~0u;
+
+            // Vertices on edges used by a single triangle of the group are on the group border, or on a border of the mesh.
+            // They are locked, so that the group still matches its neighbours at any level.
+            edges.clear();
+            for (size_t t=0;t<groupIndices.size();t+=3)
+            {
+                for (int k=0;k<3;k++)
+                {
+                    const uint32_t a = groupIndices[t+k], b = groupIndices[t+(k+1)%3];
+                    edges.emplace_back(std::min(a, b), std::max(a, b));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            locked.assign(groupVertices.size(), false);
+            for (size_t e=0;e<edges.size();)
+            {
+                size_t end = e + 1;
+                while (end < edges.size() && edges[end] == edges[e])
+                    end++;
+                if (end - e == 1)
+                    locked[edges[e].first] = locked[edges[e].second] = true;
+                e = end;
+            }
+
+            const size_t triangleCount = groupIndices.size() / 3;
+            const float simplifyError = SimplifyTriangles(groupIndices, groupPositions, locked, size_t(float(triangleCount) * MeshletParam_LodTriangleRatio));
+            if (groupIndices.empty() || float(groupIndices.size() / 3) > float(triangleCount) * (1.0f - MeshletParam_LodMinReduction))
+                continue; // The group members stay roots of the DAG.
+
+            // The group error and bounds contain those of its members, so that a coarser level is never selected
+            // where a finer one is not, and the whole group switches at the same distance.
+            float4 memberSpheres[MeshletParam_LodGroupSize];
+            float groupError = simplifyError;
+            for (size_t i=0;i<group.size();i++)
+            {
+                memberSpheres[i] = outData.meshlets[group[i]].lodSphere;
+                groupError = std::max(groupError, outData.meshlets[group[i]].lodError);
+            }
+            const float4 groupSphere = MergeSpheres(memberSpheres, group.size());
+
+            for (uint32_t m : group)
+            {
+                outData.meshlets[m].parentSphere = groupSphere;
+                outData.meshlets[m].parentError = groupError;
+            }
+
+            // Split the simplified group into meshlets again, and map their vertices back to the geometry.
+            MeshletData groupData;
+            BuildMeshlets(groupIndices.data(), groupIndices.size(), groupPositions.data(), groupPositions.size(), groupData);
+
+            const uint32_t vertexOffset = uint32_t(outData.vertices.size());
+            const uint32_t triangleOffset = uint32_t(outData.triangles.size());
+            for (Meshlet meshlet : groupData.meshlets)
+            {
+                meshlet.vertexOffset += vertexOffset;
+                meshlet.triangleOffset += triangleOffset;
+                meshlet.lodSphere = groupSphere;
+                meshlet.lodError = groupError;
+                nextLevel.push_back(uint32_t(outData.meshlets.size()));
+                outData.meshlets.push_back(meshlet);
+            }
+            for (uint32_t vertex : groupData.vertices)
+                outData.vertices.push_back(groupVertices[vertex]);
+            outData.triangles.insert(outData.triangles.end(), groupData.triangles.begin(), groupData.triangles.end());
+        }
+
+        level = std::move(nextLevel);
+    }
+
+    return uint32_t(outData.meshlets.size()) - firstMeshlet;
+}
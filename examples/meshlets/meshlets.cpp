@@ -1,5 +1,5 @@
 /*
-* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
 *
 * Permission is hereby granted, free of charge, to any person obtaining a
 * copy of this software and associated documentation files (the "Software"),
@@ -21,90 +21,741 @@
 */
 
 #include <donut/app/ApplicationBase.h>
+#include <donut/app/Camera.h>
+#include <donut/app/imgui_renderer.h>
 #include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/DescriptorTableManager.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/core/log.h>
 #include <donut/core/vfs/VFS.h>
+#include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
+#include "gpu_timer_ring.h"
+#include "meshlet_cache.h"
 
 using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/view_cb.h>
 
 static const char* g_WindowTitle = "Donut Example: Meshlets";
 
-class MeshletExample : public app::IRenderPass
+// Number of meshlets tested by one amplification shader group. Ensure this value is matched with AS_GROUP_SIZE in shaders.hlsl.
+static const uint32_t MeshletParam_AmplificationGroupSize = 32;
+
+// Number of meshlets tested by one culling compute shader group. Ensure this value is matched with CS_GROUP_SIZE in shaders.hlsl.
+static const uint32_t MeshletParam_CullingGroupSize = 64;
+
+// The culling compute shader writes indices that combine the work item with the vertex in its meshlet.
+// Ensure this value is matched with MESHLET_VERTEX_ID_BITS in shaders.hlsl.
+static const uint32_t MeshletParam_VertexIdBits = 6;
+static_assert((1u << MeshletParam_VertexIdBits) >= MeshletParam_MaxVertices);
+
+// The index of the last vertex of the last possible work item would be 0xFFFFFFFF, which is the strip cut value of
+// 32-bit index buffers, so that work item is never used.
+static const uint32_t MeshletParam_MaxCullingWorkItems = (1u << (32 - MeshletParam_VertexIdBits)) - 1;
+
+// Ensure these values are matched with the MESHLET_FLAG_ defines in shaders.hlsl.
+enum MeshletFlags : uint32_t
+{
+    MeshletFlags_FrustumCulling = 1,
+    MeshletFlags_ConeCulling = 2,
+    MeshletFlags_ShowMeshlets = 4,
+};
+
+enum class GeometryPipeline
+{
+    Meshlets,
+    ComputeCulling,
+    VertexShader,
+
+    COUNT
+};
+
+struct UIData
+{
+    int pipeline = (int)GeometryPipeline::Meshlets;
+    bool meshShadersSupported = true;
+    bool frustumCulling = true;
+    bool coneCulling = true;
+    bool showMeshlets = false;
+    float lodErrorThreshold = 1.f; // In pixels, 0 draws the full detail meshlets.
+
+    float gpuTimes[(int)GeometryPipeline::COUNT] = {}; // Last measured time of each pipeline, in milliseconds.
+    uint64_t visibleMeshlets = 0;
+    uint64_t visibleTriangles = 0;
+    uint64_t totalMeshlets = 0;
+    uint64_t totalTriangles = 0;
+};
+
+class MeshletExample : public app::ApplicationBase
 {
 private:
+    // Ensure the layout is matched with the DrawConstants struct in shaders.hlsl.
+    struct DrawConstants
+    {
+        uint32_t instance;
+        uint32_t geometryInMesh;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t flags;
+        float lodErrorThreshold;
+    };
+
+    // One meshlet of one mesh instance, culled by one thread of the culling compute shader.
+    // Ensure the layout is matched with the MeshletWorkItem struct in shaders.hlsl.
+    struct MeshletWorkItem
+    {
+        uint32_t instance;
+        uint32_t geometryInMesh;
+        uint32_t meshlet;
+    };
+
+    std::shared_ptr<vfs::RootFileSystem> m_RootFS;
+
+    nvrhi::CommandListHandle m_CommandList;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::BindingLayoutHandle m_BindlessLayout;
+    nvrhi::BindingSetHandle m_BindingSet;
+    nvrhi::BindingSetHandle m_CullingBindingSet;
     nvrhi::ShaderHandle m_AmplificationShader;
     nvrhi::ShaderHandle m_MeshShader;
+    nvrhi::ShaderHandle m_VertexShader;
+    nvrhi::ShaderHandle m_CulledVertexShader;
+    nvrhi::ShaderHandle m_CullingShader;
     nvrhi::ShaderHandle m_PixelShader;
-    nvrhi::MeshletPipelineHandle m_Pipeline;
-    nvrhi::CommandListHandle m_CommandList;
+    nvrhi::MeshletPipelineHandle m_MeshletPipeline;
+    nvrhi::GraphicsPipelineHandle m_GraphicsPipeline;
+    nvrhi::GraphicsPipelineHandle m_CulledGraphicsPipeline;
+    nvrhi::ComputePipelineHandle m_CullingPipeline;
+
+    nvrhi::BufferHandle m_ViewConstants;
+    nvrhi::BufferHandle m_MeshletBuffer;
+    nvrhi::BufferHandle m_MeshletVertexBuffer;
+    nvrhi::BufferHandle m_MeshletTriangleBuffer;
+    nvrhi::BufferHandle m_StatsBuffer;
+    nvrhi::BufferHandle m_WorkItemBuffer;
+    nvrhi::BufferHandle m_CulledIndexBuffer;
+    nvrhi::BufferHandle m_CulledDrawArgsBuffer;
+    nvrhi::BufferHandle m_NullUAVBuffer;
+
+    nvrhi::TextureHandle m_DepthBuffer;
+    std::vector<nvrhi::FramebufferHandle> m_Framebuffers;
+
+    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
+    std::unique_ptr<engine::Scene> m_Scene;
+    std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTableManager;
+
+    std::vector<MeshletRange> m_GeometryMeshlets; // Indexed by MeshGeometry::globalGeometryIndex.
+    std::vector<uint32_t> m_MeshletTriangleCounts; // Only used until the work items are created.
+    uint32_t m_WorkItemCount = 0;
+    uint64_t m_TotalMeshlets = 0;
+    uint64_t m_TotalTriangles = 0;
+
+    app::FirstPersonCamera m_Camera;
+    engine::PlanarView m_View;
+
+    UIData* m_UI;
+
+    // Per frame timer queries, tagged with the geometry pipeline, and a statistics readback for each timer slot
+    GpuTimerRing<GeometryPipeline> m_FrameTimers;
+    nvrhi::BufferHandle m_StatsReadbacks[GpuTimerRing<GeometryPipeline>::c_SlotCount];
 
 public:
-    using IRenderPass::IRenderPass;
+    MeshletExample(app::DeviceManager* deviceManager, UIData* ui)
+        : ApplicationBase(deviceManager)
+        , m_UI(ui)
+    {
+    }
 
-    bool Init()
+    std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const
     {
-        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+        return m_ShaderFactory;
+    }
 
+    bool Init()
+    {
+        std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Assets/Models/Sponza/glTF/Sponza.gltf";
+        std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/meshlets" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 
-        engine::ShaderFactory shaderFactory(GetDevice(), nativeFS, appShaderPath);
-        m_AmplificationShader = shaderFactory.CreateShader("shaders.hlsl", "main_as", nullptr, nvrhi::ShaderType::Amplification);
-        m_MeshShader = shaderFactory.CreateShader("shaders.hlsl", "main_ms", nullptr, nvrhi::ShaderType::Mesh);
-        m_PixelShader = shaderFactory.CreateShader("shaders.hlsl", "main_ps", nullptr, nvrhi::ShaderType::Pixel);
+        m_RootFS = std::make_shared<vfs::RootFileSystem>();
+        m_RootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_RootFS->mount("/shaders/app", appShaderPath);
+
+        m_ShaderFactory = std::make_shared<engine::ShaderFactory>(GetDevice(), m_RootFS, "/shaders");
+        m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
 
-        if (!m_AmplificationShader || !m_MeshShader || !m_PixelShader)
+        // Without mesh shaders, meshlets are culled with the compute shader path only.
+        m_UI->meshShadersSupported = GetDevice()->queryFeatureSupport(nvrhi::Feature::Meshlets);
+        if (m_UI->meshShadersSupported)
+        {
+            m_AmplificationShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_as", nullptr, nvrhi::ShaderType::Amplification);
+            m_MeshShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_ms", nullptr, nvrhi::ShaderType::Mesh);
+
+            if (!m_AmplificationShader || !m_MeshShader)
+                return false;
+        }
+        else
+        {
+            log::info("The graphics device does not support Meshlets, using compute shader culling instead");
+            m_UI->pipeline = (int)GeometryPipeline::ComputeCulling;
+        }
+
+        m_VertexShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_vs", nullptr, nvrhi::ShaderType::Vertex);
+        m_CulledVertexShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_culled_vs", nullptr, nvrhi::ShaderType::Vertex);
+        m_CullingShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_cs", nullptr, nvrhi::ShaderType::Compute);
+        m_PixelShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_ps", nullptr, nvrhi::ShaderType::Pixel);
+
+        if (!m_VertexShader || !m_CulledVertexShader || !m_CullingShader || !m_PixelShader)
         {
             return false;
         }
-        
+
+        nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+        bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+        bindlessLayoutDesc.firstSlot = 0;
+        bindlessLayoutDesc.maxCapacity = 1024;
+        bindlessLayoutDesc.registerSpaces = {
+            nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
+            nvrhi::BindingLayoutItem::Texture_SRV(2)
+        };
+        m_BindlessLayout = GetDevice()->createBindlessLayout(bindlessLayoutDesc);
+
+        m_DescriptorTableManager = std::make_shared<engine::DescriptorTableManager>(GetDevice(), m_BindlessLayout);
+
+        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+        m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, m_DescriptorTableManager);
+
         m_CommandList = GetDevice()->createCommandList();
 
+        SetAsynchronousLoadingEnabled(false);
+        BeginLoadingScene(nativeFS, sceneFileName);
+
+        m_Scene->FinishedLoading(GetFrameIndex());
+
+        m_Camera.LookAt(float3(0.f, 1.8f, 0.f), float3(1.f, 1.8f, 0.f));
+        m_Camera.SetMoveSpeed(3.f);
+
+        m_ViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        m_StatsBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t) * 2).setStructStride(sizeof(uint32_t)).setCanHaveUAVs(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setKeepInitialState(true).setDebugName("MeshletStats"));
+
+        m_FrameTimers.Init(GetDevice());
+        for (nvrhi::BufferHandle& statsReadback : m_StatsReadbacks)
+        {
+            statsReadback = GetDevice()->createBuffer(nvrhi::BufferDesc()
+                .setByteSize(sizeof(uint32_t) * 2).setCpuAccess(nvrhi::CpuAccessMode::Read)
+                .setInitialState(nvrhi::ResourceStates::CopyDest).setKeepInitialState(true).setDebugName("MeshletStatsReadback"));
+        }
+
+        if (!CreateMeshlets(sceneFileName))
+            return false;
+
+        CreateWorkItems();
+
+        GetDevice()->waitForIdle();
+
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_ViewConstants),
+            nvrhi::BindingSetItem::PushConstants(1, sizeof(DrawConstants)),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_Scene->GetGeometryBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_Scene->GetMaterialBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_MeshletBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_MeshletVertexBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_MeshletTriangleBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_WorkItemBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_StatsBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_NullUAVBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer),
+            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_AnisotropicWrapSampler)
+        };
+        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_BindingLayout, m_BindingSet);
+
+        // The culling pass writes the index buffer and the draw arguments that the draw then reads, so it has its own set.
+        bindingSetDesc.bindings[10] = nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_CulledIndexBuffer);
+        bindingSetDesc.bindings[11] = nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_CulledDrawArgsBuffer);
+        m_CullingBindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+        nvrhi::ComputePipelineDesc computePipelineDesc;
+        computePipelineDesc.CS = m_CullingShader;
+        computePipelineDesc.bindingLayouts = { m_BindingLayout, m_BindlessLayout };
+        m_CullingPipeline = GetDevice()->createComputePipeline(computePipelineDesc);
+
+        return true;
+    }
+
+    // Partitions every geometry of the scene into meshlets, and uploads them into scene-wide buffers.
+    // Geometry vertices and indices are not duplicated: meshlets reference them through the bindless buffers.
+    // Meshlets are read from the cache file written by meshlets_bake when it matches the scene, and built otherwise.
+    bool CreateMeshlets(const std::filesystem::path& sceneFileName)
+    {
+        std::vector<MeshletGeometry> geometries;
+        std::vector<uint32_t> geometryIndices; // globalGeometryIndex of each entry in geometries.
+
+        for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
+        {
+            for (const auto& geometry : mesh->geometries)
+            {
+                MeshletGeometry meshletGeometry;
+                if (!GetMeshletGeometry(*mesh, *geometry, meshletGeometry))
+                {
+                    log::warning("Mesh '%s' has no CPU copy of its geometry, it will not be drawn with meshlets", mesh->name.c_str());
+                    continue;
+                }
+
+                geometries.push_back(meshletGeometry);
+                geometryIndices.push_back(geometry->globalGeometryIndex);
+            }
+        }
+
+        MeshletCache cache;
+        const std::filesystem::path cacheFileName = GetMeshletCachePath(sceneFileName);
+        bool cacheValid = ReadMeshletCache(cacheFileName, cache);
+        for (size_t i = 0; cacheValid && i < geometries.size(); i++)
+            cacheValid = cache.Find(geometries[i]) != nullptr;
+
+        if (cacheValid)
+        {
+            log::info("Loaded meshlets from '%s'", cacheFileName.generic_string().c_str());
+        }
+        else
+        {
+            log::info("No up to date meshlet cache at '%s', building meshlets. Run meshlets_bake on the scene to skip this step.", cacheFileName.generic_string().c_str());
+            BuildMeshletCache(geometries, cache);
+        }
+
+        for (size_t i = 0; i < geometries.size(); i++)
+        {
+            if (geometryIndices[i] >= m_GeometryMeshlets.size())
+                m_GeometryMeshlets.resize(geometryIndices[i] + 1);
+            m_GeometryMeshlets[geometryIndices[i]] = cache.Find(geometries[i])->range;
+        }
+
+        const MeshletData& meshletData = cache.data;
+        m_MeshletTriangleCounts.reserve(meshletData.meshlets.size());
+        for (const Meshlet& meshlet : meshletData.meshlets)
+            m_MeshletTriangleCounts.push_back(meshlet.triangleCount);
+        if (meshletData.meshlets.empty())
+        {
+            log::fatal("The scene has no geometry to build meshlets from");
+            return false;
+        }
+
+        log::info("Scene has %d meshlets, averaging %.1f vertices and %.1f triangles per meshlet",
+            int(meshletData.meshlets.size()),
+            double(meshletData.vertices.size()) / double(meshletData.meshlets.size()),
+            double(meshletData.triangles.size()) / double(meshletData.meshlets.size()));
+
+        auto createStructuredBuffer = [this](size_t byteSize, uint32_t stride, const char* name)
+        {
+            return GetDevice()->createBuffer(nvrhi::BufferDesc()
+                .setByteSize(byteSize).setStructStride(stride)
+                .setInitialState(nvrhi::ResourceStates::ShaderResource).setKeepInitialState(true).setDebugName(name));
+        };
+
+        m_MeshletBuffer = createStructuredBuffer(meshletData.meshlets.size() * sizeof(Meshlet), sizeof(Meshlet), "Meshlets");
+        m_MeshletVertexBuffer = createStructuredBuffer(meshletData.vertices.size() * sizeof(uint32_t), sizeof(uint32_t), "MeshletVertices");
+        m_MeshletTriangleBuffer = createStructuredBuffer(meshletData.triangles.size() * sizeof(uint32_t), sizeof(uint32_t), "MeshletTriangles");
+
+        m_CommandList->open();
+        m_CommandList->writeBuffer(m_MeshletBuffer, meshletData.meshlets.data(), meshletData.meshlets.size() * sizeof(Meshlet));
+        m_CommandList->writeBuffer(m_MeshletVertexBuffer, meshletData.vertices.data(), meshletData.vertices.size() * sizeof(uint32_t));
+        m_CommandList->writeBuffer(m_MeshletTriangleBuffer, meshletData.triangles.data(), meshletData.triangles.size() * sizeof(uint32_t));
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        return true;
+    }
+
+    // Lists every meshlet of every mesh instance for the culling compute shader, and creates the buffers it writes.
+    void CreateWorkItems()
+    {
+        std::vector<MeshletWorkItem> workItems;
+        uint64_t maxIndexCount = 0;
+
+        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        {
+            const auto& mesh = instance->GetMesh();
+            for (size_t i = 0; i < mesh->geometries.size(); i++)
+            {
+                const engine::MeshGeometry& geometry = *mesh->geometries[i];
+                const MeshletRange range = geometry.globalGeometryIndex < m_GeometryMeshlets.size() ? m_GeometryMeshlets[geometry.globalGeometryIndex] : MeshletRange();
+
+                for (uint32_t meshlet = range.firstMeshlet; meshlet < range.firstMeshlet + range.meshletCount; meshlet++)
+                {
+                    workItems.push_back({ uint32_t(instance->GetInstanceIndex()), uint32_t(i), meshlet });
+                    maxIndexCount += m_MeshletTriangleCounts[meshlet] * 3;
+                }
+
+                m_TotalMeshlets += range.meshletCount;
+                m_TotalTriangles += geometry.numIndices / 3;
+            }
+        }
+        m_MeshletTriangleCounts.clear();
+
+        if (workItems.size() > MeshletParam_MaxCullingWorkItems)
+        {
+            log::warning("The scene has %zu meshlet instances, compute shader culling draws only the first %u",
+                workItems.size(), MeshletParam_MaxCullingWorkItems);
+            workItems.resize(MeshletParam_MaxCullingWorkItems);
+        }
+
+        m_WorkItemCount = uint32_t(workItems.size());
+        if (workItems.empty())
+            workItems.push_back({});
+
+        m_WorkItemBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(workItems.size() * sizeof(MeshletWorkItem)).setStructStride(sizeof(MeshletWorkItem))
+            .setInitialState(nvrhi::ResourceStates::ShaderResource).setKeepInitialState(true).setDebugName("MeshletWorkItems"));
+
+        // Large enough for every meshlet of every level of detail passing culling, which never happens with LOD selection.
+        m_CulledIndexBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(std::max(maxIndexCount, uint64_t(1)) * sizeof(uint32_t)).setStructStride(sizeof(uint32_t))
+            .setFormat(nvrhi::Format::R32_UINT).setIsIndexBuffer(true).setCanHaveUAVs(true)
+            .setInitialState(nvrhi::ResourceStates::IndexBuffer).setKeepInitialState(true).setDebugName("CulledMeshletIndices"));
+
+        m_CulledDrawArgsBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(nvrhi::DrawIndexedIndirectArguments)).setStructStride(sizeof(uint32_t))
+            .setIsDrawIndirectArgs(true).setCanHaveUAVs(true)
+            .setInitialState(nvrhi::ResourceStates::IndirectArgument).setKeepInitialState(true).setDebugName("CulledMeshletDrawArgs"));
+
+        m_NullUAVBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t)).setStructStride(sizeof(uint32_t)).setCanHaveUAVs(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setKeepInitialState(true).setDebugName("NullUAV"));
+
+        m_CommandList->open();
+        m_CommandList->writeBuffer(m_WorkItemBuffer, workItems.data(), workItems.size() * sizeof(MeshletWorkItem));
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+    }
+
+    bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override
+    {
+        std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(),
+            *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTableManager, nullptr);
+
+        if (scene->Load(sceneFileName))
+        {
+            m_Scene = std::move(scene);
+            return true;
+        }
+
+        return false;
+    }
+
+    bool KeyboardUpdate(int key, int scancode, int action, int mods) override
+    {
+        m_Camera.KeyboardUpdate(key, scancode, action, mods);
         return true;
     }
-    
+
+    bool MousePosUpdate(double xpos, double ypos) override
+    {
+        m_Camera.MousePosUpdate(xpos, ypos);
+        return true;
+    }
+
+    bool MouseButtonUpdate(int button, int action, int mods) override
+    {
+        m_Camera.MouseButtonUpdate(button, action, mods);
+        return true;
+    }
+
     void Animate(float fElapsedTimeSeconds) override
     {
+        m_Camera.Animate(fElapsedTimeSeconds);
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
     }
 
     void BackBufferResizing() override
-    { 
-        m_Pipeline = nullptr;
+    {
+        m_DepthBuffer = nullptr;
+        m_Framebuffers.clear();
+        m_MeshletPipeline = nullptr;
+        m_GraphicsPipeline = nullptr;
+        m_CulledGraphicsPipeline = nullptr;
+    }
+
+    // Reads the timer and statistics of the frame that last used this frame's slot.
+    void HarvestFrameQueries()
+    {
+        float gpuTime;
+        GeometryPipeline pipeline;
+        if (!m_FrameTimers.Harvest(GetFrameIndex(), gpuTime, pipeline))
+            return;
+
+        m_UI->gpuTimes[(int)pipeline] = gpuTime;
+
+        if (pipeline == GeometryPipeline::VertexShader)
+            return;
+
+        nvrhi::IBuffer* statsReadback = m_StatsReadbacks[m_FrameTimers.GetSlot()];
+        const uint32_t* stats = (const uint32_t*)GetDevice()->mapBuffer(statsReadback, nvrhi::CpuAccessMode::Read);
+        if (stats)
+        {
+            m_UI->visibleMeshlets = stats[0];
+            m_UI->visibleTriangles = stats[1];
+            GetDevice()->unmapBuffer(statsReadback);
+        }
     }
 
     void Render(nvrhi::IFramebuffer* framebuffer) override
     {
-        if (!m_Pipeline)
+        const auto& fbinfo = framebuffer->getFramebufferInfo();
+
+        if (!m_DepthBuffer)
+        {
+            nvrhi::TextureDesc textureDesc;
+            textureDesc.format = nvrhi::Format::D24S8;
+            textureDesc.isRenderTarget = true;
+            textureDesc.initialState = nvrhi::ResourceStates::DepthWrite;
+            textureDesc.keepInitialState = true;
+            textureDesc.clearValue = nvrhi::Color(0.f);
+            textureDesc.useClearValue = true;
+            textureDesc.debugName = "DepthBuffer";
+            textureDesc.width = fbinfo.width;
+            textureDesc.height = fbinfo.height;
+            textureDesc.dimension = nvrhi::TextureDimension::Texture2D;
+
+            m_DepthBuffer = GetDevice()->createTexture(textureDesc);
+        }
+
+        m_Framebuffers.resize(GetDeviceManager()->GetBackBufferCount());
+
+        int const fbindex = GetDeviceManager()->GetCurrentBackBufferIndex();
+        if (!m_Framebuffers[fbindex])
+        {
+            nvrhi::FramebufferDesc framebufferDesc;
+            framebufferDesc.addColorAttachment(framebuffer->getDesc().colorAttachments[0]);
+            framebufferDesc.setDepthAttachment(m_DepthBuffer);
+            m_Framebuffers[fbindex] = GetDevice()->createFramebuffer(framebufferDesc);
+        }
+
+        // Both pipelines use the same render state, so that they produce the same image.
+        nvrhi::RenderState renderState;
+        renderState.depthStencilState.depthTestEnable = true;
+        renderState.depthStencilState.depthFunc = nvrhi::ComparisonFunc::GreaterOrEqual;
+        renderState.rasterState.frontCounterClockwise = true;
+        renderState.rasterState.setCullBack();
+
+        if (!m_MeshletPipeline && m_UI->meshShadersSupported)
         {
             nvrhi::MeshletPipelineDesc psoDesc;
             psoDesc.AS = m_AmplificationShader;
             psoDesc.MS = m_MeshShader;
             psoDesc.PS = m_PixelShader;
             psoDesc.primType = nvrhi::PrimitiveType::TriangleList;
-            psoDesc.renderState.depthStencilState.depthTestEnable = false;
+            psoDesc.bindingLayouts = { m_BindingLayout, m_BindlessLayout };
+            psoDesc.renderState = renderState;
 
-            m_Pipeline = GetDevice()->createMeshletPipeline(psoDesc, framebuffer);
+            m_MeshletPipeline = GetDevice()->createMeshletPipeline(psoDesc, m_Framebuffers[fbindex]);
         }
 
+        if (!m_GraphicsPipeline)
+        {
+            nvrhi::GraphicsPipelineDesc pipelineDesc;
+            pipelineDesc.VS = m_VertexShader;
+            pipelineDesc.PS = m_PixelShader;
+            pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
+            pipelineDesc.bindingLayouts = { m_BindingLayout, m_BindlessLayout };
+            pipelineDesc.renderState = renderState;
+
+            m_GraphicsPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_Framebuffers[fbindex]);
+
+            pipelineDesc.VS = m_CulledVertexShader;
+            m_CulledGraphicsPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_Framebuffers[fbindex]);
+        }
+
+        HarvestFrameQueries();
+
+        nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
+        m_View.SetViewport(windowViewport);
+        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
+        m_View.UpdateCache();
+
+        const GeometryPipeline pipeline = (GeometryPipeline)m_UI->pipeline;
+        uint32_t flags = 0;
+        if (m_UI->frustumCulling)
+            flags |= MeshletFlags_FrustumCulling;
+        if (m_UI->coneCulling)
+            flags |= MeshletFlags_ConeCulling;
+        if (m_UI->showMeshlets)
+            flags |= MeshletFlags_ShowMeshlets;
+
         m_CommandList->open();
 
-        nvrhi::utils::ClearColorAttachment(m_CommandList, framebuffer, 0, nvrhi::Color(0.f));
+        nvrhi::TextureHandle colorBuffer = framebuffer->getDesc().colorAttachments[0].texture;
+        m_CommandList->clearTextureFloat(colorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.f));
+        m_CommandList->clearDepthStencilTexture(m_DepthBuffer, nvrhi::AllSubresources, true, 0.f, true, 0);
+        m_CommandList->clearBufferUInt(m_StatsBuffer, 0);
+
+        PlanarViewConstants viewConstants;
+        m_View.FillPlanarViewConstants(viewConstants);
+        m_CommandList->writeBuffer(m_ViewConstants, &viewConstants, sizeof(viewConstants));
+
+        m_FrameTimers.Begin(m_CommandList);
+
+        DrawConstants constants = {};
+        constants.flags = flags;
+        constants.lodErrorThreshold = m_UI->lodErrorThreshold;
+
+        if (pipeline == GeometryPipeline::ComputeCulling)
+        {
+            // Cull all meshlets of the scene in one dispatch, which appends the triangles of the visible ones
+            // to the index buffer, then draw them with a single indirect draw.
+            nvrhi::DrawIndexedIndirectArguments drawArgs;
+            drawArgs.indexCount = 0;
+            drawArgs.instanceCount = 1;
+            m_CommandList->writeBuffer(m_CulledDrawArgsBuffer, &drawArgs, sizeof(drawArgs));
+
+            // With no meshlets, the draw arguments written above draw nothing
+            if (m_WorkItemCount != 0)
+            {
+                nvrhi::ComputeState computeState;
+                computeState.pipeline = m_CullingPipeline;
+                computeState.bindings = { m_CullingBindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+                m_CommandList->setComputeState(computeState);
+
+                constants.meshletCount = m_WorkItemCount;
+                m_CommandList->setPushConstants(&constants, sizeof(constants));
+                m_CommandList->dispatch((m_WorkItemCount + MeshletParam_CullingGroupSize - 1) / MeshletParam_CullingGroupSize);
+            }
+
+            nvrhi::GraphicsState state;
+            state.pipeline = m_CulledGraphicsPipeline;
+            state.framebuffer = m_Framebuffers[fbindex];
+            state.bindings = { m_BindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+            state.viewport = m_View.GetViewportState();
+            state.indexBuffer = nvrhi::IndexBufferBinding().setBuffer(m_CulledIndexBuffer).setFormat(nvrhi::Format::R32_UINT);
+            state.indirectParams = m_CulledDrawArgsBuffer;
+            m_CommandList->setGraphicsState(state);
+
+            m_CommandList->setPushConstants(&constants, sizeof(constants));
+            m_CommandList->drawIndexedIndirect(0);
+        }
+        else
+        {
+            if (pipeline == GeometryPipeline::Meshlets)
+            {
+                nvrhi::MeshletState state;
+                state.pipeline = m_MeshletPipeline;
+                state.framebuffer = m_Framebuffers[fbindex];
+                state.bindings = { m_BindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+                state.viewport = m_View.GetViewportState();
+                m_CommandList->setMeshletState(state);
+            }
+            else
+            {
+                nvrhi::GraphicsState state;
+                state.pipeline = m_GraphicsPipeline;
+                state.framebuffer = m_Framebuffers[fbindex];
+                state.bindings = { m_BindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+                state.viewport = m_View.GetViewportState();
+                m_CommandList->setGraphicsState(state);
+            }
+
+            for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+            {
+                const auto& mesh = instance->GetMesh();
+
+                for (size_t i = 0; i < mesh->geometries.size(); i++)
+                {
+                    const engine::MeshGeometry& geometry = *mesh->geometries[i];
+                    const MeshletRange range = geometry.globalGeometryIndex < m_GeometryMeshlets.size() ? m_GeometryMeshlets[geometry.globalGeometryIndex] : MeshletRange();
 
-        nvrhi::MeshletState state;
-        state.pipeline = m_Pipeline;
-        state.framebuffer = framebuffer;
-        state.viewport.addViewportAndScissorRect(framebuffer->getFramebufferInfo().getViewport());
+                    constants.instance = uint32_t(instance->GetInstanceIndex());
+                    constants.geometryInMesh = uint32_t(i);
+                    constants.firstMeshlet = range.firstMeshlet;
+                    constants.meshletCount = range.meshletCount;
+                    m_CommandList->setPushConstants(&constants, sizeof(constants));
 
-        m_CommandList->setMeshletState(state);
-        
-        m_CommandList->dispatchMesh(1);
+                    if (pipeline == GeometryPipeline::Meshlets)
+                    {
+                        if (range.meshletCount != 0)
+                            m_CommandList->dispatchMesh((range.meshletCount + MeshletParam_AmplificationGroupSize - 1) / MeshletParam_AmplificationGroupSize);
+                    }
+                    else
+                    {
+                        nvrhi::DrawArguments args;
+                        args.instanceCount = 1;
+                        args.vertexCount = geometry.numIndices;
+                        m_CommandList->draw(args);
+                    }
+                }
+            }
+        }
+
+        m_FrameTimers.End(m_CommandList, pipeline);
+
+        m_CommandList->copyBuffer(m_StatsReadbacks[m_FrameTimers.GetSlot()], 0, m_StatsBuffer, 0, sizeof(uint32_t) * 2);
 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
+
+        m_UI->totalMeshlets = m_TotalMeshlets;
+        m_UI->totalTriangles = m_TotalTriangles;
+        if (pipeline == GeometryPipeline::VertexShader)
+        {
+            // The vertex pipeline draws every triangle at full detail, without meshlets.
+            m_UI->visibleMeshlets = 0;
+            m_UI->visibleTriangles = m_TotalTriangles;
+        }
     }
+};
 
+class UserInterface : public app::ImGui_Renderer
+{
+private:
+    UIData* m_ui;
+
+public:
+    UserInterface(app::DeviceManager* deviceManager, UIData* ui)
+        : ImGui_Renderer(deviceManager)
+        , m_ui(ui)
+    {
+        ImGui::GetIO().IniFilename = nullptr;
+    }
+
+    void buildUI() override
+    {
+        ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
+        ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+        ImGui::Combo("Pipeline", &m_ui->pipeline,
+            m_ui->meshShadersSupported
+                ? "Meshlets (Amplification + Mesh Shaders)\0" "Meshlets (Compute Culling + Indirect Draw)\0" "Classic (Vertex Shader)\0"
+                : "Meshlets (not supported by the device)\0" "Meshlets (Compute Culling + Indirect Draw)\0" "Classic (Vertex Shader)\0");
+        if (!m_ui->meshShadersSupported && m_ui->pipeline == (int)GeometryPipeline::Meshlets)
+            m_ui->pipeline = (int)GeometryPipeline::ComputeCulling;
+
+        const bool meshlets = m_ui->pipeline != (int)GeometryPipeline::VertexShader;
+        ImGui::BeginDisabled(!meshlets);
+        ImGui::Checkbox("Frustum culling", &m_ui->frustumCulling);
+        ImGui::Checkbox("Backface cone culling", &m_ui->coneCulling);
+        ImGui::Checkbox("Show meshlets", &m_ui->showMeshlets);
+        ImGui::SliderFloat("LOD error (pixels)", &m_ui->lodErrorThreshold, 0.f, 8.f, "%.2f");
+        ImGui::EndDisabled();
+        ImGui::Separator();
+
+        // Both times are kept, so that switching pipelines compares them.
+        if (m_ui->meshShadersSupported)
+            ImGui::Text("GPU time, mesh shaders: %.3f ms", m_ui->gpuTimes[(int)GeometryPipeline::Meshlets]);
+        ImGui::Text("GPU time, compute culling: %.3f ms", m_ui->gpuTimes[(int)GeometryPipeline::ComputeCulling]);
+        ImGui::Text("GPU time, vertex shader: %.3f ms", m_ui->gpuTimes[(int)GeometryPipeline::VertexShader]);
+        ImGui::Text("Meshlets drawn: %llu (%llu in all LODs)", (unsigned long long)m_ui->visibleMeshlets, (unsigned long long)m_ui->totalMeshlets);
+        ImGui::Text("Triangles drawn: %llu (%.1f%% of %llu at full detail)", (unsigned long long)m_ui->visibleTriangles,
+            m_ui->totalTriangles ? 100.0 * double(m_ui->visibleTriangles) / double(m_ui->totalTriangles) : 0.0, (unsigned long long)m_ui->totalTriangles);
+
+        ImGui::End();
+    }
 };
 
 #ifdef WIN32
@@ -118,7 +769,7 @@ int main(int __argc, const char** __argv)
 
     app::DeviceCreationParameters deviceParams;
 #ifdef _DEBUG
-    deviceParams.enableDebugRuntime = true; 
+    deviceParams.enableDebugRuntime = true;
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
@@ -128,22 +779,21 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
-    if (!deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::Meshlets))
-    {
-        log::fatal("The graphics device does not support Meshlets");
-        return 1;
-    }
-    
     {
-        MeshletExample example(deviceManager);
-        if (example.Init())
+        UIData uiData;
+        MeshletExample example(deviceManager, &uiData);
+        UserInterface gui(deviceManager, &uiData);
+
+        if (example.Init() && gui.Init(example.GetShaderFactory()))
         {
             deviceManager->AddRenderPassToBack(&example);
+            deviceManager->AddRenderPassToBack(&gui);
             deviceManager->RunMessageLoop();
+            deviceManager->RemoveRenderPass(&gui);
             deviceManager->RemoveRenderPass(&example);
         }
     }
-    
+
     deviceManager->Shutdown();
 
     delete deviceManager;
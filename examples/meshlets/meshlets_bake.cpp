@@ -0,0 +1,143 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+// Builds the meshlets of glTF scenes ahead of time, and writes them into the cache files read by the meshlets example.
+
+#include <donut/engine/GltfImporter.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include "meshlet_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+using namespace donut;
+
+static bool BakeScene(const std::filesystem::path& sceneFileName, const std::filesystem::path& cacheFileName, uint32_t threadCount)
+{
+    auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+
+    // The importer requests the scene textures from a texture cache. Without a device, the cache only reads the files.
+    engine::TextureCache textureCache(nullptr, nativeFS, nullptr);
+    engine::GltfImporter importer(nativeFS, std::make_shared<engine::SceneTypeFactory>());
+    engine::SceneLoadingStats stats;
+    engine::SceneImportResult result;
+    if (!importer.Load(sceneFileName, textureCache, stats, nullptr, result))
+    {
+        log::error("Cannot load scene '%s'", sceneFileName.generic_string().c_str());
+        return false;
+    }
+
+    // The scene graph gives the same set of meshes as the one the example renders.
+    auto sceneGraph = std::make_shared<engine::SceneGraph>();
+    sceneGraph->SetRootNode(result.rootNode);
+
+    std::vector<MeshletGeometry> geometries;
+    for (const auto& mesh : sceneGraph->GetMeshes())
+    {
+        for (const auto& geometry : mesh->geometries)
+        {
+            MeshletGeometry meshletGeometry;
+            if (GetMeshletGeometry(*mesh, *geometry, meshletGeometry))
+                geometries.push_back(meshletGeometry);
+            else
+                log::warning("Mesh '%s' has no CPU copy of its geometry, skipping it", mesh->name.c_str());
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    MeshletCache cache;
+    BuildMeshletCache(geometries, cache, threadCount);
+    const double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    if (!WriteMeshletCache(cacheFileName, cache))
+    {
+        log::error("Cannot write '%s'", cacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    size_t triangleCount = 0;
+    for (const MeshletGeometry& geometry : geometries)
+        triangleCount += geometry.indexCount / 3;
+
+    printf("%s: %d geometries (%d unique), %d triangles, %d meshlets, built in %.2f s\n",
+        cacheFileName.generic_string().c_str(), int(geometries.size()), int(cache.entries.size()), int(triangleCount),
+        int(cache.data.meshlets.size()), buildSeconds);
+    return true;
+}
+
+int main(int argc, const char** argv)
+{
+    log::ConsoleApplicationMode();
+
+    std::vector<std::filesystem::path> sceneFileNames;
+    std::filesystem::path outputFileName;
+    uint32_t threadCount = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            printf("Usage: %s [options] <scene.gltf>...\n"
+                " -o <file>        Write the meshlets into <file>, only with a single scene.\n"
+                "                  By default, they are written next to each scene, with the .meshlets extension.\n"
+                " -threads <n>     Build on <n> threads (default: all hardware threads)\n"
+                "The output does not depend on the number of threads, so cache files can be compared.\n",
+                argv[0]);
+            return 0;
+        }
+        else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-threads") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                log::error("%s requires a parameter", argv[i]);
+                return 1;
+            }
+            if (strcmp(argv[i], "-o") == 0)
+                outputFileName = argv[i + 1];
+            else
+                threadCount = uint32_t(std::max(atoi(argv[i + 1]), 1));
+            ++i;
+        }
+        else
+        {
+            sceneFileNames.push_back(argv[i]);
+        }
+    }
+
+    if (sceneFileNames.empty() || (!outputFileName.empty() && sceneFileNames.size() > 1))
+    {
+        log::error("Expected one scene with -o, or one or more scenes without it. Run with --help for usage.");
+        return 1;
+    }
+
+    bool success = true;
+    for (const std::filesystem::path& sceneFileName : sceneFileNames)
+    {
+        const std::filesystem::path cacheFileName = outputFileName.empty() ? GetMeshletCachePath(sceneFileName) : outputFileName;
+        success = BakeScene(sceneFileName, cacheFileName, threadCount) && success;
+    }
+
+    return success ? 0 : 1;
+}
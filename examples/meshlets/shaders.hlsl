@@ -1,5 +1,5 @@
 /*
-* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
 *
 * Permission is hereby granted, free of charge, to any person obtaining a
 * copy of this software and associated documentation files (the "Software"),
@@ -20,65 +20,340 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
-#define MAX_PRIMS_PER_MESHLET 1
-#define MAX_VERTICES_PER_MESHLET 3
+#pragma pack_matrix(row_major)
 
-static const float2 g_positions[] = {
-	float2(-0.5, -0.5),
-	float2(0, 0.5),
-	float2(0.5, -0.5)
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/view_cb.h>
+#include <donut/shaders/packing.hlsli>
+#include <donut/shaders/binding_helpers.hlsli>
+
+// Ensure these values are matched with MeshletParam_MaxVertices and MeshletParam_MaxTriangles in meshlet_builder.h.
+#define MAX_VERTICES_PER_MESHLET 64
+#define MAX_PRIMS_PER_MESHLET 124
+
+#define AS_GROUP_SIZE 32
+#define MS_GROUP_SIZE 128
+#define CS_GROUP_SIZE 64
+
+// Indices written by the culling compute shader combine the work item and the vertex in its meshlet. The application
+// limits the work item count so that no index is 0xFFFFFFFF.
+#define MESHLET_VERTEX_ID_BITS 6
+
+// Ensure these values are matched with the MeshletFlags in meshlets.cpp.
+#define MESHLET_FLAG_FRUSTUM_CULLING 1
+#define MESHLET_FLAG_CONE_CULLING 2
+#define MESHLET_FLAG_SHOW_MESHLETS 4
+
+// Ensure the layout is matched with the Meshlet struct in meshlet_builder.h.
+struct Meshlet
+{
+    float4 boundingSphere;
+    float4 coneAxisCutoff;
+    float4 lodSphere;
+    float4 parentSphere;
+    float lodError;
+    float parentError;
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
 };
 
-static const float3 g_colors[] = {
-	float3(1, 0, 0),
-	float3(0, 1, 0),
-	float3(0, 0, 1)	
+// One meshlet of one mesh instance, for the culling compute shader.
+struct MeshletWorkItem
+{
+    uint instance;
+    uint geometryInMesh;
+    uint meshlet;
 };
 
-struct Payload
+// In the culling compute shader, meshletCount is the number of work items.
+struct DrawConstants
 {
-	int dummy;
+    uint instance;
+    uint geometryInMesh;
+    uint firstMeshlet;
+    uint meshletCount;
+    uint flags;
+    float lodErrorThreshold; // In pixels.
 };
 
+ConstantBuffer<PlanarViewConstants> g_View : register(b0);
+VK_PUSH_CONSTANT ConstantBuffer<DrawConstants> g_Draw : register(b1);
+StructuredBuffer<InstanceData> t_InstanceData : register(t0);
+StructuredBuffer<GeometryData> t_GeometryData : register(t1);
+StructuredBuffer<MaterialConstants> t_MaterialConstants : register(t2);
+StructuredBuffer<Meshlet> t_Meshlets : register(t3);
+StructuredBuffer<uint> t_MeshletVertices : register(t4);
+StructuredBuffer<uint> t_MeshletTriangles : register(t5);
+StructuredBuffer<MeshletWorkItem> t_MeshletWorkItems : register(t6);
+RWStructuredBuffer<uint> u_Stats : register(u0); // [0]: visible meshlets, [1]: visible triangles.
+RWStructuredBuffer<uint> u_CulledIndices : register(u1);
+RWStructuredBuffer<uint> u_CulledDrawArgs : register(u2); // DrawIndexedIndirectArguments, starting with the index count.
+SamplerState s_MaterialSampler : register(s0);
+
+VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
+VK_BINDING(1, 1) Texture2D t_BindlessTextures[] : register(t0, space2);
+
 struct Vertex
 {
-	float4 pos : SV_Position;
-	float3 color : COLOR;
+    float4 pos : SV_Position;
+    float2 uv : TEXCOORD;
+    float3 normal : NORMAL;
+    float3 color : COLOR;
+    nointerpolation uint material : MATERIAL;
+};
+
+Vertex LoadVertex(InstanceData instance, GeometryData geometry, uint index)
+{
+    ByteAddressBuffer vertexBuffer = t_BindlessBuffers[geometry.vertexBufferIndex];
+
+    float3 objectSpacePosition = asfloat(vertexBuffer.Load3(geometry.positionOffset + index * 12));
+    float3 objectSpaceNormal = geometry.normalOffset == ~0u ? float3(0, 1, 0) : Unpack_RGB8_SNORM(vertexBuffer.Load(geometry.normalOffset + index * 4));
+
+    float3 worldSpacePosition = mul(instance.transform, float4(objectSpacePosition, 1.0)).xyz;
+
+    Vertex vertex;
+    vertex.pos = mul(float4(worldSpacePosition, 1.0), g_View.matWorldToClip);
+    vertex.uv = geometry.texCoord1Offset == ~0u ? 0 : asfloat(vertexBuffer.Load2(geometry.texCoord1Offset + index * 8));
+    vertex.normal = mul(instance.transform, float4(objectSpaceNormal, 0.0)).xyz;
+    vertex.color = 1;
+    vertex.material = geometry.materialIndex;
+    return vertex;
+}
+
+// Classic vertex pipeline, used as the reference for the meshlet pipeline.
+void main_vs(
+    in uint i_vertexID : SV_VertexID,
+    out Vertex o_vertex)
+{
+    InstanceData instance = t_InstanceData[g_Draw.instance];
+    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Draw.geometryInMesh];
+
+    ByteAddressBuffer indexBuffer = t_BindlessBuffers[geometry.indexBufferIndex];
+    uint index = indexBuffer.Load(geometry.indexOffset + i_vertexID * 4);
+
+    o_vertex = LoadVertex(instance, geometry, index);
+}
+
+// Size in pixels of an object space error, seen from the point of the sphere nearest to the camera.
+float GetProjectedError(float4 sphere, float error, InstanceData instance, float instanceScale)
+{
+    float3 center = mul(instance.transform, float4(sphere.xyz, 1.0)).xyz;
+    float distance = max(length(center - g_View.cameraDirectionOrPosition.xyz) - sphere.w * instanceScale, 1e-5);
+    float pixelsPerUnit = g_View.matViewToClip._m11 * g_View.viewportSize.y * 0.5;
+    return error * instanceScale * pixelsPerUnit / distance;
+}
+
+bool IsMeshletVisible(Meshlet meshlet, InstanceData instance)
+{
+    // Errors and radii are scaled by the largest axis scale of the instance.
+    float3 axisScales = float3(length(instance.transform._m00_m10_m20), length(instance.transform._m01_m11_m21), length(instance.transform._m02_m12_m22));
+    float instanceScale = max(axisScales.x, max(axisScales.y, axisScales.z));
+
+    // Level of detail: draw the meshlet when its error is small enough on screen, but the error of the coarser meshlets
+    // simplified from it is not. Parent spheres contain the meshlet spheres and parent errors are never smaller,
+    // so exactly one level is selected on every part of the surface.
+    if (GetProjectedError(meshlet.lodSphere, meshlet.lodError, instance, instanceScale) > g_Draw.lodErrorThreshold ||
+        GetProjectedError(meshlet.parentSphere, meshlet.parentError, instance, instanceScale) <= g_Draw.lodErrorThreshold)
+        return false;
+
+    // Bounding sphere in world space.
+    float3 center = mul(instance.transform, float4(meshlet.boundingSphere.xyz, 1.0)).xyz;
+    float radius = meshlet.boundingSphere.w * instanceScale;
+
+    if (g_Draw.flags & MESHLET_FLAG_FRUSTUM_CULLING)
+    {
+        // Frustum planes, extracted from the columns of the world to clip matrix. The projection is reverse-Z
+        // with an infinite far plane, so the near plane is where z equals w, and there is no far plane.
+        float4x4 m = transpose(g_View.matWorldToClip);
+        float4 planes[5] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] - m[2] };
+
+        [unroll]
+        for (uint i = 0; i < 5; i++)
+        {
+            if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+                return false;
+        }
+    }
+
+    // Backface culling: every triangle faces away from the camera when the view vector is inside the dual of the normal cone.
+    // The test is conservative for the whole bounding sphere.
+    if ((g_Draw.flags & MESHLET_FLAG_CONE_CULLING) && meshlet.coneAxisCutoff.w < 1.0)
+    {
+        float3 coneAxis = normalize(mul(instance.transform, float4(meshlet.coneAxisCutoff.xyz, 0.0)).xyz);
+        float3 viewVector = center - g_View.cameraDirectionOrPosition.xyz;
+        if (dot(viewVector, coneAxis) >= meshlet.coneAxisCutoff.w * length(viewVector) + radius)
+            return false;
+    }
+
+    return true;
+}
+
+struct Payload
+{
+    uint meshletIndices[AS_GROUP_SIZE];
 };
 
 groupshared Payload s_payload;
+groupshared uint s_visibleMeshletCount;
+groupshared uint s_visibleTriangleCount;
 
-[numthreads(1, 1, 1)]
+// Each thread tests one meshlet of the geometry, and the group launches one mesh shader group per visible meshlet.
+[numthreads(AS_GROUP_SIZE, 1, 1)]
 void main_as(
-	uint globalIdx : SV_DispatchThreadID)
+    uint groupThreadId : SV_GroupThreadID,
+    uint groupId : SV_GroupID)
 {
-	s_payload.dummy = 0;
-	DispatchMesh(1, 1, 1, s_payload);
+    if (groupThreadId == 0)
+    {
+        s_visibleMeshletCount = 0;
+        s_visibleTriangleCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint meshletIndex = groupId * AS_GROUP_SIZE + groupThreadId;
+    if (meshletIndex < g_Draw.meshletCount)
+    {
+        Meshlet meshlet = t_Meshlets[g_Draw.firstMeshlet + meshletIndex];
+        if (IsMeshletVisible(meshlet, t_InstanceData[g_Draw.instance]))
+        {
+            uint slot;
+            InterlockedAdd(s_visibleMeshletCount, 1, slot);
+            InterlockedAdd(s_visibleTriangleCount, meshlet.triangleCount);
+            s_payload.meshletIndices[slot] = g_Draw.firstMeshlet + meshletIndex;
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupThreadId == 0 && s_visibleMeshletCount != 0)
+    {
+        InterlockedAdd(u_Stats[0], s_visibleMeshletCount);
+        InterlockedAdd(u_Stats[1], s_visibleTriangleCount);
+    }
+
+    DispatchMesh(s_visibleMeshletCount, 1, 1, s_payload);
 }
 
-[numthreads(1,1,1)]
+float3 GetMeshletColor(uint meshletIndex)
+{
+    uint hash = meshletIndex * 0x9E3779B9u;
+    hash ^= hash >> 15;
+    return float3((hash >> 0) & 0xff, (hash >> 8) & 0xff, (hash >> 16) & 0xff) / 255.0 * 0.8 + 0.2;
+}
+
+[numthreads(MS_GROUP_SIZE, 1, 1)]
 [outputtopology("triangle")]
 void main_ms(
-    uint threadId : SV_GroupThreadID,
+    uint groupThreadId : SV_GroupThreadID,
+    uint groupId : SV_GroupID,
     in payload Payload i_payload,
     out indices uint3 o_tris[MAX_PRIMS_PER_MESHLET],
     out vertices Vertex o_verts[MAX_VERTICES_PER_MESHLET])
 {
-    SetMeshOutputCounts(3, 1);
-    o_tris[0] = uint3(0, 1, 2);
+    uint meshletIndex = i_payload.meshletIndices[groupId];
+    Meshlet meshlet = t_Meshlets[meshletIndex];
+
+    SetMeshOutputCounts(meshlet.vertexCount, meshlet.triangleCount);
+
+    if (groupThreadId < meshlet.vertexCount)
+    {
+        InstanceData instance = t_InstanceData[g_Draw.instance];
+        GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Draw.geometryInMesh];
+
+        uint index = t_MeshletVertices[meshlet.vertexOffset + groupThreadId];
+        Vertex vertex = LoadVertex(instance, geometry, index);
+        if (g_Draw.flags & MESHLET_FLAG_SHOW_MESHLETS)
+            vertex.color = GetMeshletColor(meshletIndex);
+        o_verts[groupThreadId] = vertex;
+    }
 
-    for (uint i = 0; i < 3; i++)
+    if (groupThreadId < meshlet.triangleCount)
     {
-    	o_verts[i].pos = float4(g_positions[i], 0, 1);
-    	o_verts[i].color = g_colors[i];
+        uint packed = t_MeshletTriangles[meshlet.triangleOffset + groupThreadId];
+        o_tris[groupThreadId] = uint3(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff);
     }
 }
 
+// Fallback for devices without mesh shaders: each thread culls one meshlet like main_as does, and appends the triangles
+// of visible meshlets to an index buffer drawn with drawIndexedIndirect.
+[numthreads(CS_GROUP_SIZE, 1, 1)]
+void main_cs(uint threadId : SV_DispatchThreadID)
+{
+    // Uniform across the dispatch, so the wave operations below are not affected
+    if (g_Draw.meshletCount == 0)
+        return;
+
+    MeshletWorkItem item = t_MeshletWorkItems[min(threadId, g_Draw.meshletCount - 1)];
+    Meshlet meshlet = t_Meshlets[item.meshlet];
+
+    bool visible = threadId < g_Draw.meshletCount && IsMeshletVisible(meshlet, t_InstanceData[item.instance]);
+    uint indexCount = visible ? meshlet.triangleCount * 3 : 0;
+
+    // One allocation per wave in the index buffer.
+    uint waveIndexCount = WaveActiveSum(indexCount);
+    uint waveVisibleCount = WaveActiveCountBits(visible);
+    uint waveOffset = 0;
+    if (WaveIsFirstLane() && waveIndexCount != 0)
+    {
+        InterlockedAdd(u_CulledDrawArgs[0], waveIndexCount, waveOffset);
+        InterlockedAdd(u_Stats[0], waveVisibleCount);
+        InterlockedAdd(u_Stats[1], waveIndexCount / 3);
+    }
+    uint indexOffset = WaveReadLaneFirst(waveOffset) + WavePrefixSum(indexCount);
+
+    if (!visible)
+        return;
+
+    uint vertexIdBase = threadId << MESHLET_VERTEX_ID_BITS;
+    for (uint i = 0; i < meshlet.triangleCount; i++)
+    {
+        uint packed = t_MeshletTriangles[meshlet.triangleOffset + i];
+        u_CulledIndices[indexOffset + i * 3 + 0] = vertexIdBase | (packed & 0xff);
+        u_CulledIndices[indexOffset + i * 3 + 1] = vertexIdBase | ((packed >> 8) & 0xff);
+        u_CulledIndices[indexOffset + i * 3 + 2] = vertexIdBase | ((packed >> 16) & 0xff);
+    }
+}
+
+// Vertex shader of the indirect draw, which decodes the indices written by main_cs.
+void main_culled_vs(
+    in uint i_vertexID : SV_VertexID,
+    out Vertex o_vertex)
+{
+    MeshletWorkItem item = t_MeshletWorkItems[i_vertexID >> MESHLET_VERTEX_ID_BITS];
+    Meshlet meshlet = t_Meshlets[item.meshlet];
+    InstanceData instance = t_InstanceData[item.instance];
+    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + item.geometryInMesh];
+
+    uint index = t_MeshletVertices[meshlet.vertexOffset + (i_vertexID & ((1u << MESHLET_VERTEX_ID_BITS) - 1))];
+    o_vertex = LoadVertex(instance, geometry, index);
+    if (g_Draw.flags & MESHLET_FLAG_SHOW_MESHLETS)
+        o_vertex.color = GetMeshletColor(item.meshlet);
+}
 
 void main_ps(
-	in Vertex i_vertex,
-	out float4 o_color : SV_Target0
-)
+    in Vertex i_vertex,
+    out float4 o_color : SV_Target0)
 {
-	o_color = float4(i_vertex.color, 1);
+    MaterialConstants material = t_MaterialConstants[i_vertex.material];
+
+    float3 diffuse = material.baseOrDiffuseColor;
+
+    if (material.baseOrDiffuseTextureIndex >= 0)
+    {
+        Texture2D diffuseTexture = t_BindlessTextures[material.baseOrDiffuseTextureIndex];
+
+        float4 diffuseTextureValue = diffuseTexture.Sample(s_MaterialSampler, i_vertex.uv);
+
+        if (material.domain == MaterialDomain_AlphaTested)
+            clip(diffuseTextureValue.a - material.alphaCutoff);
+
+        diffuse *= diffuseTextureValue.rgb;
+    }
+
+    // Simple directional light, enough to show the shape of the geometry.
+    float3 lightDirection = normalize(float3(0.3, 1.0, 0.2));
+    float lighting = 0.3 + 0.7 * saturate(dot(normalize(i_vertex.normal), lightDirection));
+
+    o_color = float4(diffuse.rgb * lighting * i_vertex.color, 1);
 }
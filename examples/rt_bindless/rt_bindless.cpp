@@ -38,9 +38,19 @@ using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "accel_struct_manager.h"
+#include "animation_evaluator.h"
+#include "gpu_timer_ring.h"
 
 static const char* g_WindowTitle = "Donut Example: Bindless Ray Tracing";
 
+// Number of TLAS refits between full rebuilds, see accel_struct_manager.h
+constexpr uint32_t c_TlasRebuildPeriod = 60;
+
+// Spacing of the characters added with -crowd, which are placed on a grid in the middle of the atrium
+constexpr uint32_t c_CrowdColumns = 12;
+constexpr float c_CrowdSpacing = 1.5f;
+
 class BindlessRayTracing : public app::ApplicationBase
 {
 private:
@@ -57,6 +67,10 @@ private:
     nvrhi::BindingLayoutHandle m_BindlessLayout;
 
     nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::vector<nvrhi::rt::InstanceDesc> m_TlasInstances;
+    uint32_t m_FramesSinceTlasRebuild = 0;
+    bool m_TlasBuilt = false;
+    std::unique_ptr<AccelStructManager> m_AccelStructs;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -71,11 +85,18 @@ private:
 
     bool m_EnableAnimations = true;
     float m_WallclockTime = 0.f;
+    AnimationEvaluator m_AnimationEvaluator;
+    std::vector<float> m_AnimationTimes;
+
+    // GPU time of the skinned BLAS updates
+    GpuTimerRing<> m_SkinnedBlasTimers;
+    float m_SkinnedBlasTime = 0.f;
+    std::vector<nvrhi::rt::IAccelStruct*> m_SkinnedBlasUpdates;
 
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init(bool useRayQuery)
+    bool Init(bool useRayQuery, uint32_t crowdSize)
     {
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-plus.scene.json";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
@@ -127,7 +148,11 @@ public:
         m_SunLight->angularSize = 0.53f;
         m_SunLight->irradiance = 5.f;
 
+        if (crowdSize > 0 && !AddCrowd(crowdSize))
+            return false;
+
         m_Scene->FinishedLoading(GetFrameIndex());
+        m_AnimationEvaluator.SetAnimations(m_Scene->GetSceneGraph()->GetAnimations());
         
         m_Camera.LookAt(float3(0.f, 1.8f, 0.f), float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
@@ -146,7 +171,9 @@ public:
                 return false;
         }
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_CommandList = GetDevice()->createCommandList(AccelStructManager::GetBuildCommandListParameters());
+
+        m_SkinnedBlasTimers.Init(GetDevice());
 
         m_CommandList->open();
 
@@ -160,6 +187,31 @@ public:
         return true;
     }
 
+    // Adds copies of the first dancing robot, with their own skinned meshes and animations,
+    // to measure how the cost of skinning and BLAS updates scales with the number of characters.
+    bool AddCrowd(uint32_t crowdSize)
+    {
+        const auto& sceneGraph = m_Scene->GetSceneGraph();
+        std::shared_ptr<engine::SceneGraphNode> robot = sceneGraph->FindNode("/DancingRobot1");
+        if (!robot)
+        {
+            log::error("The scene has no /DancingRobot1 node to copy for the crowd");
+            return false;
+        }
+
+        for (uint32_t index = 0; index < crowdSize; ++index)
+        {
+            // Attaching a node that is already in the graph attaches a copy of its subgraph
+            std::shared_ptr<engine::SceneGraphNode> copy = sceneGraph->Attach(sceneGraph->GetRootNode(), robot);
+            const float column = float(index % c_CrowdColumns) - float(c_CrowdColumns - 1) * 0.5f;
+            const float row = float(index / c_CrowdColumns);
+            copy->SetTranslation(double3(column * c_CrowdSpacing, 0.0, row * c_CrowdSpacing - 3.0));
+        }
+
+        log::info("Added %u BrainStem characters", crowdSize);
+        return true;
+    }
+
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
         std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(),
@@ -214,17 +266,25 @@ public:
             m_WallclockTime += fElapsedTimeSeconds;
             float offset = 0;
 
-            for (const auto& anim : m_Scene->GetSceneGraph()->GetAnimations())
+            const auto& animations = m_Scene->GetSceneGraph()->GetAnimations();
+            m_AnimationTimes.resize(animations.size());
+            for (size_t index = 0; index < animations.size(); ++index)
             {
-                float duration = anim->GetDuration();
+                float duration = animations[index]->GetDuration();
                 float integral;
-                float animationTime = std::modf((m_WallclockTime + offset) / duration, &integral) * duration;
-                (void)anim->Apply(animationTime);
+                m_AnimationTimes[index] = std::modf((m_WallclockTime + offset) / duration, &integral) * duration;
                 offset += 1.0f;
             }
+
+            m_AnimationEvaluator.Evaluate(m_AnimationTimes);
         }
 
-        const char* extraInfo = (m_RayPipeline != nullptr) ? "- using RayPipeline" : "- using RayQuery";
+        char extraInfo[256];
+        const uint32_t skinnedBlasCount = m_AccelStructs ? m_AccelStructs->GetLastRefitCount() + m_AccelStructs->GetLastRebuildCount() : 0;
+        snprintf(extraInfo, sizeof(extraInfo), "- using %s - %u skinned BLAS updates (%u rebuilt) in %.2f ms, %.1f us each",
+            (m_RayPipeline != nullptr) ? "RayPipeline" : "RayQuery",
+            skinnedBlasCount, m_AccelStructs ? m_AccelStructs->GetLastRebuildCount() : 0, m_SkinnedBlasTime,
+            skinnedBlasCount ? m_SkinnedBlasTime * 1000.f / float(skinnedBlasCount) : 0.f);
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
@@ -292,119 +352,98 @@ public:
         return true;
     }
 
-    void GetMeshBlasDesc(engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const
-    {
-        blasDesc.isTopLevel = false;
-        blasDesc.debugName = mesh.name;
-
-        for (const auto& geometry : mesh.geometries)
-        {
-            nvrhi::rt::GeometryDesc geometryDesc;
-            auto & triangles = geometryDesc.geometryData.triangles;
-            triangles.indexBuffer = mesh.buffers->indexBuffer;
-            triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-            triangles.indexFormat = nvrhi::Format::R32_UINT;
-            triangles.indexCount = geometry->numIndices;
-            triangles.vertexBuffer = mesh.buffers->vertexBuffer;
-            triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-            triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-            triangles.vertexStride = sizeof(float3);
-            triangles.vertexCount = geometry->numVertices;
-            geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-            geometryDesc.flags = (geometry->material->domain == engine::MaterialDomain::AlphaTested)
-                ? nvrhi::rt::GeometryFlags::None
-                : nvrhi::rt::GeometryFlags::Opaque;
-            blasDesc.bottomLevelGeometries.push_back(geometryDesc);
-        }
-
-        // don't compact acceleration structures that are built per frame
-        if (mesh.skinPrototype != nullptr)
-        {
-            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PreferFastTrace;
-        }
-        else
-        {
-            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PreferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowCompaction;
-        }
-    }
-
     void CreateAccelStructs(nvrhi::ICommandList* commandList)
     {
+        m_AccelStructs = std::make_unique<AccelStructManager>(GetDevice());
+
         for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
         {
             if (mesh->isSkinPrototype)
                 continue; // skip the skinning prototypes
             
             nvrhi::rt::AccelStructDesc blasDesc;
+            GetMeshBlasDesc(*mesh, blasDesc, [](const engine::MeshGeometry& geometry)
+                { return geometry.material->domain != engine::MaterialDomain::AlphaTested; });
 
-            GetMeshBlasDesc(*mesh, blasDesc);
-
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-
-            if (!mesh->skinPrototype)
-                nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
-
-            mesh->accelStruct = as;
+            // Skinned meshes are built per frame and not compacted, the static ones are built here
+            const bool isSkinned = mesh->skinPrototype != nullptr;
+            mesh->accelStruct = m_AccelStructs->CreateBLAS(blasDesc, isSkinned, !isSkinned);
         }
 
+        m_AccelStructs->BuildPending(commandList);
+
 
         nvrhi::rt::AccelStructDesc tlasDesc;
         tlasDesc.isTopLevel = true;
         tlasDesc.topLevelMaxInstances = m_Scene->GetSceneGraph()->GetMeshInstances().size();
+        tlasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
+        tlasDesc.debugName = "TopLevelAS";
         m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
+        m_TlasBuilt = false;
     }
 
-    void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex) const
+    void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex)
     {
-        commandList->beginMarker("Skinned BLAS Updates");
+        m_SkinnedBlasTimers.Harvest(frameIndex, m_SkinnedBlasTime);
 
-        // Transition all the buffers to their necessary states before building the BLAS'es to allow BLAS batching
+        // The skinned meshes only change their vertex positions, so their BLASes are refit in place,
+        // all in one batch, with a periodic rebuild to restore the BVH quality.
+        m_SkinnedBlasUpdates.clear();
         for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
         {
-            if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
-                continue;
-
-            commandList->setAccelStructState(skinnedInstance->GetMesh()->accelStruct, nvrhi::ResourceStates::AccelStructWrite);
-            commandList->setBufferState(skinnedInstance->GetMesh()->buffers->vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+            if (skinnedInstance->GetLastUpdateFrameIndex() >= frameIndex)
+                m_SkinnedBlasUpdates.push_back(skinnedInstance->GetMesh()->accelStruct);
         }
-        commandList->commitBarriers();
 
-        // Now build the BLAS'es
-        for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
-        {
-            if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
-                continue;
-            
-            nvrhi::rt::AccelStructDesc blasDesc;
-            GetMeshBlasDesc(*skinnedInstance->GetMesh(), blasDesc);
-            
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, skinnedInstance->GetMesh()->accelStruct, blasDesc);
-        }
+        commandList->beginMarker("Skinned BLAS Updates");
+        m_SkinnedBlasTimers.Begin(commandList);
+        m_AccelStructs->UpdateDynamicBLASes(commandList, m_SkinnedBlasUpdates);
+        m_SkinnedBlasTimers.End(commandList);
         commandList->endMarker();
 
-        std::vector<nvrhi::rt::InstanceDesc> instances;
+        const auto& meshInstances = m_Scene->GetSceneGraph()->GetMeshInstances();
+        bool topologyChanged = !m_TlasBuilt || m_TlasInstances.size() != meshInstances.size();
+        bool transformsChanged = false;
+        m_TlasInstances.resize(meshInstances.size());
 
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        for (size_t index = 0; index < meshInstances.size(); ++index)
         {
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = instance->GetMesh()->accelStruct;
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = 1;
-            instanceDesc.instanceID = instance->GetInstanceIndex();
+            const auto& instance = meshInstances[index];
+            nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[index];
+
+            nvrhi::rt::IAccelStruct* bottomLevelAS = instance->GetMesh()->accelStruct;
+            assert(bottomLevelAS);
+            if (instanceDesc.bottomLevelAS != bottomLevelAS || instanceDesc.instanceID != uint32_t(instance->GetInstanceIndex()))
+            {
+                instanceDesc.bottomLevelAS = bottomLevelAS;
+                instanceDesc.instanceMask = 1;
+                instanceDesc.instanceID = instance->GetInstanceIndex();
+                topologyChanged = true;
+            }
 
             auto node = instance->GetNode();
             assert(node);
-            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
-
-            instances.push_back(instanceDesc);
+            if (UpdateTlasInstanceTransform(instanceDesc, node->GetLocalToWorldTransformFloat()))
+                transformsChanged = true;
         }
 
         // Compact acceleration structures that are tagged for compaction and have finished executing the original build
-        commandList->compactBottomLevelAccelStructs();
+        const bool blasesCompacted = m_AccelStructs->Compact(commandList);
+        if (blasesCompacted && m_AccelStructs->IsCompactionComplete())
+            m_AccelStructs->LogMemoryStats();
+
+        // The TLAS also needs a refit when no transform has changed, but the skinned BLASes have been updated,
+        // or compaction has moved static BLASes to new memory. Otherwise it is still valid.
+        if (!topologyChanged && !transformsChanged && m_SkinnedBlasUpdates.empty() && !blasesCompacted)
+            return;
 
-        commandList->beginMarker("TLAS Update");
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
+        const bool rebuild = ShouldRebuildTlas(topologyChanged, c_TlasRebuildPeriod, m_FramesSinceTlasRebuild);
+
+        commandList->beginMarker(rebuild ? "TLAS Rebuild" : "TLAS Update");
+        commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_TlasInstances.data(), m_TlasInstances.size(),
+            GetTlasBuildFlags(m_TopLevelAS, rebuild));
         commandList->endMarker();
+        m_TlasBuilt = true;
     }
 
 
@@ -505,12 +544,17 @@ int main(int __argc, const char** __argv)
     deviceParams.enableRayTracingExtensions = true;
 
     bool useRayQuery = false;
+    uint32_t crowdSize = 0;
     for (int i = 1; i < __argc; i++)
     {
         if (strcmp(__argv[i], "-rayQuery") == 0)
         {
             useRayQuery = true;
         }
+        else if (strcmp(__argv[i], "-crowd") == 0 && i + 1 < __argc)
+        {
+            crowdSize = uint32_t(std::max(atoi(__argv[++i]), 0));
+        }
         else if (strcmp(__argv[i], "-debug") == 0)
         {
             deviceParams.enableDebugRuntime = true;
@@ -538,7 +582,7 @@ int main(int __argc, const char** __argv)
 
     {
         BindlessRayTracing example(deviceManager);
-        if (example.Init(useRayQuery))
+        if (example.Init(useRayQuery, crowdSize))
         {
             deviceManager->AddRenderPassToBack(&example);
             deviceManager->RunMessageLoop();
@@ -0,0 +1,277 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "accel_struct_manager.h"
+
+#include <donut/engine/SceneTypes.h>
+#include <donut/core/log.h>
+#include <donut/core/math/math.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+
+using namespace donut;
+using namespace donut::math;
+
+// Scratch chunk size of the build command lists. A build whose scratch does not fit in the current chunk gets a new one,
+// so this is large enough for the initial builds of the sample scenes to share a single chunk.
+static const size_t c_ScratchChunkSize = 32 * 1024 * 1024;
+
+void GetMeshBlasDesc(const engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc,
+    const std::function<bool(const engine::MeshGeometry&)>& isOpaque)
+{
+    blasDesc.isTopLevel = false;
+    blasDesc.debugName = mesh.name;
+
+    for (const auto& geometry : mesh.geometries)
+    {
+        nvrhi::rt::GeometryDesc geometryDesc;
+        auto& triangles = geometryDesc.geometryData.triangles;
+        triangles.indexBuffer = mesh.buffers->indexBuffer;
+        triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
+        triangles.indexFormat = nvrhi::Format::R32_UINT;
+        triangles.indexCount = geometry->numIndices;
+        triangles.vertexBuffer = mesh.buffers->vertexBuffer;
+        triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
+        triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
+        triangles.vertexStride = sizeof(float3);
+        triangles.vertexCount = geometry->numVertices;
+        geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
+        geometryDesc.flags = (!isOpaque || isOpaque(*geometry))
+            ? nvrhi::rt::GeometryFlags::Opaque
+            : nvrhi::rt::GeometryFlags::None;
+        blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+    }
+}
+
+bool UpdateTlasInstanceTransform(nvrhi::rt::InstanceDesc& instanceDesc, const affine3& transform)
+{
+    nvrhi::rt::AffineTransform columnMajor;
+    affineToColumnMajor(transform, columnMajor);
+
+    if (memcmp(instanceDesc.transform, columnMajor, sizeof(columnMajor)) == 0)
+        return false;
+
+    memcpy(instanceDesc.transform, columnMajor, sizeof(columnMajor));
+    return true;
+}
+
+bool ShouldRebuildTlas(bool topologyChanged, uint32_t rebuildPeriod, uint32_t& framesSinceRebuild)
+{
+    const bool rebuild = topologyChanged || framesSinceRebuild >= rebuildPeriod;
+    framesSinceRebuild = rebuild ? 0 : framesSinceRebuild + 1;
+    return rebuild;
+}
+
+nvrhi::rt::AccelStructBuildFlags GetTlasBuildFlags(nvrhi::rt::IAccelStruct* topLevelAS, bool rebuild)
+{
+    const nvrhi::rt::AccelStructBuildFlags buildFlags = topLevelAS->getDesc().buildFlags;
+    assert((buildFlags & nvrhi::rt::AccelStructBuildFlags::AllowUpdate) != nvrhi::rt::AccelStructBuildFlags::None);
+
+    return rebuild ? buildFlags : buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate;
+}
+
+AccelStructManager::AccelStructManager(nvrhi::IDevice* device)
+    : m_Device(device)
+{
+}
+
+nvrhi::CommandListParameters AccelStructManager::GetBuildCommandListParameters()
+{
+    return nvrhi::CommandListParameters().setScratchChunkSize(c_ScratchChunkSize);
+}
+
+nvrhi::rt::AccelStructHandle AccelStructManager::CreateBLAS(nvrhi::rt::AccelStructDesc blasDesc, bool isDynamic, bool build)
+{
+    assert(!blasDesc.isTopLevel);
+
+    // Dynamic BLASes are rebuilt or refit every frame, so they are built for updates instead of compaction
+    blasDesc.buildFlags = isDynamic
+        ? nvrhi::rt::AccelStructBuildFlags::PreferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowUpdate
+        : nvrhi::rt::AccelStructBuildFlags::PreferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowCompaction;
+
+    nvrhi::rt::AccelStructHandle accelStruct = m_Device->createAccelStruct(blasDesc);
+    if (!accelStruct)
+        return nullptr;
+
+    BlasMemoryStats stats;
+    stats.name = blasDesc.debugName;
+    stats.size = GetAccelStructSize(accelStruct);
+    stats.uncompactedSize = stats.size;
+    stats.isDynamic = isDynamic;
+    m_Indices[accelStruct] = m_AccelStructs.size();
+    m_AccelStructs.push_back(accelStruct);
+    m_Stats.push_back(stats);
+    m_RefitsSinceBuild.push_back(build ? 0 : c_DynamicBlasRebuildPeriod);
+
+    if (!isDynamic)
+        ++m_NumUncompacted;
+
+    if (build)
+        m_PendingBuilds.push_back({ accelStruct, std::move(blasDesc) });
+
+    return accelStruct;
+}
+
+void AccelStructManager::BuildPending(nvrhi::ICommandList* commandList)
+{
+    if (m_PendingBuilds.empty())
+        return;
+
+    commandList->beginMarker("BLAS Builds");
+
+    for (const PendingBuild& pending : m_PendingBuilds)
+    {
+        commandList->setAccelStructState(pending.accelStruct, nvrhi::ResourceStates::AccelStructWrite);
+
+        for (const nvrhi::rt::GeometryDesc& geometryDesc : pending.desc.bottomLevelGeometries)
+        {
+            if (geometryDesc.geometryType == nvrhi::rt::GeometryType::Triangles)
+            {
+                commandList->setBufferState(geometryDesc.geometryData.triangles.indexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+                commandList->setBufferState(geometryDesc.geometryData.triangles.vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+            }
+            else
+                commandList->setBufferState(geometryDesc.geometryData.aabbs.buffer, nvrhi::ResourceStates::AccelStructBuildInput);
+        }
+    }
+    commandList->commitBarriers();
+
+    for (const PendingBuild& pending : m_PendingBuilds)
+    {
+        commandList->buildBottomLevelAccelStruct(pending.accelStruct, pending.desc.bottomLevelGeometries.data(),
+            pending.desc.bottomLevelGeometries.size(), pending.desc.buildFlags);
+    }
+
+    commandList->endMarker();
+
+    m_PendingBuilds.clear();
+}
+
+void AccelStructManager::UpdateDynamicBLASes(nvrhi::ICommandList* commandList, const std::vector<nvrhi::rt::IAccelStruct*>& accelStructs)
+{
+    m_LastRefitCount = 0;
+    m_LastRebuildCount = 0;
+
+    if (accelStructs.empty())
+        return;
+
+    for (nvrhi::rt::IAccelStruct* accelStruct : accelStructs)
+    {
+        commandList->setAccelStructState(accelStruct, nvrhi::ResourceStates::AccelStructWrite);
+
+        for (const nvrhi::rt::GeometryDesc& geometryDesc : accelStruct->getDesc().bottomLevelGeometries)
+        {
+            commandList->setBufferState(geometryDesc.geometryData.triangles.indexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+            commandList->setBufferState(geometryDesc.geometryData.triangles.vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+        }
+    }
+    commandList->commitBarriers();
+
+    for (nvrhi::rt::IAccelStruct* accelStruct : accelStructs)
+    {
+        auto it = m_Indices.find(accelStruct);
+        assert(it != m_Indices.end() && m_Stats[it->second].isDynamic);
+        uint32_t& refitsSinceBuild = m_RefitsSinceBuild[it->second];
+
+        const bool refit = refitsSinceBuild < c_DynamicBlasRebuildPeriod;
+        const nvrhi::rt::AccelStructDesc& desc = accelStruct->getDesc();
+        const nvrhi::rt::AccelStructBuildFlags buildFlags = refit
+            ? desc.buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate
+            : desc.buildFlags;
+
+        commandList->buildBottomLevelAccelStruct(accelStruct, desc.bottomLevelGeometries.data(),
+            desc.bottomLevelGeometries.size(), buildFlags);
+
+        if (refit)
+        {
+            ++refitsSinceBuild;
+            ++m_LastRefitCount;
+        }
+        else
+        {
+            refitsSinceBuild = 0;
+            ++m_LastRebuildCount;
+        }
+    }
+}
+
+bool AccelStructManager::Compact(nvrhi::ICommandList* commandList)
+{
+    if (m_NumUncompacted == 0)
+        return false;
+
+    commandList->compactBottomLevelAccelStructs();
+
+    // Compaction replaces the memory of the BLASes when it's recorded
+    bool compacted = false;
+    for (size_t index = 0; index < m_AccelStructs.size(); ++index)
+    {
+        BlasMemoryStats& stats = m_Stats[index];
+        if (stats.isDynamic || stats.isCompacted || !m_AccelStructs[index]->isCompacted())
+            continue;
+
+        stats.isCompacted = true;
+        stats.size = GetAccelStructSize(m_AccelStructs[index]);
+        --m_NumUncompacted;
+        compacted = true;
+    }
+
+    return compacted;
+}
+
+uint64_t AccelStructManager::GetTotalSize() const
+{
+    return std::accumulate(m_Stats.begin(), m_Stats.end(), uint64_t(0),
+        [](uint64_t sum, const BlasMemoryStats& stats) { return sum + stats.size; });
+}
+
+uint64_t AccelStructManager::GetTotalUncompactedSize() const
+{
+    return std::accumulate(m_Stats.begin(), m_Stats.end(), uint64_t(0),
+        [](uint64_t sum, const BlasMemoryStats& stats) { return sum + stats.uncompactedSize; });
+}
+
+void AccelStructManager::LogMemoryStats(size_t maxBlasCount) const
+{
+    const double megabyte = 1024.0 * 1024.0;
+    log::info("%zu BLASes use %.2f MB, %.2f MB before compaction", m_Stats.size(),
+        double(GetTotalSize()) / megabyte, double(GetTotalUncompactedSize()) / megabyte);
+
+    std::vector<const BlasMemoryStats*> largest;
+    for (const BlasMemoryStats& stats : m_Stats)
+        largest.push_back(&stats);
+    std::sort(largest.begin(), largest.end(), [](const BlasMemoryStats* a, const BlasMemoryStats* b) { return a->size > b->size; });
+
+    for (size_t index = 0; index < std::min(maxBlasCount, largest.size()); ++index)
+    {
+        const BlasMemoryStats& stats = *largest[index];
+        log::info("    %-32s %8.1f KB (%.1f KB before compaction)%s", stats.name.c_str(),
+            double(stats.size) / 1024.0, double(stats.uncompactedSize) / 1024.0, stats.isDynamic ? ", dynamic" : "");
+    }
+}
+
+uint64_t AccelStructManager::GetAccelStructSize(nvrhi::rt::IAccelStruct* accelStruct) const
+{
+    return m_Device->getAccelStructMemoryRequirements(accelStruct).size;
+}
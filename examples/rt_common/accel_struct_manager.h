@@ -0,0 +1,137 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::engine
+{
+    struct MeshInfo;
+    struct MeshGeometry;
+}
+
+// Memory used by one bottom level acceleration structure.
+struct BlasMemoryStats
+{
+    std::string name;
+    uint64_t size = 0; // Current size, which is the compacted size once compaction has completed.
+    uint64_t uncompactedSize = 0; // Size of the original build.
+    bool isDynamic = false;
+    bool isCompacted = false;
+};
+
+// Describes the triangles of all geometries of a mesh. Geometries for which isOpaque returns false are added without
+// the Opaque flag, so that any-hit shaders and ray queries see their candidates. A null isOpaque makes all geometries opaque.
+void GetMeshBlasDesc(const donut::engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc,
+    const std::function<bool(const donut::engine::MeshGeometry&)>& isOpaque = nullptr);
+
+// The samples keep their TLAS instance descs between frames, rewrite only the ones that have changed, and refit the TLAS
+// instead of rebuilding it. A refit is cheaper, but keeps the BVH topology of the last build, whose quality degrades as
+// the instances move away from where they were. So the TLAS is rebuilt every few frames, and whenever the set of
+// instances or their BLASes change, which a refit cannot handle. The TLAS must be created with AllowUpdate, and
+// rebuilds keep that flag, otherwise the refits that follow them would be invalid.
+
+// Writes the transform into a TLAS instance desc if it differs from the one already there. Returns true if it did.
+bool UpdateTlasInstanceTransform(nvrhi::rt::InstanceDesc& instanceDesc, const donut::math::affine3& transform);
+
+// Returns true if the TLAS must be rebuilt rather than refit: when topologyChanged is set, or when it has been refit
+// rebuildPeriod times in a row. framesSinceRebuild counts the refits, and is updated for the build that follows.
+bool ShouldRebuildTlas(bool topologyChanged, uint32_t rebuildPeriod, uint32_t& framesSinceRebuild);
+
+// Build flags for a rebuild or a refit of a TLAS created with AllowUpdate.
+nvrhi::rt::AccelStructBuildFlags GetTlasBuildFlags(nvrhi::rt::IAccelStruct* topLevelAS, bool rebuild);
+
+// Creates the bottom level acceleration structures of the ray tracing samples, batches their initial builds,
+// compacts the static ones, and tracks how much memory they use.
+//
+// Static BLASes are built with AllowCompaction and compacted once the GPU has finished building them. Dynamic BLASes,
+// which the application rebuilds itself (skinned meshes, particles), are never compacted.
+class AccelStructManager
+{
+public:
+    // Number of consecutive refits of a dynamic BLAS before it is rebuilt. Refits keep the BVH topology of the last
+    // build, which gets less efficient as the vertices move away from where they were.
+    static constexpr uint32_t c_DynamicBlasRebuildPeriod = 120;
+
+    explicit AccelStructManager(nvrhi::IDevice* device);
+
+    // Parameters for the command lists that build acceleration structures. nvrhi suballocates the scratch memory of
+    // the builds from chunks of this size and recycles them once the GPU is done, so a batch of builds shares one
+    // allocation instead of creating a scratch buffer per BLAS.
+    static nvrhi::CommandListParameters GetBuildCommandListParameters();
+
+    // Creates a BLAS and, unless build is false, queues its build for the next BuildPending. The buffers referenced
+    // by blasDesc must stay alive until then. The build flags of blasDesc are replaced according to isDynamic.
+    nvrhi::rt::AccelStructHandle CreateBLAS(nvrhi::rt::AccelStructDesc blasDesc, bool isDynamic, bool build = true);
+
+    // Records the queued builds. All resources are transitioned first, so that the builds are not separated by barriers.
+    void BuildPending(nvrhi::ICommandList* commandList);
+
+    // Updates dynamic BLASes whose vertex positions have changed, such as skinned meshes, using the geometries they were
+    // created with. The updates are recorded back to back behind one set of barriers, and share the scratch chunk of the
+    // command list. A BLAS is refit in place, unless it has never been built or has been refit c_DynamicBlasRebuildPeriod
+    // times in a row, in which case it is rebuilt to restore the BVH quality.
+    void UpdateDynamicBLASes(nvrhi::ICommandList* commandList, const std::vector<nvrhi::rt::IAccelStruct*>& accelStructs);
+
+    // Number of BLASes refit and rebuilt by the last UpdateDynamicBLASes.
+    uint32_t GetLastRefitCount() const { return m_LastRefitCount; }
+    uint32_t GetLastRebuildCount() const { return m_LastRebuildCount; }
+
+    // Compacts the static BLASes whose builds have finished executing. Returns true if any BLAS has been compacted,
+    // in which case it has moved to new memory and the TLASes that reference it must be rebuilt or refit.
+    bool Compact(nvrhi::ICommandList* commandList);
+
+    // Returns true when all static BLASes have been compacted.
+    bool IsCompactionComplete() const { return m_NumUncompacted == 0; }
+
+    const std::vector<BlasMemoryStats>& GetBlasStats() const { return m_Stats; }
+    uint64_t GetTotalSize() const;
+    uint64_t GetTotalUncompactedSize() const;
+
+    // Writes the total memory usage, and the largest BLASes, to the log.
+    void LogMemoryStats(size_t maxBlasCount = 8) const;
+
+private:
+    struct PendingBuild
+    {
+        nvrhi::rt::AccelStructHandle accelStruct;
+        nvrhi::rt::AccelStructDesc desc;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    std::vector<nvrhi::rt::AccelStructHandle> m_AccelStructs; // Parallel to m_Stats
+    std::vector<BlasMemoryStats> m_Stats;
+    std::vector<uint32_t> m_RefitsSinceBuild; // Parallel to m_Stats, only used by dynamic BLASes
+    std::unordered_map<nvrhi::rt::IAccelStruct*, size_t> m_Indices;
+    uint32_t m_LastRefitCount = 0;
+    uint32_t m_LastRebuildCount = 0;
+    std::vector<PendingBuild> m_PendingBuilds;
+    size_t m_NumUncompacted = 0;
+
+    uint64_t GetAccelStructSize(nvrhi::rt::IAccelStruct* accelStruct) const;
+};
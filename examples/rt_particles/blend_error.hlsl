@@ -0,0 +1,49 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// Measures how far a blending mode is from the depth peeled reference: sums the mean absolute
+// RGB difference of all pixels, clamped to 1, into a fixed point counter.
+
+#include "rt_particles_cb.h"
+
+Texture2D<float4> t_Color : register(t0);
+Texture2D<float4> t_Reference : register(t1);
+RWByteAddressBuffer u_Error : register(u0);
+
+[numthreads(BLEND_ERROR_GROUP_SIZE, BLEND_ERROR_GROUP_SIZE, 1)]
+void main(uint2 pixelPosition : SV_DispatchThreadID)
+{
+    uint2 size;
+    t_Color.GetDimensions(size.x, size.y);
+
+    float error = 0;
+    if (all(pixelPosition < size))
+    {
+        const float3 difference = abs(t_Color[pixelPosition].rgb - t_Reference[pixelPosition].rgb);
+        error = min(dot(difference, 1.0 / 3.0), 1.0);
+    }
+
+    // One atomic per wave. At the error scale, a 4K image cannot overflow the counter.
+    const float waveError = WaveActiveSum(error);
+    if (WaveIsFirstLane())
+        u_Error.InterlockedAdd(0, uint(waveError * BLEND_ERROR_SCALE + 0.5));
+}
@@ -0,0 +1,288 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// This file implements the blending modes for particles found along a ray, selected with BLEND_MODE.
+// Every mode keeps a BlendState per ray, and provides the same three functions:
+//   blendBegin   - initializes the state,
+//   blendAdd     - adds a fragment, in the arbitrary order in which the ray query finds them,
+//   blendResolve - returns the composited color and attenuation of all fragments.
+// BLEND_MODE_REFERENCE needs several traversals of the ray, see blendNextLayer.
+
+#include "mlab.hlsli"
+#include "random.hlsli"
+
+#ifndef BLEND_MODE
+#define BLEND_MODE BLEND_MODE_MLAB
+#endif
+
+#if BLEND_MODE == BLEND_MODE_MLAB
+
+// Multi-layer alpha blending, see mlab.hlsli.
+// Fragments that don't fit into the array are merged into its last entry in arrival order.
+
+struct BlendState
+{
+    BlendFragment fragments[MLAB_FRAGMENTS];
+};
+
+void blendBegin(inout BlendState state)
+{
+    blendInit(state.fragments);
+}
+
+void blendAdd(inout BlendState state, BlendFragment f, uint fragmentId, uint randomSeed)
+{
+    blendInsert(f, state.fragments);
+}
+
+BlendFragment blendResolve(BlendState state)
+{
+    return blendIntegrate(state.fragments);
+}
+
+#elif BLEND_MODE == BLEND_MODE_KBUFFER
+
+// K-buffer: keeps the MLAB_FRAGMENTS nearest fragments sorted by insertion, and composites them exactly.
+// Fragments that fall off the end of the buffer are accumulated into an order independent tail
+// with weighted average blending, which is composited behind the sorted fragments.
+
+struct BlendState
+{
+    BlendFragment fragments[MLAB_FRAGMENTS];
+    float3 tailColor;
+    float tailAlpha;
+    float tailAttenuation;
+};
+
+void blendBegin(inout BlendState state)
+{
+    blendInit(state.fragments);
+    state.tailColor = 0;
+    state.tailAlpha = 0;
+    state.tailAttenuation = 1;
+}
+
+void blendAdd(inout BlendState state, BlendFragment f, uint fragmentId, uint randomSeed)
+{
+    // Insertion sort, walking from the back of the buffer. Entries are only written at or after
+    // the current position, so the comparisons with the previous entries see their original values.
+    const BlendFragment last = state.fragments[MLAB_FRAGMENTS - 1];
+
+    [unroll]
+    for (int i = MLAB_FRAGMENTS - 1; i > 0; --i)
+    {
+        if (f.depth < state.fragments[i - 1].depth)
+            state.fragments[i] = state.fragments[i - 1];
+        else if (f.depth < state.fragments[i].depth)
+            state.fragments[i] = f;
+    }
+
+    if (f.depth < state.fragments[0].depth)
+        state.fragments[0] = f;
+
+    // Whichever is farther of the new fragment and the previous last one doesn't fit in the buffer
+    const BlendFragment dropped = (f.depth < last.depth) ? last : f;
+    state.tailColor += dropped.color;
+    state.tailAlpha += 1.0 - dropped.attenuation;
+    state.tailAttenuation *= dropped.attenuation;
+}
+
+BlendFragment blendResolve(BlendState state)
+{
+    BlendFragment result = blendIntegrate(state.fragments);
+
+    const float3 tailColor = state.tailColor / max(state.tailAlpha, 1e-5) * (1.0 - state.tailAttenuation);
+    result.color += tailColor * result.attenuation;
+    result.attenuation *= state.tailAttenuation;
+
+    return result;
+}
+
+#elif BLEND_MODE == BLEND_MODE_WBOIT
+
+// Weighted blended order independent transparency, see M. McGuire, L. Bavoil:
+// "Weighted Blended Order-Independent Transparency". The fragments are averaged with weights
+// that favor near and opaque ones, which needs no sorting and a constant amount of state.
+
+struct BlendState
+{
+    float3 accumulatedColor;
+    float accumulatedAlpha;
+    float attenuation;
+};
+
+void blendBegin(inout BlendState state)
+{
+    state.accumulatedColor = 0;
+    state.accumulatedAlpha = 0;
+    state.attenuation = 1;
+}
+
+void blendAdd(inout BlendState state, BlendFragment f, uint fragmentId, uint randomSeed)
+{
+    // Depth weight function from equation 10 in the paper, with the depth in world units
+    const float alpha = 1.0 - f.attenuation;
+    const float weight = clamp(10.0 / (1e-5 + pow(f.depth / 5.0, 2.0) + pow(f.depth / 200.0, 6.0)), 1e-2, 3e3);
+
+    state.accumulatedColor += f.color * weight;
+    state.accumulatedAlpha += alpha * weight;
+    state.attenuation *= f.attenuation;
+}
+
+BlendFragment blendResolve(BlendState state)
+{
+    BlendFragment result;
+    result.color = state.accumulatedColor / max(state.accumulatedAlpha, 1e-5) * (1.0 - state.attenuation);
+    result.attenuation = state.attenuation;
+    result.depth = 0;
+    return result;
+}
+
+#elif BLEND_MODE == BLEND_MODE_STOCHASTIC
+
+// Stochastic transparency, see E. Enderton et al.: "Stochastic Transparency".
+// Every fragment covers each of the MLAB_FRAGMENTS samples with a probability equal to its opacity,
+// and each sample keeps the nearest fragment that covers it. The average of the samples converges
+// to the correctly sorted result, with noise instead of ordering errors.
+
+struct BlendState
+{
+    float3 colors[MLAB_FRAGMENTS];
+    float depths[MLAB_FRAGMENTS];
+};
+
+void blendBegin(inout BlendState state)
+{
+    [unroll]
+    for (int i = 0; i < MLAB_FRAGMENTS; ++i)
+    {
+        state.colors[i] = 0;
+        state.depths[i] = 1.#INF;
+    }
+}
+
+void blendAdd(inout BlendState state, BlendFragment f, uint fragmentId, uint randomSeed)
+{
+    // The coverage of a fragment only depends on the fragment and the ray, so that it's the same
+    // whichever order the fragments are found in.
+    uint seed = pcgHash(randomSeed ^ pcgHash(fragmentId));
+    const float alpha = 1.0 - f.attenuation;
+    const float3 color = f.color / alpha;
+
+    [unroll]
+    for (int i = 0; i < MLAB_FRAGMENTS; ++i)
+    {
+        if (randomFloat(seed) < alpha && f.depth < state.depths[i])
+        {
+            state.colors[i] = color;
+            state.depths[i] = f.depth;
+        }
+    }
+}
+
+BlendFragment blendResolve(BlendState state)
+{
+    BlendFragment result;
+    result.color = 0;
+    result.attenuation = 0;
+    result.depth = 0;
+
+    [unroll]
+    for (int i = 0; i < MLAB_FRAGMENTS; ++i)
+    {
+        result.color += state.colors[i];
+        result.attenuation += isinf(state.depths[i]) ? 1.0 : 0.0;
+    }
+
+    result.color /= MLAB_FRAGMENTS;
+    result.attenuation /= MLAB_FRAGMENTS;
+    return result;
+}
+
+#elif BLEND_MODE == BLEND_MODE_REFERENCE
+
+// Reference blending by depth peeling: every traversal of the ray finds the nearest fragment behind the one
+// composited by the previous traversal, and blends it under the result. This is exact but very slow,
+// and is meant for measuring the error of the other modes.
+
+static const uint c_MaxReferenceLayers = 256;
+
+struct BlendState
+{
+    BlendFragment result;
+    BlendFragment nearest;
+    uint nearestId;
+    float lastDepth;
+    uint lastId;
+    uint layer;
+};
+
+void blendBegin(inout BlendState state)
+{
+    state.result.color = 0;
+    state.result.attenuation = 1;
+    state.result.depth = 0;
+    state.nearest.depth = 1.#INF;
+    state.nearestId = 0;
+    state.lastDepth = -1.#INF;
+    state.lastId = 0;
+    state.layer = 0;
+}
+
+void blendAdd(inout BlendState state, BlendFragment f, uint fragmentId, uint randomSeed)
+{
+    // Fragments are ordered by depth, and by ID when the depths are equal
+    const bool behindLast = f.depth > state.lastDepth || (f.depth == state.lastDepth && fragmentId > state.lastId);
+    const bool beforeNearest = f.depth < state.nearest.depth || (f.depth == state.nearest.depth && fragmentId < state.nearestId);
+
+    if (behindLast && beforeNearest)
+    {
+        state.nearest = f;
+        state.nearestId = fragmentId;
+    }
+}
+
+// Composites the nearest fragment found by the last traversal, and returns true if another traversal is needed.
+bool blendNextLayer(inout BlendState state)
+{
+    if (isinf(state.nearest.depth))
+        return false;
+
+    state.result.color += state.nearest.color * state.result.attenuation;
+    state.result.attenuation *= state.nearest.attenuation;
+
+    state.lastDepth = state.nearest.depth;
+    state.lastId = state.nearestId;
+    state.nearest.depth = 1.#INF;
+    ++state.layer;
+
+    return state.layer < c_MaxReferenceLayers && state.result.attenuation > 1e-4;
+}
+
+BlendFragment blendResolve(BlendState state)
+{
+    return state.result;
+}
+
+#else
+#error Unknown BLEND_MODE
+#endif
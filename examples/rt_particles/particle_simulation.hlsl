@@ -0,0 +1,140 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "rt_particles_cb.h"
+#include "random.hlsli"
+
+ConstantBuffer<ParticleSimulationConstants> g_Const : register(b0);
+
+RWStructuredBuffer<ParticleState> u_Particles : register(u0);
+RWByteAddressBuffer u_Vertices : register(u1);
+RWStructuredBuffer<ParticleInfo> u_ParticleInfos : register(u2);
+RWStructuredBuffer<TlasInstanceDesc> u_Instances : register(u3);
+
+// Must match the emission and motion of ParticleEntity in rt_particles.cpp
+static const float c_ParticleLifetime = 2.0;
+static const uint c_VerticesPerQuad = 4;
+
+void emitParticle(inout ParticleState particle, uint emitIndex, uint seed)
+{
+    // Find the emitter whose range contains this particle
+    float3 emitterPosition = g_Const.emitters[0].xyz;
+    for (uint emitter = 0; emitter < MAX_PARTICLE_EMITTERS; ++emitter)
+    {
+        if (float(emitIndex) < g_Const.emitters[emitter].w)
+        {
+            emitterPosition = g_Const.emitters[emitter].xyz;
+            break;
+        }
+    }
+
+    particle.active = 1;
+    particle.position = emitterPosition;
+    particle.velocity = randomFloat3(seed) - 0.5;
+    particle.velocity.y = 1.0 + particle.velocity.y;
+    particle.radius = randomFloat(seed) * 0.05 + 0.1;
+    particle.age = 0;
+    particle.color = randomFloat3(seed) * 0.5 + 0.1;
+    particle.rotation = randomFloat(seed) * 6.28;
+}
+
+void animateParticle(inout ParticleState particle, float time)
+{
+    particle.position += particle.velocity * time;
+    particle.velocity.y += 1.0 * time;
+    particle.velocity.x += 1.0 * time;
+    particle.age += time;
+    particle.radius += 0.5 * time;
+
+    if (particle.age > c_ParticleLifetime)
+        particle.active = 0;
+}
+
+// Simulates one particle slot, and writes everything the ray tracing pass needs for it: the billboard quad vertices
+// for the geometric particle BLAS, the ParticleInfo, and the intersection particle instance for the TLAS.
+// Quads, ParticleInfos and instances are all indexed by the slot, so that the shaders don't need any compaction.
+// The index buffer and texture coordinates of the quads are constant and written once on the CPU.
+[numthreads(PARTICLE_SIMULATION_GROUP_SIZE, 1, 1)]
+void main(uint slot : SV_DispatchThreadID)
+{
+    if (slot >= g_Const.particleCapacity)
+        return;
+
+    ParticleState particle = u_Particles[slot];
+
+    // New particles take the slots that follow the previously emitted ones, wrapping around the buffer.
+    const uint emitIndex = (slot + g_Const.particleCapacity - g_Const.emitFirst) % g_Const.particleCapacity;
+    if (emitIndex < g_Const.emitCount)
+        emitParticle(particle, emitIndex, pcgHash(slot ^ pcgHash(g_Const.randomSeed)));
+    else if (particle.active != 0)
+        animateParticle(particle, g_Const.deltaTime);
+
+    u_Particles[slot] = particle;
+
+    const uint positionAddress = g_Const.positionOffset + slot * c_VerticesPerQuad * 12;
+
+    // Scale and translate the AABB to make it contain the particle billboard. Instances of inactive particles
+    // still reference the BLAS, so that they don't turn from inactive to active in a TLAS refit, but have a zero mask.
+    TlasInstanceDesc instance;
+    instance.transform[0] = float4(particle.radius, 0, 0, particle.position.x);
+    instance.transform[1] = float4(0, particle.radius, 0, particle.position.y);
+    instance.transform[2] = float4(0, 0, particle.radius, particle.position.z);
+    instance.instanceIDAndMask = slot | ((particle.active != 0 ? INSTANCE_MASK_INTERSECTION_PARTICLE : 0) << 24);
+    instance.hitGroupOffsetAndFlags = 0;
+    instance.blasDeviceAddress = g_Const.intersectionBlasAddress;
+    u_Instances[g_Const.firstParticleInstance + slot] = instance;
+
+    if (particle.active == 0)
+    {
+        // Triangles with a NaN vertex position are inactive in the BLAS
+        const uint3 inactivePosition = uint3(0x7fc00000, 0, 0);
+        for (uint vertex = 0; vertex < c_VerticesPerQuad; ++vertex)
+            u_Vertices.Store3(positionAddress + vertex * 12, inactivePosition);
+
+        return;
+    }
+
+    // Compute the quad orientation in world space
+    const float rotation = (g_Const.orientationMode == ORIENTATION_MODE_BEAM) ? 0.0 : particle.rotation;
+    const float2 localRight = float2(cos(rotation), sin(rotation));
+    const float2 localUp = float2(-localRight.y, localRight.x);
+    const float3 worldRight = localRight.x * g_Const.cameraRight + localRight.y * g_Const.cameraUp;
+    const float3 worldUp = localUp.x * g_Const.cameraRight + localUp.y * g_Const.cameraUp;
+
+    // Positions
+    u_Vertices.Store3(positionAddress + 0 * 12, asuint(particle.position - worldRight * particle.radius + worldUp * particle.radius));
+    u_Vertices.Store3(positionAddress + 1 * 12, asuint(particle.position + worldRight * particle.radius + worldUp * particle.radius));
+    u_Vertices.Store3(positionAddress + 2 * 12, asuint(particle.position + worldRight * particle.radius - worldUp * particle.radius));
+    u_Vertices.Store3(positionAddress + 3 * 12, asuint(particle.position - worldRight * particle.radius - worldUp * particle.radius));
+
+    // Fill out the ParticleInfo structure for use in the ray tracing shader
+    ParticleInfo particleInfo;
+    particleInfo.center = particle.position;
+    particleInfo.rotation = particle.rotation;
+    particleInfo.colorFactor = particle.color;
+    particleInfo.opacityFactor = saturate((c_ParticleLifetime - particle.age) * 0.5);
+    particleInfo.xAxis = worldRight;
+    particleInfo.yAxis = worldUp;
+    particleInfo.inverseRadius = 1.0 / particle.radius;
+    particleInfo.textureIndex = g_Const.textureIndex;
+    u_ParticleInfos[slot] = particleInfo;
+}
@@ -40,13 +40,26 @@ using namespace donut;
 using namespace donut::math;
 
 #include "rt_particles_cb.h"
+#include "accel_struct_manager.h"
+#include "gpu_timer_ring.h"
 
 static const char* g_WindowTitle = "Donut Example: Ray Traced Particles";
 
-constexpr uint32_t c_MaxParticles = 1024;
+constexpr uint32_t c_MaxParticles = 16 * 1024;
+// Capacity of the GPU simulation, which also determines the size of all particle buffers
+constexpr uint32_t c_MaxGpuParticles = 128 * 1024;
+static_assert(c_MaxGpuParticles >= c_MaxParticles);
+static_assert(sizeof(TlasInstanceDesc) == 64, "TlasInstanceDesc must match the native TLAS instance layout");
+
+// The TLAS instances of CPU simulated particles are allocated in steps of this size, see BuildTLAS
+constexpr uint32_t c_ParticleInstanceGranularity = 256;
 constexpr uint32_t c_IndicesPerQuad = 6;
 constexpr uint32_t c_VerticesPerQuad = 4;
 
+// Number of TLAS refits between full rebuilds, see accel_struct_manager.h. Shorter than in rt_bindless,
+// because the particles move much further between rebuilds than the scene instances do.
+constexpr uint32_t c_TlasRebuildPeriod = 30;
+
 static float RandomFloat()
 {
     return float(std::rand()) / RAND_MAX;
@@ -97,23 +110,109 @@ struct ParticleEntity
     }
 };
 
+// Fixed capacity particle storage with O(1) allocation and release. The live particles are packed densely
+// at the front of the array, and releasing one moves the last live particle into its place.
+// Iterating over the live particles therefore never touches free slots.
+class ParticlePool
+{
+private:
+    std::vector<ParticleEntity> m_Particles;
+    uint32_t m_LiveCount = 0;
+
+public:
+    explicit ParticlePool(uint32_t capacity)
+        : m_Particles(capacity)
+    { }
+
+    // Returns nullptr if the pool is full
+    ParticleEntity* Allocate()
+    {
+        if (m_LiveCount == m_Particles.size())
+            return nullptr;
+
+        return &m_Particles[m_LiveCount++];
+    }
+
+    void Release(uint32_t index)
+    {
+        assert(index < m_LiveCount);
+        --m_LiveCount;
+        if (index != m_LiveCount)
+            m_Particles[index] = m_Particles[m_LiveCount];
+    }
+
+    uint32_t GetLiveCount() const { return m_LiveCount; }
+    ParticleEntity& operator[](uint32_t index) { return m_Particles[index]; }
+    const ParticleEntity& operator[](uint32_t index) const { return m_Particles[index]; }
+};
+
+struct ParticleEmitter
+{
+    float3 position = 0.f;
+    float particlesPerSecond = 20.f;
+    bool enabled = true;
+
+    // Fraction of a particle left over from the previous frames, so that the emission rate doesn't depend on the frame rate
+    float emitAccumulator = 0.f;
+
+    // Returns the number of particles to emit after the time step. The fraction of a particle left over
+    // is stored in emitAccumulator, and can be used to spread the emitted particles over the time step.
+    uint32_t Update(float time)
+    {
+        if (!enabled)
+            return 0;
+
+        emitAccumulator += time * particlesPerSecond;
+        const uint32_t emitCount = uint32_t(emitAccumulator);
+        emitAccumulator -= float(emitCount);
+        return emitCount;
+    }
+};
+
 enum class ParticleTexture
 {
     Smoke = 0,
     Logo
 };
 
+// Fragment counts of the MLAB, K-buffer and stochastic blending pipelines, see MLAB_FRAGMENTS in shaders.cfg
+static const uint c_BlendFragmentCounts[] = { 1, 2, 4, 8 };
+static const uint c_NumBlendFragmentCounts = uint(sizeof(c_BlendFragmentCounts) / sizeof(c_BlendFragmentCounts[0]));
+
+static const char* c_BlendModeNames[BLEND_MODE_COUNT] = {
+    "MLAB",
+    "K-buffer",
+    "Weighted blended OIT",
+    "Stochastic",
+    "Reference (depth peeling)"
+};
+
+// Whether a blending mode has one pipeline per fragment count, or a single one
+static bool BlendModeUsesFragments(uint blendMode)
+{
+    return blendMode != BLEND_MODE_WBOIT && blendMode != BLEND_MODE_REFERENCE;
+}
+
 struct UIData
 {
-    bool updatePipeline = true;
     bool enableAnimations = true;
+    bool gpuSimulation = false;
     bool alwaysUpdateOrientation = true;
     bool reorientParticlesInPrimaryRays = false;
     bool reorientParticlesInSecondaryRays = true;
     uint orientationMode = ORIENTATION_MODE_QUATERNION;
-    uint mlabFragments = 4;
+    uint blendMode = BLEND_MODE_MLAB;
+    uint blendFragmentsIndex = 2;
+    bool compareWithReference = false;
+    float blendTimes[BLEND_MODE_COUNT] = {};
+    float blendErrors[BLEND_MODE_COUNT] = {};
     ParticleTexture particleTexture = ParticleTexture::Smoke;
-    float3 emitterPosition = 0.f;
+    std::vector<ParticleEmitter> emitters = { ParticleEmitter() };
+    uint32_t liveParticles = 0;
+    uint32_t tlasDirtyInstances = 0;
+    bool tlasRebuilt = false;
+    uint64_t blasMemory = 0;
+    uint64_t blasUncompactedMemory = 0;
 };
 
 class RayTracedParticles : public app::ApplicationBase
@@ -121,21 +220,40 @@ class RayTracedParticles : public app::ApplicationBase
 private:
 	std::shared_ptr<vfs::RootFileSystem> m_RootFS;
 
-    nvrhi::ShaderHandle m_ComputeShader;
-    nvrhi::ComputePipelineHandle m_ComputePipeline;
+    // Indexed by blending mode and c_BlendFragmentCounts, only the first entry is used by modes without fragments
+    nvrhi::ComputePipelineHandle m_ComputePipelines[BLEND_MODE_COUNT][c_NumBlendFragmentCounts];
+    nvrhi::ShaderHandle m_ErrorShader;
+    nvrhi::ComputePipelineHandle m_ErrorPipeline;
+    nvrhi::BindingLayoutHandle m_ErrorBindingLayout;
+    nvrhi::BindingSetHandle m_ErrorBindingSet;
+    nvrhi::BufferHandle m_ErrorBuffer;
+    nvrhi::ShaderHandle m_SimulationShader;
+    nvrhi::ComputePipelineHandle m_SimulationPipeline;
+    nvrhi::BindingLayoutHandle m_SimulationBindingLayout;
+    nvrhi::BindingSetHandle m_SimulationBindingSet;
     nvrhi::CommandListHandle m_CommandList;
     nvrhi::BindingLayoutHandle m_BindingLayout;
     nvrhi::BindingSetHandle m_BindingSet;
     nvrhi::BindingLayoutHandle m_BindlessLayout;
 
     nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::vector<nvrhi::rt::InstanceDesc> m_TlasInstances;
+    nvrhi::BufferHandle m_TlasInstanceBuffer;
+    uint32_t m_NumSceneTlasInstances = 0;
+    uint32_t m_NumParticleTlasInstances = 0;
+    uint32_t m_FramesSinceTlasRebuild = 0;
+    std::unique_ptr<AccelStructManager> m_AccelStructs;
+    bool m_BlasMemoryMoved = false;
 
     nvrhi::BufferHandle m_ConstantBuffer;
+    nvrhi::BufferHandle m_SimulationConstantBuffer;
 
     std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
     std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTable;
     std::unique_ptr<engine::Scene> m_Scene;
     nvrhi::TextureHandle m_ColorBuffer;
+    nvrhi::TextureHandle m_ReferenceBuffer;
+    nvrhi::BindingSetHandle m_ReferenceBindingSet;
     app::ThirdPersonCamera m_Camera;
     engine::PlanarView m_View;
     std::shared_ptr<engine::DirectionalLight> m_SunLight;
@@ -147,9 +265,10 @@ private:
     std::shared_ptr<engine::MeshInstance> m_ParticleInstance;
     std::shared_ptr<engine::Material> m_ParticleMaterial;
     nvrhi::BufferHandle m_ParticleInfoBuffer;
+    nvrhi::BufferHandle m_ParticleStateBuffer;
     nvrhi::rt::AccelStructHandle m_ParticleIntersectionBLAS;
     
-    std::vector<ParticleEntity> m_Particles;
+    ParticlePool m_Particles = ParticlePool(c_MaxParticles);
     std::vector<ParticleInfo> m_ParticleInfoData;
 
     std::shared_ptr<engine::LoadedTexture> m_EnvironmentMap;
@@ -157,8 +276,24 @@ private:
     std::shared_ptr<engine::LoadedTexture> m_LogoTexture;
 
     UIData* m_ui;
-    float m_WallclockTime = 0.f;
-    float m_LastEmitTime = 0.f;
+    uint32_t m_NumActiveParticleInstances = 0;
+
+    // GPU simulation state: the particles emitted by each emitter and the time elapsed since the last simulation step
+    bool m_GpuParticlesValid = false;
+    uint32_t m_GpuEmitCursor = 0;
+    std::vector<std::pair<float3, uint32_t>> m_GpuEmissions;
+    float m_GpuDeltaTime = 0.f;
+
+    // Per frame timer queries of the blending pass, tagged with what the frame measured, and an error readback for
+    // each timer slot
+    struct BlendTiming
+    {
+        uint blendMode = BLEND_MODE_MLAB;
+        uint32_t pixelCount = 0;
+        bool measuredError = false;
+    };
+    GpuTimerRing<BlendTiming> m_BlendTimers;
+    nvrhi::BufferHandle m_ErrorReadbacks[GpuTimerRing<BlendTiming>::c_SlotCount];
 
 public:
     RayTracedParticles(app::DeviceManager* deviceManager, UIData* ui)
@@ -209,10 +344,9 @@ public:
         
         m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), m_RootFS, m_DescriptorTable);
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_CommandList = GetDevice()->createCommandList(AccelStructManager::GetBuildCommandListParameters());
         
         CreateParticleMesh();
-        m_Particles.resize(c_MaxParticles);
         m_ParticleInfoData.resize(c_MaxParticles);
 
         m_EnvironmentMap = m_TextureCache->LoadTextureFromFileDeferred("/media/rt_particles/environment-map.dds", false);
@@ -227,28 +361,38 @@ public:
 
         auto emitterNode = m_Scene->GetSceneGraph()->FindNode("/Emitter");
         if (emitterNode)
-            m_ui->emitterPosition = emitterNode->GetLocalToWorldTransformFloat().m_translation;
+            m_ui->emitters[0].position = emitterNode->GetLocalToWorldTransformFloat().m_translation;
 
         m_Scene->FinishedLoading(GetFrameIndex());
 
-        m_Camera.SetTargetPosition(m_ui->emitterPosition + float3(0.f, 2.f, 0.f));
+        m_Camera.SetTargetPosition(m_ui->emitters[0].position + float3(0.f, 2.f, 0.f));
         m_Camera.SetDistance(6.f);
         m_Camera.SetRotation(radians(225.f), radians(20.f));
         m_Camera.SetMoveSpeed(3.f);
 
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(
             sizeof(GlobalConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        m_SimulationConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(
+            sizeof(ParticleSimulationConstants), "ParticleSimulationConstants", engine::c_MaxRenderPassConstantBufferVersions));
         
         m_CommandList->open();
 
         CreateAccelStructs(m_CommandList);
         BuildParticleIntersectionBLAS(m_CommandList);
+        WriteParticleQuads(m_CommandList);
                 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
 
         GetDevice()->waitForIdle();
 
+        if (!CreateSimulationPipeline(*m_ShaderFactory))
+            return false;
+
+        if (!CreateComputePipelines(*m_ShaderFactory) || !CreateErrorPipeline(*m_ShaderFactory))
+            return false;
+
         return true;
     }
 
@@ -262,13 +406,13 @@ public:
         auto& positionRange = m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::Position);
         auto& texcoordRange = m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::TexCoord1);
         positionRange.byteOffset = 0;
-        positionRange.byteSize = c_MaxParticles * c_VerticesPerQuad * sizeof(float3);
+        positionRange.byteSize = c_MaxGpuParticles * c_VerticesPerQuad * sizeof(float3);
         texcoordRange.byteOffset = positionRange.byteOffset + positionRange.byteSize;
-        texcoordRange.byteSize = c_MaxParticles * c_VerticesPerQuad * sizeof(float2);
+        texcoordRange.byteSize = c_MaxGpuParticles * c_VerticesPerQuad * sizeof(float2);
 
         // Index buffer
         nvrhi::BufferDesc bufferDesc;
-        bufferDesc.byteSize = c_MaxParticles * c_IndicesPerQuad * sizeof(uint32_t);
+        bufferDesc.byteSize = c_MaxGpuParticles * c_IndicesPerQuad * sizeof(uint32_t);
         bufferDesc.debugName = "ParticleIndices";
         bufferDesc.canHaveRawViews = true;
         bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource | nvrhi::ResourceStates::AccelStructBuildInput;
@@ -276,9 +420,10 @@ public:
         bufferDesc.isAccelStructBuildInput = true;
         m_ParticleBuffers->indexBuffer = GetDevice()->createBuffer(bufferDesc);
 
-        // Vertex buffer
+        // Vertex buffer, written by the GPU simulation as a UAV
         bufferDesc.byteSize = texcoordRange.byteOffset + texcoordRange.byteSize;
         bufferDesc.debugName = "ParticleVertices";
+        bufferDesc.canHaveUAVs = true;
         m_ParticleBuffers->vertexBuffer = GetDevice()->createBuffer(bufferDesc);
 
         // Index and vertex buffer bindless descriptors
@@ -297,8 +442,8 @@ public:
         m_ParticleGeometry->material = m_ParticleMaterial;
 
         // Set numVertices and numIndices to max possible to make sure that we create an appropriate BLAS before rendering
-        m_ParticleGeometry->numVertices = c_MaxParticles * c_VerticesPerQuad;
-        m_ParticleGeometry->numIndices = c_MaxParticles * c_IndicesPerQuad;
+        m_ParticleGeometry->numVertices = c_MaxGpuParticles * c_VerticesPerQuad;
+        m_ParticleGeometry->numIndices = c_MaxGpuParticles * c_IndicesPerQuad;
         m_ParticleBuffers->indexData.resize(m_ParticleGeometry->numIndices);
         m_ParticleBuffers->positionData.resize(m_ParticleGeometry->numVertices);
         m_ParticleBuffers->texcoord1Data.resize(m_ParticleGeometry->numVertices);
@@ -313,21 +458,53 @@ public:
         m_ParticleInstance = std::make_shared<engine::MeshInstance>(m_ParticleMesh);
 
         // Particle info buffer
-        bufferDesc.byteSize = c_MaxParticles * sizeof(ParticleInfo);
+        bufferDesc.byteSize = c_MaxGpuParticles * sizeof(ParticleInfo);
         bufferDesc.canHaveRawViews = false;
         bufferDesc.structStride = sizeof(ParticleInfo);
         bufferDesc.debugName = "ParticleInfoBuffer";
         m_ParticleInfoBuffer = GetDevice()->createBuffer(bufferDesc);
+
+        // Particle state buffer for the GPU simulation
+        bufferDesc.byteSize = c_MaxGpuParticles * sizeof(ParticleState);
+        bufferDesc.structStride = sizeof(ParticleState);
+        bufferDesc.isAccelStructBuildInput = false;
+        bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        bufferDesc.debugName = "ParticleStateBuffer";
+        m_ParticleStateBuffer = GetDevice()->createBuffer(bufferDesc);
     }
 
-    // Updates particle geometry -- to be called before rendering every frame
-    void BuildParticleGeometry(nvrhi::ICommandList* commandList)
+    // Fills the index buffer and texture coordinates for all particle quads once. These are the same for every particle
+    // in both simulation modes, so only the positions and ParticleInfos need to be written per frame.
+    void WriteParticleQuads(nvrhi::ICommandList* commandList)
+    {
+        for (uint32_t quad = 0; quad < c_MaxGpuParticles; ++quad)
+        {
+            uint32_t baseIndex = quad * c_IndicesPerQuad;
+            uint32_t baseVertex = quad * c_VerticesPerQuad;
+
+            m_ParticleBuffers->indexData[baseIndex + 0] = baseVertex + 0;
+            m_ParticleBuffers->indexData[baseIndex + 1] = baseVertex + 1;
+            m_ParticleBuffers->indexData[baseIndex + 2] = baseVertex + 2;
+            m_ParticleBuffers->indexData[baseIndex + 3] = baseVertex + 0;
+            m_ParticleBuffers->indexData[baseIndex + 4] = baseVertex + 2;
+            m_ParticleBuffers->indexData[baseIndex + 5] = baseVertex + 3;
+
+            m_ParticleBuffers->texcoord1Data[baseVertex + 0] = float2(0.f, 0.f);
+            m_ParticleBuffers->texcoord1Data[baseVertex + 1] = float2(1.f, 0.f);
+            m_ParticleBuffers->texcoord1Data[baseVertex + 2] = float2(1.f, 1.f);
+            m_ParticleBuffers->texcoord1Data[baseVertex + 3] = float2(0.f, 1.f);
+        }
+
+        commandList->writeBuffer(m_ParticleBuffers->indexBuffer, m_ParticleBuffers->indexData.data(), m_ParticleBuffers->indexData.size() * sizeof(uint32_t));
+        commandList->writeBuffer(m_ParticleBuffers->vertexBuffer, m_ParticleBuffers->texcoord1Data.data(), m_ParticleBuffers->texcoord1Data.size() * sizeof(float2),
+            m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::TexCoord1).byteOffset);
+    }
+
+    // Returns the camera plane vectors for particle orientation
+    void GetParticleBasis(float3& cameraRight, float3& cameraUp) const
     {
-        commandList->beginMarker("Update Particles");
-        
-        // Get the camera plane vectors for particle orientation
         float3 cameraForward = m_Camera.GetDir();
-        float3 cameraUp = m_Camera.GetUp();
+        cameraUp = m_Camera.GetUp();
 
         // To demonstrate beam orientation, we create vertical sprites that are free to rotate
         // around the world-space Y axis, simulating what old Doom-like games used.
@@ -341,27 +518,24 @@ public:
             cameraUp = float3(0.f, 1.f, 0.f);
         }
 
-        const float3 cameraRight = cross(cameraForward, cameraUp);
+        cameraRight = cross(cameraForward, cameraUp);
+    }
+
+    // Updates particle geometry -- to be called before rendering every frame
+    void BuildParticleGeometry(nvrhi::ICommandList* commandList)
+    {
+        commandList->beginMarker("Update Particles");
+        
+        float3 cameraRight, cameraUp;
+        GetParticleBasis(cameraRight, cameraUp);
 
-        // Generate the geometry for particles
-        uint32_t numParticles = 0;
-        for (uint32_t index = 0; index < m_Particles.size(); ++index)
+        // Generate the geometry for the live particles
+        const uint32_t numParticles = m_Particles.GetLiveCount();
+        for (uint32_t index = 0; index < numParticles; ++index)
         {
             const ParticleEntity* particle = &m_Particles[index];
 
-            if (!particle->active)
-                continue;
-
-            uint32_t baseIndex = numParticles * c_IndicesPerQuad;
-            uint32_t baseVertex = numParticles * c_VerticesPerQuad;
-
-            // Indices for a quad
-            m_ParticleBuffers->indexData[baseIndex + 0] = baseVertex + 0;
-            m_ParticleBuffers->indexData[baseIndex + 1] = baseVertex + 1;
-            m_ParticleBuffers->indexData[baseIndex + 2] = baseVertex + 2;
-            m_ParticleBuffers->indexData[baseIndex + 3] = baseVertex + 0;
-            m_ParticleBuffers->indexData[baseIndex + 4] = baseVertex + 2;
-            m_ParticleBuffers->indexData[baseIndex + 5] = baseVertex + 3;
+            uint32_t baseVertex = index * c_VerticesPerQuad;
 
             // Compute the quad orientation in world space
             const float rotation = m_ui->orientationMode == ORIENTATION_MODE_BEAM ? 0.f : particle->rotation;
@@ -376,14 +550,8 @@ public:
             m_ParticleBuffers->positionData[baseVertex + 2] = particle->position + worldRight * particle->radius - worldUp * particle->radius ;
             m_ParticleBuffers->positionData[baseVertex + 3] = particle->position - worldRight * particle->radius - worldUp * particle->radius ;
 
-            // Texture coordinates
-            m_ParticleBuffers->texcoord1Data[baseVertex + 0] = float2(0.f, 0.f);
-            m_ParticleBuffers->texcoord1Data[baseVertex + 1] = float2(1.f, 0.f);
-            m_ParticleBuffers->texcoord1Data[baseVertex + 2] = float2(1.f, 1.f);
-            m_ParticleBuffers->texcoord1Data[baseVertex + 3] = float2(0.f, 1.f);
-
             // Fill out the ParticleInfo structure for use in shaders, mostly in the intersection particle code path
-            ParticleInfo* particleInfo = &m_ParticleInfoData[numParticles];
+            ParticleInfo* particleInfo = &m_ParticleInfoData[index];
             particleInfo->center = particle->position;
             particleInfo->rotation = particle->rotation;
             particleInfo->colorFactor = particle->color;
@@ -392,8 +560,6 @@ public:
             particleInfo->yAxis = worldUp;
             particleInfo->inverseRadius = 1.f / particle->radius;
             particleInfo->textureIndex = m_ParticleMaterial->baseOrDiffuseTexture->bindlessDescriptor.Get();
-
-            ++numParticles;
         }
 
         m_ParticleGeometry->numIndices = numParticles * c_IndicesPerQuad;
@@ -401,23 +567,82 @@ public:
 
         if (numParticles > 0)
         {
-            // Copy the index and vertex data to the GPU
-            commandList->writeBuffer(m_ParticleBuffers->indexBuffer, m_ParticleBuffers->indexData.data(), m_ParticleGeometry->numIndices * sizeof(uint32_t));
+            // Copy the positions to the GPU. The indices and texture coordinates are the same for every quad,
+            // they have been written for the whole capacity by WriteParticleQuads, and the BLAS only uses the
+            // first numIndices of them.
             commandList->writeBuffer(m_ParticleBuffers->vertexBuffer, m_ParticleBuffers->positionData.data(), m_ParticleGeometry->numVertices *  sizeof(float3),
                 m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset);
-            commandList->writeBuffer(m_ParticleBuffers->vertexBuffer, m_ParticleBuffers->texcoord1Data.data(), m_ParticleGeometry->numVertices * sizeof(float2),
-                m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::TexCoord1).byteOffset);
 
             // Copy the particle info data to the GPU
             commandList->writeBuffer(m_ParticleInfoBuffer, m_ParticleInfoData.data(), numParticles * sizeof(ParticleInfo), 0);
         }
 
-        // Build the BLAS
+        BuildParticleBLAS(commandList);
+        
+        commandList->endMarker();
+    }
+
+    // Simulates the particles and writes their geometry, ParticleInfos and TLAS instances on the GPU.
+    // Unlike BuildParticleGeometry, the particles are not compacted: every slot has a quad and an instance,
+    // which are disabled when the particle is inactive, so the CPU doesn't need to know how many particles are alive.
+    void SimulateParticlesOnGpu(nvrhi::ICommandList* commandList)
+    {
+        commandList->beginMarker("Simulate Particles");
+
+        if (!m_GpuParticlesValid)
+        {
+            commandList->clearBufferUInt(m_ParticleStateBuffer, 0);
+            m_GpuEmitCursor = 0;
+            m_GpuParticlesValid = true;
+        }
+
+        ParticleSimulationConstants constants = {};
+        constants.deltaTime = m_GpuDeltaTime;
+        GetParticleBasis(constants.cameraRight, constants.cameraUp);
+        constants.emitFirst = m_GpuEmitCursor;
+
+        // The particles of each emitter take a consecutive range of the emitted slots
+        uint32_t emitCount = 0;
+        for (size_t index = 0; index < m_GpuEmissions.size() && index < MAX_PARTICLE_EMITTERS; ++index)
+        {
+            emitCount = std::min(emitCount + m_GpuEmissions[index].second, c_MaxGpuParticles);
+            constants.emitters[index] = float4(m_GpuEmissions[index].first, float(emitCount));
+        }
+        constants.emitCount = emitCount;
+        constants.particleCapacity = c_MaxGpuParticles;
+        constants.firstParticleInstance = uint32_t(m_Scene->GetSceneGraph()->GetMeshInstances().size());
+        constants.positionOffset = uint32_t(m_ParticleBuffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset);
+        constants.randomSeed = GetFrameIndex();
+        const uint64_t blasAddress = m_ParticleIntersectionBLAS->getDeviceAddress();
+        constants.intersectionBlasAddress = uint2(uint32_t(blasAddress), uint32_t(blasAddress >> 32));
+        constants.orientationMode = m_ui->orientationMode;
+        constants.textureIndex = m_ParticleMaterial->baseOrDiffuseTexture->bindlessDescriptor.Get();
+        commandList->writeBuffer(m_SimulationConstantBuffer, &constants, sizeof(constants));
+
+        m_GpuEmitCursor = (m_GpuEmitCursor + emitCount) % c_MaxGpuParticles;
+        m_GpuEmissions.clear();
+        m_GpuDeltaTime = 0.f;
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_SimulationPipeline;
+        state.bindings = { m_SimulationBindingSet };
+        commandList->setComputeState(state);
+        commandList->dispatch(div_ceil(c_MaxGpuParticles, PARTICLE_SIMULATION_GROUP_SIZE));
+
+        m_ParticleGeometry->numIndices = c_MaxGpuParticles * c_IndicesPerQuad;
+        m_ParticleGeometry->numVertices = c_MaxGpuParticles * c_VerticesPerQuad;
+
+        BuildParticleBLAS(commandList);
+
+        commandList->endMarker();
+    }
+
+    void BuildParticleBLAS(nvrhi::ICommandList* commandList)
+    {
         nvrhi::rt::AccelStructDesc blasDesc;
         GetMeshBlasDesc(*m_ParticleMesh, blasDesc);
+        blasDesc.buildFlags = m_ParticleMesh->accelStruct->getDesc().buildFlags;
         nvrhi::utils::BuildBottomLevelAccelStruct(commandList, m_ParticleMesh->accelStruct, blasDesc);
-        
-        commandList->endMarker();
     }
 
     void BuildParticleIntersectionBLAS(nvrhi::ICommandList* commandList)
@@ -447,10 +672,10 @@ public:
                 .setBuffer(aabbBuffer)
                 .setCount(1)));
 
-        m_ParticleIntersectionBLAS = GetDevice()->createAccelStruct(blasDesc);
+        m_ParticleIntersectionBLAS = m_AccelStructs->CreateBLAS(blasDesc, false);
 
-        // Build the BLAS
-        nvrhi::utils::BuildBottomLevelAccelStruct(commandList, m_ParticleIntersectionBLAS, blasDesc);
+        // Build the BLAS while the AABB buffer is alive
+        m_AccelStructs->BuildPending(commandList);
     }
 
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
@@ -507,167 +732,368 @@ public:
     {
         m_Camera.Animate(fElapsedTimeSeconds);
 
-        if (IsSceneLoaded() && m_ui->enableAnimations)
+        if (IsSceneLoaded() && m_ui->enableAnimations && m_ui->gpuSimulation)
         {
-            m_WallclockTime += fElapsedTimeSeconds;
-
-            // Animate the live particles, also find the index of the first empty particle slot for spawning later.
-            int firstEmptyParticle = -1;
-            for (uint32_t i = 0; i < m_Particles.size(); ++i)
+            // The GPU simulation runs in Render, accumulate the time step and the particles to emit until then.
+            m_GpuDeltaTime += fElapsedTimeSeconds;
+            for (auto& emitter : m_ui->emitters)
             {
-                ParticleEntity* particle = &m_Particles[i];
-                
-                if (particle->active)
-                {
-                    particle->Animate(fElapsedTimeSeconds);
-                }
-
-                if (!particle->active)
-                {
-                    if (firstEmptyParticle < 0)
-                        firstEmptyParticle = i;
-                }
+                const uint32_t emitCount = emitter.Update(fElapsedTimeSeconds);
+                if (emitCount > 0)
+                    m_GpuEmissions.push_back(std::make_pair(emitter.position, emitCount));
             }
+        }
+        else if (IsSceneLoaded() && m_ui->enableAnimations)
+        {
+            // Animate the live particles and release the ones that have expired. Releasing a particle moves
+            // the last live one into its slot, which is then visited in the same iteration.
+            for (uint32_t index = 0; index < m_Particles.GetLiveCount(); )
+            {
+                ParticleEntity& particle = m_Particles[index];
+                particle.Animate(fElapsedTimeSeconds);
 
-            const float particlesPerSecond = 20.f;
-            const float particleEmissionPeriod = 1.f / particlesPerSecond;
+                if (particle.active)
+                    ++index;
+                else
+                    m_Particles.Release(index);
+            }
 
-            // Emit a new particle if enough time has passed since the last emission.
-            if (m_WallclockTime - m_LastEmitTime > particleEmissionPeriod && firstEmptyParticle >= 0)
+            // Emit the new particles. They are spread evenly over the time step by animating each one
+            // for the time since it would have been emitted at the emitter's rate.
+            for (auto& emitter : m_ui->emitters)
             {
-                ParticleEntity* particle = &m_Particles[firstEmptyParticle];
+                const uint32_t emitCount = emitter.Update(fElapsedTimeSeconds);
+                for (uint32_t emitIndex = 0; emitIndex < emitCount; ++emitIndex)
+                {
+                    ParticleEntity* particle = m_Particles.Allocate();
+                    if (!particle)
+                        break;
 
-                particle->Emit(m_ui->emitterPosition);
+                    particle->Emit(emitter.position);
+                    particle->Animate((float(emitCount - 1 - emitIndex) + emitter.emitAccumulator) / emitter.particlesPerSecond);
 
-                m_LastEmitTime = m_WallclockTime;
+                    if (!particle->active)
+                        m_Particles.Release(m_Particles.GetLiveCount() - 1);
+                }
             }
         }
+
+        m_ui->liveParticles = m_ui->gpuSimulation ? 0 : m_Particles.GetLiveCount();
         
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
     }
     
-    bool CreateComputePipeline(engine::ShaderFactory& shaderFactory)
+    // Creates the pipelines of all blending modes and fragment counts up front, so that switching between them
+    // in the UI is immediate and the timings compare like for like.
+    bool CreateComputePipelines(engine::ShaderFactory& shaderFactory)
     {
-        char fragmentsText[4];
-        snprintf(fragmentsText, sizeof(fragmentsText), "%d", m_ui->mlabFragments);
-        std::vector<engine::ShaderMacro> defines = { { "MLAB_FRAGMENTS", fragmentsText } };
+        for (uint blendMode = 0; blendMode < BLEND_MODE_COUNT; ++blendMode)
+        {
+            const uint numPipelines = BlendModeUsesFragments(blendMode) ? c_NumBlendFragmentCounts : 1;
+            for (uint fragmentsIndex = 0; fragmentsIndex < numPipelines; ++fragmentsIndex)
+            {
+                std::vector<engine::ShaderMacro> defines = { { "BLEND_MODE", std::to_string(blendMode) } };
+                if (BlendModeUsesFragments(blendMode))
+                    defines.push_back({ "MLAB_FRAGMENTS", std::to_string(c_BlendFragmentCounts[fragmentsIndex]) });
+
+                nvrhi::ShaderHandle shader = shaderFactory.CreateShader("app/rt_particles.hlsl", "main", &defines, nvrhi::ShaderType::Compute);
+
+                if (!shader)
+                    return false;
 
-        m_ComputeShader = shaderFactory.CreateShader("app/rt_particles.hlsl", "main", &defines, nvrhi::ShaderType::Compute);
+                auto pipelineDesc = nvrhi::ComputePipelineDesc()
+                    .setComputeShader(shader)
+                    .addBindingLayout(m_BindingLayout)
+                    .addBindingLayout(m_BindlessLayout);
 
-        if (!m_ComputeShader)
+                m_ComputePipelines[blendMode][fragmentsIndex] = GetDevice()->createComputePipeline(pipelineDesc);
+
+                if (!m_ComputePipelines[blendMode][fragmentsIndex])
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool CreateErrorPipeline(engine::ShaderFactory& shaderFactory)
+    {
+        m_ErrorShader = shaderFactory.CreateShader("app/blend_error.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
+
+        if (!m_ErrorShader)
             return false;
 
+        nvrhi::BindingLayoutDesc layoutDesc;
+        layoutDesc.visibility = nvrhi::ShaderType::Compute;
+        layoutDesc.bindings = {
+            nvrhi::BindingLayoutItem::Texture_SRV(0),
+            nvrhi::BindingLayoutItem::Texture_SRV(1),
+            nvrhi::BindingLayoutItem::RawBuffer_UAV(0)
+        };
+        m_ErrorBindingLayout = GetDevice()->createBindingLayout(layoutDesc);
+
         auto pipelineDesc = nvrhi::ComputePipelineDesc()
-            .setComputeShader(m_ComputeShader)
-            .addBindingLayout(m_BindingLayout)
-            .addBindingLayout(m_BindlessLayout);
+            .setComputeShader(m_ErrorShader)
+            .addBindingLayout(m_ErrorBindingLayout);
 
-        m_ComputePipeline = GetDevice()->createComputePipeline(pipelineDesc);
+        m_ErrorPipeline = GetDevice()->createComputePipeline(pipelineDesc);
 
-        if (!m_ComputePipeline)
+        if (!m_ErrorPipeline)
             return false;
 
+        m_ErrorBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t)).setCanHaveRawViews(true).setCanHaveUAVs(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setKeepInitialState(true).setDebugName("BlendError"));
+
+        m_BlendTimers.Init(GetDevice());
+        for (nvrhi::BufferHandle& errorReadback : m_ErrorReadbacks)
+        {
+            errorReadback = GetDevice()->createBuffer(nvrhi::BufferDesc()
+                .setByteSize(sizeof(uint32_t)).setCpuAccess(nvrhi::CpuAccessMode::Read)
+                .setInitialState(nvrhi::ResourceStates::CopyDest).setKeepInitialState(true).setDebugName("BlendErrorReadback"));
+        }
+
         return true;
     }
 
-    void GetMeshBlasDesc(engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const
+    // Reads the timer and blending error of the frame that last used this frame's slot.
+    void HarvestFrameQueries()
     {
-        blasDesc.isTopLevel = false;
-        blasDesc.debugName = mesh.name;
-
-        for (const auto& geometry : mesh.geometries)
-        {
-            nvrhi::rt::GeometryDesc geometryDesc;
-            auto & triangles = geometryDesc.geometryData.triangles;
-            triangles.indexBuffer = mesh.buffers->indexBuffer;
-            triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-            triangles.indexFormat = nvrhi::Format::R32_UINT;
-            triangles.indexCount = geometry->numIndices;
-            triangles.vertexBuffer = mesh.buffers->vertexBuffer;
-            triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-            triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-            triangles.vertexStride = sizeof(float3);
-            triangles.vertexCount = geometry->numVertices;
-            geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-            geometryDesc.flags = (geometry->material->domain == engine::MaterialDomain::Opaque)
-                ? nvrhi::rt::GeometryFlags::Opaque
-                : nvrhi::rt::GeometryFlags::None;
-            blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+        float blendTime;
+        BlendTiming timing;
+        if (!m_BlendTimers.Harvest(GetFrameIndex(), blendTime, timing))
+            return;
+
+        m_ui->blendTimes[timing.blendMode] = blendTime;
+
+        if (!timing.measuredError)
+            return;
+
+        nvrhi::IBuffer* errorReadback = m_ErrorReadbacks[m_BlendTimers.GetSlot()];
+        const uint32_t* error = (const uint32_t*)GetDevice()->mapBuffer(errorReadback, nvrhi::CpuAccessMode::Read);
+        if (error)
+        {
+            m_ui->blendErrors[timing.blendMode] = float(double(*error) / (BLEND_ERROR_SCALE * double(timing.pixelCount)));
+            GetDevice()->unmapBuffer(errorReadback);
         }
-        
-        blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PreferFastTrace;
+    }
+
+    bool CreateSimulationPipeline(engine::ShaderFactory& shaderFactory)
+    {
+        m_SimulationShader = shaderFactory.CreateShader("app/particle_simulation.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
+
+        if (!m_SimulationShader)
+            return false;
+
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_SimulationConstantBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_ParticleStateBuffer),
+            nvrhi::BindingSetItem::RawBuffer_UAV(1, m_ParticleBuffers->vertexBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_ParticleInfoBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(3, m_TlasInstanceBuffer)
+        };
+
+        if (!nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::Compute, 0, bindingSetDesc,
+            m_SimulationBindingLayout, m_SimulationBindingSet))
+            return false;
+
+        auto pipelineDesc = nvrhi::ComputePipelineDesc()
+            .setComputeShader(m_SimulationShader)
+            .addBindingLayout(m_SimulationBindingLayout);
+
+        m_SimulationPipeline = GetDevice()->createComputePipeline(pipelineDesc);
+
+        if (!m_SimulationPipeline)
+            return false;
+
+        return true;
+    }
+
+    void GetMeshBlasDesc(engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const
+    {
+        ::GetMeshBlasDesc(mesh, blasDesc, [](const engine::MeshGeometry& geometry)
+            { return geometry.material->domain == engine::MaterialDomain::Opaque; });
     }
 
     void CreateAccelStructs(nvrhi::ICommandList* commandList)
     {
+        m_AccelStructs = std::make_unique<AccelStructManager>(GetDevice());
+
         for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
         {
             nvrhi::rt::AccelStructDesc blasDesc;
             GetMeshBlasDesc(*mesh, blasDesc);
 
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-
             // Build the BLAS if it's not the particle mesh - that one's dynamic
-            if (mesh != m_ParticleMesh)
-                nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
-
-            mesh->accelStruct = as;
+            const bool isParticleMesh = mesh == m_ParticleMesh;
+            mesh->accelStruct = m_AccelStructs->CreateBLAS(blasDesc, isParticleMesh, !isParticleMesh);
         }
+
+        m_AccelStructs->BuildPending(commandList);
         
         nvrhi::rt::AccelStructDesc tlasDesc;
         tlasDesc.isTopLevel = true;
         // Note: the TLAS will include the scene geometries (including the single instance for geometric particles)
         // and many instances of the intersection BLAS, one instnace per particle.
         const uint32_t numSceneInstances = uint32_t(m_Scene->GetSceneGraph()->GetMeshInstances().size());
-        tlasDesc.topLevelMaxInstances = numSceneInstances + c_MaxParticles;
+        tlasDesc.topLevelMaxInstances = numSceneInstances + c_MaxGpuParticles;
+        tlasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
+        tlasDesc.debugName = "TopLevelAS";
         m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
+
+        // Instance buffer for the TLAS builds with GPU simulated particles. The scene instances are written
+        // by the CPU in BuildTLAS, and the particle instances that follow them by the simulation shader.
+        nvrhi::BufferDesc instanceBufferDesc;
+        instanceBufferDesc.byteSize = tlasDesc.topLevelMaxInstances * sizeof(TlasInstanceDesc);
+        instanceBufferDesc.structStride = sizeof(TlasInstanceDesc);
+        instanceBufferDesc.canHaveUAVs = true;
+        instanceBufferDesc.isAccelStructBuildInput = true;
+        instanceBufferDesc.initialState = nvrhi::ResourceStates::AccelStructBuildInput;
+        instanceBufferDesc.keepInitialState = true;
+        instanceBufferDesc.debugName = "TlasInstances";
+        m_TlasInstanceBuffer = GetDevice()->createBuffer(instanceBufferDesc);
     }
 
     void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex)
-    {   
-        std::vector<nvrhi::rt::InstanceDesc> instances;
+    {
+        // The scene instances come first, followed by the intersection instances for particles.
+        // Instances that are not used by a live particle have a zero mask, so that particles spawning and dying
+        // doesn't change the instance count, and the TLAS can be refit instead of rebuilt.
+        const auto& meshInstances = m_Scene->GetSceneGraph()->GetMeshInstances();
+
+        // The GPU simulation has an instance for every slot. The CPU simulation allocates instances for its live
+        // particles in steps of c_ParticleInstanceGranularity, and only gives them back when well below the allocation,
+        // so that the count stays the same over most frames.
+        uint32_t numParticleInstances = c_MaxGpuParticles;
+        if (!m_ui->gpuSimulation)
+        {
+            const uint32_t liveCount = m_Particles.GetLiveCount();
+            numParticleInstances = m_NumParticleTlasInstances;
+            if (liveCount > numParticleInstances || liveCount + 2 * c_ParticleInstanceGranularity < numParticleInstances)
+                numParticleInstances = std::min(div_ceil(liveCount, c_ParticleInstanceGranularity) * c_ParticleInstanceGranularity, c_MaxParticles);
+        }
+
+        // Compaction moves BLASes to new memory, which invalidates the addresses in the GPU instance buffer
+        bool topologyChanged = m_NumSceneTlasInstances != uint32_t(meshInstances.size())
+            || m_NumParticleTlasInstances != numParticleInstances
+            || m_BlasMemoryMoved;
+        m_BlasMemoryMoved = false;
+        m_NumSceneTlasInstances = uint32_t(meshInstances.size());
+        m_NumParticleTlasInstances = numParticleInstances;
+
+        if (topologyChanged && !m_ui->gpuSimulation)
+        {
+            // Start with all particle instances unused, the live ones are filled in below
+            m_TlasInstances.resize(m_NumSceneTlasInstances + numParticleInstances);
+            for (uint32_t index = m_NumSceneTlasInstances; index < m_TlasInstances.size(); ++index)
+            {
+                nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[index];
+                instanceDesc.bottomLevelAS = m_ParticleIntersectionBLAS;
+                instanceDesc.instanceMask = 0;
+            }
+            m_NumActiveParticleInstances = 0;
+        }
+        else if (topologyChanged)
+        {
+            m_TlasInstances.resize(m_NumSceneTlasInstances);
+        }
 
-        // Generate regular instances for scene meshes
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        uint32_t dirtyInstances = 0;
+
+        // Update the regular instances for scene meshes
+        for (uint32_t index = 0; index < m_NumSceneTlasInstances; ++index)
         {
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = instance->GetMesh()->accelStruct;
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = (instance->GetMesh() == m_ParticleMesh)
-                ? INSTANCE_MASK_PARTICLE_GEOMETRY
-                : INSTANCE_MASK_OPAQUE;
-            instanceDesc.instanceID = instance->GetInstanceIndex();
+            const auto& instance = meshInstances[index];
+            nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[index];
+
+            nvrhi::rt::IAccelStruct* bottomLevelAS = instance->GetMesh()->accelStruct;
+            assert(bottomLevelAS);
+            if (instanceDesc.bottomLevelAS != bottomLevelAS || instanceDesc.instanceID != uint32_t(instance->GetInstanceIndex()))
+            {
+                instanceDesc.bottomLevelAS = bottomLevelAS;
+                instanceDesc.instanceMask = (instance->GetMesh() == m_ParticleMesh)
+                    ? INSTANCE_MASK_PARTICLE_GEOMETRY
+                    : INSTANCE_MASK_OPAQUE;
+                instanceDesc.instanceID = instance->GetInstanceIndex();
+                topologyChanged = true;
+            }
 
             auto node = instance->GetNode();
             assert(node);
-            affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
-
-            instances.push_back(instanceDesc);
+            if (UpdateTlasInstanceTransform(instanceDesc, node->GetLocalToWorldTransformFloat()))
+                ++dirtyInstances;
         }
 
-        // Generate intersection instances for active particles
-        uint32_t particleIndex = 0;
-        for (const auto& particle : m_Particles)
+        if (m_ui->gpuSimulation)
+        {
+            // The particle instances are written by SimulateParticlesOnGpu, copy the scene instances
+            // in front of them when they have changed.
+            if (topologyChanged || dirtyInstances != 0)
+            {
+                std::vector<TlasInstanceDesc> sceneInstances(m_NumSceneTlasInstances);
+                for (uint32_t index = 0; index < m_NumSceneTlasInstances; ++index)
+                {
+                    const nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[index];
+                    TlasInstanceDesc& gpuInstance = sceneInstances[index];
+                    memcpy(gpuInstance.transform, instanceDesc.transform, sizeof(instanceDesc.transform));
+                    gpuInstance.instanceIDAndMask = instanceDesc.instanceID | (uint32_t(instanceDesc.instanceMask) << 24);
+                    gpuInstance.hitGroupOffsetAndFlags = uint32_t(instanceDesc.instanceContributionToHitGroupIndex) | (uint32_t(instanceDesc.flags) << 24);
+                    const uint64_t blasAddress = instanceDesc.bottomLevelAS->getDeviceAddress();
+                    gpuInstance.blasDeviceAddress = uint2(uint32_t(blasAddress), uint32_t(blasAddress >> 32));
+                }
+                commandList->writeBuffer(m_TlasInstanceBuffer, sceneInstances.data(), sceneInstances.size() * sizeof(TlasInstanceDesc));
+            }
+        }
+        else
         {
-            // Skip inactive particles
-            if (!particle.active)
-                continue;
+            // Update the intersection instances for the live particles. The instance ID is the index of the particle
+            // in the ParticleInfo buffer, which is the same as its index in the particle pool.
+            const uint32_t liveCount = m_Particles.GetLiveCount();
+            for (uint32_t index = 0; index < liveCount; ++index)
+            {
+                const ParticleEntity& particle = m_Particles[index];
+                nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[m_NumSceneTlasInstances + index];
 
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = m_ParticleIntersectionBLAS;
-            instanceDesc.instanceMask = INSTANCE_MASK_INTERSECTION_PARTICLE;
-            instanceDesc.instanceID = particleIndex;
-            // Scale and translate the AABB to make it contain the particle billboard
-            const affine3 transform = scaling(float3(particle.radius)) * translation(particle.position);
-            affineToColumnMajor(transform, instanceDesc.transform);
+                bool dirty = false;
+                if (instanceDesc.instanceMask != INSTANCE_MASK_INTERSECTION_PARTICLE || instanceDesc.instanceID != index)
+                {
+                    instanceDesc.instanceMask = INSTANCE_MASK_INTERSECTION_PARTICLE;
+                    instanceDesc.instanceID = index;
+                    dirty = true;
+                }
 
-            instances.push_back(instanceDesc);
+                // Scale and translate the AABB to make it contain the particle billboard
+                const affine3 transform = scaling(float3(particle.radius)) * translation(particle.position);
+                if (UpdateTlasInstanceTransform(instanceDesc, transform))
+                    dirty = true;
+
+                if (dirty)
+                    ++dirtyInstances;
+            }
 
-            ++particleIndex;
+            // Disable the instances of the particles that have died since the last frame,
+            // their transforms are kept until the instances are used again.
+            for (uint32_t index = liveCount; index < m_NumActiveParticleInstances; ++index)
+            {
+                m_TlasInstances[m_NumSceneTlasInstances + index].instanceMask = 0;
+                ++dirtyInstances;
+            }
+            m_NumActiveParticleInstances = liveCount;
         }
+
+        // Refit even when no instance has changed because the particle geometry BLAS is rebuilt every frame.
+        const bool rebuild = ShouldRebuildTlas(topologyChanged, c_TlasRebuildPeriod, m_FramesSinceTlasRebuild);
+
+        m_ui->tlasDirtyInstances = dirtyInstances;
+        m_ui->tlasRebuilt = rebuild;
         
-        commandList->beginMarker("TLAS Update");
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
+        commandList->beginMarker(rebuild ? "TLAS Rebuild" : "TLAS Update");
+        const nvrhi::rt::AccelStructBuildFlags buildFlags = GetTlasBuildFlags(m_TopLevelAS, rebuild);
+        if (m_ui->gpuSimulation)
+            commandList->buildTopLevelAccelStructFromBuffer(m_TopLevelAS, m_TlasInstanceBuffer, 0, m_NumSceneTlasInstances + c_MaxGpuParticles, buildFlags);
+        else
+            commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_TlasInstances.data(), m_TlasInstances.size(), buildFlags);
         commandList->endMarker();
     }
 
@@ -675,6 +1101,7 @@ public:
     void BackBufferResizing() override
     { 
         m_ColorBuffer = nullptr;
+        m_ReferenceBuffer = nullptr;
         m_BindingCache->Clear();
     }
 
@@ -682,17 +1109,6 @@ public:
     {
         const auto& fbinfo = framebuffer->getFramebufferInfo();
 
-        if (m_ui->updatePipeline)
-        {
-            if (!CreateComputePipeline(*m_ShaderFactory))
-            {
-                glfwSetWindowShouldClose(GetDeviceManager()->GetWindow(), 1);
-                return;
-            }
-
-            m_ui->updatePipeline = false;
-        }
-
         if (!m_ColorBuffer)
         {
             nvrhi::TextureDesc desc;
@@ -717,8 +1133,23 @@ public:
             };
 
             m_BindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+            desc.debugName = "ReferenceBuffer";
+            m_ReferenceBuffer = GetDevice()->createTexture(desc);
+            bindingSetDesc.bindings.back() = nvrhi::BindingSetItem::Texture_UAV(0, m_ReferenceBuffer);
+            m_ReferenceBindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+            nvrhi::BindingSetDesc errorBindingSetDesc;
+            errorBindingSetDesc.bindings = {
+                nvrhi::BindingSetItem::Texture_SRV(0, m_ColorBuffer),
+                nvrhi::BindingSetItem::Texture_SRV(1, m_ReferenceBuffer),
+                nvrhi::BindingSetItem::RawBuffer_UAV(0, m_ErrorBuffer)
+            };
+            m_ErrorBindingSet = GetDevice()->createBindingSet(errorBindingSetDesc, m_ErrorBindingLayout);
         }
 
+        HarvestFrameQueries();
+
         auto particleTexture = (m_ui->particleTexture == ParticleTexture::Smoke) ? m_SmokeTexture : m_LogoTexture;
         if (m_ParticleMaterial->baseOrDiffuseTexture != particleTexture)
         {
@@ -736,10 +1167,26 @@ public:
 
         m_CommandList->open();
         
-        if (m_ui->enableAnimations || m_ui->alwaysUpdateOrientation || m_ParticleMaterial->dirty)
+        // Restart the GPU simulation from an empty buffer every time it's enabled
+        if (!m_ui->gpuSimulation)
+            m_GpuParticlesValid = false;
+
+        if (m_AccelStructs->Compact(m_CommandList))
+        {
+            m_BlasMemoryMoved = true;
+            if (m_AccelStructs->IsCompactionComplete())
+                m_AccelStructs->LogMemoryStats();
+        }
+        m_ui->blasMemory = m_AccelStructs->GetTotalSize();
+        m_ui->blasUncompactedMemory = m_AccelStructs->GetTotalUncompactedSize();
+
+        if (m_ui->enableAnimations || m_ui->alwaysUpdateOrientation || m_ParticleMaterial->dirty || m_BlasMemoryMoved)
         {
             m_Scene->Refresh(m_CommandList, GetFrameIndex());
-            BuildParticleGeometry(m_CommandList);
+            if (m_ui->gpuSimulation)
+                SimulateParticlesOnGpu(m_CommandList);
+            else
+                BuildParticleGeometry(m_CommandList);
             BuildTLAS(m_CommandList, GetFrameIndex());
         }
         
@@ -750,17 +1197,57 @@ public:
         constants.reorientParticlesInSecondaryRays = m_ui->reorientParticlesInSecondaryRays;
         constants.orientationMode = m_ui->orientationMode;
         constants.environmentMapTextureIndex = m_EnvironmentMap->bindlessDescriptor.Get();
+        constants.frameIndex = GetFrameIndex();
         m_CommandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
         
+        const uint blendMode = m_ui->blendMode;
+        const uint fragmentsIndex = BlendModeUsesFragments(blendMode) ? m_ui->blendFragmentsIndex : 0;
+
         nvrhi::ComputeState state;
-        state.pipeline = m_ComputePipeline;
+        state.pipeline = m_ComputePipelines[blendMode][fragmentsIndex];
         state.bindings = { m_BindingSet, m_DescriptorTable->GetDescriptorTable() };
         m_CommandList->setComputeState(state);
 
+        // Render the same frame with the reference blending after this one, and measure the difference
+        BlendTiming timing;
+        timing.blendMode = blendMode;
+        timing.pixelCount = fbinfo.width * fbinfo.height;
+        timing.measuredError = m_ui->compareWithReference && blendMode != BLEND_MODE_REFERENCE;
+
+        m_BlendTimers.Begin(m_CommandList);
         m_CommandList->dispatch(
             div_ceil(fbinfo.width, 16),
             div_ceil(fbinfo.height, 16));
-        
+        m_BlendTimers.End(m_CommandList, timing);
+
+        if (timing.measuredError)
+        {
+            m_CommandList->beginMarker("Blending Error");
+
+            state.pipeline = m_ComputePipelines[BLEND_MODE_REFERENCE][0];
+            state.bindings = { m_ReferenceBindingSet, m_DescriptorTable->GetDescriptorTable() };
+            m_CommandList->setComputeState(state);
+            m_CommandList->dispatch(
+                div_ceil(fbinfo.width, 16),
+                div_ceil(fbinfo.height, 16));
+
+            m_CommandList->clearBufferUInt(m_ErrorBuffer, 0);
+
+            nvrhi::ComputeState errorState;
+            errorState.pipeline = m_ErrorPipeline;
+            errorState.bindings = { m_ErrorBindingSet };
+            m_CommandList->setComputeState(errorState);
+            m_CommandList->dispatch(
+                div_ceil(fbinfo.width, BLEND_ERROR_GROUP_SIZE),
+                div_ceil(fbinfo.height, BLEND_ERROR_GROUP_SIZE));
+
+            m_CommandList->copyBuffer(m_ErrorReadbacks[m_BlendTimers.GetSlot()], 0, m_ErrorBuffer, 0, sizeof(uint32_t));
+
+            m_CommandList->endMarker();
+        }
+        else if (blendMode == BLEND_MODE_REFERENCE)
+            m_ui->blendErrors[blendMode] = 0.f;
+
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_ColorBuffer, m_BindingCache.get());
 
         m_CommandList->close();
@@ -788,6 +1275,9 @@ public:
 
         ImGui::Checkbox("Animate particles (Space)", &m_ui->enableAnimations);
         ImGui::Checkbox("Update orientation when paused", &m_ui->alwaysUpdateOrientation);
+        ImGui::Checkbox("Simulate on GPU", &m_ui->gpuSimulation);
+        if (!m_ui->gpuSimulation)
+            ImGui::Text("Live particles: %u / %u", m_ui->liveParticles, c_MaxParticles);
         ImGui::Separator();
 
         ImGui::Text("Orientation mode:");
@@ -807,39 +1297,96 @@ public:
         ImGui::Unindent();
         ImGui::Separator();
 
-        // MLAB fragment count combo-box
-        uint allowedMlabFragmentCounts[] = {1, 2, 4, 8};
-        char fragmentsText[4];
-        snprintf(fragmentsText, sizeof(fragmentsText), "%d", m_ui->mlabFragments);
-        ImGui::PushItemWidth(40.f);
-        uint newFragmentCount = m_ui->mlabFragments;
-        if (ImGui::BeginCombo("Blending fragments", fragmentsText))
+        ImGui::Text("Blending:");
+        ImGui::Indent();
+        ImGui::PushItemWidth(200.f);
+        if (ImGui::BeginCombo("##blendMode", c_BlendModeNames[m_ui->blendMode]))
         {
-            for (uint fragmentCount : allowedMlabFragmentCounts)
+            for (uint blendMode = 0; blendMode < BLEND_MODE_COUNT; ++blendMode)
             {
-                snprintf(fragmentsText, sizeof(fragmentsText), "%d", fragmentCount);
-                if (ImGui::Selectable(fragmentsText, newFragmentCount == fragmentCount))
-                    newFragmentCount = fragmentCount;
+                if (ImGui::Selectable(c_BlendModeNames[blendMode], m_ui->blendMode == blendMode))
+                    m_ui->blendMode = blendMode;
             }
             ImGui::EndCombo();
         }
         ImGui::PopItemWidth();
-        if (newFragmentCount != m_ui->mlabFragments)
+
+        // Fragment count combo-box: MLAB and K-buffer fragments, or stochastic samples per pixel
+        if (BlendModeUsesFragments(m_ui->blendMode))
+        {
+            char fragmentsText[4];
+            snprintf(fragmentsText, sizeof(fragmentsText), "%u", c_BlendFragmentCounts[m_ui->blendFragmentsIndex]);
+            ImGui::PushItemWidth(40.f);
+            if (ImGui::BeginCombo(m_ui->blendMode == BLEND_MODE_STOCHASTIC ? "Samples" : "Fragments", fragmentsText))
+            {
+                for (uint fragmentsIndex = 0; fragmentsIndex < c_NumBlendFragmentCounts; ++fragmentsIndex)
+                {
+                    snprintf(fragmentsText, sizeof(fragmentsText), "%u", c_BlendFragmentCounts[fragmentsIndex]);
+                    if (ImGui::Selectable(fragmentsText, m_ui->blendFragmentsIndex == fragmentsIndex))
+                        m_ui->blendFragmentsIndex = fragmentsIndex;
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::PopItemWidth();
+        }
+
+        ImGui::Checkbox("Compare with reference", &m_ui->compareWithReference);
+        for (uint blendMode = 0; blendMode < BLEND_MODE_COUNT; ++blendMode)
         {
-            m_ui->mlabFragments = newFragmentCount;
-            m_ui->updatePipeline = true;
+            ImGui::Text("%-26s %.2f ms", c_BlendModeNames[blendMode], m_ui->blendTimes[blendMode]);
+            if (m_ui->compareWithReference)
+            {
+                ImGui::SameLine();
+                ImGui::Text(", error %.4f", m_ui->blendErrors[blendMode]);
+            }
         }
+        ImGui::Unindent();
         ImGui::Separator();
 
-        ImGui::Text("Emitter position:");
+        ImGui::Text("Emitters:");
         ImGui::Indent();
-        ImGui::DragFloat3("##emitterPosition", &m_ui->emitterPosition.x, 0.01f);
+        ImGui::PushItemWidth(150.f);
+        for (size_t index = 0; index < m_ui->emitters.size(); )
+        {
+            ParticleEmitter& emitter = m_ui->emitters[index];
+            ImGui::PushID(int(index));
+            ImGui::Checkbox("##enabled", &emitter.enabled);
+            ImGui::SameLine();
+            ImGui::DragFloat3("Position", &emitter.position.x, 0.01f);
+            ImGui::SliderFloat("Particles/s", &emitter.particlesPerSecond, 1.f, float(c_MaxGpuParticles) * 0.5f, "%.0f",
+                ImGuiSliderFlags_Logarithmic);
+            bool remove = false;
+            if (m_ui->emitters.size() > 1)
+            {
+                ImGui::SameLine();
+                remove = ImGui::Button("Remove");
+            }
+            ImGui::PopID();
+
+            if (remove)
+                m_ui->emitters.erase(m_ui->emitters.begin() + index);
+            else
+                ++index;
+        }
+        ImGui::PopItemWidth();
+        if (m_ui->emitters.size() < MAX_PARTICLE_EMITTERS && ImGui::Button("Add emitter"))
+        {
+            ParticleEmitter emitter = m_ui->emitters.back();
+            emitter.position.x += 1.f;
+            emitter.emitAccumulator = 0.f;
+            m_ui->emitters.push_back(emitter);
+        }
         ImGui::Unindent();
 
         ImGui::Text("Particle texture:");
         ImGui::Indent();
         ImGui::Combo("##particleTexture", (int*)&m_ui->particleTexture, "Smoke\0Logo\0");
         ImGui::Unindent();
+        ImGui::Separator();
+
+        ImGui::Text("TLAS %s, %u dirty instances", m_ui->tlasRebuilt ? "rebuilt" : "refit", m_ui->tlasDirtyInstances);
+        ImGui::Text("BLAS memory: %.2f MB, %.2f MB before compaction",
+            double(m_ui->blasMemory) / (1024.0 * 1024.0), double(m_ui->blasUncompactedMemory) / (1024.0 * 1024.0));
 
         // End of window
         ImGui::End();
@@ -30,7 +30,7 @@
 #include <donut/shaders/lighting.hlsli>
 #include <donut/shaders/scene_material.hlsli>
 #include "rt_particles_cb.h"
-#include "mlab.hlsli"
+#include "blending.hlsli"
 #include "utils.hlsli"
 
 VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
@@ -237,7 +237,8 @@ float4 getIntersectionParticleColor(RayDesc ray, uint particleIndex, float accum
 }
 
 // Traces a ray looking for particles, returns the accumulated radiance and transmittance.
-BlendFragment accumulateParticles(RayDesc ray, float accumulatedHitDistance, float3x3 accumulatedVectorTransform, bool isSecondaryRay)
+BlendFragment accumulateParticles(RayDesc ray, float accumulatedHitDistance, float3x3 accumulatedVectorTransform, bool isSecondaryRay,
+    uint randomSeed)
 {
     // Use intersection particles if re-orientation is needed for this type of ray
     // (primary or secondary), per user settings. Primary and secondary rays generally
@@ -252,14 +253,20 @@ BlendFragment accumulateParticles(RayDesc ray, float accumulatedHitDistance, flo
         ? INSTANCE_MASK_INTERSECTION_PARTICLE
         : INSTANCE_MASK_PARTICLE_GEOMETRY;
 
+    // Initialize the blending state.
+    // See blending.hlsli for more information.
+    BlendState blendState;
+    blendBegin(blendState);
+
+#if BLEND_MODE == BLEND_MODE_REFERENCE
+    // Trace the ray once per layer of particles
+    do
+    {
+#endif
+
     RayQuery<RAY_FLAG_NONE> rayQuery;
     rayQuery.TraceRayInline(SceneBVH, RAY_FLAG_NONE, rayMask, ray);
 
-    // Initialize the blending array.
-    // See mlab.hlsli for more information.
-    BlendFragment buffer[MLAB_FRAGMENTS];
-    blendInit(buffer);
-
     while (rayQuery.Proceed())
     {
         float4 particleColor = 0;
@@ -294,16 +301,20 @@ BlendFragment accumulateParticles(RayDesc ray, float accumulatedHitDistance, flo
         if (particleColor.a == 0)
             continue;
         
-        // Insert the fragment into the blending array.
+        // Add the fragment to the blending state.
         BlendFragment f;
         f.color = particleColor.rgb * particleColor.a;
         f.attenuation = 1.0 - particleColor.a;
         f.depth = particleDistance;
-        blendInsert(f, buffer);
+        blendAdd(blendState, f, particleIndex, randomSeed);
     }
 
-    // Integrate the blending array into one fragment.
-    return blendIntegrate(buffer);
+#if BLEND_MODE == BLEND_MODE_REFERENCE
+    } while (blendNextLayer(blendState));
+#endif
+
+    // Composite all the fragments into one.
+    return blendResolve(blendState);
 }
 
 // Traces a ray looking for an opaque surface, returns the hit (if found) or instanceID = c_MissInstanceID (if not)
@@ -352,6 +363,7 @@ float3 shadeOpaqueSurface(
 void main(uint2 pixelPosition : SV_DispatchThreadID)
 {
     RayDesc ray = setupPrimaryRay(pixelPosition, g_Const.view);
+    const uint randomSeed = pcgHash(pixelPosition.x + (pixelPosition.y << 16)) ^ pcgHash(g_Const.frameIndex);
 
     float3 finalColor = 0;
     float attenuation = 1.0;
@@ -374,7 +386,8 @@ void main(uint2 pixelPosition : SV_DispatchThreadID)
         }
 
         // Trace a ray looking for particles.
-        BlendFragment particles = accumulateParticles(ray, accumulatedHitDistance, accumulatedVectorTransform, bounce > 0);
+        BlendFragment particles = accumulateParticles(ray, accumulatedHitDistance, accumulatedVectorTransform, bounce > 0,
+            pcgHash(randomSeed + bounce));
 
         // Blend the particles over the regular geometry.
         float3 segmentColor = particles.color + surfaceColor * particles.attenuation;
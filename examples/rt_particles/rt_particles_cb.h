@@ -35,6 +35,7 @@ struct GlobalConstants
     uint orientationMode;
 
     int environmentMapTextureIndex;
+    uint frameIndex;
 };
 
 struct ParticleInfo
@@ -52,10 +53,76 @@ struct ParticleInfo
     float opacityFactor;
 };
 
+// State of one particle simulated on the GPU, see particle_simulation.hlsl
+struct ParticleState
+{
+    float3 position;
+    float radius;
+
+    float3 velocity;
+    float age;
+
+    float3 color;
+    float rotation;
+
+    uint active;
+};
+
+#define MAX_PARTICLE_EMITTERS               8
+
+struct ParticleSimulationConstants
+{
+    float3 cameraRight;
+    float deltaTime;
+
+    float3 cameraUp;
+    uint emitFirst;
+
+    uint emitCount;
+    uint particleCapacity;
+    uint firstParticleInstance;
+    uint positionOffset;
+
+    uint2 intersectionBlasAddress;
+    uint orientationMode;
+    int textureIndex;
+
+    uint randomSeed;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+
+    // Emitter position (xyz), and the end of the emitter's range within the emitted particles (w)
+    float4 emitters[MAX_PARTICLE_EMITTERS];
+};
+
+// Native TLAS instance layout, identical in D3D12_RAYTRACING_INSTANCE_DESC and VkAccelerationStructureInstanceKHR.
+// Used for TLAS builds from a GPU buffer, where the particle instances are written by the simulation shader.
+struct TlasInstanceDesc
+{
+    float4 transform[3];
+    uint instanceIDAndMask; // Instance ID in bits 0-23, instance mask in bits 24-31
+    uint hitGroupOffsetAndFlags; // Hit group index contribution in bits 0-23, instance flags in bits 24-31
+    uint2 blasDeviceAddress;
+};
+
+#define PARTICLE_SIMULATION_GROUP_SIZE      64
+
 #define INSTANCE_MASK_OPAQUE                1
 #define INSTANCE_MASK_PARTICLE_GEOMETRY     2
 #define INSTANCE_MASK_INTERSECTION_PARTICLE 4
 
+#define BLEND_MODE_MLAB                     0
+#define BLEND_MODE_KBUFFER                  1
+#define BLEND_MODE_WBOIT                    2
+#define BLEND_MODE_STOCHASTIC               3
+#define BLEND_MODE_REFERENCE                4
+#define BLEND_MODE_COUNT                    5
+
+// Fixed point scale of the per-pixel errors accumulated by blend_error.hlsl
+#define BLEND_ERROR_SCALE                   256.0
+#define BLEND_ERROR_GROUP_SIZE              16
+
 #define ORIENTATION_MODE_AVT_MATRIX         0
 #define ORIENTATION_MODE_QUATERNION         1
 #define ORIENTATION_MODE_BEAM               2
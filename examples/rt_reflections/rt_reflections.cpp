@@ -41,6 +41,7 @@ using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "accel_struct_manager.h"
 
 static const char* g_WindowTitle = "Donut Example: Ray Traced Reflections";
 
@@ -153,6 +154,8 @@ private:
 
     nvrhi::rt::AccelStructHandle m_BottomLevelAS;
     nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::vector<nvrhi::rt::InstanceDesc> m_TlasInstances;
+    std::unique_ptr<AccelStructManager> m_AccelStructs;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -211,7 +214,7 @@ public:
         if (!CreateRayTracingPipeline(*m_ShaderFactory))
             return false;
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_CommandList = GetDevice()->createCommandList(AccelStructManager::GetBuildCommandListParameters());
 
         m_CommandList->open();
 
@@ -404,40 +407,22 @@ public:
 
     void CreateAccelStruct(nvrhi::ICommandList* commandList)
     {
+        m_AccelStructs = std::make_unique<AccelStructManager>(GetDevice());
+
         for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
         {
             nvrhi::rt::AccelStructDesc blasDesc;
-            blasDesc.isTopLevel = false;
+            GetMeshBlasDesc(*mesh, blasDesc);
 
-            for (const auto& geometry : mesh->geometries)
-            {
-                nvrhi::rt::GeometryDesc geometryDesc;
-                auto& triangles = geometryDesc.geometryData.triangles;
-                triangles.indexBuffer = mesh->buffers->indexBuffer;
-                triangles.indexOffset = (mesh->indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-                triangles.indexFormat = nvrhi::Format::R32_UINT;
-                triangles.indexCount = geometry->numIndices;
-                triangles.vertexBuffer = mesh->buffers->vertexBuffer;
-                triangles.vertexOffset = (mesh->vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh->buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-                triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-                triangles.vertexStride = sizeof(float3);
-                triangles.vertexCount = geometry->numVertices;
-                geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-                geometryDesc.flags = nvrhi::rt::GeometryFlags::Opaque;
-                blasDesc.bottomLevelGeometries.push_back(geometryDesc);
-            }
-
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
-
-            mesh->accelStruct = as;
+            mesh->accelStruct = m_AccelStructs->CreateBLAS(blasDesc, false);
         }
 
+        m_AccelStructs->BuildPending(commandList);
+
 
         nvrhi::rt::AccelStructDesc tlasDesc;
         tlasDesc.isTopLevel = true;
 
-        std::vector<nvrhi::rt::InstanceDesc> instances;
         for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
         {
             const auto& mesh = instance->GetMesh();
@@ -452,13 +437,25 @@ public:
             assert(node);
             dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
             
-            instances.push_back(instanceDesc);
+            m_TlasInstances.push_back(instanceDesc);
         }
 
-        tlasDesc.topLevelMaxInstances = instances.size();
+        tlasDesc.topLevelMaxInstances = m_TlasInstances.size();
         m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
 
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
+        commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_TlasInstances.data(), m_TlasInstances.size());
+    }
+
+    // Compacts the BLASes once their builds have finished, and rebuilds the TLAS to reference their new memory
+    void CompactAccelStructs(nvrhi::ICommandList* commandList)
+    {
+        if (!m_AccelStructs->Compact(commandList))
+            return;
+
+        commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_TlasInstances.data(), m_TlasInstances.size());
+
+        if (m_AccelStructs->IsCompactionComplete())
+            m_AccelStructs->LogMemoryStats();
     }
     
     void BackBufferResizing() override
@@ -517,6 +514,8 @@ public:
 
         m_CommandList->open();
 
+        CompactAccelStructs(m_CommandList);
+
         m_RenderTargets->Clear(m_CommandList);
         render::GBufferFillPass::Context gbufferContext;
         render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_GBufferFramebuffer, 
@@ -0,0 +1,67 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include "../instanced_views/instanced_views.hlsli"
+#include "cube_multiview_cb.h"
+
+ConstantBuffer<CubeMultiviewConstants> g_Const : register(b0);
+
+// Every instance of a draw is the same geometry instance, seen by the next face in the draw's view list,
+// and gs_main routes it to the array slice of that face
+void vs_main(
+    in uint i_vertexID : SV_VertexID,
+    in uint i_instanceID : SV_InstanceID,
+    out InstancedViewVertex o_vertex)
+{
+    float3 worldSpacePosition = LoadInstancedViewVertex(i_vertexID, i_instanceID, o_vertex);
+
+    o_vertex.position = mul(float4(worldSpacePosition, 1.0), g_Const.matWorldToClip[o_vertex.view]);
+}
+
+void ps_main(
+    in InstancedViewVertex i_vertex,
+    out float4 o_color : SV_Target0)
+{
+    MaterialConstants material = t_MaterialConstants[i_vertex.material];
+
+    float3 diffuse = material.baseOrDiffuseColor;
+
+    if (material.baseOrDiffuseTextureIndex >= 0)
+    {
+        Texture2D diffuseTexture = t_BindlessTextures[material.baseOrDiffuseTextureIndex];
+
+        float4 diffuseTextureValue = diffuseTexture.Sample(s_MaterialSampler, i_vertex.uv);
+        
+        if (material.domain == MaterialDomain_AlphaTested)
+            clip(diffuseTextureValue.a - material.alphaCutoff);
+
+        diffuse *= diffuseTextureValue.rgb;
+    }
+
+    // Hemispherical ambient, as the per-face forward pass computes it without lights
+    float3 normal = normalize(i_vertex.normal);
+    float3 ambient = lerp(g_Const.ambientColorBottom.rgb, g_Const.ambientColorTop.rgb, normal.y * 0.5 + 0.5);
+
+    o_color = float4(diffuse * ambient, 1);
+}
@@ -30,16 +30,29 @@
 #include <donut/engine/Scene.h>
 #include <donut/engine/FramebufferFactory.h>
 #include <donut/engine/BindingCache.h>
+#include <donut/engine/DescriptorTableManager.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/core/log.h>
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
+#include <nvrhi/utils.h>
 #include <taskflow/taskflow.hpp>
+#include <chrono>
+#include <cstdio>
+#include "flat_draw_strategy.h"
+#include "instanced_views.h"
 
 using namespace donut;
+using namespace donut::math;
+
+#include "cube_multiview_cb.h"
 
 static const char* g_WindowTitle = "Donut Example: Threaded Rendering";
 
+static const uint32_t c_CubeFaceSize = 1024;
+static const float c_CubeZNear = 0.1f;
+static const float c_CubeZFar = 100.f;
+
 class ThreadedRendering : public app::ApplicationBase
 {
 private:
@@ -49,15 +62,32 @@ private:
     std::array<nvrhi::CommandListHandle, 6> m_FaceCommandLists;
 
     bool m_UseThreads = true;
+    bool m_SinglePass = false;
+    double m_RecordingTime = 0.0;
     std::unique_ptr<tf::Executor> m_Executor;
     
     nvrhi::TextureHandle m_DepthBuffer;
     nvrhi::TextureHandle m_ColorBuffer;
     std::unique_ptr<engine::FramebufferFactory> m_Framebuffer;
+    nvrhi::FramebufferHandle m_CubeFramebuffer; // All six faces, for the single pass mode
     
     std::unique_ptr<render::ForwardShadingPass> m_ForwardShadingPass;
+
+    // Single pass mode: each geometry instance is drawn once, instanced into the faces it is visible in
+    nvrhi::ShaderHandle m_MultiviewVertexShader;
+    nvrhi::ShaderHandle m_MultiviewGeometryShader;
+    nvrhi::ShaderHandle m_MultiviewPixelShader;
+    nvrhi::BindingLayoutHandle m_MultiviewBindingLayout;
+    nvrhi::BindingLayoutHandle m_BindlessLayout;
+    nvrhi::BindingSetHandle m_MultiviewBindingSet;
+    nvrhi::GraphicsPipelineHandle m_MultiviewPipelines[2]; // Back face culled, double sided
+    nvrhi::BufferHandle m_MultiviewConstants;
+    std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTableManager;
+    std::unique_ptr<FlatOpaqueDrawStrategy> m_MultiviewDrawStrategy;
+    InstancedViewsDrawStats m_MultiviewDrawStats;
     std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
     std::unique_ptr<engine::Scene> m_Scene;
+    std::shared_ptr<FlatDrawList> m_DrawList;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
 
     app::FirstPersonCamera m_Camera;
@@ -70,9 +100,11 @@ public:
     {
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Assets/Models/Sponza/glTF/Sponza.gltf";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/threaded_rendering" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         
         m_RootFS = std::make_shared<vfs::RootFileSystem>();
         m_RootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_RootFS->mount("/shaders/app", appShaderPath);
 
         m_Executor = std::make_unique<tf::Executor>();
 
@@ -80,13 +112,42 @@ public:
         m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
         m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
 
+        // The single pass mode reads the scene through bindless descriptors, like the Bindless Rendering example
+        nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+        bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+        bindlessLayoutDesc.firstSlot = 0;
+        bindlessLayoutDesc.maxCapacity = 1024;
+        bindlessLayoutDesc.registerSpaces = {
+            nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
+            nvrhi::BindingLayoutItem::Texture_SRV(2)
+        };
+        m_BindlessLayout = GetDevice()->createBindlessLayout(bindlessLayoutDesc);
+
+        m_DescriptorTableManager = std::make_shared<engine::DescriptorTableManager>(GetDevice(), m_BindlessLayout);
+
         auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
-        m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, nullptr);
+        m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, m_DescriptorTableManager);
 
         SetAsynchronousLoadingEnabled(false);
         BeginLoadingScene(nativeFS, sceneFileName);
 
         m_Scene->FinishedLoading(GetFrameIndex());
+
+        // The scene is static, so the draw list is built once and shared by the six faces
+        m_DrawList = std::make_shared<FlatDrawList>();
+        m_DrawList->Build(m_Scene->GetSceneGraph()->GetRootNode().get());
+
+        m_MultiviewVertexShader = m_ShaderFactory->CreateShader("/shaders/app/cube_multiview.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
+        m_MultiviewGeometryShader = m_ShaderFactory->CreateShader("/shaders/app/cube_multiview.hlsl", "gs_main", nullptr, nvrhi::ShaderType::Geometry);
+        m_MultiviewPixelShader = m_ShaderFactory->CreateShader("/shaders/app/cube_multiview.hlsl", "ps_main", nullptr, nvrhi::ShaderType::Pixel);
+
+        m_MultiviewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(CubeMultiviewConstants), "CubeMultiviewConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        GetDevice()->waitForIdle();
+
+        m_MultiviewBindingLayout = GetDevice()->createBindingLayout(GetInstancedViewsBindingLayoutDesc());
+        m_MultiviewBindingSet = GetDevice()->createBindingSet(GetInstancedViewsBindingSetDesc(m_MultiviewConstants, *m_Scene, m_CommonPasses->m_AnisotropicWrapSampler), m_MultiviewBindingLayout);
+        m_MultiviewDrawStrategy = std::make_unique<FlatOpaqueDrawStrategy>(m_DrawList);
         
         m_Camera.LookAt(dm::float3(0.f, 1.8f, 0.f), dm::float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
@@ -113,8 +174,8 @@ public:
         auto textureDesc = nvrhi::TextureDesc()
             .setDimension(nvrhi::TextureDimension::TextureCube)
             .setArraySize(6)
-            .setWidth(1024)
-            .setHeight(1024)
+            .setWidth(c_CubeFaceSize)
+            .setHeight(c_CubeFaceSize)
             .setClearValue(nvrhi::Color(0.f))
             .setIsRenderTarget(true)
             .setKeepInitialState(true);
@@ -134,12 +195,17 @@ public:
         m_Framebuffer = std::make_unique<engine::FramebufferFactory>(GetDevice());
         m_Framebuffer->RenderTargets.push_back(m_ColorBuffer);
         m_Framebuffer->DepthTarget = m_DepthBuffer;
+
+        const nvrhi::TextureSubresourceSet allFaces(0, 1, 0, CUBE_FACE_COUNT);
+        m_CubeFramebuffer = GetDevice()->createFramebuffer(nvrhi::FramebufferDesc()
+            .addColorAttachment(m_ColorBuffer, allFaces)
+            .setDepthAttachment(m_DepthBuffer, allFaces));
     }
 
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
         std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(),
-            *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+            *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTableManager, nullptr);
 
         if (scene->Load(sceneFileName))
         {
@@ -159,6 +225,11 @@ public:
             m_UseThreads = !m_UseThreads;
         }
 
+        if (key == GLFW_KEY_M && action == GLFW_PRESS)
+        {
+            m_SinglePass = !m_SinglePass;
+        }
+
         return true;
     }
 
@@ -178,7 +249,13 @@ public:
     {
         m_Camera.Animate(fElapsedTimeSeconds);
 
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle,m_UseThreads ? "(With threads)" : "(No threads)");
+        char extraInfo[128];
+        if (m_SinglePass)
+            snprintf(extraInfo, sizeof(extraInfo), "(Single pass, %u draws into %u faces, %.2f ms CPU)", m_MultiviewDrawStats.drawCount, m_MultiviewDrawStats.viewDrawCount, m_RecordingTime * 1e3);
+        else
+            snprintf(extraInfo, sizeof(extraInfo), "(%s, %.2f ms CPU)", m_UseThreads ? "With threads" : "No threads", m_RecordingTime * 1e3);
+
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
     void BackBufferResizing() override
@@ -202,7 +279,7 @@ public:
         commandList->setResourceStatesForFramebuffer(m_Framebuffer->GetFramebuffer(*faceView));
         commandList->commitBarriers();
 
-        render::InstancedOpaqueDrawStrategy strategy;
+        FlatOpaqueDrawStrategy strategy(m_DrawList);
 
         render::RenderCompositeView(commandList, faceView, faceView, *m_Framebuffer,
             m_Scene->GetSceneGraph()->GetRootNode(), strategy, *m_ForwardShadingPass, context);
@@ -212,14 +289,74 @@ public:
         commandList->close();
     }
 
+    void CreateMultiviewPipelines()
+    {
+        nvrhi::GraphicsPipelineDesc pipelineDesc;
+        pipelineDesc.VS = m_MultiviewVertexShader;
+        pipelineDesc.GS = m_MultiviewGeometryShader;
+        pipelineDesc.PS = m_MultiviewPixelShader;
+        pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
+        pipelineDesc.bindingLayouts = { m_MultiviewBindingLayout, m_BindlessLayout };
+        pipelineDesc.renderState.depthStencilState.depthTestEnable = true;
+        pipelineDesc.renderState.depthStencilState.depthFunc = nvrhi::ComparisonFunc::GreaterOrEqual;
+        pipelineDesc.renderState.rasterState.frontCounterClockwise = !m_CubemapView.GetChildView(engine::ViewType::PLANAR, 0)->IsMirrored();
+
+        pipelineDesc.renderState.rasterState.setCullBack();
+        m_MultiviewPipelines[0] = GetDevice()->createGraphicsPipeline(pipelineDesc, m_CubeFramebuffer);
+
+        pipelineDesc.renderState.rasterState.setCullNone();
+        m_MultiviewPipelines[1] = GetDevice()->createGraphicsPipeline(pipelineDesc, m_CubeFramebuffer);
+    }
+
+    // Renders all six faces in one pass over the draw list. Each item is culled once against the faces, and drawn with
+    // DrawInstancedViews with one instance per face it touches, sent to the face's array slice.
+    void RenderCubeSinglePass(nvrhi::ICommandList* commandList)
+    {
+        if (!m_MultiviewPipelines[0])
+            CreateMultiviewPipelines();
+
+        const nvrhi::TextureSubresourceSet allFaces(0, 1, 0, CUBE_FACE_COUNT);
+        commandList->clearDepthStencilTexture(m_DepthBuffer, allFaces, true, 0.f, false, 0);
+        commandList->clearTextureFloat(m_ColorBuffer, allFaces, nvrhi::Color(0.f));
+
+        CubeMultiviewConstants constants = {};
+        for (int face = 0; face < CUBE_FACE_COUNT; face++)
+            constants.matWorldToClip[face] = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face)->GetViewProjectionMatrix();
+        // Same ambient terms as the per-face forward pass
+        constants.ambientColorTop = float4(1.f);
+        constants.ambientColorBottom = float4(0.3f);
+        commandList->writeBuffer(m_MultiviewConstants, &constants, sizeof(constants));
+
+        // Child view i of the cube map view is face i
+        m_MultiviewDrawStrategy->CullForViews(m_CubemapView);
+
+        nvrhi::GraphicsState state;
+        state.framebuffer = m_CubeFramebuffer;
+        state.bindings = { m_MultiviewBindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+        state.viewport.addViewportAndScissorRect(nvrhi::Viewport(float(c_CubeFaceSize), float(c_CubeFaceSize)));
+
+        m_MultiviewDrawStats = DrawInstancedViews(commandList, state, *m_DrawList,
+            m_MultiviewDrawStrategy->GetSharedVisibleItems(), m_MultiviewDrawStrategy->GetSharedViewMasks(),
+            [this](const render::DrawItem& item)
+            {
+                return m_MultiviewPipelines[item.cullMode == nvrhi::RasterCullMode::None ? 1 : 0].Get();
+            });
+    }
+
     void Render(nvrhi::IFramebuffer* framebuffer) override
     {
         dm::affine viewMatrix = m_Camera.GetWorldToViewMatrix();
-        m_CubemapView.SetTransform(viewMatrix, 0.1f, 100.f);
+        m_CubemapView.SetTransform(viewMatrix, c_CubeZNear, c_CubeZFar);
         m_CubemapView.UpdateCache();
 
+        auto recordingStart = std::chrono::high_resolution_clock::now();
+
         tf::Taskflow taskFlow;
-        if (m_UseThreads)
+        if (m_SinglePass)
+        {
+            // Recorded on the main command list below
+        }
+        else if (m_UseThreads)
         {
             for (int face = 0; face < 6; face++)
             {
@@ -238,6 +375,11 @@ public:
         
         m_CommandList->open();
 
+        if (m_SinglePass)
+        {
+            RenderCubeSinglePass(m_CommandList);
+        }
+
         const std::vector<std::pair<int, int>> faceLayout = {
             { 3, 1 },
             { 1, 1 },
@@ -270,11 +412,19 @@ public:
         
         m_CommandList->close();
 
-        if (m_UseThreads)
+        if (!m_SinglePass && m_UseThreads)
         {
             m_Executor->wait_for_all();
         }
 
+        m_RecordingTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - recordingStart).count();
+
+        if (m_SinglePass)
+        {
+            GetDevice()->executeCommandList(m_CommandList);
+            return;
+        }
+
         nvrhi::ICommandList* commandLists[] = {
             m_FaceCommandLists[0],
             m_FaceCommandLists[1],
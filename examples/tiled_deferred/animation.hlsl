@@ -20,19 +20,21 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#include <donut/shaders/binding_helpers.hlsli>
 #include "scene_data.hlsli"
 
-// These are root 32-bit values
-cbuffer InlineConstants : register(b0)
+// These are root 32-bit values (push constants)
+struct AnimationConstants
 {
-    float g_Time;
-    float g_TimeDiff;
-    uint g_ResetState;
+    float time;
+    float timeDiff;
+    uint resetState;
 };
+VK_PUSH_CONSTANT ConstantBuffer<AnimationConstants> g_Inline : register(b0);
 
 StructuredBuffer<Instance> t_InstanceData : register(t0);
 RWStructuredBuffer<AnimState> u_AnimStateData : register(u0);
-RWStructuredBuffer<Light> u_LightData : register(u0);
+RWStructuredBuffer<Light> u_LightData : register(u2);
 
 #define DANCE_BUMP 0
 #define DANCE_JUMP 1
@@ -54,7 +56,7 @@ float CosineInterpolation(float v) { return (1-cos(v*c_PI))/2; }
 
 void StepDance(inout AnimState state, uint rndSeed)
 {
-    state.timeInState += g_TimeDiff;
+    state.timeInState += g_Inline.timeDiff;
 
     if (state.timeInState >= state.statePeriod)
     {
@@ -141,10 +143,14 @@ void StepDance(inout AnimState state, uint rndSeed)
 void CSMainObjects(uint2 dispatchThreadId : SV_DispatchThreadID)
 {
     const uint objectIndex = dispatchThreadId.y*0xFFFF*32 + dispatchThreadId.x;
+    uint objectCount, stride;
+    u_AnimStateData.GetDimensions(objectCount, stride);
+    if (objectIndex >= objectCount)
+        return;
     const uint rnd = Random(objectIndex);
 
     AnimState state;
-    if (g_ResetState)
+    if (g_Inline.resetState)
     {
         state = (AnimState)0;
         state.scale = float3(1,1,1);
@@ -153,7 +159,7 @@ void CSMainObjects(uint2 dispatchThreadId : SV_DispatchThreadID)
 
     const uint animType = t_InstanceData[objectIndex].animType;
     if (animType == AT_RotateY)
-        state.rotationY += g_TimeDiff * lerp(0.4f, 1.0f, NormalizeRandom(rnd)) * ((rnd & 1) ? -1 : 1);
+        state.rotationY += g_Inline.timeDiff * lerp(0.4f, 1.0f, NormalizeRandom(rnd)) * ((rnd & 1) ? -1 : 1);
     else if (animType == AT_Dance)
         StepDance(state, rnd);
 
@@ -164,18 +170,22 @@ void CSMainObjects(uint2 dispatchThreadId : SV_DispatchThreadID)
 void CSMainLights(uint2 dispatchThreadId : SV_DispatchThreadID)
 {
     const uint lightIndex = dispatchThreadId.y*0xFFFF*32 + dispatchThreadId.x;
+    uint lightCount, stride;
+    u_LightData.GetDimensions(lightCount, stride);
+    if (lightIndex >= lightCount)
+        return;
     uint rnd = Random(lightIndex);
 
     Light light = u_LightData[lightIndex];
-    if (g_ResetState)
+    if (g_Inline.resetState)
         light.targetOffset = float3(0,0,0);
     else
     {
-        const float radius = lerp(150,300,NormalizeRandom(rnd));
+        const float radius = lerp(0.5f,1.0f,NormalizeRandom(rnd))*light.orbitRadius;
         rnd = Random(rnd);
         const float speed = lerp(1,3,NormalizeRandom(rnd));
         float2 sinCos;
-        sincos(g_Time*speed,sinCos.x,sinCos.y);
+        sincos(g_Inline.time*speed,sinCos.x,sinCos.y);
         light.targetOffset = float3(sinCos.y*radius,0,sinCos.x*radius);
     }
 
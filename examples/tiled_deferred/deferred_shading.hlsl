@@ -20,30 +20,32 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#include <donut/shaders/binding_helpers.hlsli>
 #include "scene_data.hlsli"
 #include "materials.hlsli"
 #include "lighting.hlsli"
 
-// These are root 32-bit values
-cbuffer InlineConstants : register(b0)
+// These are root 32-bit values (push constants)
+struct LightTileConstants
 {
-    uint g_LightTilesX, g_LightTilesY;
-    uint g_LightCount;
+    uint lightTilesX, lightTilesY;
+    uint lightCount;
 };
+VK_PUSH_CONSTANT ConstantBuffer<LightTileConstants> g_Inline : register(b0);
 
 StructuredBuffer<Material> t_MaterialData : register(t0);
 Texture2D<uint4> t_GBuffer : register(t1);
 Texture2D<float> t_DepthBuffer : register(t2);
-StructuredBuffer<uint> t_CulledLightsData : register(t3);
+StructuredBuffer<uint> t_LightList : register(t3);
 StructuredBuffer<Light> t_LightData : register(t4);
+StructuredBuffer<uint2> t_TileLightGrid : register(t5);
 RWTexture2D<float4> u_LDRBuffer : register(u1);
 
-[numthreads(8, 4, 1)]
+[numthreads(c_LightTileWidth, c_LightTileHeight, 1)]
 void CSMain(uint2 dispatchThreadId : SV_DispatchThreadID, uint2 groupId : SV_GroupID)
 {
     const uint2 pixelXY = dispatchThreadId;
     const float depth = t_DepthBuffer.Load(uint3(pixelXY,0));
-    uint lightReadSlotIndex = (groupId.y*g_LightTilesX + groupId.x) * c_MaxLightsPerTile;
 
     if (depth == 1.0f)
     {
@@ -60,14 +62,20 @@ void CSMain(uint2 dispatchThreadId : SV_DispatchThreadID, uint2 groupId : SV_Gro
 
     static const bool useCulledLights = true;
 
+    // The tile's lights are a contiguous range in the light list. If the list overflowed this frame
+    // (it is grown by the CPU a few frames later), only the part that fits is used.
+    uint lightListCapacity, lightListStride;
+    t_LightList.GetDimensions(lightListCapacity, lightListStride);
+    const uint2 tileOffsetAndCount = t_TileLightGrid[groupId.y*g_Inline.lightTilesX + groupId.x];
+    const uint lightListStart = min(tileOffsetAndCount.x, lightListCapacity);
+    const uint lightListEnd = min(tileOffsetAndCount.x+tileOffsetAndCount.y, lightListCapacity);
+
     float3 color = float3(0,0,0);
-    uint lightCount = useCulledLights ? c_MaxLightsPerTile : g_LightCount;
+    uint lightCount = useCulledLights ? (lightListEnd-lightListStart) : g_Inline.lightCount;
 
     for (uint i=0;i<lightCount;i++)
     {
-        const uint lightIndex = useCulledLights ? t_CulledLightsData[lightReadSlotIndex+i] : i;
-        if (lightIndex == 0xFFFFFFFF)
-            break;
+        const uint lightIndex = useCulledLights ? t_LightList[lightListStart+i] : i;
 
         const Light light = t_LightData[lightIndex];
         if (!PointInSpotLight(pixelXY, depth, light))
@@ -20,17 +20,20 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#include <donut/shaders/binding_helpers.hlsli>
 #include "scene_data.hlsli"
 
-// This is a root 32-bit value
-cbuffer InstanceConstantBuffer : register(b0)
+// This is a root 32-bit value (push constant)
+struct DrawConstants
 {
-    uint g_InstanceID;
+    uint visibleListOffset; // Start of the current mesh type's region in the visible object list.
 };
+VK_PUSH_CONSTANT ConstantBuffer<DrawConstants> g_Inline : register(b0);
 
 StructuredBuffer<Instance> t_InstanceData : register(t0);
 StructuredBuffer<Material> t_MaterialData : register(t3);
 StructuredBuffer<AnimState> t_AnimStateData : register(t4);
+StructuredBuffer<uint> t_VisibleObjects : register(t5);
 
 struct PSInput
 {
@@ -41,10 +44,13 @@ struct PSInput
     uint material : MATERIAL;
 };
 
-PSInput VSMain(float3 vertexPosition : POSITION, float3 vertexNormal : NORMAL)
+PSInput VSMain(float3 vertexPosition : POSITION, float3 vertexNormal : NORMAL, uint instanceID : SV_InstanceID)
 {
-    const Instance instanceData = t_InstanceData[g_InstanceID];
-    const AnimState animStateData = t_AnimStateData[g_InstanceID];
+    // Instances are drawn indirectly from the list written by object_culling.hlsl. The draws always start
+    // at instance 0, so SV_InstanceID means the same on all APIs.
+    const uint objectIndex = t_VisibleObjects[g_Inline.visibleListOffset+instanceID];
+    const Instance instanceData = t_InstanceData[objectIndex];
+    const AnimState animStateData = t_AnimStateData[objectIndex];
     const Material material = t_MaterialData[instanceData.material];
 
     float3 scale = instanceData.size*animStateData.scale;
@@ -0,0 +1,204 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include "scene_data.hlsli"
+#include "lighting.hlsli"
+
+// Tiled light culling builds one compacted light list for the whole screen in three passes:
+// 1. CSCountLights: Each tile counts the lights affecting it.
+// 2. CSBuildLightListOffsets: A prefix sum over the tile counts gives each tile its offset into the list.
+// 3. CSWriteLights: Each tile writes its light indices at its offset.
+// The tile grid holds (offset,count) per tile, followed by one extra element holding the total list size.
+
+// These are root 32-bit values (push constants)
+struct LightTileConstants
+{
+    uint lightTilesX, lightTilesY;
+    uint lightCount;
+};
+VK_PUSH_CONSTANT ConstantBuffer<LightTileConstants> g_Inline : register(b0);
+
+Texture2D<float> t_DepthBuffer : register(t1);
+StructuredBuffer<Light> t_LightData : register(t4);
+StructuredBuffer<uint2> t_TileLightGrid : register(t5);
+RWStructuredBuffer<uint2> u_TileLightGridRW : register(u0);
+RWStructuredBuffer<uint> u_LightListRW : register(u2);
+
+static const uint c_ScanThreadCount = 1024;
+
+groupshared float4 s_TilePositions[c_LightTilePixelCount]; // xyz: World position, w: 1 if the pixel has geometry
+groupshared float3 s_TileBoundsMin;
+groupshared float3 s_TileBoundsMax;
+groupshared uint s_TileHasGeometry;
+groupshared uint s_TileLightCount;
+groupshared uint s_ScanData[c_ScanThreadCount];
+
+// Loads the world positions of the tile's pixels into group shared memory, and computes their bounds.
+// Returns false when the tile has no geometry at all (sky or outside the viewport), in which case no lights are needed.
+bool LoadTile(uint2 pixelXY, uint threadIndex)
+{
+    const float depth = t_DepthBuffer.Load(uint3(pixelXY,0));
+    const bool hasGeometry = (depth != 1.0f) && all(pixelXY < (uint2)viewportSizeXY.xy);
+    const float3 worldPosition = hasGeometry ? Unproject(pixelXY, depth) : float3(0,0,0);
+
+    s_TilePositions[threadIndex] = float4(worldPosition, hasGeometry ? 1 : 0);
+
+    GroupMemoryBarrierWithGroupSync();
+
+    // The tile is small enough for a single thread to reduce its bounds.
+    if (threadIndex == 0)
+    {
+        float3 boundsMin = float3(1e30f,1e30f,1e30f);
+        float3 boundsMax = float3(-1e30f,-1e30f,-1e30f);
+        uint tileHasGeometry = 0;
+        for (uint i=0;i<c_LightTilePixelCount;i++)
+        {
+            const float4 tilePosition = s_TilePositions[i];
+            if (tilePosition.w == 0)
+                continue;
+            boundsMin = min(boundsMin, tilePosition.xyz);
+            boundsMax = max(boundsMax, tilePosition.xyz);
+            tileHasGeometry = 1;
+        }
+        s_TileBoundsMin = boundsMin;
+        s_TileBoundsMax = boundsMax;
+        s_TileHasGeometry = tileHasGeometry;
+        s_TileLightCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    return s_TileHasGeometry != 0;
+}
+
+// Tests a light against all the tile's pixels. The bounding box test rejects most lights before the per-pixel test.
+bool LightAffectsTile(Light light)
+{
+    if (!SpotLightIntersectsBox(light, s_TileBoundsMin, s_TileBoundsMax))
+        return false;
+
+    for (uint i=0;i<c_LightTilePixelCount;i++)
+    {
+        const float4 tilePosition = s_TilePositions[i];
+        if ((tilePosition.w != 0) && PositionInSpotLight(tilePosition.xyz, light))
+            return true;
+    }
+    return false;
+}
+
+[numthreads(c_LightTileWidth, c_LightTileHeight, 1)]
+void CSCountLights(uint2 dispatchThreadId : SV_DispatchThreadID, uint threadIndex : SV_GroupIndex, uint2 groupId : SV_GroupID)
+{
+    const uint tileIndex = groupId.y*g_Inline.lightTilesX + groupId.x;
+
+    // Each thread tests its own subset of the lights against the whole tile.
+    uint threadLightCount = 0;
+    if (LoadTile(dispatchThreadId, threadIndex))
+    {
+        for (uint i=threadIndex;i<g_Inline.lightCount;i+=c_LightTilePixelCount)
+        {
+            if (LightAffectsTile(t_LightData[i]))
+                threadLightCount++;
+        }
+    }
+
+    const uint waveLightCount = WaveActiveSum(threadLightCount);
+    if (WaveIsFirstLane())
+    {
+        uint oldVal;
+        InterlockedAdd(s_TileLightCount, waveLightCount, oldVal);
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+    if (threadIndex == 0)
+        u_TileLightGridRW[tileIndex] = uint2(0, s_TileLightCount);
+}
+
+[numthreads(c_ScanThreadCount, 1, 1)]
+void CSBuildLightListOffsets(uint threadIndex : SV_GroupIndex)
+{
+    // A single group scans all tiles. Each thread sums a contiguous range of tiles, the per-thread sums are scanned
+    // in group shared memory, then each thread writes the offsets for its range.
+    const uint tileCount = g_Inline.lightTilesX*g_Inline.lightTilesY;
+    const uint tilesPerThread = (tileCount+c_ScanThreadCount-1)/c_ScanThreadCount;
+    const uint firstTile = min(threadIndex*tilesPerThread, tileCount);
+    const uint lastTile = min(firstTile+tilesPerThread, tileCount);
+
+    uint threadSum = 0;
+    for (uint t=firstTile;t<lastTile;t++)
+        threadSum += u_TileLightGridRW[t].y;
+
+    s_ScanData[threadIndex] = threadSum;
+    GroupMemoryBarrierWithGroupSync();
+
+    // Inclusive scan of per-thread sums (Hillis-Steele).
+    for (uint offset=1;offset<c_ScanThreadCount;offset<<=1)
+    {
+        const uint addend = (threadIndex >= offset) ? s_ScanData[threadIndex-offset] : 0;
+        GroupMemoryBarrierWithGroupSync();
+        s_ScanData[threadIndex] += addend;
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    uint runningOffset = s_ScanData[threadIndex]-threadSum;
+    for (uint t=firstTile;t<lastTile;t++)
+    {
+        const uint count = u_TileLightGridRW[t].y;
+        u_TileLightGridRW[t] = uint2(runningOffset, count);
+        runningOffset += count;
+    }
+
+    if (threadIndex == c_ScanThreadCount-1)
+        u_TileLightGridRW[tileCount] = uint2(s_ScanData[threadIndex], 0); // Total list size, read back by the CPU to grow the list
+}
+
+[numthreads(c_LightTileWidth, c_LightTileHeight, 1)]
+void CSWriteLights(uint2 dispatchThreadId : SV_DispatchThreadID, uint threadIndex : SV_GroupIndex, uint2 groupId : SV_GroupID)
+{
+    const uint tileIndex = groupId.y*g_Inline.lightTilesX + groupId.x;
+    const uint2 tileOffsetAndCount = t_TileLightGrid[tileIndex];
+    if (tileOffsetAndCount.y == 0)
+        return; // Uniform for the whole group
+
+    uint listCapacity, listStride;
+    u_LightListRW.GetDimensions(listCapacity, listStride);
+
+    LoadTile(dispatchThreadId, threadIndex);
+
+    // Slots are allocated once per wave, so the order of lights within a tile can vary between frames.
+    // This is harmless since the contributions of all lights are summed up.
+    for (uint base=0;base<g_Inline.lightCount;base+=c_LightTilePixelCount)
+    {
+        const uint i = base+threadIndex;
+        const bool lightIsRelevant = (i < g_Inline.lightCount) && LightAffectsTile(t_LightData[i]);
+
+        const uint waveRelevantCount = WaveActiveCountBits(lightIsRelevant);
+        uint waveSlot = 0;
+        if (WaveIsFirstLane() && (waveRelevantCount > 0))
+            InterlockedAdd(s_TileLightCount, waveRelevantCount, waveSlot);
+        waveSlot = WaveReadLaneFirst(waveSlot);
+
+        const uint slot = tileOffsetAndCount.x + waveSlot + WavePrefixCountBits(lightIsRelevant);
+        if (lightIsRelevant && (slot < listCapacity))
+            u_LightListRW[slot] = i;
+    }
+}
@@ -20,7 +20,13 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
-static const uint c_MaxLightsPerTile = 64; // This value must match DeferredShadingParam_MaxLightsPerTile defined in work_graphs_d3d12.cpp
+// Only the work graph records carry a fixed-size light list. The Dispatch path uses uncapped per-tile light lists (see light_culling.hlsl).
+static const uint c_MaxLightsPerTile = 64;
+
+// Screen tile dimensions used by light culling and deferred shading. These values must match DeferredShadingParam_TileWidth/Height defined in tiled_deferred_renderer.h
+static const uint c_LightTileWidth = 8;
+static const uint c_LightTileHeight = 4;
+static const uint c_LightTilePixelCount = c_LightTileWidth*c_LightTileHeight;
 
 float3 Unproject(uint2 pixelXY, float depth)
 {
@@ -29,10 +35,8 @@ float3 Unproject(uint2 pixelXY, float depth)
     return worldSpacePos.xyz / worldSpacePos.w;
 }
 
-bool PointInSpotLight(uint2 pixelXY, float depth, Light light)
+bool PositionInSpotLight(float3 worldPosition, Light light)
 {
-    const float3 worldPosition = Unproject(pixelXY, depth);
-
     const float3 lightTarget = light.target+light.targetOffset;
     const float lightLengthSq = dot(lightTarget-light.position, lightTarget-light.position);
     const float3 lightDir = (lightTarget-light.position);
@@ -43,6 +47,20 @@ bool PointInSpotLight(uint2 pixelXY, float depth, Light light)
     return (cosAlpha >= cosOuterAngle) && (dot(lightToPoint, lightToPoint) <= lightLengthSq);
 }
 
+bool PointInSpotLight(uint2 pixelXY, float depth, Light light)
+{
+    return PositionInSpotLight(Unproject(pixelXY, depth), light);
+}
+
+// Conservative test of the light's bounding sphere against a world-space box.
+bool SpotLightIntersectsBox(Light light, float3 boxMin, float3 boxMax)
+{
+    const float3 lightTarget = light.target+light.targetOffset;
+    const float lightLengthSq = dot(lightTarget-light.position, lightTarget-light.position);
+    const float3 closestPoint = clamp(light.position, boxMin, boxMax);
+    return dot(closestPoint-light.position, closestPoint-light.position) <= lightLengthSq;
+}
+
 void EvaluateSpotLight(Light light, float3 worldPosition, out float3 outDirection, out float3 outColor, out float outAttenuation)
 {
     const float3 lightTarget = light.target+light.targetOffset;
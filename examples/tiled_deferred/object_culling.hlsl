@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include "scene_data.hlsli"
+
+// Frustum culling of the animated scene objects. Visible objects are appended to a list with one region per mesh type,
+// and the instance count of that mesh type's indexed indirect draw is incremented. The draw arguments are reset
+// by the CPU every frame, and also hold the offset of the mesh type's region in the visible object list.
+
+// These are root 32-bit values (push constants)
+struct CullingConstants
+{
+    uint objectCount;
+    uint cullingEnabled;
+};
+VK_PUSH_CONSTANT ConstantBuffer<CullingConstants> g_Inline : register(b0);
+
+StructuredBuffer<Instance> t_InstanceData : register(t0);
+StructuredBuffer<AnimState> t_AnimStateData : register(t4);
+RWStructuredBuffer<uint> u_DrawArgs : register(u0);
+RWStructuredBuffer<uint> u_VisibleObjects : register(u2);
+
+// Layout of the per mesh type draw arguments, in uints. Ensure these values are matched with TiledDeferredRenderer::ObjectDrawArgs in tiled_deferred_renderer.h.
+static const uint c_ObjectDrawArgsStride = 8;
+static const uint c_ObjectDrawArgsInstanceCount = 1;
+static const uint c_ObjectDrawArgsVisibleListOffset = 5;
+
+bool SphereInFrustum(float3 center, float radius)
+{
+    // Frustum planes extracted from the view-projection matrix columns. D3D-style projection, so the near plane is z >= 0.
+    const float4x4 m = transpose(viewProj);
+    const float4 planes[6] = { m[3]+m[0], m[3]-m[0], m[3]+m[1], m[3]-m[1], m[2], m[3]-m[2] };
+
+    [unroll]
+    for (uint i=0;i<6;i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius*length(planes[i].xyz))
+            return false;
+    }
+    return true;
+}
+
+[numthreads(32, 1, 1)]
+void CSMain(uint2 dispatchThreadId : SV_DispatchThreadID)
+{
+    const uint objectIndex = dispatchThreadId.y*0xFFFF*32 + dispatchThreadId.x;
+    if (objectIndex >= g_Inline.objectCount)
+        return;
+
+    const Instance instanceData = t_InstanceData[objectIndex];
+    const AnimState animStateData = t_AnimStateData[objectIndex];
+
+    // All meshes fit in a unit cube centered at the origin. Rotation and twist are around the Y axis, so they never move
+    // vertices out of the sphere enclosing the scaled cube. Same transform as gbuffer_fill.hlsl.
+    const float3 scale = instanceData.size*animStateData.scale;
+    const float3 center = instanceData.position+float3(0,(scale.y-instanceData.size.y)*0.5f+animStateData.offsetY,0);
+    const float radius = length(scale)*0.5f;
+
+    if (g_Inline.cullingEnabled && !SphereInFrustum(center, radius))
+        return;
+
+    // Only visible objects are left in the wave. Allocate their list slots with one atomic per mesh type found in the wave.
+    const uint meshType = instanceData.meshType;
+    for (;;)
+    {
+        const uint waveMeshType = WaveReadLaneFirst(meshType);
+        if (waveMeshType == meshType)
+        {
+            const uint argsBase = meshType*c_ObjectDrawArgsStride;
+            const uint waveVisibleCount = WaveActiveCountBits(true);
+            uint waveSlot = 0;
+            if (WaveIsFirstLane())
+                InterlockedAdd(u_DrawArgs[argsBase+c_ObjectDrawArgsInstanceCount], waveVisibleCount, waveSlot);
+            waveSlot = WaveReadLaneFirst(waveSlot);
+
+            const uint slot = u_DrawArgs[argsBase+c_ObjectDrawArgsVisibleListOffset] + waveSlot + WavePrefixCountBits(true);
+            u_VisibleObjects[slot] = objectIndex;
+            break;
+        }
+    }
+}
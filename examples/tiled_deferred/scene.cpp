@@ -0,0 +1,745 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/utils.h>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "scene.h"
+#include "parallel_for.h"
+
+using namespace donut::math;
+
+// Below is a list of constants that can be used to control scene generation.
+
+// Scene size, population and mesh density presets (control scene dimensions, number of objects, lights and materials,
+// and vertex processing cost). Presets can be selected and overridden from the command line, e.g. for a million objects:
+//   -preset 0 -floors 10 -floorSize 3200 -objectRoomSize 10
+// The light culling pass builds uncapped per-tile light lists, so presets can push tens of thousands of lights.
+static const float SceneParam_FloorToCeilingHeight = 70;
+static const float SceneParam_BallSize = 15;
+static const Scene::ScaleParams SceneParam_Presets[(int)Scene::Preset::SP_COUNT] =
+{
+	// floors, floorSize, objectRoomSize, ballRoomSize, lightsPerBall, lightRange, lightOrbitRadius, materialCountOfEachType, boxSubdivisions, sphereSides, sphereSlices, optimizeVertexCache, seed
+	{ 3,  500, 50, 120,  3, 175, 300, 10, 100, 100, 50, 1, 0 }, // SP_Default: 144 lights.
+	{ 3,  500, 50,  40, 24,  80, 120, 10, 100, 100, 50, 1, 0 }, // SP_ManyLights: 10368 lights.
+	{ 4, 1000, 50,  40, 20,  60,  80, 10, 100, 100, 50, 1, 0 }, // SP_ExtremeLights: 50000 lights.
+};
+static const char* SceneParam_PresetNames[(int)Scene::Preset::SP_COUNT] =
+{
+	"Default",
+	"Many Lights",
+	"Extreme Lights",
+};
+
+// Upper bounds of the mesh density parameters.
+static const uint32_t SceneParam_MaxBoxSubdivisions = 1024;
+static const uint64_t SceneParam_MaxSphereSidesTimesSlices = 1 << 22;
+
+// Width of the vertical strips used when emitting grid triangles in vertex-cache friendly order.
+static const uint32_t SceneParam_VertexCacheStripWidth = 12;
+
+// Materials visual look.
+static const float3 SceneParam_GroundColor = {0.5f,0.5f,0.5f};
+static const float SceneParam_PhongSpecularColorScale = 0.05f;
+static const float SceneParam_PhongSpecularPowerMin = 15.0f;
+static const float SceneParam_PhongSpecularPowerRange = 25.0f;
+static const float SceneParam_VelvetRoughnessMin = 0.45f;
+static const float SceneParam_VelvetRoughnessRange = 0.1f;
+static const float SceneParam_FlakesSpecularColorScale = 0.05f;
+static const float SceneParam_FlakesSpecularPowerMin = 15.0f;
+static const float SceneParam_FlakesSpecularPowerRange = 25.0f;
+static const float SceneParam_FlakesGranularityMin = 0.3f;
+static const float SceneParam_FlakesGranularityRange = 0.1f;
+static const float SceneParam_StanLineThicknessMin = 0.2f;
+static const float SceneParam_StanLineThicknessRange = 0.4f;
+static const float SceneParam_StanLineSpacingMin = 1.0f;
+static const float SceneParam_StanLineSpacingRange = 3.0f;
+static const float SceneParam_CheckersSize = 4.0f;
+static const float SceneParam_CheckersSpecularPowerMin = 15.0f;
+static const float SceneParam_CheckersSpecularPowerRange = 25.0f;
+
+// All math and coordinate systems are left-handed.
+struct MESH_SIZE
+{
+	uint32_t vertexCount;
+	uint32_t indexCount;
+};
+
+// Writes interleaved position/normal vertices and indices straight into mapped upload memory.
+// Indices are 16-bit when the mesh fits, 32-bit otherwise.
+struct MESH_WRITER
+{
+	float3* vertices = nullptr; // Interleaved position and normal.
+	void* indices = nullptr;
+	bool use32BitIndices = false;
+	bool optimizeVertexCache = false;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+
+	uint32_t AddVertex(const float3& position,const float3& normal)
+	{
+		vertices[vertexCount*2+0] = position;
+		vertices[vertexCount*2+1] = normal;
+		return vertexCount++;
+	}
+
+	void AddTriangle(uint32_t i0,uint32_t i1,uint32_t i2)
+	{
+		if (use32BitIndices)
+		{
+			uint32_t* dst = (uint32_t*)indices + indexCount;
+			dst[0] = i0; dst[1] = i1; dst[2] = i2;
+		}
+		else
+		{
+			uint16_t* dst = (uint16_t*)indices + indexCount;
+			dst[0] = (uint16_t)i0; dst[1] = (uint16_t)i1; dst[2] = (uint16_t)i2;
+		}
+		indexCount += 3;
+	}
+};
+
+// Counter-based random number generator. A stream is identified by a key derived from the scene seed and the
+// location being generated (e.g. floor and room), and the n-th number of a stream only depends on the key and n.
+// This makes the generated content independent of generation order and of the C runtime, so floors and rooms
+// can be generated in parallel with bit-identical results on all platforms.
+class SceneRandom
+{
+public:
+	SceneRandom(uint32_t seed,uint32_t stream0,uint32_t stream1=0,uint32_t stream2=0,uint32_t stream3=0)
+	{
+		m_key = Mix(Mix(Mix(Mix(Mix(seed)^stream0)^stream1)^stream2)^stream3);
+	}
+
+	uint32_t NextUInt() { return (uint32_t)(Mix(m_key+m_counter++) >> 32); }
+	float Next01() { return (NextUInt() >> 8) * (1.0f/(float)0xFFFFFF); } // Within [0,1], exactly representable steps.
+
+private:
+	static uint64_t Mix(uint64_t x)
+	{
+		// SplitMix64 finalizer.
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	uint64_t m_key = 0;
+	uint64_t m_counter = 0;
+};
+
+// Stream identifiers for the different parts of the world.
+enum SceneRandomStream : uint32_t
+{
+	SRS_Materials,
+	SRS_BallRoom,
+	SRS_ObjectRoom,
+};
+
+static float3 RandomPosXZ(SceneRandom& rng,float extentsX,float y,float extentsZ);
+static float3 RandomSize(SceneRandom& rng,float height,float size,float heightVariation,float sizeVariation);
+static float3 RandomColor(SceneRandom& rng,bool normalized);
+static float Random01(SceneRandom& rng);
+static float RandomAngle(SceneRandom& rng);
+static MESH_SIZE GetPlaneSize();
+static MESH_SIZE GetBoxSize(uint32_t faceSubdivisions);
+static MESH_SIZE GetSphereSize(uint32_t sides,uint32_t slices);
+static void GeneratePlane(MESH_WRITER& outMesh);
+static void GenerateBox(uint32_t faceSubdivisions,MESH_WRITER& outMesh);
+static void GenerateSphere(uint32_t sides,uint32_t slices,MESH_WRITER& outMesh);
+
+const char* Scene::GetPresetName(Preset preset)
+{
+	return SceneParam_PresetNames[(int)preset];
+}
+
+const Scene::ScaleParams& Scene::GetPresetParams(Preset preset)
+{
+	return SceneParam_Presets[(int)preset];
+}
+
+bool Scene::ParseCommandLine(int argc,const char* const* argv,Preset& outPreset,ScaleParams& outParams)
+{
+	// The preset is applied first, so that individual values can override it regardless of argument order.
+	for (int i=1;i<argc-1;i++)
+	{
+		if (strcmp(argv[i], "-preset") == 0)
+		{
+			const int preset = atoi(argv[i+1]);
+			if (preset < 0 || preset >= (int)Preset::SP_COUNT)
+			{
+				donut::log::error("Invalid scene preset %d, expected a value between 0 and %d", preset, (int)Preset::SP_COUNT-1);
+				return false;
+			}
+			outPreset = (Preset)preset;
+		}
+	}
+	outParams = GetPresetParams(outPreset);
+
+	return ApplyCommandLineOverrides(argc, argv, outParams);
+}
+
+bool Scene::ApplyCommandLineOverrides(int argc,const char* const* argv,ScaleParams& outParams)
+{
+	const struct { const char* name; uint32_t* uintValue; float* floatValue; } overrides[] =
+	{
+		{ "-floors", &outParams.floors, nullptr },
+		{ "-floorSize", nullptr, &outParams.floorSize },
+		{ "-objectRoomSize", nullptr, &outParams.objectRoomSize },
+		{ "-ballRoomSize", nullptr, &outParams.ballRoomSize },
+		{ "-lightsPerBall", &outParams.lightsPerBall, nullptr },
+		{ "-lightRange", nullptr, &outParams.lightRange },
+		{ "-lightOrbitRadius", nullptr, &outParams.lightOrbitRadius },
+		{ "-materialsPerType", &outParams.materialCountOfEachType, nullptr },
+		{ "-boxSubdivisions", &outParams.boxSubdivisions, nullptr },
+		{ "-sphereSides", &outParams.sphereSides, nullptr },
+		{ "-sphereSlices", &outParams.sphereSlices, nullptr },
+		{ "-optimizeVertexCache", &outParams.optimizeVertexCache, nullptr },
+		{ "-seed", &outParams.seed, nullptr },
+	};
+
+	for (int i=1;i<argc-1;i++)
+	{
+		for (const auto& item : overrides)
+		{
+			if (strcmp(argv[i], item.name) != 0)
+				continue;
+			if (item.uintValue)
+				*item.uintValue = (uint32_t)strtoul(argv[i+1], nullptr, 10);
+			else
+				*item.floatValue = (float)atof(argv[i+1]);
+		}
+	}
+
+	// The room counts are derived from the sizes, which must not be NaN for the comparisons below to hold.
+	bool finiteSizes = true;
+	for (const auto& item : overrides)
+		finiteSizes = finiteSizes && (!item.floatValue || std::isfinite(*item.floatValue));
+
+	// Every floor has a ground plane, at least one ball room with its lights and one object room, so none of the
+	// scene's buffers can be empty.
+	if (!finiteSizes || outParams.floors == 0 || outParams.lightsPerBall == 0 || outParams.materialCountOfEachType == 0 ||
+		outParams.floorSize < outParams.objectRoomSize || outParams.floorSize < outParams.ballRoomSize ||
+		outParams.objectRoomSize <= 0 || outParams.ballRoomSize <= SceneParam_BallSize ||
+		outParams.boxSubdivisions == 0 || outParams.sphereSides < 3 || outParams.sphereSlices < 2)
+	{
+		donut::log::error("Invalid scene parameters");
+		return false;
+	}
+
+	// Meshes switch to 32-bit indices when needed. The caps keep each mesh to about 4M vertices and 25M indices,
+	// around 100 MB for each of its buffers, which also keeps the counts well within 32 bits.
+	if (outParams.boxSubdivisions > SceneParam_MaxBoxSubdivisions ||
+		uint64_t(outParams.sphereSides)*outParams.sphereSlices > SceneParam_MaxSphereSidesTimesSlices)
+	{
+		donut::log::error("Mesh density is too high");
+		return false;
+	}
+
+	return true;
+}
+
+void Scene::CreateAssets(nvrhi::IDevice *device,nvrhi::ICommandList *commandList,const ScaleParams& params)
+{
+	m_params = params;
+
+	// Create GPU buffers for the meshes. Mesh sizes are known up front, so the generators write straight
+	// into mapped upload buffers, which are then copied to the GPU buffers.
+	const MESH_SIZE meshSizes[(int)MeshType::MT_COUNT] =
+	{
+		GetPlaneSize(),
+		GetBoxSize(m_params.boxSubdivisions),
+		GetSphereSize(m_params.sphereSides, m_params.sphereSlices),
+	};
+
+	MESH_WRITER meshWriters[(int)MeshType::MT_COUNT];
+	nvrhi::BufferHandle vertexUploadBuffers[(int)MeshType::MT_COUNT];
+	nvrhi::BufferHandle indexUploadBuffers[(int)MeshType::MT_COUNT];
+	for (int i=0;i<(int)MeshType::MT_COUNT;i++)
+	{
+		const MESH_SIZE& meshSize = meshSizes[i];
+		const bool use32BitIndices = (meshSize.vertexCount > 0xFFFF);
+
+		// Interleave position and normal information in the vertex buffer
+		const uint64_t vertexBufferSize = uint64_t(meshSize.vertexCount) * sizeof(float3) * 2;
+		const uint64_t indexBufferSize = uint64_t(meshSize.indexCount) * (use32BitIndices ? sizeof(uint32_t) : sizeof(uint16_t));
+
+		m_vertexBuffers[i] = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(vertexBufferSize).
+			setIsVertexBuffer(true).
+			setInitialState(nvrhi::ResourceStates::VertexBuffer).
+			setKeepInitialState(true).
+			setDebugName("MeshVB"));
+
+		m_indexBuffers[i] = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(indexBufferSize).
+			setIsIndexBuffer(true).
+			setInitialState(nvrhi::ResourceStates::IndexBuffer).
+			setKeepInitialState(true).
+			setDebugName("MeshIB"));
+
+		m_indexFormats[i] = use32BitIndices ? nvrhi::Format::R32_UINT : nvrhi::Format::R16_UINT;
+		m_indexCounts[i] = meshSize.indexCount;
+
+		vertexUploadBuffers[i] = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(vertexBufferSize).
+			setCpuAccess(nvrhi::CpuAccessMode::Write).
+			setInitialState(nvrhi::ResourceStates::CopySource).
+			setKeepInitialState(true).
+			setDebugName("MeshVBUpload"));
+
+		indexUploadBuffers[i] = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(indexBufferSize).
+			setCpuAccess(nvrhi::CpuAccessMode::Write).
+			setInitialState(nvrhi::ResourceStates::CopySource).
+			setKeepInitialState(true).
+			setDebugName("MeshIBUpload"));
+
+		MESH_WRITER& writer = meshWriters[i];
+		writer.vertices = (float3*)device->mapBuffer(vertexUploadBuffers[i], nvrhi::CpuAccessMode::Write);
+		writer.indices = device->mapBuffer(indexUploadBuffers[i], nvrhi::CpuAccessMode::Write);
+		writer.use32BitIndices = use32BitIndices;
+		writer.optimizeVertexCache = (m_params.optimizeVertexCache != 0);
+	}
+
+	const auto generationStart = std::chrono::high_resolution_clock::now();
+
+	// Generate geometry data. Each mesh is generated on its own thread while the world is populated.
+	std::thread meshThreads[] =
+	{
+		std::thread([&]() { GeneratePlane(meshWriters[(int)MeshType::MT_Plane]); }),
+		std::thread([&]() { GenerateBox(m_params.boxSubdivisions, meshWriters[(int)MeshType::MT_Box]); }),
+		std::thread([&]() { GenerateSphere(m_params.sphereSides, m_params.sphereSlices, meshWriters[(int)MeshType::MT_Sphere]); }),
+	};
+
+	PopulateWorld();
+	assert(!m_materials.empty() && !m_worldObjects.empty() && !m_lights.empty());
+
+	for (std::thread& thread : meshThreads)
+		thread.join();
+
+	const auto generationEnd = std::chrono::high_resolution_clock::now();
+	donut::log::info("Scene generated in %.2f ms: %zu objects, %zu lights, %zu materials, %u box vertices, %u sphere vertices",
+		std::chrono::duration<double,std::milli>(generationEnd-generationStart).count(),
+		m_worldObjects.size(), m_lights.size(), m_materials.size(),
+		meshSizes[(int)MeshType::MT_Box].vertexCount, meshSizes[(int)MeshType::MT_Sphere].vertexCount);
+
+	// Record upload data commands.
+	for (int i=0;i<(int)MeshType::MT_COUNT;i++)
+	{
+		assert(meshWriters[i].vertexCount == meshSizes[i].vertexCount);
+		assert(meshWriters[i].indexCount == meshSizes[i].indexCount);
+
+		device->unmapBuffer(vertexUploadBuffers[i]);
+		device->unmapBuffer(indexUploadBuffers[i]);
+
+		commandList->copyBuffer(m_vertexBuffers[i], 0, vertexUploadBuffers[i], 0, m_vertexBuffers[i]->getDesc().byteSize);
+		commandList->copyBuffer(m_indexBuffers[i], 0, indexUploadBuffers[i], 0, m_indexBuffers[i]->getDesc().byteSize);
+	}
+
+	// Materials data.
+	{
+		const uint64_t materialDataBufferSize = m_materials.size() * sizeof(Material);
+
+		m_materialDataBuffer = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(materialDataBufferSize).
+			setCanHaveTypedViews(true).
+			setStructStride(sizeof(Material)).
+			setInitialState(nvrhi::ResourceStates::ShaderResource).
+			setKeepInitialState(true).
+			setDebugName("MaterialsData"));
+
+		commandList->writeBuffer(m_materialDataBuffer, &m_materials[0], materialDataBufferSize);
+	}
+
+	// Instances data.
+	{
+		const uint64_t instanceDataBufferSize = m_worldObjects.size() * sizeof(Instance);
+
+		m_instanceDataBuffer = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(instanceDataBufferSize).
+			setCanHaveTypedViews(true).
+			setStructStride(sizeof(Instance)).
+			setInitialState(nvrhi::ResourceStates::ShaderResource).
+			setKeepInitialState(true).
+			setDebugName("InstancesData"));
+
+		commandList->writeBuffer(m_instanceDataBuffer, &m_worldObjects[0], instanceDataBufferSize);
+	}
+
+	// Lights data.
+	{
+		const uint64_t lightDataBufferSize = m_lights.size() * sizeof(Light);
+
+		m_lightDataBuffer = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(lightDataBufferSize).
+			setCanHaveUAVs(true).
+			setCanHaveTypedViews(true).
+			setStructStride(sizeof(Light)).
+			setInitialState(nvrhi::ResourceStates::UnorderedAccess).
+			setKeepInitialState(true).
+			setDebugName("LightsData"));
+
+		commandList->writeBuffer(m_lightDataBuffer, &m_lights[0], lightDataBufferSize);
+	}
+
+	// Animation data.
+	{
+		const uint64_t animStateBufferSize = m_worldObjects.size() * sizeof(AnimState);
+
+		m_animStateBuffer = device->createBuffer(
+			nvrhi::BufferDesc().setByteSize(animStateBufferSize).
+			setCanHaveUAVs(true).
+			setCanHaveTypedViews(true).
+			setStructStride(sizeof(AnimState)).
+			setInitialState(nvrhi::ResourceStates::UnorderedAccess).
+			setKeepInitialState(true).
+			setDebugName("AnimState"));
+	}
+}
+
+float Scene::GetSceneSize() const
+{
+	return m_params.floorSize;
+}
+
+float Scene::GetSceneHeight() const
+{
+	return SceneParam_FloorToCeilingHeight * m_params.floors;
+}
+
+void Scene::PopulateWorld()
+{
+	// Generate materials. This is a small sequential stream.
+	{
+		SceneRandom rng(m_params.seed, SRS_Materials);
+		const uint32_t countOfEachType = m_params.materialCountOfEachType;
+
+		m_materials.reserve(2 + countOfEachType*7);
+		m_materials.push_back(Material { SceneParam_GroundColor, MaterialType::BT_Lambert }); // Material 0 is lambert.
+		m_materials.push_back(Material { {1,1,1}, MaterialType::BT_Faceted }); // Material 1 is faceted.
+
+		// Lamberts.
+		for (uint32_t i=0;i<countOfEachType;i++)
+			m_materials.push_back(Material { RandomColor(rng,true), MaterialType::BT_Lambert });
+
+		// Phongs.
+		for (uint32_t i=0;i<countOfEachType;i++)
+		{
+			Material mat = { RandomColor(rng,true), MaterialType::BT_Phong };
+			mat.phong.specularColor = RandomColor(rng,true);
+			mat.phong.specularColor = mat.phong.specularColor * SceneParam_PhongSpecularColorScale;
+			mat.phong.specularPower = Random01(rng) * SceneParam_PhongSpecularPowerRange + SceneParam_PhongSpecularPowerMin;
+			m_materials.push_back(mat);
+		}
+
+		// Metallics.
+		for (uint32_t i=0;i<countOfEachType;i++)
+			m_materials.push_back(Material { RandomColor(rng,true), MaterialType::BT_Metallic });
+
+		// Velvets.
+		for (uint32_t i=0;i<countOfEachType;i++)
+		{
+			Material mat = { RandomColor(rng,true), MaterialType::BT_Velvet };
+			mat.velvet.roughness = Random01(rng) * SceneParam_VelvetRoughnessRange + SceneParam_VelvetRoughnessMin;
+			m_materials.push_back(mat);
+		}
+
+		// Flakes.
+		for (uint32_t i=0;i<countOfEachType;i++)
+		{
+			Material mat = { RandomColor(rng,true), MaterialType::BT_Flakes };
+			mat.flakes.specularColor = RandomColor(rng,true);
+			mat.phong.specularColor = mat.phong.specularColor * SceneParam_FlakesSpecularColorScale;
+			mat.flakes.specularPower = Random01(rng) * SceneParam_FlakesSpecularPowerRange + SceneParam_FlakesSpecularPowerMin;
+			mat.flakes.granularity = Random01(rng) * SceneParam_FlakesGranularityRange + SceneParam_FlakesGranularityMin;
+			m_materials.push_back(mat);
+		}
+
+		// Stans.
+		for (uint32_t i=0;i<countOfEachType;i++)
+		{
+			Material mat = { RandomColor(rng,true), MaterialType::BT_Stan };
+			mat.stan.linesColor = RandomColor(rng,false);
+			mat.stan.linesThickness = Random01(rng) * SceneParam_StanLineThicknessRange + SceneParam_StanLineThicknessMin;
+			mat.stan.linesSpacing = Random01(rng) * SceneParam_StanLineSpacingRange + SceneParam_StanLineSpacingMin;
+			m_materials.push_back(mat);
+		}
+
+		// Checkers.
+		for (uint32_t i=0;i<countOfEachType;i++)
+		{
+			Material mat = { RandomColor(rng,true), MaterialType::BT_Checker };
+			mat.curvature.baseColor2 = RandomColor(rng,false);
+			mat.curvature.checkerSize = SceneParam_CheckersSize;
+			mat.curvature.specularPower = Random01(rng) * SceneParam_CheckersSpecularPowerRange + SceneParam_CheckersSpecularPowerMin;
+			m_materials.push_back(mat);
+		}
+	} // Materials
+
+	// Spawn multiple floors, each floor has a single plane, multiple glitter balls, and many cute dancers.
+	// Every floor has the same layout, so the location of each object and light in the output arrays is known up front.
+	// Rows of rooms are then generated in parallel, each room drawing from its own random stream.
+	const uint32_t ballRoomCount1D = (uint32_t)(m_params.floorSize / m_params.ballRoomSize);
+	const uint32_t objectRoomCount1D = (uint32_t)(m_params.floorSize / m_params.objectRoomSize);
+	const uint32_t ballsPerFloor = ballRoomCount1D*ballRoomCount1D;
+	const uint32_t objectsPerFloor = objectRoomCount1D*objectRoomCount1D;
+	const uint32_t instancesPerFloor = 1 + ballsPerFloor + objectsPerFloor; // Ground, balls, then objects.
+	const uint32_t lightsPerFloor = ballsPerFloor*m_params.lightsPerBall;
+	const uint32_t materialCount = (uint32_t)m_materials.size();
+
+	m_worldObjects.resize((size_t)instancesPerFloor*m_params.floors);
+	m_lights.resize((size_t)lightsPerFloor*m_params.floors);
+
+	// Ground.
+	for (uint32_t floor=0;floor<m_params.floors;floor++)
+	{
+		const float floorHeight = floor * SceneParam_FloorToCeilingHeight;
+		m_worldObjects[floor*instancesPerFloor] = Instance {{0,floorHeight,0}, 0, {m_params.floorSize,0,m_params.floorSize}, MeshType::MT_Plane, 0, AnimType::AT_Static };
+	}
+
+	// Multiple balls hung from the ceiling, emitting lights.
+	ParallelFor(m_params.floors*ballRoomCount1D, 0, [&](uint32_t row)
+	{
+		const uint32_t floor = row / ballRoomCount1D;
+		const uint32_t roomX = row % ballRoomCount1D;
+		const float ceilingHeight = (floor+1) * SceneParam_FloorToCeilingHeight;
+		const float ballHeight = ceilingHeight-SceneParam_BallSize*0.5f;
+
+		for (uint32_t roomZ=0;roomZ<ballRoomCount1D;roomZ++)
+		{
+			SceneRandom rng(m_params.seed, SRS_BallRoom, floor, roomX, roomZ);
+			const uint32_t ballIndex = roomX*ballRoomCount1D + roomZ;
+
+			const float roomCenterX = -m_params.floorSize*0.5f + roomX * m_params.ballRoomSize + m_params.ballRoomSize*0.5f;
+			const float roomCenterZ = -m_params.floorSize*0.5f + roomZ * m_params.ballRoomSize + m_params.ballRoomSize*0.5f;
+			float3 ballPos = RandomPosXZ(rng,(m_params.ballRoomSize-SceneParam_BallSize)*0.3f,ballHeight,(m_params.ballRoomSize-SceneParam_BallSize)*0.3f);
+			ballPos.x += roomCenterX;
+			ballPos.z += roomCenterZ;
+			m_worldObjects[floor*instancesPerFloor + 1 + ballIndex] = Instance {ballPos, RandomAngle(rng), {SceneParam_BallSize,SceneParam_BallSize,SceneParam_BallSize}, MeshType::MT_Sphere, 1, AnimType::AT_RotateY };
+
+			// From each ball, generate a few lights.
+			for (uint32_t light=0;light<m_params.lightsPerBall;light++)
+			{
+				const float3 dir = normalize(RandomSize(rng,-1,0,0.8f,2.0f));
+				const float length = Random01(rng) * m_params.lightRange + SceneParam_FloorToCeilingHeight;
+				const float3 tgt = {dir.x*length+ballPos.x, dir.y*length+ballPos.y, dir.z*length+ballPos.z};
+				float angle1 = RandomAngle(rng)*0.25f+0.25f; // Within 90-degree limit.
+				float angle2 = RandomAngle(rng)*0.25f+0.25f; // Within 90-degree limit.
+				const float innerAngle = min(angle1,angle2);
+				const float outerAngle = max(angle1,angle2)+RandomAngle(rng)*0.1f;
+
+				m_lights[floor*lightsPerFloor + ballIndex*m_params.lightsPerBall + light] = Light {ballPos, tgt, float3(0,0,0), RandomColor(rng,true), innerAngle, outerAngle, m_params.lightOrbitRadius};
+			}
+		}
+	});
+
+	// Many objects on the floor, sub-divide the plane into squares and place one object randomly within that square.
+	ParallelFor(m_params.floors*objectRoomCount1D, 0, [&](uint32_t row)
+	{
+		const uint32_t floor = row / objectRoomCount1D;
+		const uint32_t roomX = row % objectRoomCount1D;
+		const float floorHeight = floor * SceneParam_FloorToCeilingHeight;
+
+		for (uint32_t roomZ=0;roomZ<objectRoomCount1D;roomZ++)
+		{
+			SceneRandom rng(m_params.seed, SRS_ObjectRoom, floor, roomX, roomZ);
+
+			const float roomCenterX = -m_params.floorSize*0.5f + roomX * m_params.objectRoomSize + m_params.objectRoomSize*0.5f;
+			const float roomCenterZ = -m_params.floorSize*0.5f + roomZ * m_params.objectRoomSize + m_params.objectRoomSize*0.5f;
+
+			float3 size = RandomSize(rng,SceneParam_FloorToCeilingHeight*0.35f,m_params.objectRoomSize*0.20f,SceneParam_FloorToCeilingHeight*0.1f,m_params.objectRoomSize*0.05f);
+			float3 pos = RandomPosXZ(rng,(m_params.objectRoomSize-size.x)*0.5f,floorHeight+size.y*0.5f,(m_params.objectRoomSize-size.z)*0.5f);
+			pos.x += roomCenterX;
+			pos.y += 0.01f; // Counter z-fighting.
+			pos.z += roomCenterZ;
+			const uint32_t material = rng.NextUInt()%(materialCount-2)+2; // Skip the first two hard-coded materials.
+
+			m_worldObjects[floor*instancesPerFloor + 1 + ballsPerFloor + roomX*objectRoomCount1D + roomZ] = Instance {pos, RandomAngle(rng), size, MeshType::MT_Box, material, AnimType::AT_Dance };
+		}
+	});
+}
+
+#pragma region Randomization Functions
+static float3 RandomPosXZ(SceneRandom& rng,float extentsX,float y,float extentsZ)
+{
+	// Components are drawn in separate statements to keep the draw order defined.
+	const float x = (rng.Next01()-0.5f)*extentsX*2.0f;
+	const float z = (rng.Next01()-0.5f)*extentsZ*2.0f;
+	return float3 { x, y, z };
+};
+
+static float3 RandomSize(SceneRandom& rng,float height,float size,float heightVariation,float sizeVariation)
+{
+	const float x = size + (rng.Next01()-0.5f)*sizeVariation;
+	const float y = height + (rng.Next01()-0.5f)*heightVariation;
+	const float z = size + (rng.Next01()-0.5f)*sizeVariation;
+	return float3 { x, y, z };
+}
+
+static float3 RandomColor(SceneRandom& rng,bool normalized)
+{
+	const float r = rng.Next01();
+	const float g = rng.Next01();
+	const float b = rng.Next01();
+	const float3 clr = float3 { r, g, b };
+	return normalized ? normalize(clr) : clr;
+}
+
+static float Random01(SceneRandom& rng)
+{
+	return rng.Next01();
+}
+
+static float RandomAngle(SceneRandom& rng)
+{
+	return rng.Next01()*PI_f*2.0f;
+};
+#pragma endregion
+
+#pragma region Geometry generation
+static MESH_SIZE GetPlaneSize()
+{
+	return MESH_SIZE { 8, 12 };
+}
+
+static MESH_SIZE GetBoxSize(uint32_t faceSubdivisions)
+{
+	return MESH_SIZE { (faceSubdivisions+1)*(faceSubdivisions+1)*4+8, faceSubdivisions*faceSubdivisions*4*6+12 };
+}
+
+static MESH_SIZE GetSphereSize(uint32_t sides,uint32_t slices)
+{
+	return MESH_SIZE { sides*(slices-1)+2, sides*3*2 + (slices-2)*sides*6 };
+}
+
+// Emits two triangles per cell of a grid of vertices. Row-major order walks full rows, so for dense grids the row
+// of vertices shared with the next row has been evicted from the post-transform vertex cache by the time it is reused.
+// The optimized order walks the grid in vertical strips narrow enough for the previous row to still be cached.
+// That also keeps consecutive triangles spatially compact, which is what meshlet partitioning needs.
+template <typename VertexIndexFunc>
+static void GenerateGridTriangles(uint32_t columns,uint32_t rows,const VertexIndexFunc& vertexIndex,MESH_WRITER& outMesh)
+{
+	const uint32_t stripWidth = outMesh.optimizeVertexCache ? SceneParam_VertexCacheStripWidth : columns;
+	for (uint32_t stripStart=0;stripStart<columns;stripStart+=stripWidth)
+	{
+		const uint32_t stripEnd = min(stripStart+stripWidth, columns);
+		for (uint32_t y=0;y<rows;y++)
+		for (uint32_t x=stripStart;x<stripEnd;x++)
+		{
+			outMesh.AddTriangle(vertexIndex(x,y), vertexIndex(x,y+1), vertexIndex(x+1,y+1));
+			outMesh.AddTriangle(vertexIndex(x+1,y+1), vertexIndex(x+1,y), vertexIndex(x,y));
+		}
+	}
+}
+
+static void GeneratePlaneInternal(float y,float sign,MESH_WRITER& outMesh)
+{
+	const float3 pos[] = { {-0.5f*sign,y,-0.5f},{-0.5f*sign,y,0.5f},{0.5f*sign,y,0.5f},{0.5f*sign,y,-0.5f} };
+	const float3 nrm = {0,sign,0};
+
+	const uint32_t baseVtx = outMesh.vertexCount;
+	for (const float3& p : pos)
+		outMesh.AddVertex(p,nrm);
+
+	outMesh.AddTriangle(baseVtx+0,baseVtx+1,baseVtx+2);
+	outMesh.AddTriangle(baseVtx+2,baseVtx+3,baseVtx+0);
+}
+
+static void GeneratePlane(MESH_WRITER& outMesh)
+{
+	GeneratePlaneInternal(0, 1,outMesh);
+	GeneratePlaneInternal(0,-1,outMesh);
+}
+
+static void GenerateBox(uint32_t faceSubdivisions,MESH_WRITER& outMesh)
+{
+	auto GenerateSide = [&](int coord0,int coord1,const float3 posInit,const float3 nrm,float sign)
+	{
+		const uint32_t baseVtx = outMesh.vertexCount;
+		float pos[] = {posInit.x,posInit.y,posInit.z};
+		for (uint32_t y=0;y<faceSubdivisions+1;y++)
+		{
+			pos[coord1] = (y/(float)faceSubdivisions-0.5f);
+			for (uint32_t x=0;x<faceSubdivisions+1;x++)
+			{
+				pos[coord0] = (x/(float)faceSubdivisions-0.5f)*sign;
+				outMesh.AddVertex({pos[0],pos[1],pos[2]},nrm);
+			}
+		}
+
+		GenerateGridTriangles(faceSubdivisions,faceSubdivisions,
+			[&](uint32_t x,uint32_t y) { return baseVtx+y*(faceSubdivisions+1)+x; },
+			outMesh);
+	};
+
+	GenerateSide(0,1,{0,0,-0.5f},{0,0,-1}, 1); // Front side.
+	GenerateSide(2,1,{ 0.5f,0,0},{ 1,0,0}, 1); // Right side.
+	GenerateSide(0,1,{0,0, 0.5f},{0,0, 1},-1); // Back side.
+	GenerateSide(2,1,{-0.5f,0,0},{-1,0,0},-1); // Left side.
+	GeneratePlaneInternal(0.5f,1,outMesh); // Top side.
+	GeneratePlaneInternal(-0.5f,-1,outMesh); // Bottom side.
+}
+
+static void GenerateSphere(uint32_t sides,uint32_t slices,MESH_WRITER& outMesh)
+{
+	assert(sides >= 3);
+	assert(slices >= 2);
+	const uint32_t baseVtx = outMesh.vertexCount;
+
+	outMesh.AddVertex({0,-0.5f,0},{0,-1,0}); // Bottom vertex.
+	for (uint32_t y=1;y<slices;y++) // Trunk vertices.
+	{
+		float3 pos = {0,y/(float)slices-0.5f,0};
+		const float ringRadius = sqrtf(1-pos.y*pos.y*4.0f)*0.5f;
+		for (uint32_t x=0;x<sides;x++)
+		{
+			const float angle = (x/(float)sides) * PI_f*2.0f;
+			pos.x = cosf(angle)*ringRadius;
+			pos.z = sinf(angle)*ringRadius;
+			outMesh.AddVertex(pos,normalize(pos));
+		}
+	}
+	const uint32_t capVtx = outMesh.AddVertex({0,0.5f,0},{0,1,0}); // Top vertex.
+
+	// Bottom cap.
+	for (uint32_t i=0;i<sides;i++)
+		outMesh.AddTriangle(baseVtx+0,baseVtx+1+i,baseVtx+1+(i+1)%sides);
+
+	// Trunk. The grid wraps around horizontally.
+	GenerateGridTriangles(sides,slices-2,
+		[&](uint32_t x,uint32_t y) { return baseVtx+1+y*sides+x%sides; },
+		outMesh);
+
+	// Top cap.
+	const uint32_t capBaseVtx = baseVtx+1+(slices-2)*sides;
+	for (uint32_t i=0;i<sides;i++)
+		outMesh.AddTriangle(capBaseVtx+i,capVtx,capBaseVtx+(i+1)%sides);
+}
+#pragma endregion
\ No newline at end of file
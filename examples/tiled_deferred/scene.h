@@ -42,6 +42,33 @@ public:
 		MT_COUNT
 	};
 
+	enum class Preset : uint32_t
+	{
+		SP_Default,
+		SP_ManyLights,
+		SP_ExtremeLights,
+		SP_COUNT
+	};
+
+	// Scene dimensions, population and mesh density. Presets are defined at the top of scene.cpp,
+	// and each value can be overridden from the command line (see ParseCommandLine).
+	struct ScaleParams
+	{
+		uint32_t floors;
+		float floorSize; // Larger means more objects and lights.
+		float objectRoomSize;
+		float ballRoomSize;
+		uint32_t lightsPerBall;
+		float lightRange; // Maximum extra length of a light beyond the floor-to-ceiling height.
+		float lightOrbitRadius; // Maximum radius of the animated light target offset.
+		uint32_t materialCountOfEachType;
+		uint32_t boxSubdivisions;
+		uint32_t sphereSides;
+		uint32_t sphereSlices;
+		uint32_t optimizeVertexCache; // Non-zero to emit mesh indices in vertex-cache friendly order.
+		uint32_t seed; // World content only depends on this seed and the values above.
+	};
+
 	enum class MaterialType : uint32_t
 	{
 		BT_Lambert,
@@ -115,6 +142,7 @@ public:
 		dm::float3 color;
 		float innerAngle;
 		float outerAngle;
+		float orbitRadius;
 	};
 
 	struct AnimState
@@ -130,7 +158,12 @@ public:
 		float twist;
 	};
 
-	void CreateAssets(nvrhi::IDevice *device,nvrhi::ICommandList *commandList);
+	static const char* GetPresetName(Preset preset);
+	static const ScaleParams& GetPresetParams(Preset preset);
+	static bool ParseCommandLine(int argc, const char* const* argv, Preset& outPreset, ScaleParams& outParams);
+	static bool ApplyCommandLineOverrides(int argc, const char* const* argv, ScaleParams& outParams); // Applies everything but -preset.
+
+	void CreateAssets(nvrhi::IDevice *device,nvrhi::ICommandList *commandList,const ScaleParams& params);
 
 	const std::vector<Material>& GetMaterials() const { return m_materials; }
 	const std::vector<Instance>& GetWorldObjects() const { return m_worldObjects; }
@@ -141,15 +174,21 @@ public:
 	nvrhi::BufferHandle GetAnimStateBuffer() const { return m_animStateBuffer; }
 	nvrhi::BufferHandle GetMeshVertexBuffer(MeshType meshType) const { return m_vertexBuffers[(int)meshType]; }
 	nvrhi::BufferHandle GetMeshIndexBuffer(MeshType meshType) const { return m_indexBuffers[(int)meshType]; }
+	nvrhi::Format GetMeshIndexFormat(MeshType meshType) const { return m_indexFormats[(int)meshType]; }
+	uint32_t GetMeshIndexCount(MeshType meshType) const { return m_indexCounts[(int)meshType]; }
 
-	static float GetSceneSize();
-	static float GetSceneHeight();
+	float GetSceneSize() const;
+	float GetSceneHeight() const;
 
 protected:
 	void PopulateWorld();
 
+	ScaleParams m_params = {};
+
 	nvrhi::BufferHandle m_vertexBuffers[(int)MeshType::MT_COUNT];
 	nvrhi::BufferHandle m_indexBuffers[(int)MeshType::MT_COUNT];
+	nvrhi::Format m_indexFormats[(int)MeshType::MT_COUNT] = {};
+	uint32_t m_indexCounts[(int)MeshType::MT_COUNT] = {};
 	nvrhi::BufferHandle m_materialDataBuffer;
 	nvrhi::BufferHandle m_instanceDataBuffer;
 	nvrhi::BufferHandle m_lightDataBuffer;
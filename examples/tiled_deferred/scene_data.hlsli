@@ -64,6 +64,7 @@ struct Light
 	float3 color;
 	float innerAngle;
 	float outerAngle;
+	float orbitRadius;
 };
 
 struct Material
@@ -0,0 +1,496 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/app/imgui_renderer.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/BindingCache.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/math/math.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "tiled_deferred_renderer.h"
+
+using namespace donut;
+using namespace donut::app;
+using namespace donut::engine;
+using namespace donut::math;
+
+static const char* g_WindowTitle = "Donut Example: Tiled Deferred Shading";
+
+// Animation time step used while benchmarking, so that every run renders exactly the same frames.
+static const float Benchmark_TimeStep = 1.0f/60.0f;
+
+
+struct UIData
+{
+    bool ShowUI = true;
+    bool Paused = false;
+    bool ResetAnim = false;
+    bool FrustumCulling = true;
+    int ScenePreset = 0;
+    float PhaseTimes[(int)TiledDeferredRenderer::Phase::COUNT] = {};
+    uint32_t ObjectCount = 0;
+    uint32_t VisibleObjectCount = 0;
+    uint32_t LightCount = 0;
+    uint32_t LightListSize = 0;
+    uint32_t LightListCapacity = 0;
+};
+
+
+// Scripted benchmark. Every combination of scene preset and resolution is rendered for a number of warm-up frames,
+// then the GPU time of each phase is averaged over the measured frames. Results are logged and written to a CSV file.
+struct BenchmarkSettings
+{
+    bool Enabled = false;
+    std::vector<int2> Resolutions = { int2(1280,720), int2(1920,1080), int2(2560,1440), int2(3840,2160) };
+    std::vector<Scene::Preset> Presets = { Scene::Preset::SP_Default, Scene::Preset::SP_ManyLights, Scene::Preset::SP_ExtremeLights };
+    std::vector<Scene::ScaleParams> SceneParams; // One per preset, with the command line overrides applied.
+    uint32_t WarmupFrames = 60;
+    uint32_t MeasuredFrames = 300;
+    std::string OutputFile = "tiled_deferred_benchmark.csv";
+    float FrameTimeBudget = 0.0f; // In milliseconds. When non-zero, the run fails if any configuration's average frame time exceeds it.
+};
+
+static bool ParseBenchmarkCommandLine(int argc, const char* const* argv, BenchmarkSettings& outSettings)
+{
+    for (int i=1;i<argc;i++)
+    {
+        const bool hasValue = (i+1 < argc);
+        if (strcmp(argv[i], "-benchmark") == 0)
+            outSettings.Enabled = true;
+        else if (strcmp(argv[i], "-benchmarkResolutions") == 0 && hasValue)
+        {
+            // Comma separated list of WIDTHxHEIGHT.
+            outSettings.Resolutions.clear();
+            for (const char* token = argv[++i]; token; token = strchr(token, ','), token = token ? token+1 : nullptr)
+            {
+                int2 resolution;
+                if (sscanf(token, "%dx%d", &resolution.x, &resolution.y) != 2 || resolution.x <= 0 || resolution.y <= 0)
+                {
+                    log::error("Invalid benchmark resolution list '%s', expected e.g. 1280x720,1920x1080", argv[i]);
+                    return false;
+                }
+                outSettings.Resolutions.push_back(resolution);
+            }
+        }
+        else if (strcmp(argv[i], "-benchmarkPresets") == 0 && hasValue)
+        {
+            // Comma separated list of preset indices.
+            outSettings.Presets.clear();
+            for (const char* token = argv[++i]; token; token = strchr(token, ','), token = token ? token+1 : nullptr)
+            {
+                const int preset = atoi(token);
+                if (preset < 0 || preset >= (int)Scene::Preset::SP_COUNT)
+                {
+                    log::error("Invalid benchmark preset %d, expected a value between 0 and %d", preset, (int)Scene::Preset::SP_COUNT-1);
+                    return false;
+                }
+                outSettings.Presets.push_back((Scene::Preset)preset);
+            }
+        }
+        else if (strcmp(argv[i], "-benchmarkWarmupFrames") == 0 && hasValue)
+            outSettings.WarmupFrames = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "-benchmarkFrames") == 0 && hasValue)
+            outSettings.MeasuredFrames = max((uint32_t)strtoul(argv[++i], nullptr, 10), 1u);
+        else if (strcmp(argv[i], "-benchmarkOutput") == 0 && hasValue)
+            outSettings.OutputFile = argv[++i];
+        else if (strcmp(argv[i], "-benchmarkBudget") == 0 && hasValue)
+            outSettings.FrameTimeBudget = (float)atof(argv[++i]);
+    }
+
+    // The scene overrides given on the command line apply to every benchmarked preset.
+    for (Scene::Preset preset : outSettings.Presets)
+    {
+        Scene::ScaleParams params = Scene::GetPresetParams(preset);
+        if (!Scene::ApplyCommandLineOverrides(argc, argv, params))
+            return false;
+        outSettings.SceneParams.push_back(params);
+    }
+
+    return true;
+}
+
+
+class TiledDeferred : public app::IRenderPass
+{
+private:
+    TiledDeferredRenderer m_Renderer;
+    nvrhi::CommandListHandle m_CommandList;
+    std::shared_ptr<ShaderFactory> m_ShaderFactory;
+    std::shared_ptr<CommonRenderPasses> m_CommonPasses;
+    std::unique_ptr<BindingCache> m_BindingCache;
+
+    // State.
+    UIData& m_UI;
+    Scene::Preset m_CurrentPreset = Scene::Preset::SP_Default;
+    Scene::ScaleParams m_InitialSceneParams;
+    float m_TimeInSeconds = 0.0f;
+    float m_TimeDiffThisFrame = 0.0f;
+    bool m_ResetAnimation = true;
+
+    // Benchmark state.
+    BenchmarkSettings m_Benchmark;
+    size_t m_BenchmarkConfig = 0;
+    bool m_BenchmarkConfigStarted = false;
+    uint64_t m_BenchmarkConfigStartFrame = 0;
+    double m_BenchmarkPhaseSums[(int)TiledDeferredRenderer::Phase::COUNT] = {};
+    uint32_t m_BenchmarkPhaseCounts[(int)TiledDeferredRenderer::Phase::COUNT] = {};
+    std::string m_BenchmarkResults;
+    bool m_BenchmarkFailed = false;
+
+public:
+    TiledDeferred(DeviceManager* deviceManager, UIData& ui, const Scene::ScaleParams& sceneParams, const BenchmarkSettings& benchmark) :
+        IRenderPass(deviceManager),
+        m_UI(ui),
+        m_InitialSceneParams(sceneParams),
+        m_Benchmark(benchmark)
+    {}
+
+    bool Init()
+    {
+        std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/tiled_deferred" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+
+        std::shared_ptr<vfs::RootFileSystem> rootFS = std::make_shared<vfs::RootFileSystem>();
+        rootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_ShaderFactory = std::make_shared<ShaderFactory>(GetDevice(), rootFS, "/shaders");
+        m_CommonPasses = std::make_shared<CommonRenderPasses>(GetDevice(), m_ShaderFactory);
+        m_BindingCache = std::make_unique<BindingCache>(GetDevice());
+
+        m_CommandList = GetDevice()->createCommandList();
+
+        if (!m_Renderer.Init(GetDevice(), appShaderPath))
+            return false;
+
+        if (!m_Benchmark.Enabled)
+            CreateScene((Scene::Preset)m_UI.ScenePreset, m_InitialSceneParams);
+
+        return true;
+    }
+
+    bool BenchmarkFailed() const { return m_BenchmarkFailed; }
+
+    void CreateScene(Scene::Preset preset, const Scene::ScaleParams& params)
+    {
+        m_Renderer.CreateScene(m_CommandList, params);
+        m_CurrentPreset = preset;
+        m_UI.ScenePreset = (int)preset;
+        m_UI.ObjectCount = (uint32_t)m_Renderer.GetScene().GetWorldObjects().size();
+        m_UI.LightCount = (uint32_t)m_Renderer.GetScene().GetLights().size();
+        m_ResetAnimation = true;
+    }
+
+    void StartBenchmarkConfig()
+    {
+        const size_t presetIndex = m_BenchmarkConfig / m_Benchmark.Resolutions.size();
+        const Scene::Preset preset = m_Benchmark.Presets[presetIndex];
+        if (m_BenchmarkConfig == 0 || preset != m_CurrentPreset)
+            CreateScene(preset, m_Benchmark.SceneParams[presetIndex]);
+
+        // Every configuration replays the same animation from the start.
+        m_TimeInSeconds = 0.0f;
+        m_ResetAnimation = true;
+
+        m_BenchmarkConfigStartFrame = m_Renderer.GetFrameIndex();
+        for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+        {
+            m_BenchmarkPhaseSums[i] = 0.0;
+            m_BenchmarkPhaseCounts[i] = 0;
+        }
+        m_BenchmarkConfigStarted = true;
+    }
+
+    void FinishBenchmarkConfig()
+    {
+        const size_t presetIndex = m_BenchmarkConfig / m_Benchmark.Resolutions.size();
+        const int2 resolution = m_Benchmark.Resolutions[m_BenchmarkConfig % m_Benchmark.Resolutions.size()];
+        const char* presetName = Scene::GetPresetName(m_Benchmark.Presets[presetIndex]);
+
+        if (m_BenchmarkResults.empty())
+        {
+            m_BenchmarkResults = "Preset,Width,Height,Objects,Lights,Visible Objects,Light List Entries";
+            for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+                m_BenchmarkResults += std::string(",") + TiledDeferredRenderer::GetPhaseName((TiledDeferredRenderer::Phase)i) + " (ms)";
+            m_BenchmarkResults += "\n";
+        }
+
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%s,%d,%d,%u,%u,%u,%u", presetName, resolution.x, resolution.y,
+            m_UI.ObjectCount, m_UI.LightCount, m_Renderer.GetVisibleObjectCount(), m_Renderer.GetLightListSize());
+        m_BenchmarkResults += buffer;
+
+        std::string summary;
+        for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+        {
+            const double average = m_BenchmarkPhaseCounts[i] ? m_BenchmarkPhaseSums[i]/m_BenchmarkPhaseCounts[i] : 0.0;
+            snprintf(buffer, sizeof(buffer), ",%.4f", average);
+            m_BenchmarkResults += buffer;
+            snprintf(buffer, sizeof(buffer), "%s%s %.3f ms", i ? ", " : "", TiledDeferredRenderer::GetPhaseName((TiledDeferredRenderer::Phase)i), average);
+            summary += buffer;
+
+            if ((TiledDeferredRenderer::Phase)i == TiledDeferredRenderer::Phase::Frame &&
+                m_Benchmark.FrameTimeBudget > 0.0f && average > m_Benchmark.FrameTimeBudget)
+            {
+                log::warning("Benchmark: %s at %dx%d exceeds the frame time budget of %.3f ms", presetName, resolution.x, resolution.y, m_Benchmark.FrameTimeBudget);
+                m_BenchmarkFailed = true;
+            }
+        }
+        m_BenchmarkResults += "\n";
+
+        log::info("Benchmark: %s at %dx%d: %s", presetName, resolution.x, resolution.y, summary.c_str());
+
+        m_BenchmarkConfig++;
+        m_BenchmarkConfigStarted = false;
+    }
+
+    void FinishBenchmark()
+    {
+        FILE* file = fopen(m_Benchmark.OutputFile.c_str(), "w");
+        if (file)
+        {
+            fputs(m_BenchmarkResults.c_str(), file);
+            fclose(file);
+            log::info("Benchmark results written to %s", m_Benchmark.OutputFile.c_str());
+        }
+        else
+        {
+            log::error("Could not write the benchmark results to %s", m_Benchmark.OutputFile.c_str());
+            m_BenchmarkFailed = true;
+        }
+
+        glfwSetWindowShouldClose(GetDeviceManager()->GetWindow(), 1);
+    }
+
+    void AccumulateBenchmarkTimings(const TiledDeferredRenderer::FrameTimings& timings)
+    {
+        const uint64_t firstMeasuredFrame = m_BenchmarkConfigStartFrame + m_Benchmark.WarmupFrames;
+        const uint64_t lastMeasuredFrame = firstMeasuredFrame + m_Benchmark.MeasuredFrames - 1;
+        if (timings.frameIndex < firstMeasuredFrame || timings.frameIndex > lastMeasuredFrame)
+            return;
+
+        for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+        {
+            if (timings.phaseTimes[i] < 0.0f)
+                continue;
+            m_BenchmarkPhaseSums[i] += timings.phaseTimes[i];
+            m_BenchmarkPhaseCounts[i]++;
+        }
+
+        if (timings.frameIndex == lastMeasuredFrame)
+            FinishBenchmarkConfig();
+    }
+
+    void BackBufferResizing() override
+    {
+        m_BindingCache->Clear();
+    }
+
+    void Animate(float fElapsedTimeSeconds) override
+    {
+        if (m_Benchmark.Enabled)
+            m_TimeDiffThisFrame = Benchmark_TimeStep;
+        else if (!m_UI.Paused)
+            m_TimeDiffThisFrame = fElapsedTimeSeconds;
+        else m_TimeDiffThisFrame = 0.0f;
+        m_TimeInSeconds += m_TimeDiffThisFrame;
+
+        if (m_ResetAnimation || m_UI.ResetAnim || m_Renderer.IsAnimationResetPending())
+            m_TimeInSeconds = m_TimeDiffThisFrame = 0.0f;
+
+        if (!m_Benchmark.Enabled && (int)m_CurrentPreset != m_UI.ScenePreset)
+            CreateScene((Scene::Preset)m_UI.ScenePreset, Scene::GetPresetParams((Scene::Preset)m_UI.ScenePreset));
+
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+    }
+
+    void Render(nvrhi::IFramebuffer* framebuffer) override
+    {
+        const auto& fbinfo = framebuffer->getFramebufferInfo();
+
+        // Harvest the results of an earlier frame. This can complete a benchmark configuration.
+        TiledDeferredRenderer::FrameTimings timings;
+        if (m_Renderer.BeginFrame(timings))
+        {
+            for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+                m_UI.PhaseTimes[i] = timings.phaseTimes[i];
+
+            if (m_Benchmark.Enabled && m_BenchmarkConfigStarted)
+                AccumulateBenchmarkTimings(timings);
+        }
+        m_UI.VisibleObjectCount = m_Renderer.GetVisibleObjectCount();
+        m_UI.LightListSize = m_Renderer.GetLightListSize();
+        m_UI.LightListCapacity = m_Renderer.GetLightListCapacity();
+
+        // The benchmark renders at its own resolutions, and the result is scaled to the window.
+        int2 renderSize = int2(fbinfo.width, fbinfo.height);
+        if (m_Benchmark.Enabled)
+        {
+            if (m_BenchmarkConfig >= m_Benchmark.Presets.size() * m_Benchmark.Resolutions.size())
+            {
+                FinishBenchmark();
+                m_Renderer.EndFrame();
+                return;
+            }
+            if (!m_BenchmarkConfigStarted)
+                StartBenchmarkConfig();
+            renderSize = m_Benchmark.Resolutions[m_BenchmarkConfig % m_Benchmark.Resolutions.size()];
+        }
+
+        // First frame, window resize or new scene. This is where the bulk of the loading occurs.
+        if (m_Renderer.UpdateRenderTargets(renderSize))
+            m_BindingCache->Clear();
+
+        m_CommandList->open();
+
+        m_Renderer.BeginPhase(m_CommandList, TiledDeferredRenderer::Phase::Frame);
+
+        m_Renderer.UpdateSceneConstants(m_CommandList, m_TimeInSeconds);
+        m_Renderer.PopulateAnimationPass(m_CommandList, m_TimeInSeconds, m_TimeDiffThisFrame, m_ResetAnimation || m_UI.ResetAnim);
+        m_Renderer.PopulateObjectCullingPass(m_CommandList, m_UI.FrustumCulling);
+        m_Renderer.PopulateGBufferPass(m_CommandList);
+        m_Renderer.PopulateLightCullingPass(m_CommandList);
+        m_Renderer.PopulateDeferredShadingPass(m_CommandList);
+
+        m_Renderer.EndPhase(m_CommandList, TiledDeferredRenderer::Phase::Frame);
+
+        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_Renderer.GetRenderTargets()->m_LDRBuffer, m_BindingCache.get());
+
+        // Done with this frame.
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        m_Renderer.EndFrame();
+        m_ResetAnimation = false;
+    }
+};
+
+class UIRenderer : public ImGui_Renderer
+{
+private:
+    std::shared_ptr<donut::vfs::RootFileSystem> m_RootFs;
+    std::shared_ptr<ShaderFactory> m_ShaderFactory;
+
+    UIData& m_UI;
+
+public:
+    UIRenderer(DeviceManager* deviceManager, UIData& ui) : ImGui_Renderer(deviceManager), m_UI(ui) {}
+
+    bool Init()
+    {
+        std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        m_RootFs = std::make_shared<donut::vfs::RootFileSystem>();
+        m_RootFs->mount("/shaders/donut", frameworkShaderPath);
+
+        m_ShaderFactory = std::make_shared<ShaderFactory>(GetDevice(), m_RootFs, "/shaders");
+        return ImGui_Renderer::Init(m_ShaderFactory);
+    }
+
+protected:
+    virtual void buildUI(void) override
+    {
+        if (!m_UI.ShowUI)
+            return;
+
+        const char *presetNames[(int)Scene::Preset::SP_COUNT];
+        for (int i=0;i<(int)Scene::Preset::SP_COUNT;i++)
+            presetNames[i] = Scene::GetPresetName((Scene::Preset)i);
+
+        ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
+        ImGui::Begin("Options/Stats", 0, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Combo("Scene Preset", &m_UI.ScenePreset, presetNames, (int)Scene::Preset::SP_COUNT);
+        ImGui::Checkbox("Pause Animation", &m_UI.Paused);
+        ImGui::Checkbox("Frustum Culling", &m_UI.FrustumCulling);
+        m_UI.ResetAnim = ImGui::Button("Reset Animation");
+        for (int i=0;i<(int)TiledDeferredRenderer::Phase::COUNT;i++)
+            ImGui::Text("%s (GPU): %.3f ms", TiledDeferredRenderer::GetPhaseName((TiledDeferredRenderer::Phase)i), m_UI.PhaseTimes[i]);
+        ImGui::Text("Visible Objects: %u / %u", m_UI.VisibleObjectCount, m_UI.ObjectCount);
+        ImGui::Text("Lights: %u", m_UI.LightCount);
+        ImGui::Text("Light List Entries: %u (capacity %u)", m_UI.LightListSize, m_UI.LightListCapacity);
+        ImGui::End();
+    }
+};
+
+#ifdef WIN32
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
+#else
+int main(int __argc, const char** __argv)
+#endif
+{
+    nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
+
+    // Scene scale can be controlled from the command line. See Scene::ParseCommandLine for the available options.
+    Scene::Preset scenePreset = Scene::Preset::SP_Default;
+    Scene::ScaleParams sceneParams;
+    if (!Scene::ParseCommandLine(__argc, __argv, scenePreset, sceneParams))
+        return 1;
+
+    BenchmarkSettings benchmark;
+    if (!ParseBenchmarkCommandLine(__argc, __argv, benchmark))
+        return 1;
+
+    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    app::DeviceCreationParameters deviceParams;
+#ifdef _DEBUG
+    deviceParams.enableDebugRuntime = true;
+    deviceParams.enableNvrhiValidationLayer = true;
+#endif
+    deviceParams.backBufferWidth = 1920;
+    deviceParams.backBufferHeight = 1080;
+    deviceParams.vsyncEnabled = !benchmark.Enabled && deviceParams.vsyncEnabled;
+
+    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
+    {
+        log::fatal("Cannot initialize a graphics device with the requested parameters");
+        return 1;
+    }
+
+    bool benchmarkFailed = false;
+    {
+        UIData uiData;
+        uiData.ScenePreset = (int)scenePreset;
+        uiData.ShowUI = !benchmark.Enabled;
+        TiledDeferred example(deviceManager, uiData, sceneParams, benchmark);
+        UIRenderer ui(deviceManager, uiData);
+        if (example.Init() && ui.Init())
+        {
+            deviceManager->AddRenderPassToBack(&example);
+            deviceManager->AddRenderPassToBack(&ui);
+            deviceManager->RunMessageLoop();
+            deviceManager->RemoveRenderPass(&ui);
+            deviceManager->RemoveRenderPass(&example);
+        }
+        benchmarkFailed = example.BenchmarkFailed();
+    }
+
+    deviceManager->Shutdown();
+
+    delete deviceManager;
+
+    return benchmarkFailed ? 2 : 0;
+}
@@ -0,0 +1,766 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include "tiled_deferred_renderer.h"
+
+using namespace donut;
+using namespace donut::math;
+
+// Camera control constants. These are all relative to the scene size, so they need no tweaking when changing the scene parameters.
+static const float Camera_PositionOrbitSpeed = 0.1f;
+static const float Camera_TargetOrbitSpeed = 0.03f;
+static const float Camera_PositionRadiusRatio = 0.75f;
+static const float Camera_TargetRadiusRatio = 0.1f;
+static const float Camera_ClimbSpeed = 0.1f;
+static const float Camera_ClimbRatio = 0.6f;
+static const float Camera_VerticalFOV = (dm::PI_f/4.0f)*1.15f; // In radians.
+static const float Camera_NearClipDistance = 0.5f;
+
+// Maximum thread group count of a dispatch dimension, the same on all APIs supported by nvrhi.
+static const uint32_t Dispatch_MaxThreadGroupsPerDimension = 65535;
+
+static inline float4x4 lookToD3DStyle(const float3& eyePosition, const float3& focusPosition, const float3& upDirection)
+{
+    float3 eyeDirection = focusPosition - eyePosition;
+    float3 negEyePosition = -eyePosition;
+    float3 z = normalize(eyeDirection);
+    float3 x = normalize(cross(upDirection, z));
+    float3 y = cross(z, x);
+
+    float4x4 m;
+    m.row0 = float4(x, dot(x, negEyePosition));
+    m.row1 = float4(y, dot(y, negEyePosition));
+    m.row2 = float4(z, dot(z, negEyePosition));
+    m.row3 = float4(0,0,0,1);
+    return transpose(m);
+}
+
+// Dispatches enough groups of 32 threads to cover itemCount items. The shaders compute the item index as
+// (groupY*Dispatch_MaxThreadGroupsPerDimension + groupX)*32 + thread, and skip indices beyond the item count.
+static void DispatchItems(nvrhi::ICommandList* commandList, size_t itemCount)
+{
+    const size_t threadsX = 32;
+    const size_t totalDispatchSize = max((itemCount+(threadsX-1)) / threadsX, size_t(1));
+    const size_t dispatchY = (totalDispatchSize+Dispatch_MaxThreadGroupsPerDimension-1) / Dispatch_MaxThreadGroupsPerDimension;
+    const size_t dispatchX = min(totalDispatchSize, size_t(Dispatch_MaxThreadGroupsPerDimension));
+    commandList->dispatch((uint32_t)dispatchX, (uint32_t)dispatchY);
+}
+
+
+RenderTargets::RenderTargets(nvrhi::IDevice* device, int2 size)
+    : m_Size(size)
+{
+    nvrhi::TextureDesc desc;
+    desc.width = size.x;
+    desc.height = size.y;
+    desc.keepInitialState = true;
+
+    // Depth buffer
+    desc.useClearValue = true;
+    desc.clearValue = nvrhi::Color(1.f);
+    desc.isRenderTarget = true;
+    desc.isTypeless = true;
+    desc.format = nvrhi::Format::D32;
+    desc.initialState = nvrhi::ResourceStates::ShaderResource;
+    desc.debugName = "DepthBuffer";
+    m_Depth = device->createTexture(desc);
+
+    // G buffer
+    desc.format = nvrhi::Format::RGBA16_UINT;
+    desc.clearValue = nvrhi::Color(0.f);
+    desc.useClearValue = false;
+    desc.isTypeless = false;
+    desc.initialState = nvrhi::ResourceStates::ShaderResource;
+    desc.debugName = "GBuffer";
+    m_GBuffer = device->createTexture(desc);
+
+    // LDR buffer
+    desc.format = nvrhi::Format::RGBA8_UNORM;
+    desc.isRenderTarget = false;
+    desc.isUAV = true;
+    desc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    desc.debugName = "LDRBuffer";
+    m_LDRBuffer = device->createTexture(desc);
+
+    m_GBufferDepth = std::make_shared<engine::FramebufferFactory>(device);
+    m_GBufferDepth->RenderTargets = { m_GBuffer };
+    m_GBufferDepth->DepthTarget = m_Depth;
+
+    m_FrameBufferGB = m_GBufferDepth->GetFramebuffer(nvrhi::TextureSubresourceSet());
+}
+
+
+const char* TiledDeferredRenderer::GetPhaseName(Phase phase)
+{
+    static const char* names[(int)Phase::COUNT] =
+    {
+        "Frame",
+        "Animation",
+        "Object Culling",
+        "G-Buffer",
+        "Light Culling",
+        "Shading",
+    };
+    return names[(int)phase];
+}
+
+bool TiledDeferredRenderer::Init(nvrhi::IDevice* device, const std::filesystem::path& shaderPath)
+{
+    m_Device = device;
+    m_ShaderPath = shaderPath;
+
+    // Resources used to fill unused shader binding slots (null resources).
+    m_NullSRVBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+        .setByteSize(512).setStructStride(16).setKeepInitialState(true)
+        .setInitialState(nvrhi::ResourceStates::ShaderResource).setDebugName("NullSRVBuffer"));
+    m_NullUAVBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+        .setByteSize(512).setStructStride(16).setKeepInitialState(true)
+        .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setCanHaveUAVs(true).setDebugName("NullUAVBuffer"));
+    m_NullSRVTexture = m_Device->createTexture(nvrhi::TextureDesc()
+        .setFormat(nvrhi::Format::RGBA8_UNORM).setKeepInitialState(true)
+        .setInitialState(nvrhi::ResourceStates::ShaderResource).setDebugName("NullSRVTexture"));
+    m_NullUAVTexture = m_Device->createTexture(nvrhi::TextureDesc()
+        .setFormat(nvrhi::Format::RGBA8_UNORM).setKeepInitialState(true)
+        .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setIsUAV(true).setDebugName("NullUAVTexture"));
+
+    for (FrameQueries& queries : m_FrameQueries)
+    {
+        for (nvrhi::TimerQueryHandle& timer : queries.phaseTimers)
+            timer = m_Device->createTimerQuery();
+        queries.lightListSizeReadback = m_Device->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint2)).setCpuAccess(nvrhi::CpuAccessMode::Read)
+            .setInitialState(nvrhi::ResourceStates::CopyDest).setKeepInitialState(true).setDebugName("LightListSizeReadback"));
+        queries.objectDrawArgsReadback = m_Device->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(m_ObjectDrawArgsInit)).setCpuAccess(nvrhi::CpuAccessMode::Read)
+            .setInitialState(nvrhi::ResourceStates::CopyDest).setKeepInitialState(true).setDebugName("ObjectDrawArgsReadback"));
+    }
+
+    return true;
+}
+
+void TiledDeferredRenderer::CreateScene(nvrhi::ICommandList* commandList, const Scene::ScaleParams& params)
+{
+    m_Device->waitForIdle();
+
+    // Create the scene procedurally.
+    m_Scene = Scene();
+    commandList->open();
+    m_Scene.CreateAssets(m_Device, commandList, params);
+    commandList->close();
+    m_Device->executeCommandList(commandList);
+    m_Device->waitForIdle();
+
+    // Binding sets and pipelines reference the scene buffers. Recreate everything on the next frame.
+    // Readbacks still in flight refer to the previous scene.
+    m_PipelinesDirty = true;
+    for (FrameQueries& queries : m_FrameQueries)
+        queries.objectDrawArgsReadbackValid = queries.lightListSizeReadbackValid = false;
+    m_ForceResetAnimation = true;
+}
+
+bool TiledDeferredRenderer::UpdateRenderTargets(int2 size)
+{
+    if (!m_PipelinesDirty && m_RenderTargets && !m_RenderTargets->IsUpdateRequired(size))
+        return false;
+
+    m_RenderTargets = std::make_unique<RenderTargets>(m_Device, size);
+    LoadScenePipelines();
+    m_PipelinesDirty = false;
+    return true;
+}
+
+bool TiledDeferredRenderer::LoadScenePipelines()
+{
+    auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+    engine::ShaderFactory shaderFactory(m_Device, nativeFS, m_ShaderPath);
+
+    nvrhi::ShaderHandle animateObjects_computeShader = shaderFactory.CreateShader("animation.hlsl", "CSMainObjects", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle animateLights_computeShader = shaderFactory.CreateShader("animation.hlsl", "CSMainLights", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle objectCulling_computeShader = shaderFactory.CreateShader("object_culling.hlsl", "CSMain", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle gbuffer_vertexShader = shaderFactory.CreateShader("gbuffer_fill.hlsl", "VSMain", nullptr, nvrhi::ShaderType::Vertex);
+    nvrhi::ShaderHandle gbuffer_pixelShader = shaderFactory.CreateShader("gbuffer_fill.hlsl", "PSMain", nullptr, nvrhi::ShaderType::Pixel);
+    nvrhi::ShaderHandle countLights_computeShader = shaderFactory.CreateShader("light_culling.hlsl", "CSCountLights", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle buildLightListOffsets_computeShader = shaderFactory.CreateShader("light_culling.hlsl", "CSBuildLightListOffsets", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle writeLights_computeShader = shaderFactory.CreateShader("light_culling.hlsl", "CSWriteLights", nullptr, nvrhi::ShaderType::Compute);
+    nvrhi::ShaderHandle deferredShading_computeShader = shaderFactory.CreateShader("deferred_shading.hlsl", "CSMain", nullptr, nvrhi::ShaderType::Compute);
+
+    if (!animateObjects_computeShader || !animateLights_computeShader ||
+        !objectCulling_computeShader || !gbuffer_vertexShader || !gbuffer_pixelShader ||
+        !countLights_computeShader || !buildLightListOffsets_computeShader ||
+        !writeLights_computeShader || !deferredShading_computeShader)
+    {
+        return false;
+    }
+
+    // All passes share one binding layout. Unused slots are bound to null resources.
+    auto bindingLayoutDesc = nvrhi::BindingLayoutDesc()
+        .setRegisterSpace(0)
+        .setVisibility(nvrhi::ShaderType::All)
+        .addItem(nvrhi::BindingLayoutItem::PushConstants(0,sizeof(int3)))
+        .addItem(nvrhi::BindingLayoutItem::VolatileConstantBuffer(1))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0))
+        .addItem(nvrhi::BindingLayoutItem::Texture_SRV(1))
+        .addItem(nvrhi::BindingLayoutItem::Texture_SRV(2))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(4))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0))
+        .addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(2))
+        .addItem(nvrhi::BindingLayoutItem::Texture_UAV(1));
+    m_BindingLayout = m_Device->createBindingLayout(bindingLayoutDesc);
+
+    nvrhi::VertexAttributeDesc attributes[] = {
+        nvrhi::VertexAttributeDesc()
+            .setName("POSITION")
+            .setFormat(nvrhi::Format::RGB32_FLOAT)
+            .setOffset(0)
+            .setElementStride(sizeof(float3)*2),
+        nvrhi::VertexAttributeDesc()
+            .setName("NORMAL")
+            .setFormat(nvrhi::Format::RGB32_FLOAT)
+            .setOffset(sizeof(float3))
+            .setElementStride(sizeof(float3)*2),
+        };
+    m_InputLayout = m_Device->createInputLayout(attributes, uint32_t(std::size(attributes)), gbuffer_vertexShader);
+
+    // Create pipeine states
+    {
+        nvrhi::GraphicsPipelineDesc psoGfxDesc;
+        psoGfxDesc.inputLayout = m_InputLayout;
+        psoGfxDesc.bindingLayouts = { m_BindingLayout };
+        psoGfxDesc.VS = gbuffer_vertexShader;
+        psoGfxDesc.PS = gbuffer_pixelShader;
+
+        m_GBufferFillPSO = m_Device->createGraphicsPipeline(psoGfxDesc, m_RenderTargets->m_FrameBufferGB);
+    }
+
+    nvrhi::ComputePipelineDesc psoCSDesc;
+    psoCSDesc.bindingLayouts = { m_BindingLayout };
+
+    m_AnimateObjectsPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(animateObjects_computeShader));
+    m_AnimateLightsPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(animateLights_computeShader));
+    m_ObjectCullingPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(objectCulling_computeShader));
+    m_CountLightsPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(countLights_computeShader));
+    m_BuildLightListOffsetsPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(buildLightListOffsets_computeShader));
+    m_WriteLightsPSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(writeLights_computeShader));
+    m_ShadePSO = m_Device->createComputePipeline(psoCSDesc.setComputeShader(deferredShading_computeShader));
+
+    // Create the object culling outputs: one indexed indirect draw per mesh type, each drawing
+    // the visible objects listed in its own region of the visible object list.
+    {
+        const std::vector<Scene::Instance>& worldObjects = m_Scene.GetWorldObjects();
+
+        uint32_t objectCounts[(int)Scene::MeshType::MT_COUNT] = {};
+        for (const Scene::Instance& object : worldObjects)
+            objectCounts[(int)object.meshType]++;
+
+        uint32_t visibleListOffset = 0;
+        for (int i=0;i<(int)Scene::MeshType::MT_COUNT;i++)
+        {
+            ObjectDrawArgs& args = m_ObjectDrawArgsInit[i];
+            args = {};
+            args.draw.indexCount = m_Scene.GetMeshIndexCount((Scene::MeshType)i);
+            args.draw.instanceCount = 0;
+            args.visibleListOffset = visibleListOffset;
+            visibleListOffset += objectCounts[i];
+        }
+
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(m_ObjectDrawArgsInit);
+        bufferDesc.structStride = sizeof(uint32_t);
+        bufferDesc.canHaveUAVs = true;
+        bufferDesc.isDrawIndirectArgs = true;
+        bufferDesc.debugName = "ObjectDrawArgs";
+        bufferDesc.initialState = nvrhi::ResourceStates::IndirectArgument;
+        bufferDesc.keepInitialState = true;
+        m_ObjectDrawArgsBuffer = m_Device->createBuffer(bufferDesc);
+
+        bufferDesc.byteSize = max(worldObjects.size(), size_t(1)) * sizeof(uint32_t);
+        bufferDesc.isDrawIndirectArgs = false;
+        bufferDesc.debugName = "VisibleObjects";
+        bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        m_VisibleObjectsBuffer = m_Device->createBuffer(bufferDesc);
+    }
+
+    // Create the tile light grid and the light list buffers.
+    {
+        const uint32_t tileCount = GetLightTileCount(m_RenderTargets->m_Size.x, m_RenderTargets->m_Size.y);
+
+        // One (offset,count) pair per tile, plus one extra element for the total light list size.
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = (tileCount+1) * sizeof(uint2);
+        bufferDesc.structStride = sizeof(uint2);
+        bufferDesc.canHaveUAVs = true;
+        bufferDesc.debugName = "TileLightGrid";
+        bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        bufferDesc.keepInitialState = true;
+        m_TileLightGridBuffer = m_Device->createBuffer(bufferDesc);
+
+        CreateLightListBuffer(tileCount * DeferredShadingParam_InitialLightListEntriesPerTile);
+    }
+
+    // Create the constant buffer.
+    {
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(SceneConstantBuffer);
+        bufferDesc.maxVersions = 16;
+        bufferDesc.isConstantBuffer = true;
+        bufferDesc.isVolatile = true;
+        bufferDesc.debugName = "SceneConstants";
+        bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        bufferDesc.keepInitialState = true;
+        m_ConstantBuffer = m_Device->createBuffer(bufferDesc);
+    }
+
+    CreateBindingSets();
+
+    // Readbacks from before this point refer to the previous scene or resolution.
+    for (FrameQueries& queries : m_FrameQueries)
+        queries.objectDrawArgsReadbackValid = queries.lightListSizeReadbackValid = false;
+
+    // Animation state must be reset to good values before being updated every frame.
+    m_ForceResetAnimation = true;
+    return true;
+}
+
+void TiledDeferredRenderer::CreateLightListBuffer(uint32_t capacity)
+{
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = capacity * sizeof(uint32_t);
+    bufferDesc.structStride = sizeof(uint32_t);
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.debugName = "LightList";
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    m_LightListBuffer = m_Device->createBuffer(bufferDesc);
+    m_LightListCapacity = capacity;
+
+    // Sizes read back from before this point refer to the previous buffer.
+    for (FrameQueries& queries : m_FrameQueries)
+        queries.lightListSizeReadbackValid = false;
+}
+
+void TiledDeferredRenderer::CreateBindingSets()
+{
+    // Create the resource binding sets for each pass. The resource registers must match with
+    // assignments used in the shader files. Donut internally takes care of resource states and transition barriers.
+    m_BindingSets[(int)ScenePass::AnimateObjects] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetWorldObjectsBuffer()))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_Scene.GetAnimStateBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::AnimateLights] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_Scene.GetLightsBuffer()))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::ObjectCulling] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetWorldObjectsBuffer()))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetAnimStateBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_ObjectDrawArgsBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_VisibleObjectsBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::GBufferFill] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetWorldObjectsBuffer()))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_Scene.GetMaterialsBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetAnimStateBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_VisibleObjectsBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::LightCullingCount] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_Depth))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_TileLightGridBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::LightCullingOffsets] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_TileLightGridBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::LightCullingWrite] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_Depth))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_TileLightGridBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_LightListBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
+        m_BindingLayout);
+
+    m_BindingSets[(int)ScenePass::DeferredShading] = m_Device->createBindingSet(nvrhi::BindingSetDesc()
+        .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
+        .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetMaterialsBuffer()))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_GBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_Depth))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_LightListBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_TileLightGridBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_NullUAVBuffer))
+        .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_RenderTargets->m_LDRBuffer)),
+        m_BindingLayout);
+}
+
+bool TiledDeferredRenderer::BeginFrame(FrameTimings& outTimings)
+{
+    FrameQueries& queries = m_FrameQueries[GetFrameSlot()];
+
+    bool harvested = false;
+    if (queries.used)
+    {
+        outTimings.frameIndex = queries.frameIndex;
+        for (int i=0;i<(int)Phase::COUNT;i++)
+        {
+            outTimings.phaseTimes[i] = -1.0f;
+            if (queries.phaseTimerUsed[i] && m_Device->pollTimerQuery(queries.phaseTimers[i]))
+                outTimings.phaseTimes[i] = m_Device->getTimerQueryTime(queries.phaseTimers[i])*1000.0f;
+        }
+        harvested = true;
+    }
+
+    if (queries.objectDrawArgsReadbackValid)
+    {
+        const ObjectDrawArgs* drawArgs = (const ObjectDrawArgs*)m_Device->mapBuffer(queries.objectDrawArgsReadback, nvrhi::CpuAccessMode::Read);
+        if (drawArgs)
+        {
+            uint32_t visibleObjectCount = 0;
+            for (int i=0;i<(int)Scene::MeshType::MT_COUNT;i++)
+                visibleObjectCount += drawArgs[i].draw.instanceCount;
+            m_Device->unmapBuffer(queries.objectDrawArgsReadback);
+            m_VisibleObjectCount = visibleObjectCount;
+        }
+    }
+
+    if (queries.lightListSizeReadbackValid)
+    {
+        const uint2* lightListSize = (const uint2*)m_Device->mapBuffer(queries.lightListSizeReadback, nvrhi::CpuAccessMode::Read);
+        if (lightListSize)
+        {
+            const uint32_t requiredCapacity = lightListSize->x;
+            m_Device->unmapBuffer(queries.lightListSizeReadback);
+            UpdateLightListCapacity(requiredCapacity);
+        }
+    }
+
+    // Reset the slot for this frame.
+    for (int i=0;i<(int)Phase::COUNT;i++)
+    {
+        m_Device->resetTimerQuery(queries.phaseTimers[i]);
+        queries.phaseTimerUsed[i] = false;
+    }
+    queries.objectDrawArgsReadbackValid = false;
+    queries.lightListSizeReadbackValid = false;
+    queries.frameIndex = m_FrameIndex;
+    queries.used = true;
+
+    return harvested;
+}
+
+void TiledDeferredRenderer::EndFrame()
+{
+    m_FrameIndex++;
+}
+
+void TiledDeferredRenderer::BeginPhase(nvrhi::ICommandList* commandList, Phase phase)
+{
+    FrameQueries& queries = m_FrameQueries[GetFrameSlot()];
+    commandList->beginTimerQuery(queries.phaseTimers[(int)phase]);
+    queries.phaseTimerUsed[(int)phase] = true;
+}
+
+void TiledDeferredRenderer::EndPhase(nvrhi::ICommandList* commandList, Phase phase)
+{
+    commandList->endTimerQuery(m_FrameQueries[GetFrameSlot()].phaseTimers[(int)phase]);
+}
+
+void TiledDeferredRenderer::UpdateLightListCapacity(uint32_t requiredCapacity)
+{
+    m_LightListSize = requiredCapacity;
+    if (requiredCapacity <= m_LightListCapacity)
+        return;
+
+    // Grow with some headroom to avoid reallocating every time the camera moves.
+    CreateLightListBuffer(requiredCapacity + requiredCapacity/2);
+    CreateBindingSets();
+}
+
+void TiledDeferredRenderer::UpdateSceneConstants(nvrhi::ICommandList* commandList, float timeInSeconds)
+{
+    // Camera calculations.
+    float3 camPosition, camTarget;
+    float4x4 view, proj;
+    {
+        const float sceneSize = m_Scene.GetSceneSize();
+        const float sceneHeight = m_Scene.GetSceneHeight();
+
+        camPosition.x = cosf(timeInSeconds * Camera_PositionOrbitSpeed) * sceneSize * Camera_PositionRadiusRatio;
+        camPosition.y = sinf(timeInSeconds * Camera_ClimbSpeed - 1.75f) * sceneHeight * Camera_ClimbRatio + sceneHeight * Camera_ClimbRatio + 10.0f;
+        camPosition.z = sinf(timeInSeconds * Camera_PositionOrbitSpeed) * sceneSize * Camera_PositionRadiusRatio;
+
+        camTarget.x = cosf(timeInSeconds * Camera_TargetOrbitSpeed) * sceneSize * Camera_TargetRadiusRatio;
+        camTarget.y = 0;
+        camTarget.z = sinf(timeInSeconds * Camera_TargetOrbitSpeed) * sceneSize * Camera_TargetRadiusRatio;
+
+        float aspectRatio = (float)m_RenderTargets->m_Size.x / (float)m_RenderTargets->m_Size.y;
+
+        const float3 camUp = {0,1,0};
+        view = lookToD3DStyle(camPosition, camTarget, camUp);
+        proj = perspProjD3DStyle(Camera_VerticalFOV, aspectRatio, Camera_NearClipDistance, sceneSize*1.2f);
+    }
+
+    // Write the new values to the constant buffer. Donut internally handles versioning of the buffer.
+    SceneConstantBuffer constants = {};
+    constants.viewProj = transpose(view*proj);
+    constants.viewProjInverse = transpose(inverse(view*proj));
+    constants.camPosAndSceneTime.x = camPosition.x;
+    constants.camPosAndSceneTime.y = camPosition.y;
+    constants.camPosAndSceneTime.z = camPosition.z;
+    constants.camPosAndSceneTime.w = timeInSeconds;
+    constants.camDir = float4(normalize(camTarget-camPosition),0);
+    constants.viewportSizeXY.x = (float)m_RenderTargets->m_Size.x;
+    constants.viewportSizeXY.y = (float)m_RenderTargets->m_Size.y;
+
+    commandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
+}
+
+void TiledDeferredRenderer::PopulateAnimationPass(nvrhi::ICommandList* commandList, float timeInSeconds, float timeDiff, bool resetState)
+{
+    commandList->beginMarker("Animation");
+    BeginPhase(commandList, Phase::Animation);
+
+    const bool resetAnim = m_ForceResetAnimation || resetState;
+
+    // Object Animation compute shader.
+    nvrhi::ComputeState state;
+    state.pipeline = m_AnimateObjectsPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::AnimateObjects] };
+    commandList->setComputeState(state);
+
+    uint32_t rootConstants[3] = {0, 0, resetAnim ? 1U : 0U};
+    ((float*)rootConstants)[0] = timeInSeconds;
+    ((float*)rootConstants)[1] = timeDiff;
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+
+    // Dispatch enough thread groups to cover all scene objects.
+    DispatchItems(commandList, m_Scene.GetWorldObjects().size());
+
+    // Light Animation compute shader.
+    state.pipeline = m_AnimateLightsPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::AnimateLights] };
+    commandList->setComputeState(state);
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+
+    // Dispatch enough thread groups to cover all scene lights.
+    DispatchItems(commandList, m_Scene.GetLights().size());
+
+    EndPhase(commandList, Phase::Animation);
+    commandList->endMarker();
+
+    m_ForceResetAnimation = false; // Animation buffer initialized, no need to redo it again in subsequent frames.
+}
+
+void TiledDeferredRenderer::PopulateObjectCullingPass(nvrhi::ICommandList* commandList, bool frustumCulling)
+{
+    commandList->beginMarker("Object Culling");
+    BeginPhase(commandList, Phase::ObjectCulling);
+
+    // Reset the instance counts of the indirect draws.
+    commandList->writeBuffer(m_ObjectDrawArgsBuffer, m_ObjectDrawArgsInit, sizeof(m_ObjectDrawArgsInit));
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_ObjectCullingPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::ObjectCulling] };
+    commandList->setComputeState(state);
+
+    const uint32_t rootConstants[3] = {(uint32_t)m_Scene.GetWorldObjects().size(), frustumCulling ? 1U : 0U, 0};
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+
+    // Dispatch enough thread groups to cover all scene objects.
+    DispatchItems(commandList, m_Scene.GetWorldObjects().size());
+
+    EndPhase(commandList, Phase::ObjectCulling);
+
+    // Read back the visible object counts for display.
+    FrameQueries& queries = m_FrameQueries[GetFrameSlot()];
+    commandList->copyBuffer(queries.objectDrawArgsReadback, 0, m_ObjectDrawArgsBuffer, 0, sizeof(m_ObjectDrawArgsInit));
+    queries.objectDrawArgsReadbackValid = true;
+
+    commandList->endMarker();
+}
+
+void TiledDeferredRenderer::PopulateGBufferPass(nvrhi::ICommandList* commandList)
+{
+    commandList->beginMarker("G-Buffer Fill");
+    BeginPhase(commandList, Phase::GBufferFill);
+
+    // It is enough to clear the depth-buffer without the g-buffer. Depth buffer values of 1 mean "sky".
+    commandList->clearDepthStencilTexture(m_RenderTargets->m_Depth, nvrhi::TextureSubresourceSet(), true, 1.0f, false, 0);
+
+    nvrhi::GraphicsState state;
+    state.pipeline = m_GBufferFillPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::GBufferFill] };
+    state.framebuffer = m_RenderTargets->m_FrameBufferGB;
+    state.viewport.addViewportAndScissorRect(m_RenderTargets->m_FrameBufferGB->getFramebufferInfo().getViewport());
+    state.indexBuffer = nvrhi::IndexBufferBinding();
+    state.vertexBuffers.push_back(nvrhi::VertexBufferBinding());
+    state.indirectParams = m_ObjectDrawArgsBuffer;
+
+    // One indirect draw per mesh type, with the instance count written by the object culling pass.
+    for (int i=0;i<(int)Scene::MeshType::MT_COUNT;i++)
+    {
+        const Scene::MeshType meshType = (Scene::MeshType)i;
+        state.indexBuffer.buffer = m_Scene.GetMeshIndexBuffer(meshType);
+        state.indexBuffer.format = m_Scene.GetMeshIndexFormat(meshType);
+        state.vertexBuffers.front().buffer = m_Scene.GetMeshVertexBuffer(meshType);
+        commandList->setGraphicsState(state);
+
+        uint32_t rootConstant[3] = { m_ObjectDrawArgsInit[i].visibleListOffset, 0, 0 };
+        commandList->setPushConstants(&rootConstant,sizeof(rootConstant));
+        commandList->drawIndexedIndirect(uint32_t(i*sizeof(ObjectDrawArgs)), 1);
+    }
+
+    EndPhase(commandList, Phase::GBufferFill);
+    commandList->endMarker();
+}
+
+void TiledDeferredRenderer::PopulateLightCullingPass(nvrhi::ICommandList* commandList)
+{
+    commandList->beginMarker("Light Culling");
+    BeginPhase(commandList, Phase::LightCulling);
+
+    const uint32_t tilesX = GetLightTileCountX(m_RenderTargets->m_Size.x);
+    const uint32_t tilesY = GetLightTileCountY(m_RenderTargets->m_Size.y);
+    const uint32_t rootConstants[3] = {tilesX, tilesY, (uint32_t)m_Scene.GetLights().size()};
+
+    // Count the lights affecting each tile. Dispatch enough thread groups to cover all screen tiles.
+    nvrhi::ComputeState state;
+    state.pipeline = m_CountLightsPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::LightCullingCount] };
+    commandList->setComputeState(state);
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+    commandList->dispatch(tilesX, tilesY);
+
+    // Prefix sum over the tile counts. A single thread group handles all tiles.
+    state.pipeline = m_BuildLightListOffsetsPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::LightCullingOffsets] };
+    commandList->setComputeState(state);
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+    commandList->dispatch(1);
+
+    // Fill the compacted light list.
+    state.pipeline = m_WriteLightsPSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::LightCullingWrite] };
+    commandList->setComputeState(state);
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+    commandList->dispatch(tilesX, tilesY);
+
+    EndPhase(commandList, Phase::LightCulling);
+
+    // Read back the total light list size to grow the list when it overflows.
+    FrameQueries& queries = m_FrameQueries[GetFrameSlot()];
+    commandList->copyBuffer(queries.lightListSizeReadback, 0, m_TileLightGridBuffer, tilesX*tilesY*sizeof(uint2), sizeof(uint2));
+    queries.lightListSizeReadbackValid = true;
+
+    commandList->endMarker();
+}
+
+void TiledDeferredRenderer::PopulateDeferredShadingPass(nvrhi::ICommandList* commandList)
+{
+    commandList->beginMarker("Deferred Shading");
+    BeginPhase(commandList, Phase::Shading);
+
+    // Deferred shading compute shader.
+    nvrhi::ComputeState state;
+    state.pipeline = m_ShadePSO;
+    state.bindings = { m_BindingSets[(int)ScenePass::DeferredShading] };
+    commandList->setComputeState(state);
+
+    const uint32_t tilesX = GetLightTileCountX(m_RenderTargets->m_Size.x);
+    const uint32_t tilesY = GetLightTileCountY(m_RenderTargets->m_Size.y);
+    const uint32_t rootConstants[3] = {tilesX, tilesY, (uint32_t)m_Scene.GetLights().size()};
+    commandList->setPushConstants(rootConstants, sizeof(rootConstants));
+
+    // Dispatch one thread group per light tile to cover the entire viewport.
+    commandList->dispatch(tilesX, tilesY, 1);
+
+    EndPhase(commandList, Phase::Shading);
+    commandList->endMarker();
+}
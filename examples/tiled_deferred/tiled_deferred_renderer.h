@@ -0,0 +1,218 @@
+/*
+* Copyright (c) 2014-2024, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/FramebufferFactory.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <filesystem>
+#include <memory>
+#include "scene.h"
+
+// Constants used by deferred shading. Ensure these values are matched with the shaders.
+static const uint32_t DeferredShadingParam_TileWidth = 8; // If changed, make sure to also change the constant c_LightTileWidth in lighting.hlsli
+static const uint32_t DeferredShadingParam_TileHeight = 4; // If changed, make sure to also change the constant c_LightTileHeight in lighting.hlsli
+static const uint32_t DeferredShadingParam_InitialLightListEntriesPerTile = 64; // Initial light list size. The list grows when the GPU reports it overflowed.
+
+
+struct RenderTargets
+{
+    nvrhi::TextureHandle m_Depth;
+    nvrhi::TextureHandle m_LDRBuffer;
+    nvrhi::TextureHandle m_GBuffer;
+    nvrhi::IFramebuffer* m_FrameBufferGB;
+    std::shared_ptr<donut::engine::FramebufferFactory> m_GBufferDepth;
+
+    donut::math::int2 m_Size;
+
+    RenderTargets(nvrhi::IDevice* device, donut::math::int2 size);
+
+    bool IsUpdateRequired(donut::math::int2 size) const { return any(m_Size != size); }
+};
+
+
+// Renders the procedural scene with GPU-driven passes: animation, object culling, g-buffer fill,
+// tiled light culling and deferred shading. Only nvrhi is used, so this runs on all graphics APIs.
+// The caller records the passes on its own command list, and can replace the last two passes with its own
+// shading technique, using the same binding layout and resources (see the work_graphs sample).
+class TiledDeferredRenderer
+{
+public:
+    enum class Phase
+    {
+        Frame,
+        Animation,
+        ObjectCulling,
+        GBufferFill,
+        LightCulling,
+        Shading,
+
+        COUNT
+    };
+
+    // GPU times of one frame, in milliseconds. Phases that did not run in that frame are negative.
+    struct FrameTimings
+    {
+        uint64_t frameIndex = 0;
+        float phaseTimes[(int)Phase::COUNT] = {};
+    };
+
+    static const char* GetPhaseName(Phase phase);
+    static uint32_t GetLightTileCountX(uint32_t viewportWidth) { return (viewportWidth+DeferredShadingParam_TileWidth-1)/DeferredShadingParam_TileWidth; }
+    static uint32_t GetLightTileCountY(uint32_t viewportHeight) { return (viewportHeight+DeferredShadingParam_TileHeight-1)/DeferredShadingParam_TileHeight; }
+    static uint32_t GetLightTileCount(uint32_t viewportWidth, uint32_t viewportHeight) { return GetLightTileCountX(viewportWidth) * GetLightTileCountY(viewportHeight); }
+
+    // shaderPath is the directory holding the compiled shaders of this renderer for the device's graphics API.
+    bool Init(nvrhi::IDevice* device, const std::filesystem::path& shaderPath);
+    void CreateScene(nvrhi::ICommandList* commandList, const Scene::ScaleParams& params);
+
+    // Recreates the render targets, pipelines and binding sets when the size changed or the scene was recreated.
+    // Returns true when that happened, so that objects referencing them can be recreated too.
+    bool UpdateRenderTargets(donut::math::int2 size);
+
+    // Harvests the GPU timings and readbacks of the frame that last used this frame's query slot, then resets the slot.
+    // Returns false when there is nothing to harvest yet. Must be called before recording the frame.
+    bool BeginFrame(FrameTimings& outTimings);
+    void EndFrame();
+    uint64_t GetFrameIndex() const { return m_FrameIndex; } // Index of the frame being recorded, matches FrameTimings::frameIndex.
+
+    void BeginPhase(nvrhi::ICommandList* commandList, Phase phase);
+    void EndPhase(nvrhi::ICommandList* commandList, Phase phase);
+
+    void UpdateSceneConstants(nvrhi::ICommandList* commandList, float timeInSeconds);
+    void PopulateAnimationPass(nvrhi::ICommandList* commandList, float timeInSeconds, float timeDiff, bool resetState);
+    void PopulateObjectCullingPass(nvrhi::ICommandList* commandList, bool frustumCulling);
+    void PopulateGBufferPass(nvrhi::ICommandList* commandList);
+    void PopulateLightCullingPass(nvrhi::ICommandList* commandList);
+    void PopulateDeferredShadingPass(nvrhi::ICommandList* commandList);
+
+    // Animation state must be reset to good values before being updated. This is pending after the scene or pipelines were recreated.
+    bool IsAnimationResetPending() const { return m_ForceResetAnimation; }
+
+    const Scene& GetScene() const { return m_Scene; }
+    const RenderTargets* GetRenderTargets() const { return m_RenderTargets.get(); }
+    nvrhi::IBindingLayout* GetBindingLayout() const { return m_BindingLayout; }
+    nvrhi::IComputePipeline* GetShadePipeline() const { return m_ShadePSO; }
+    nvrhi::IBindingSet* GetShadingBindingSet() const { return m_BindingSets[(int)ScenePass::DeferredShading]; }
+    uint32_t GetVisibleObjectCount() const { return m_VisibleObjectCount; }
+    uint32_t GetLightListSize() const { return m_LightListSize; }
+    uint32_t GetLightListCapacity() const { return m_LightListCapacity; }
+
+    static const uint32_t QueuedFramesCount = 10;
+
+private:
+    enum class ScenePass
+    {
+        AnimateObjects,
+        AnimateLights,
+        ObjectCulling,
+        GBufferFill,
+        LightCullingCount,
+        LightCullingOffsets,
+        LightCullingWrite,
+        DeferredShading,
+
+        COUNT
+    };
+
+    // Indexed indirect draw arguments of one mesh type, filled by the object culling pass.
+    // Ensure the layout is matched with the c_ObjectDrawArgs constants in object_culling.hlsl.
+    struct ObjectDrawArgs
+    {
+        nvrhi::DrawIndexedIndirectArguments draw; // instanceCount is incremented by the culling pass.
+        uint32_t visibleListOffset; // Start of this mesh type's region in the visible object list.
+        uint32_t padding[2];
+    };
+
+    // Constant buffer definition.
+    struct SceneConstantBuffer
+    {
+        donut::math::float4x4 viewProj;
+        donut::math::float4x4 viewProjInverse;
+        donut::math::float4 camPosAndSceneTime;
+        donut::math::float4 camDir;
+        donut::math::float4 viewportSizeXY;
+
+        // Constant buffers are 256-byte aligned. Add padding in the struct to allow multiple buffers
+        // to be array-indexed.
+        float padding[20];
+    };
+
+    bool LoadScenePipelines();
+    void CreateLightListBuffer(uint32_t capacity);
+    void CreateBindingSets();
+    void UpdateLightListCapacity(uint32_t requiredCapacity);
+    uint32_t GetFrameSlot() const { return uint32_t(m_FrameIndex % QueuedFramesCount); }
+
+    nvrhi::DeviceHandle m_Device;
+    std::filesystem::path m_ShaderPath;
+    Scene m_Scene;
+
+    std::unique_ptr<RenderTargets> m_RenderTargets;
+    bool m_PipelinesDirty = true;
+    nvrhi::InputLayoutHandle m_InputLayout;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::BindingSetHandle m_BindingSets[(int)ScenePass::COUNT];
+
+    // Pipeline state objects.
+    nvrhi::ComputePipelineHandle m_AnimateObjectsPSO;
+    nvrhi::ComputePipelineHandle m_AnimateLightsPSO;
+    nvrhi::ComputePipelineHandle m_ObjectCullingPSO;
+    nvrhi::GraphicsPipelineHandle m_GBufferFillPSO;
+    nvrhi::ComputePipelineHandle m_CountLightsPSO;
+    nvrhi::ComputePipelineHandle m_BuildLightListOffsetsPSO;
+    nvrhi::ComputePipelineHandle m_WriteLightsPSO;
+    nvrhi::ComputePipelineHandle m_ShadePSO;
+
+    // Resources.
+    nvrhi::BufferHandle m_ConstantBuffer;
+    nvrhi::BufferHandle m_TileLightGridBuffer;
+    nvrhi::BufferHandle m_LightListBuffer;
+    uint32_t m_LightListCapacity = 0;
+    uint32_t m_LightListSize = 0;
+    nvrhi::BufferHandle m_ObjectDrawArgsBuffer;
+    nvrhi::BufferHandle m_VisibleObjectsBuffer;
+    ObjectDrawArgs m_ObjectDrawArgsInit[(int)Scene::MeshType::MT_COUNT] = {};
+    uint32_t m_VisibleObjectCount = 0;
+
+    nvrhi::BufferHandle m_NullSRVBuffer;
+    nvrhi::BufferHandle m_NullUAVBuffer;
+    nvrhi::TextureHandle m_NullSRVTexture;
+    nvrhi::TextureHandle m_NullUAVTexture;
+
+    // Per frame queries and readbacks, reused every QueuedFramesCount frames. By then the GPU is done with them, so reading does not stall.
+    struct FrameQueries
+    {
+        nvrhi::TimerQueryHandle phaseTimers[(int)Phase::COUNT];
+        bool phaseTimerUsed[(int)Phase::COUNT] = {};
+        nvrhi::BufferHandle lightListSizeReadback;
+        bool lightListSizeReadbackValid = false;
+        nvrhi::BufferHandle objectDrawArgsReadback;
+        bool objectDrawArgsReadbackValid = false;
+        uint64_t frameIndex = 0;
+        bool used = false;
+    };
+    FrameQueries m_FrameQueries[QueuedFramesCount];
+    uint64_t m_FrameIndex = 0;
+    bool m_ForceResetAnimation = true;
+};
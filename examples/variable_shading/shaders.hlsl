@@ -32,35 +32,134 @@
         D3D12_SHADING_RATE_4X4	= 0xa
     } 	D3D12_SHADING_RATE;
 */
+
+#include "shading_rate_cb.h"
+
+ConstantBuffer<ShadingRateConstants> g_Const : register(b0);
+
 RWTexture2D<uint> shadingRateSurface : register(u0);
+RWBuffer<uint> shadingSampleCount : register(u1);
+RWTexture2D<float4> overlayTarget : register(u2);
 Texture2D<float2> motionVectors : register(t0);
 Texture2D<float4> prevFrameColors : register(t1);
 
-#define TILE_SIZE 16
+// Error of quarter rate relative to half rate along one axis, for typical image content
+static const float c_QuarterRateErrorScale = 2.13;
+
+static const uint c_ThreadCount = SHADING_RATE_GROUP_SIZE * SHADING_RATE_GROUP_SIZE;
+groupshared float s_ErrorX[c_ThreadCount];
+groupshared float s_ErrorY[c_ThreadCount];
+groupshared float s_Motion[c_ThreadCount];
+
+// Luminance after a simple tone curve and gamma, so that differences are roughly uniform in perceived brightness
+float GetPerceptualLuminance(int2 pixel)
+{
+    float luminance = dot(prevFrameColors[pixel].rgb, float3(0.2126, 0.7152, 0.0722));
+    return pow(luminance / (1.0 + luminance), 1.0 / 2.2);
+}
+
+uint GetRateLog2(float error)
+{
+    if (error * c_QuarterRateErrorScale < g_Const.threshold)
+        return 2;
+    if (error < g_Const.threshold)
+        return 1;
+    return 0;
+}
 
-[numthreads(1, 1, 1)]
-void main_cs(uint3 DispatchThreadID : SV_DispatchThreadID)
+// One group per tile of the shading rate surface. Each axis gets the coarsest rate whose error stays below the threshold,
+// where the error of halving the rate is estimated from the mean luminance difference between neighbours along that axis,
+// measured in the previous frame at the reprojected pixels. Motion blurs the image and hides detail, so the error
+// shrinks with the mean motion of the tile.
+[numthreads(SHADING_RATE_GROUP_SIZE, SHADING_RATE_GROUP_SIZE, 1)]
+void main_cs(uint2 tile : SV_GroupID, uint2 threadInTile : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
 {
-    // This is a fairly nonsensical algorithm, reads the average color for the tile in the previous frame
-    // and sets the shading rate to 4X4 if green channel is bigger than red channel, 1X1 otherwise
-    // really just intended to make the VRS difference very noticeable to confirm that it is working
-    float2 motionVector = motionVectors.Load(int3(TILE_SIZE * DispatchThreadID.xy, 0));
-    uint2 oldTexel = uint2(float2(DispatchThreadID.xy * TILE_SIZE) + motionVector);
-    float4 averageColor = 0;
-    for (int i = 0; i < TILE_SIZE; i++)
+    const uint2 tileOrigin = tile * g_Const.tileSize;
+    const int2 maxPixel = int2(g_Const.viewSize) - 2;
+
+    float errorX = 0;
+    float errorY = 0;
+    float motion = 0;
+
+    if (g_Const.mode == SHADING_RATE_MODE_ADAPTIVE)
     {
-        for (int j = 0; j < TILE_SIZE; j++)
+        for (uint y = threadInTile.y; y < g_Const.tileSize; y += SHADING_RATE_GROUP_SIZE)
         {
-            averageColor += prevFrameColors.Load(int3(oldTexel + uint2(i, j), 0));
+            for (uint x = threadInTile.x; x < g_Const.tileSize; x += SHADING_RATE_GROUP_SIZE)
+            {
+                int2 pixel = min(int2(tileOrigin + uint2(x, y)), int2(g_Const.viewSize) - 1);
+                float2 motionVector = motionVectors[pixel];
+                int2 prevPixel = clamp(int2(float2(pixel) + 0.5 + motionVector), 0, maxPixel);
+
+                float center = GetPerceptualLuminance(prevPixel);
+                errorX += abs(GetPerceptualLuminance(prevPixel + int2(1, 0)) - center);
+                errorY += abs(GetPerceptualLuminance(prevPixel + int2(0, 1)) - center);
+                motion += length(motionVector);
+            }
         }
     }
-    averageColor /= (TILE_SIZE * TILE_SIZE);
-    if (averageColor.g > averageColor.r)
-    {
-        shadingRateSurface[DispatchThreadID.xy] = 0xa;
-    }
-    else
+
+    s_ErrorX[threadIndex] = errorX;
+    s_ErrorY[threadIndex] = errorY;
+    s_Motion[threadIndex] = motion;
+    GroupMemoryBarrierWithGroupSync();
+
+    if (threadIndex != 0)
+        return;
+
+    uint rateLog2X = 1;
+    uint rateLog2Y = 1;
+
+    if (g_Const.mode == SHADING_RATE_MODE_ADAPTIVE)
     {
-        shadingRateSurface[DispatchThreadID.xy] = 0x0;
+        for (uint i = 1; i < c_ThreadCount; i++)
+        {
+            errorX += s_ErrorX[i];
+            errorY += s_ErrorY[i];
+            motion += s_Motion[i];
+        }
+
+        float sampleCount = float(g_Const.tileSize * g_Const.tileSize);
+        float motionFactor = 1.0 / (1.0 + g_Const.motionScale * motion / sampleCount);
+
+        rateLog2X = GetRateLog2(errorX / sampleCount * motionFactor);
+        rateLog2Y = GetRateLog2(errorY / sampleCount * motionFactor);
+
+        // 4x1 and 1x4 are not valid shading rates
+        if (rateLog2X == 2 && rateLog2Y == 0)
+            rateLog2X = 1;
+        if (rateLog2Y == 2 && rateLog2X == 0)
+            rateLog2Y = 1;
     }
-}
\ No newline at end of file
+
+    // Same encoding as D3D12_SHADING_RATE and the Vulkan fragment shading rate attachment
+    shadingRateSurface[tile] = (rateLog2X << 2) | rateLog2Y;
+
+    // Number of pixel shader samples the tile will need, for the statistics
+    uint2 tileExtent = min(tileOrigin + g_Const.tileSize, g_Const.viewSize) - tileOrigin;
+    InterlockedAdd(shadingSampleCount[0], (tileExtent.x * tileExtent.y) >> (rateLog2X + rateLog2Y));
+}
+
+// Tints the image by shading rate: blue for 2x1 and 1x2, green for 2x2, yellow for 4x2 and 2x4, red for 4x4
+[numthreads(SHADING_RATE_GROUP_SIZE, SHADING_RATE_GROUP_SIZE, 1)]
+void overlay_cs(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Const.viewSize))
+        return;
+
+    uint rate = shadingRateSurface[pixel / g_Const.tileSize];
+    uint coarseness = (rate >> 2) + (rate & 3);
+    if (coarseness == 0)
+        return;
+
+    const float3 colors[4] = {
+        float3(0.0, 0.3, 1.0),
+        float3(0.0, 1.0, 0.0),
+        float3(1.0, 1.0, 0.0),
+        float3(1.0, 0.0, 0.0)
+    };
+
+    float4 color = overlayTarget[pixel];
+    color.rgb = lerp(color.rgb, colors[min(coarseness, 4) - 1], 0.35);
+    overlayTarget[pixel] = color;
+}
@@ -37,17 +37,43 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 
 using namespace donut;
 using namespace donut::math;
 
+#include "gpu_timer_ring.h"
 #include "lighting_cb.h"
+#include "shading_rate_cb.h"
 
 static const char* g_WindowTitle = "Donut Example: Variable Rate Shading";
 
+enum class VrsMode
+{
+    Off,
+    Adaptive, // Rate from the luminance gradients and motion of the previous frame
+    Uniform2x2,
+
+    Count
+};
+
+static const char* g_VrsModeNames[] = { "VRS off", "Adaptive VRS", "Uniform 2x2" };
+
+// Perceptual luminance difference between neighbours below which halving the shading rate is not visible, at sensitivity 1
+static const float c_BaseShadingRateThreshold = 0.02f;
+static const float c_ShadingRateMotionScale = 0.1f;
+
+// The comparison harness skips a few frames after each mode change, then averages this many frames
+static const uint32_t c_ComparisonWarmupFrames = 16;
+static const uint32_t c_ComparisonFrames = 128;
+
 // NVIDIA Variable Rate Shading (VRS) sample application
 // Relevant sample code is in the Render() function, marked with comments
+// Keys: V cycles the VRS mode, O toggles the shading rate overlay, + and - change the sensitivity,
+// C renders a few hundred frames in each mode and logs their GPU time and pixel shader work
 
 class RenderTargets
 {
@@ -169,12 +195,52 @@ private:
     std::unique_ptr<engine::BindingCache> m_BindingCache;
 
     nvrhi::ShaderHandle m_shadingRateSurfaceShader;
+    nvrhi::ShaderHandle m_overlayShader;
     nvrhi::ComputePipelineHandle m_Pipeline;
+    nvrhi::ComputePipelineHandle m_overlayPipeline;
     nvrhi::BindingLayoutHandle m_bindingLayout;
+    nvrhi::BindingLayoutHandle m_overlayBindingLayout;
     nvrhi::BindingSetHandle m_bindingSet;
+    nvrhi::BindingSetHandle m_overlayBindingSet;
     nvrhi::TextureHandle m_shadingRateSurface;
+    nvrhi::BufferHandle m_shadingRateConstants;
+    nvrhi::BufferHandle m_shadingSampleCount;
     uint m_vrsTileSize;
 
+    VrsMode m_vrsMode = VrsMode::Adaptive;
+    float m_sensitivity = 1.f;
+    bool m_showOverlay = false;
+
+    // GPU time of the scene passes, shading samples requested by the rate surface, and pixel shader invocations
+    // where pipeline statistics are available. The sample count and statistics are read back with the timer of
+    // the same slot.
+    struct FrameTiming
+    {
+        VrsMode mode = VrsMode::Off;
+        uint32_t pixelCount = 0;
+    };
+    static const uint32_t c_QueryCount = GpuTimerRing<FrameTiming>::c_SlotCount;
+    GpuTimerRing<FrameTiming> m_frameTimers;
+    nvrhi::BufferHandle m_shadingSampleReadbacks[c_QueryCount];
+
+#if DONUT_WITH_DX12
+    nvrhi::RefCountPtr<ID3D12QueryHeap> m_pipelineStatisticsHeap;
+    nvrhi::RefCountPtr<ID3D12Resource> m_pipelineStatisticsReadback;
+#endif
+
+    struct ModeStatistics
+    {
+        double gpuTime = 0.0; // Milliseconds
+        double shadingSampleFraction = 0.0;
+        double pixelShaderInvocations = 0.0;
+        uint32_t frames = 0;
+    };
+    ModeStatistics m_lastFrame;
+    ModeStatistics m_comparison[int(VrsMode::Count)];
+    bool m_comparisonRunning = false;
+    uint32_t m_comparisonSkippedFrames = 0;
+    VrsMode m_modeBeforeComparison = VrsMode::Adaptive;
+
     engine::PlanarView m_ViewPrevious;
     bool m_PreviousViewsValid = false;
 
@@ -200,7 +266,8 @@ public:
         m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
 
         m_shadingRateSurfaceShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_cs", nullptr, nvrhi::ShaderType::Compute);
-        if (!m_shadingRateSurfaceShader)
+        m_overlayShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "overlay_cs", nullptr, nvrhi::ShaderType::Compute);
+        if (!m_shadingRateSurfaceShader || !m_overlayShader)
         {
             return false;
         }
@@ -227,6 +294,25 @@ public:
         m_Camera.SetMoveSpeed(3.f);
 
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(LightingConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
+        m_shadingRateConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(ShadingRateConstants), "ShadingRateConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(uint32_t);
+        bufferDesc.format = nvrhi::Format::R32_UINT;
+        bufferDesc.canHaveTypedViews = true;
+        bufferDesc.canHaveUAVs = true;
+        bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        bufferDesc.keepInitialState = true;
+        bufferDesc.debugName = "ShadingSampleCount";
+        m_shadingSampleCount = GetDevice()->createBuffer(bufferDesc);
+
+        bufferDesc = nvrhi::BufferDesc();
+        bufferDesc.byteSize = sizeof(uint32_t);
+        bufferDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+        bufferDesc.debugName = "ShadingSampleCountReadback";
+        m_frameTimers.Init(GetDevice());
+        for (nvrhi::BufferHandle& shadingSamples : m_shadingSampleReadbacks)
+            shadingSamples = GetDevice()->createBuffer(bufferDesc);
 
         m_CommandList = GetDevice()->createCommandList();
         
@@ -247,6 +333,40 @@ public:
             m_vrsTileSize = info.shadingRateImageTileSize;
         }
 
+#if DONUT_WITH_DX12
+        // nvrhi has no pipeline statistics queries, so on D3D12 they are made on the native objects
+        if (GetDevice()->getGraphicsAPI() == nvrhi::GraphicsAPI::D3D12)
+        {
+            ID3D12Device* device = GetDevice()->getNativeObject(nvrhi::ObjectTypes::D3D12_Device);
+
+            D3D12_QUERY_HEAP_DESC heapDesc = {};
+            heapDesc.Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS;
+            heapDesc.Count = c_QueryCount;
+            device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&m_pipelineStatisticsHeap));
+
+            D3D12_HEAP_PROPERTIES heapProperties = {};
+            heapProperties.Type = D3D12_HEAP_TYPE_READBACK;
+
+            D3D12_RESOURCE_DESC resourceDesc = {};
+            resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+            resourceDesc.Width = sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS) * c_QueryCount;
+            resourceDesc.Height = 1;
+            resourceDesc.DepthOrArraySize = 1;
+            resourceDesc.MipLevels = 1;
+            resourceDesc.SampleDesc.Count = 1;
+            resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+            device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc,
+                D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_pipelineStatisticsReadback));
+
+            if (!m_pipelineStatisticsHeap || !m_pipelineStatisticsReadback)
+            {
+                log::warning("Pipeline statistics queries are not available, pixel shader invocations will not be reported");
+                m_pipelineStatisticsHeap = nullptr;
+                m_pipelineStatisticsReadback = nullptr;
+            }
+        }
+#endif
+
         GetDevice()->waitForIdle();
 
         return true;
@@ -269,6 +389,32 @@ public:
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override
     {
         m_Camera.KeyboardUpdate(key, scancode, action, mods);
+
+        if (action != GLFW_PRESS)
+            return true;
+
+        switch (key)
+        {
+        case GLFW_KEY_V:
+            if (!m_comparisonRunning)
+                m_vrsMode = VrsMode((int(m_vrsMode) + 1) % int(VrsMode::Count));
+            break;
+        case GLFW_KEY_O:
+            m_showOverlay = !m_showOverlay;
+            break;
+        case GLFW_KEY_EQUAL:
+            m_sensitivity = std::min(m_sensitivity * 1.25f, 8.f);
+            break;
+        case GLFW_KEY_MINUS:
+            m_sensitivity = std::max(m_sensitivity / 1.25f, 0.125f);
+            break;
+        case GLFW_KEY_C:
+            if (!m_comparisonRunning)
+                StartComparison();
+            break;
+        default:;
+        }
+
         return true;
     }
 
@@ -287,7 +433,125 @@ public:
     void Animate(float fElapsedTimeSeconds) override
     {
         m_Camera.Animate(fElapsedTimeSeconds);
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+
+        char extraInfo[256];
+        int length = snprintf(extraInfo, sizeof(extraInfo), "(%s%s, sensitivity %.2f, scene %.2f ms GPU, %.0f%% shading samples",
+            m_comparisonRunning ? "Comparing: " : "", g_VrsModeNames[int(m_vrsMode)], m_sensitivity,
+            m_lastFrame.gpuTime, m_lastFrame.shadingSampleFraction * 100.0);
+        if (m_lastFrame.pixelShaderInvocations > 0.0 && length > 0 && length < int(sizeof(extraInfo)))
+            length += snprintf(extraInfo + length, sizeof(extraInfo) - length, ", %.0f PS invocations", m_lastFrame.pixelShaderInvocations);
+        if (length > 0 && length < int(sizeof(extraInfo)))
+            snprintf(extraInfo + length, sizeof(extraInfo) - length, ")");
+
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
+    }
+
+    // Renders c_ComparisonFrames frames in each VRS mode and logs the averages. Keep the camera still meanwhile.
+    void StartComparison()
+    {
+        for (ModeStatistics& statistics : m_comparison)
+            statistics = ModeStatistics();
+
+        m_modeBeforeComparison = m_vrsMode;
+        m_vrsMode = VrsMode(0);
+        m_comparisonSkippedFrames = 0;
+        m_comparisonRunning = true;
+    }
+
+    void AddComparisonFrame(VrsMode mode, const ModeStatistics& frame)
+    {
+        if (!m_comparisonRunning || mode != m_vrsMode)
+            return;
+
+        if (m_comparisonSkippedFrames < c_ComparisonWarmupFrames)
+        {
+            ++m_comparisonSkippedFrames;
+            return;
+        }
+
+        ModeStatistics& statistics = m_comparison[int(mode)];
+        statistics.gpuTime += frame.gpuTime;
+        statistics.shadingSampleFraction += frame.shadingSampleFraction;
+        statistics.pixelShaderInvocations += frame.pixelShaderInvocations;
+        ++statistics.frames;
+
+        if (statistics.frames < c_ComparisonFrames)
+            return;
+
+        m_comparisonSkippedFrames = 0;
+        m_vrsMode = VrsMode(int(mode) + 1);
+        if (m_vrsMode != VrsMode::Count)
+            return;
+
+        m_comparisonRunning = false;
+        m_vrsMode = m_modeBeforeComparison;
+
+        const ModeStatistics& reference = m_comparison[int(VrsMode::Off)];
+        log::info("VRS comparison, average of %u frames per mode:", c_ComparisonFrames);
+        for (int index = 0; index < int(VrsMode::Count); index++)
+        {
+            const ModeStatistics& result = m_comparison[index];
+            const double frames = double(result.frames);
+            const double invocations = result.pixelShaderInvocations / frames;
+            const double referenceInvocations = reference.pixelShaderInvocations / double(reference.frames);
+
+            if (invocations > 0.0)
+            {
+                log::info("  %-14s %7.3f ms GPU, %5.1f%% shading samples, %12.0f PS invocations (%5.1f%%)",
+                    g_VrsModeNames[index], result.gpuTime / frames, result.shadingSampleFraction / frames * 100.0,
+                    invocations, invocations / referenceInvocations * 100.0);
+            }
+            else
+            {
+                log::info("  %-14s %7.3f ms GPU, %5.1f%% shading samples",
+                    g_VrsModeNames[index], result.gpuTime / frames, result.shadingSampleFraction / frames * 100.0);
+            }
+        }
+    }
+
+    void HarvestFrameQuery()
+    {
+        float gpuTime;
+        FrameTiming timing;
+        if (!m_frameTimers.Harvest(GetFrameIndex(), gpuTime, timing))
+            return;
+
+        const uint32_t slot = m_frameTimers.GetSlot();
+
+        ModeStatistics frame;
+        frame.gpuTime = gpuTime;
+        frame.shadingSampleFraction = 1.0;
+        frame.frames = 1;
+
+        if (timing.mode != VrsMode::Off)
+        {
+            nvrhi::IBuffer* shadingSampleReadback = m_shadingSampleReadbacks[slot];
+            const uint32_t* shadingSamples = static_cast<const uint32_t*>(GetDevice()->mapBuffer(shadingSampleReadback, nvrhi::CpuAccessMode::Read));
+            if (shadingSamples)
+            {
+                frame.shadingSampleFraction = double(*shadingSamples) / double(timing.pixelCount);
+                GetDevice()->unmapBuffer(shadingSampleReadback);
+            }
+        }
+
+#if DONUT_WITH_DX12
+        if (m_pipelineStatisticsReadback)
+        {
+            D3D12_RANGE readRange = { slot * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS), (slot + 1) * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS) };
+            D3D12_RANGE writtenRange = { 0, 0 };
+            void* data = nullptr;
+            if (SUCCEEDED(m_pipelineStatisticsReadback->Map(0, &readRange, &data)))
+            {
+                D3D12_QUERY_DATA_PIPELINE_STATISTICS statistics;
+                memcpy(&statistics, static_cast<const char*>(data) + readRange.Begin, sizeof(statistics));
+                frame.pixelShaderInvocations = double(statistics.PSInvocations);
+                m_pipelineStatisticsReadback->Unmap(0, &writtenRange);
+            }
+        }
+#endif
+
+        m_lastFrame = frame;
+        AddComparisonFrame(timing.mode, frame);
     }
 
     void BackBufferResizing() override
@@ -298,6 +562,7 @@ public:
         m_shadingRateSurface = nullptr;
         m_temporalPass = nullptr;
         m_Pipeline = nullptr;
+        m_overlayPipeline = nullptr;
     }
 
     void Render(nvrhi::IFramebuffer* framebuffer) override
@@ -370,7 +635,9 @@ public:
             nvrhi::BindingLayoutDesc layoutDesc;
             layoutDesc.visibility = nvrhi::ShaderType::Compute;
             layoutDesc.bindings = {
+                nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
                 nvrhi::BindingLayoutItem::Texture_UAV(0),
+                nvrhi::BindingLayoutItem::TypedBuffer_UAV(1),
                 nvrhi::BindingLayoutItem::Texture_SRV(0),
                 nvrhi::BindingLayoutItem::Texture_SRV(1)
             };
@@ -378,7 +645,9 @@ public:
 
             nvrhi::BindingSetDesc bindingSetDesc;
             bindingSetDesc.bindings = {
+                nvrhi::BindingSetItem::ConstantBuffer(0, m_shadingRateConstants),
                 nvrhi::BindingSetItem::Texture_UAV(0, m_shadingRateSurface, nvrhi::Format::R8_UINT),
+                nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_shadingSampleCount),
                 nvrhi::BindingSetItem::Texture_SRV(0, m_RenderTargets->m_MotionVectors, nvrhi::Format::RG16_FLOAT),
                 nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_HdrColor, nvrhi::Format::RGBA16_FLOAT)
             };
@@ -389,8 +658,33 @@ public:
             psoDesc.bindingLayouts = { m_bindingLayout };
 
             m_Pipeline = GetDevice()->createComputePipeline(psoDesc);
+
+            // The overlay reads the rate surface as a UAV too, which keeps it out of shader resource state
+            layoutDesc.bindings = {
+                nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+                nvrhi::BindingLayoutItem::Texture_UAV(0),
+                nvrhi::BindingLayoutItem::Texture_UAV(2)
+            };
+            m_overlayBindingLayout = GetDevice()->createBindingLayout(layoutDesc);
+
+            bindingSetDesc.bindings = {
+                nvrhi::BindingSetItem::ConstantBuffer(0, m_shadingRateConstants),
+                nvrhi::BindingSetItem::Texture_UAV(0, m_shadingRateSurface, nvrhi::Format::R8_UINT),
+                nvrhi::BindingSetItem::Texture_UAV(2, m_RenderTargets->m_ResolvedColor)
+            };
+            m_overlayBindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_overlayBindingLayout);
+
+            psoDesc.CS = m_overlayShader;
+            psoDesc.bindingLayouts = { m_overlayBindingLayout };
+
+            m_overlayPipeline = GetDevice()->createComputePipeline(psoDesc);
         }
 
+        HarvestFrameQuery();
+        const uint32_t querySlot = m_frameTimers.GetSlot();
+
+        const bool vrsEnabled = m_vrsMode != VrsMode::Off;
+
         m_CommandList->open();
 
         if (m_PreviousViewsValid)
@@ -398,13 +692,29 @@ public:
             m_temporalPass->RenderMotionVectors(m_CommandList, m_View, m_ViewPrevious);
         }
 
-        nvrhi::ComputeState state;
-        state.pipeline = m_Pipeline;
-        state.bindings = { m_bindingSet };
-        m_CommandList->setComputeState(state);
+        ShadingRateConstants shadingRateConstants = {};
+        shadingRateConstants.surfaceSize = surfaceDimensions;
+        shadingRateConstants.viewSize = uint2(fbinfo.width, fbinfo.height);
+        shadingRateConstants.tileSize = m_vrsTileSize;
+        shadingRateConstants.mode = m_vrsMode == VrsMode::Uniform2x2 ? SHADING_RATE_MODE_UNIFORM_2X2 : SHADING_RATE_MODE_ADAPTIVE;
+        shadingRateConstants.threshold = c_BaseShadingRateThreshold / m_sensitivity;
+        shadingRateConstants.motionScale = c_ShadingRateMotionScale;
+
+        if (vrsEnabled)
+        {
+            m_CommandList->writeBuffer(m_shadingRateConstants, &shadingRateConstants, sizeof(shadingRateConstants));
+            m_CommandList->clearBufferUInt(m_shadingSampleCount, 0);
+
+            nvrhi::ComputeState state;
+            state.pipeline = m_Pipeline;
+            state.bindings = { m_bindingSet };
+            m_CommandList->setComputeState(state);
 
-        // Dispatch call to generate the VRS surface
-        m_CommandList->dispatch(surfaceDimensions.x, surfaceDimensions.y, 1);
+            // Dispatch call to generate the VRS surface, one group per tile
+            m_CommandList->dispatch(surfaceDimensions.x, surfaceDimensions.y, 1);
+
+            m_CommandList->copyBuffer(m_shadingSampleReadbacks[querySlot], 0, m_shadingSampleCount, 0, sizeof(uint32_t));
+        }
 
         m_RenderTargets->Clear(m_CommandList);
 
@@ -413,8 +723,19 @@ public:
         m_View.FillPlanarViewConstants(constants.view);
         // the PrepareLights() call below will send the constants to the command list, so no need to call it explictly here
 
+        m_frameTimers.Begin(m_CommandList);
+
 #if DONUT_WITH_DX12
-        if (m_UseRawD3D12)
+        ID3D12GraphicsCommandList* statisticsCommandList = nullptr;
+        if (m_pipelineStatisticsHeap)
+        {
+            statisticsCommandList = m_CommandList->getNativeObject(nvrhi::ObjectTypes::D3D12_GraphicsCommandList);
+            statisticsCommandList->BeginQuery(m_pipelineStatisticsHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, querySlot);
+        }
+#endif
+
+#if DONUT_WITH_DX12
+        if (m_UseRawD3D12 && vrsEnabled)
         {
             // VRS command list methods require ID3D12GraphicsCommandList5
             ID3D12GraphicsCommandList* d3dcmdlist = m_CommandList->getNativeObject(nvrhi::ObjectTypes::D3D12_GraphicsCommandList);
@@ -447,7 +768,7 @@ public:
 #endif // DONUT_WITH_DX12
         {
             // enable VRS, with a per-drawcall shading rate of 1X1, and make the shading rate image result always override all others
-            m_View.SetVariableRateShadingState(nvrhi::VariableRateShadingState().setEnabled(true).setShadingRate(nvrhi::VariableShadingRate::e1x1).setImageCombiner(nvrhi::ShadingRateCombiner::Override));
+            m_View.SetVariableRateShadingState(nvrhi::VariableRateShadingState().setEnabled(vrsEnabled).setShadingRate(nvrhi::VariableShadingRate::e1x1).setImageCombiner(nvrhi::ShadingRateCombiner::Override));
         }
 
         // Forward pass to draw the scene with the VRS surface set above
@@ -457,7 +778,21 @@ public:
         render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_HdrFramebufferDepth, m_Scene->GetSceneGraph()->GetRootNode(), *m_TransparentDrawStrategy, *m_ForwardPass, forwardContext);
 
 #if DONUT_WITH_DX12
-        if (m_UseRawD3D12)
+        if (statisticsCommandList)
+        {
+            statisticsCommandList->EndQuery(m_pipelineStatisticsHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, querySlot);
+            statisticsCommandList->ResolveQueryData(m_pipelineStatisticsHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, querySlot, 1,
+                m_pipelineStatisticsReadback, querySlot * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+        }
+#endif
+
+        FrameTiming timing;
+        timing.mode = m_vrsMode;
+        timing.pixelCount = fbinfo.width * fbinfo.height;
+        m_frameTimers.End(m_CommandList, timing);
+
+#if DONUT_WITH_DX12
+        if (m_UseRawD3D12 && vrsEnabled)
         {
             ID3D12GraphicsCommandList* d3dcmdlist = m_CommandList->getNativeObject(nvrhi::ObjectTypes::D3D12_GraphicsCommandList);
             ID3D12GraphicsCommandList5* vrscmdlist = nullptr;
@@ -491,6 +826,15 @@ public:
             m_PreviousViewsValid = true;
         }
 
+        if (m_showOverlay && vrsEnabled)
+        {
+            nvrhi::ComputeState state;
+            state.pipeline = m_overlayPipeline;
+            state.bindings = { m_overlayBindingSet };
+            m_CommandList->setComputeState(state);
+            m_CommandList->dispatch(div_ceil(fbinfo.width, SHADING_RATE_GROUP_SIZE), div_ceil(fbinfo.height, SHADING_RATE_GROUP_SIZE), 1);
+        }
+
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->m_ResolvedColor, m_BindingCache.get());
 
         m_CommandList->close();
@@ -22,7 +22,6 @@
 
 #include "d3dx12/d3dx12.h"
 #include <donut/app/ApplicationBase.h>
-#include <donut/engine/FramebufferFactory.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/app/imgui_renderer.h>
@@ -30,7 +29,7 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
 #include <wrl.h>
-#include "scene.h"
+#include "tiled_deferred_renderer.h"
 
 using namespace donut;
 using namespace donut::app;
@@ -42,105 +41,29 @@ static const char* g_WindowTitle = "Donut Example: Work Graphs";
 #define WORKGRAPH_NAME L"D3D12WorkGraphs"
 
 
-// Constants used by deferred shading. Ensure these values are matched with the shaders.
-static const uint32_t DeferredShadingParam_MaxLightsPerTile = 64; // If changed, make sure to also change the constant c_MaxLightsPerTile in lighting.hlsli
-static const uint32_t DeferredShadingParam_TileWidth = 8;
-static const uint32_t DeferredShadingParam_TileHeight = 4;
-
-// Simulation and camera control constants.
-static const float Animation_SpeedMultiplier = 1.0f;
-static const float Camera_PositionOrbitSpeed = 0.1f;
-static const float Camera_TargetOrbitSpeed = 0.03f;
-static const float Camera_PositionRadiusRatio = 0.75f;
-static const float Camera_TargetRadiusRatio = 0.1f;
-static const float Camera_ClimbSpeed = 0.1f;
-static const float Camera_ClimbRatio = 0.6f;
-static const float Camera_VerticalFOV = (dm::PI_f/4.0f)*1.15f; // In radians.
-static const float Camera_NearClipDistance = 0.5f;
-
-
 struct UIData
 {
     bool ShowUI = true;
     int CurrentTechnique = 0;
     bool Paused = false;
     bool ResetAnim = false;
+    int ScenePreset = 0;
     float GPUFrameTime = 0.0f;
     float GPUShadingTime = 0.0f;
+    uint32_t LightCount = 0;
+    uint32_t LightListSize = 0;
+    uint32_t LightListCapacity = 0;
+    bool FrustumCulling = true;
+    uint32_t ObjectCount = 0;
+    uint32_t VisibleObjectCount = 0;
 };
 
 
-struct RenderTargets
-{
-    nvrhi::TextureHandle m_Depth;
-    nvrhi::TextureHandle m_LDRBuffer;
-    nvrhi::TextureHandle m_GBuffer;
-    nvrhi::IFramebuffer* m_FrameBufferGB;
-    std::shared_ptr<engine::FramebufferFactory> m_GBufferDepth;
-
-    int2 m_Size;
-
-    RenderTargets(nvrhi::IDevice* device, int2 size)
-        : m_Size(size)
-    {
-        nvrhi::TextureDesc desc;
-        desc.width = size.x;
-        desc.height = size.y;
-        desc.keepInitialState = true;
-
-        // Depth buffer
-        desc.useClearValue = true;
-        desc.clearValue = nvrhi::Color(1.f);
-        desc.isRenderTarget = true;
-        desc.isTypeless = true;
-        desc.format = nvrhi::Format::D32;
-        desc.initialState = nvrhi::ResourceStates::ShaderResource;
-        desc.debugName = "DepthBuffer";
-        m_Depth = device->createTexture(desc);
-
-        // G buffer
-        desc.format = nvrhi::Format::RGBA16_UINT;
-        desc.clearValue = nvrhi::Color(0.f);
-        desc.useClearValue = false;
-        desc.isTypeless = false;
-        desc.initialState = nvrhi::ResourceStates::ShaderResource;
-        desc.debugName = "GBuffer";
-        m_GBuffer = device->createTexture(desc);
-
-        // LDR buffer
-        desc.format = nvrhi::Format::RGBA8_UNORM;
-        desc.isRenderTarget = false;
-        desc.isUAV = true;
-        desc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        desc.debugName = "LDRBuffer";
-        m_LDRBuffer = device->createTexture(desc);
-
-        m_GBufferDepth = std::make_shared<engine::FramebufferFactory>(device);
-        m_GBufferDepth->RenderTargets = { m_GBuffer };
-        m_GBufferDepth->DepthTarget = m_Depth;
-
-        m_FrameBufferGB = m_GBufferDepth->GetFramebuffer(nvrhi::TextureSubresourceSet());
-    }
-
-    bool IsUpdateRequired(int2 size) const { return any(m_Size != size); }
-};
-
-
+// The scene, its animation, object culling and g-buffer passes come from the cross-API tiled deferred renderer
+// (see examples/tiled_deferred). This sample compares its light culling and shading passes against a single work graph.
 class WorkGraphs : public app::IRenderPass
 {
 private:
-    enum class ScenePass
-    {
-        AnimateObjects,
-        AnimateLights,
-        GBufferFill,
-        LightCulling,
-        DeferredShading,
-        WorkGraph,
-
-        COUNT
-    };
-
     enum class Techniques
     {
         WorkGraphBroadcastingLaunch,
@@ -149,21 +72,9 @@ private:
         COUNT,
     };
 
-    std::unique_ptr<RenderTargets> m_RenderTargets;
-    nvrhi::InputLayoutHandle m_InputLayout;
-    nvrhi::BindingLayoutHandle m_BindingLayout;
-    nvrhi::BindingSetHandle m_BindingSets[(int)ScenePass::COUNT];
-
-    Scene m_Scene;
+    TiledDeferredRenderer m_Renderer;
     nvrhi::CommandListHandle m_CommandList;
 
-    // Pipeline state objects.
-    nvrhi::ComputePipelineHandle m_AnimateObjectsPSO;
-    nvrhi::ComputePipelineHandle m_AnimateLightsPSO;
-    nvrhi::GraphicsPipelineHandle m_GBufferFillPSO;
-    nvrhi::ComputePipelineHandle m_CullLightsPSO;
-    nvrhi::ComputePipelineHandle m_ShadePSO;
-
     // Work graph objects.
     ComPtr<ID3D12StateObject> m_WorkGraphBroadcastingSO;
 
@@ -171,42 +82,14 @@ private:
 
     nvrhi::BufferHandle m_WorkGraphBackingMemory;
 
-    // Resources.
-    nvrhi::BufferHandle m_ConstantBuffer;
-    nvrhi::BufferHandle m_CulledLightsBuffer;
-
-    nvrhi::BufferHandle m_NullSRVBuffer;
-    nvrhi::BufferHandle m_NullUAVBuffer;
-    nvrhi::TextureHandle m_NullSRVTexture;
-    nvrhi::TextureHandle m_NullUAVTexture;
-
     // State.
     Techniques m_CurrentTechnique = Techniques::WorkGraphBroadcastingLaunch;
+    Scene::Preset m_CurrentPreset = Scene::Preset::SP_Default;
     bool m_InitWorkGraphBackingMemory = true;
     UIData& m_UI;
-
-    // Timing.
-    static const uint32_t QueuedFramesCount = 10;
-    nvrhi::TimerQueryHandle m_FrameTimers[QueuedFramesCount];
-    nvrhi::TimerQueryHandle m_ShadingTimers[QueuedFramesCount];
-    int m_NextTimerToUse = 0;
+    Scene::ScaleParams m_InitialSceneParams;
     float m_TimeInSeconds = 0.0f;
     float m_TimeDiffThisFrame = 0.0f;
-    bool m_ForceResetAnimation = true;
-
-    // Constant buffer definition.
-    struct SceneConstantBuffer
-    {
-        float4x4 viewProj;
-        float4x4 viewProjInverse;
-        float4 camPosAndSceneTime;
-        float4 camDir;
-        float4 viewportSizeXY;
-
-        // Constant buffers are 256-byte aligned. Add padding in the struct to allow multiple buffers
-        // to be array-indexed.
-        float padding[20];
-    };
 
     // Utility functions.
     static inline bool HRSuccess(HRESULT hr) { assert(SUCCEEDED(hr)); return SUCCEEDED(hr); }
@@ -216,47 +99,14 @@ private:
         shaderLib->getBytecode(&bc.pShaderBytecode, &bc.BytecodeLength);
         return bc;
     };
-    static inline uint32_t GetLightTileCountX(uint32_t viewportWidth) { return (viewportWidth+DeferredShadingParam_TileWidth-1)/DeferredShadingParam_TileWidth; };
-    static inline uint32_t GetLightTileCountY(uint32_t viewportHeight) { return (viewportHeight+DeferredShadingParam_TileHeight-1)/DeferredShadingParam_TileHeight; };
-    static inline uint32_t GetLightTileCount(uint32_t viewportWidth, uint32_t viewportHeight) { return GetLightTileCountX(viewportWidth) * GetLightTileCountY(viewportHeight); };
-    float GetLastValidQueryTimer(nvrhi::TimerQueryHandle timers[QueuedFramesCount])
-    {
-        nvrhi::IDevice *device = GetDevice();
-        for (int i=m_NextTimerToUse-1;i>=0;i--)
-        {
-            if (device->pollTimerQuery(timers[i]))
-                return device->getTimerQueryTime(timers[i])*1000.0f;
-        }
-
-        for (int i=QueuedFramesCount-1;i>m_NextTimerToUse;i--)
-        {
-            if (device->pollTimerQuery(timers[i]))
-                return device->getTimerQueryTime(timers[i])*1000.0f;
-        }
-        return -1.0f;
-    }
-    static inline float4x4 lookToD3DStyle(const float3& eyePosition, const float3& focusPosition, const float3& upDirection)
-    {
-        float3 eyeDirection = focusPosition - eyePosition;
-        float3 negEyePosition = -eyePosition;
-        float3 z = normalize(eyeDirection);
-        float3 x = normalize(cross(upDirection, z));
-        float3 y = cross(z, x);
-
-        float4x4 m;
-        m.row0 = float4(x, dot(x, negEyePosition));
-        m.row1 = float4(y, dot(y, negEyePosition));
-        m.row2 = float4(z, dot(z, negEyePosition));
-        m.row3 = float4(0,0,0,1);
-        return transpose(m);
-    }
 
 public:
     using IRenderPass::IRenderPass;
 
-    WorkGraphs(DeviceManager* deviceManager, UIData& ui) :
+    WorkGraphs(DeviceManager* deviceManager, UIData& ui, const Scene::ScaleParams& sceneParams) :
         IRenderPass(deviceManager),
-        m_UI(ui)
+        m_UI(ui),
+        m_InitialSceneParams(sceneParams)
     {}
 
     bool Init()
@@ -280,212 +130,26 @@ public:
 
         m_CommandList = GetDevice()->createCommandList();
 
-        // Resources used to fill unused shader binding slots (null resources).
-        m_NullSRVBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
-            .setByteSize(512).setStructStride(16).setKeepInitialState(true)
-            .setInitialState(nvrhi::ResourceStates::ShaderResource).setDebugName("NullSRVBuffer"));
-        m_NullUAVBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
-            .setByteSize(512).setStructStride(16).setKeepInitialState(true)
-            .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setCanHaveUAVs(true).setDebugName("NullUAVBuffer"));
-        m_NullSRVTexture = GetDevice()->createTexture(nvrhi::TextureDesc()
-            .setFormat(nvrhi::Format::RGBA8_UNORM).setKeepInitialState(true)
-            .setInitialState(nvrhi::ResourceStates::ShaderResource).setDebugName("NullSRVTexture"));
-        m_NullUAVTexture = GetDevice()->createTexture(nvrhi::TextureDesc()
-            .setFormat(nvrhi::Format::RGBA8_UNORM).setKeepInitialState(true)
-            .setInitialState(nvrhi::ResourceStates::UnorderedAccess).setIsUAV(true).setDebugName("NullUAVTexture"));
-
-        for (uint32_t i=0; i<QueuedFramesCount; i++)
-        {
-            m_FrameTimers[i] = GetDevice()->createTimerQuery();
-            m_ShadingTimers[i] = GetDevice()->createTimerQuery();
-        }
-        
-        // Create the scene procedurally.
-        m_CommandList->open();
-        m_Scene.CreateAssets(GetDevice(), m_CommandList);
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
-        GetDevice()->waitForIdle();
+        // The renderer's shaders are built by the tiled_deferred target.
+        std::filesystem::path rendererShaderPath = app::GetDirectoryWithExecutable() / "shaders/tiled_deferred" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        if (!m_Renderer.Init(GetDevice(), rendererShaderPath))
+            return false;
+
+        CreateScene((Scene::Preset)m_UI.ScenePreset, m_InitialSceneParams);
 
         return true;
     }
 
-    bool LoadScenePipelines(nvrhi::IFramebuffer* gBufferFramebuffer,nvrhi::IFramebuffer* backBufferFramebuffer)
+    void CreateScene(Scene::Preset preset, const Scene::ScaleParams& params)
     {
-        std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/work_graphs_d3d12" /  app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
-        
-        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
-        engine::ShaderFactory shaderFactory(GetDevice(), nativeFS, appShaderPath);
-
-        nvrhi::ShaderHandle animateObjects_computeShader = shaderFactory.CreateShader("animation.hlsl", "CSMainObjects", nullptr, nvrhi::ShaderType::Compute);
-        nvrhi::ShaderHandle animateLights_computeShader = shaderFactory.CreateShader("animation.hlsl", "CSMainLights", nullptr, nvrhi::ShaderType::Compute);
-        nvrhi::ShaderHandle gbuffer_vertexShader = shaderFactory.CreateShader("gbuffer_fill.hlsl", "VSMain", nullptr, nvrhi::ShaderType::Vertex);
-        nvrhi::ShaderHandle gbuffer_pixelShader = shaderFactory.CreateShader("gbuffer_fill.hlsl", "PSMain", nullptr, nvrhi::ShaderType::Pixel);
-        nvrhi::ShaderHandle lightCulling_computeShader = shaderFactory.CreateShader("light_culling.hlsl", "CSMain", nullptr, nvrhi::ShaderType::Compute);
-        nvrhi::ShaderHandle deferredShading_computeShader = shaderFactory.CreateShader("deferred_shading.hlsl", "CSMain", nullptr, nvrhi::ShaderType::Compute);
-
-        if (!animateObjects_computeShader || !animateLights_computeShader ||
-            !gbuffer_vertexShader || !gbuffer_pixelShader ||
-            !lightCulling_computeShader || !deferredShading_computeShader)
-        {
-            return false;
-        }
-
-		auto bindingLayoutDesc = nvrhi::BindingLayoutDesc()
-            .setRegisterSpace(0)
-            .setVisibility(nvrhi::ShaderType::All)
-            .addItem(nvrhi::BindingLayoutItem::PushConstants(0,sizeof(int3)))
-            .addItem(nvrhi::BindingLayoutItem::VolatileConstantBuffer(1))
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0))
-			.addItem(nvrhi::BindingLayoutItem::Texture_SRV(1))
-			.addItem(nvrhi::BindingLayoutItem::Texture_SRV(2))
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3))
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(4))
-			.addItem(nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0))
-            .addItem(nvrhi::BindingLayoutItem::Texture_UAV(1));
-        m_BindingLayout = GetDevice()->createBindingLayout(bindingLayoutDesc);
-
-        nvrhi::VertexAttributeDesc attributes[] = {
-            nvrhi::VertexAttributeDesc()
-                .setName("POSITION")
-                .setFormat(nvrhi::Format::RGB32_FLOAT)
-                .setOffset(0)
-                .setElementStride(sizeof(float3)*2),
-            nvrhi::VertexAttributeDesc()
-                .setName("NORMAL")
-                .setFormat(nvrhi::Format::RGB32_FLOAT)
-                .setOffset(sizeof(float3))
-                .setElementStride(sizeof(float3)*2),
-            };
-        m_InputLayout = GetDevice()->createInputLayout(attributes, uint32_t(std::size(attributes)), gbuffer_vertexShader);
-
-        // Create pipeine states
-        {
-            nvrhi::GraphicsPipelineDesc psoGfxDesc;
-            psoGfxDesc.inputLayout = m_InputLayout;
-            psoGfxDesc.bindingLayouts = { m_BindingLayout };
-            psoGfxDesc.VS = gbuffer_vertexShader;
-            psoGfxDesc.PS = gbuffer_pixelShader;
+        m_Renderer.CreateScene(m_CommandList, params);
 
-            m_GBufferFillPSO = GetDevice()->createGraphicsPipeline(psoGfxDesc, gBufferFramebuffer);
-        }
-
-        nvrhi::ComputePipelineDesc psoCSDesc;
-        psoCSDesc.bindingLayouts = { m_BindingLayout };
-
-        m_AnimateObjectsPSO = GetDevice()->createComputePipeline(psoCSDesc.setComputeShader(animateObjects_computeShader));
-        m_AnimateLightsPSO = GetDevice()->createComputePipeline(psoCSDesc.setComputeShader(animateLights_computeShader));
-        m_CullLightsPSO = GetDevice()->createComputePipeline(psoCSDesc.setComputeShader(lightCulling_computeShader));
-        m_ShadePSO = GetDevice()->createComputePipeline(psoCSDesc.setComputeShader(deferredShading_computeShader));
-
-        // Create the culled lights buffer.
-        {
-            uint2 framebufferSize = uint2(gBufferFramebuffer->getFramebufferInfo().width, gBufferFramebuffer->getFramebufferInfo().height);
-            const uint32_t tileCount = GetLightTileCount(framebufferSize.x, framebufferSize.y);
-
-            nvrhi::BufferDesc bufferDesc;
-            bufferDesc.byteSize = tileCount * DeferredShadingParam_MaxLightsPerTile * sizeof(UINT32);
-            bufferDesc.structStride = sizeof(UINT32);
-            bufferDesc.canHaveUAVs = true;
-            bufferDesc.debugName = "CulledLights";
-            bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
-            bufferDesc.keepInitialState = true;
-            m_CulledLightsBuffer = GetDevice()->createBuffer(bufferDesc);
-        }
-
-        // Create the constant buffer.
-        {
-            nvrhi::BufferDesc bufferDesc;
-            bufferDesc.byteSize = sizeof(SceneConstantBuffer);
-            bufferDesc.maxVersions = 16;
-            bufferDesc.isConstantBuffer = true;
-            bufferDesc.isVolatile = true;
-            bufferDesc.debugName = "SceneConstants";
-            bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
-            bufferDesc.keepInitialState = true;
-            m_ConstantBuffer = GetDevice()->createBuffer(bufferDesc);
-        }
-
-        // Create the resource binding sets for each pass. The resource registers must match with
-        // assignments used in the shader files. Donut internally takes care of resource states and transition barriers.
-        m_BindingSets[(int)ScenePass::AnimateObjects] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetWorldObjectsBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_Scene.GetAnimStateBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
-            m_BindingLayout);
-
-        m_BindingSets[(int)ScenePass::AnimateLights] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_Scene.GetLightsBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
-            m_BindingLayout);
-
-        m_BindingSets[(int)ScenePass::GBufferFill] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetWorldObjectsBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_Scene.GetMaterialsBuffer()))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetAnimStateBuffer()))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
-            m_BindingLayout);
-
-        m_BindingSets[(int)ScenePass::LightCulling] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_Depth))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_NullSRVTexture))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_CulledLightsBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_NullUAVTexture)),
-            m_BindingLayout);
-
-        m_BindingSets[(int)ScenePass::DeferredShading] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetMaterialsBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_GBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_Depth))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_CulledLightsBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_RenderTargets->m_LDRBuffer)),
-            m_BindingLayout);
-
-         m_BindingSets[(int)ScenePass::WorkGraph] = GetDevice()->createBindingSet(nvrhi::BindingSetDesc()
-            .addItem(nvrhi::BindingSetItem::PushConstants(0, sizeof(uint3)))
-            .addItem(nvrhi::BindingSetItem::ConstantBuffer(1, m_ConstantBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene.GetMaterialsBuffer()))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_GBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_Depth))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_NullSRVBuffer))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene.GetLightsBuffer()))
-            .addItem(nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_NullUAVBuffer))
-            .addItem(nvrhi::BindingSetItem::Texture_UAV(1, m_RenderTargets->m_LDRBuffer)),
-            m_BindingLayout);
-
-        // Animation state must be reset to good values before being updated every frame.
-        m_ForceResetAnimation = true;
-        return true;
+        m_CurrentPreset = preset;
+        m_UI.LightCount = (uint32_t)m_Renderer.GetScene().GetLights().size();
+        m_UI.ObjectCount = (uint32_t)m_Renderer.GetScene().GetWorldObjects().size();
     }
 
-    bool LoadWorkGraphPipelines(nvrhi::IFramebuffer* framebuffer)
+    bool LoadWorkGraphPipelines()
     {
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/work_graphs_d3d12" /  app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         
@@ -499,8 +163,8 @@ public:
             return false;
 
         ID3D12Device *device = GetDevice()->getNativeObject(nvrhi::ObjectTypes::D3D12_Device);
-        ID3D12RootSignature *rootSignature = m_ShadePSO->getNativeObject(nvrhi::ObjectTypes::D3D12_RootSignature);
-        uint2 framebufferSize = uint2(framebuffer->getFramebufferInfo().width, framebuffer->getFramebufferInfo().height);
+        ID3D12RootSignature *rootSignature = m_Renderer.GetShadePipeline()->getNativeObject(nvrhi::ObjectTypes::D3D12_RootSignature);
+        uint2 framebufferSize = uint2(m_Renderer.GetRenderTargets()->m_Size);
 
         ComPtr<ID3D12Device5> deviceD3D12;
         device->QueryInterface(IID_PPV_ARGS(&deviceD3D12));
@@ -514,7 +178,7 @@ public:
         // pieces of information (sub-objects) besides the shader itself. It is possible that all the sub-objects
         // needed for creating the state object are already present in the compiled library, in which case
         // CreateStateObject will use those sub-objects automatically.
-        // In this sample, the work graph is using a root signature object that is shared with all other shaders in the application.
+        // In this sample, the work graph is using a root signature object that is shared with all the shaders of the renderer.
         // Thus, we manually provide the root signature to the state object descriptor.
         // (The use of D3DX is optional. It simplifies code a lot for this demo).
 
@@ -542,7 +206,7 @@ public:
         // it is better to avoid the performance cost when using SV_DispatchGrid, and rely on overriding
         // the [NodeDispatchGrid()] attribute instead.
         auto rootNodeDispatchGridSizeOverride = workGraphSubObj_WorkGraph->CreateBroadcastingLaunchNodeOverrides(L"LightCull_Node");
-        rootNodeDispatchGridSizeOverride->DispatchGrid(GetLightTileCountX(framebufferSize.x), GetLightTileCountY(framebufferSize.y), 1);
+        rootNodeDispatchGridSizeOverride->DispatchGrid(TiledDeferredRenderer::GetLightTileCountX(framebufferSize.x), TiledDeferredRenderer::GetLightTileCountY(framebufferSize.y), 1);
 
         // All sub-objects have been defined. Now create the state object.
         if (!HRSuccess(deviceD3D12->CreateStateObject(soWorkGraphDesc, IID_PPV_ARGS(&m_WorkGraphBroadcastingSO))))
@@ -574,189 +238,24 @@ public:
         bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
         bufferDesc.keepInitialState = true;
         m_WorkGraphBackingMemory = GetDevice()->createBuffer(bufferDesc);
+        m_InitWorkGraphBackingMemory = true; // Newly created backing memory must be initialized before its first use.
 
         return true;
     }
 
-    void UpdateSceneConstants()
-    {
-        // Camera calculations.
-        float3 camPosition, camTarget;
-        float4x4 view, proj;
-        {
-            const float sceneSize = Scene::GetSceneSize();
-            const float sceneHeight = Scene::GetSceneHeight();
-
-            camPosition.x = cosf(m_TimeInSeconds * Camera_PositionOrbitSpeed) * sceneSize * Camera_PositionRadiusRatio;
-            camPosition.y = sinf(m_TimeInSeconds * Camera_ClimbSpeed - 1.75f) * sceneHeight * Camera_ClimbRatio + sceneHeight * Camera_ClimbRatio + 10.0f;
-            camPosition.z = sinf(m_TimeInSeconds * Camera_PositionOrbitSpeed) * sceneSize * Camera_PositionRadiusRatio;
-
-            camTarget.x = cosf(m_TimeInSeconds * Camera_TargetOrbitSpeed) * sceneSize * Camera_TargetRadiusRatio;
-            camTarget.y = 0;
-            camTarget.z = sinf(m_TimeInSeconds * Camera_TargetOrbitSpeed) * sceneSize * Camera_TargetRadiusRatio;
-
-            float aspectRatio = (float)m_RenderTargets->m_Size.x / (float)m_RenderTargets->m_Size.y;
-
-            const float3 camUp = {0,1,0};
-            view = lookToD3DStyle(camPosition, camTarget, camUp);
-            proj = perspProjD3DStyle(Camera_VerticalFOV, aspectRatio, Camera_NearClipDistance, sceneSize*1.2f);
-        }
-
-        // Write the new values to the constant buffer. Donut internally handles versioning of the buffer.
-        SceneConstantBuffer constants = {};
-        constants.viewProj = transpose(view*proj);
-        constants.viewProjInverse = transpose(inverse(view*proj));
-        constants.camPosAndSceneTime.x = camPosition.x;
-        constants.camPosAndSceneTime.y = camPosition.y;
-        constants.camPosAndSceneTime.z = camPosition.z;
-        constants.camPosAndSceneTime.w = m_TimeInSeconds;
-        constants.camDir = float4(normalize(camTarget-camPosition),0);
-        constants.viewportSizeXY.x = (float)m_RenderTargets->m_Size.x;
-        constants.viewportSizeXY.y = (float)m_RenderTargets->m_Size.y;
-
-        m_CommandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
-    }
-
-    void PopulateAnimationPass()
-    {
-        m_CommandList->beginMarker("Animation");
-
-        bool resetAnim = m_ForceResetAnimation || m_UI.ResetAnim;
-
-        // Object Animation compute shader.
-        nvrhi::ComputeState state;
-        state.pipeline = m_AnimateObjectsPSO;
-        state.bindings = { m_BindingSets[(int)ScenePass::AnimateObjects] };
-        m_CommandList->setComputeState(state);
-
-        uint32_t rootConstants[3] = {0, 0, resetAnim ? 1U : 0U};
-        ((float*)rootConstants)[0] = m_TimeInSeconds;
-        ((float*)rootConstants)[1] = m_TimeDiffThisFrame;
-        m_CommandList->setPushConstants(rootConstants, sizeof(rootConstants));
-
-        // Dispatch enough thread groups to cover all scene objects.
-        {
-            const int threadsX = 32;
-            const size_t totalDispatchSize = (m_Scene.GetWorldObjects().size()+(threadsX-1)) / threadsX;
-            const size_t dispatchY = max(totalDispatchSize / D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, size_t(1));
-            const size_t dispatchX = max(totalDispatchSize % D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, size_t(1));
-            m_CommandList->dispatch((uint32_t)dispatchX, (uint32_t)dispatchY);
-        }
-
-        // Light Animation compute shader.
-        state.pipeline = m_AnimateLightsPSO;
-        state.bindings = { m_BindingSets[(int)ScenePass::AnimateLights] };
-        m_CommandList->setComputeState(state);
-        m_CommandList->setPushConstants(rootConstants, sizeof(rootConstants));
-
-        // Dispatch enough thread groups to cover all scene objects.
-        {
-            const int threadsX = 32;
-            const size_t totalDispatchSize = (m_Scene.GetLights().size()+(threadsX-1)) / threadsX;
-            const size_t dispatchY = max(totalDispatchSize / D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, size_t(1));
-            const size_t dispatchX = max(totalDispatchSize % D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, size_t(1));
-            m_CommandList->dispatch((uint32_t)dispatchX, (uint32_t)dispatchY);
-        }
-
-        m_CommandList->endMarker();
-
-        m_ForceResetAnimation = false; // Animation buffer initialized, no need to redo it again in subsequent frames.
-    }
-
-    void PopulateGBufferPass()
-    {
-        // It is enough to clear the depth-buffer without the g-buffer. Depth buffer values of 1 mean "sky".
-        m_CommandList->clearDepthStencilTexture(m_RenderTargets->m_Depth, nvrhi::TextureSubresourceSet(), true, 1.0f, false, 0);
-
-        nvrhi::GraphicsState state;
-        state.pipeline = m_GBufferFillPSO;
-        state.bindings = { m_BindingSets[(int)ScenePass::GBufferFill] };
-        state.framebuffer = m_RenderTargets->m_FrameBufferGB;
-        state.viewport.addViewportAndScissorRect(m_RenderTargets->m_FrameBufferGB->getFramebufferInfo().getViewport());
-        state.indexBuffer = nvrhi::IndexBufferBinding().setFormat(nvrhi::Format::R16_UINT);
-        state.vertexBuffers.push_back(nvrhi::VertexBufferBinding());
-
-        m_CommandList->beginMarker("Draw all meshes");
-
-        size_t objectIndex = 0;
-        Scene::MeshType lastMeshType = Scene::MeshType::MT_COUNT;
-        uint32_t indexCount = 0;
-        for (const Scene::Instance& object : m_Scene.GetWorldObjects())
-        {
-            if (object.meshType != lastMeshType)
-            {
-                lastMeshType = object.meshType;
-
-                indexCount = (uint32_t)(m_Scene.GetMeshIndexBuffer(object.meshType)->getDesc().byteSize / sizeof(UINT16));
-                state.indexBuffer.buffer = m_Scene.GetMeshIndexBuffer(object.meshType);
-                state.vertexBuffers.front().buffer = m_Scene.GetMeshVertexBuffer(object.meshType);
-                m_CommandList->setGraphicsState(state);
-            }
-            
-            uint32_t rootConstant[3] = { (uint32_t)objectIndex, 0, 0 };
-            m_CommandList->setPushConstants(&rootConstant,sizeof(rootConstant));
-            m_CommandList->drawIndexed(nvrhi::DrawArguments().setVertexCount(indexCount));
-            objectIndex++;
-        }
-        m_CommandList->endMarker();
-    }
-
-    void PopulateLightCullingPass()
-    {
-        m_CommandList->beginMarker("Light Culling");
-
-        // Light culling compute shader.
-        nvrhi::ComputeState state;
-        state.pipeline = m_CullLightsPSO;
-        state.bindings = { m_BindingSets[(int)ScenePass::LightCulling] };
-        m_CommandList->setComputeState(state);
-
-        const uint32_t tilesX = GetLightTileCountX(m_RenderTargets->m_Size.x);
-        const uint32_t tilesY = GetLightTileCountY(m_RenderTargets->m_Size.y);
-        const uint32_t rootConstants[3] = {tilesX, tilesY, (uint32_t)m_Scene.GetLights().size()};
-        m_CommandList->setPushConstants(rootConstants, sizeof(rootConstants));
-
-        // Dispatch enough thread groups to cover all screen tiles.
-        m_CommandList->dispatch(tilesX, tilesY);
-
-        m_CommandList->endMarker();
-    }
-
-    void PopulateDeferredShadingPass()
-    {
-        m_CommandList->beginMarker("Deferred Shading");
-
-        // Deferred shading compute shader.
-        nvrhi::ComputeState state;
-        state.pipeline = m_ShadePSO;
-        state.bindings = { m_BindingSets[(int)ScenePass::DeferredShading] };
-        m_CommandList->setComputeState(state);
-
-        const uint32_t tilesX = GetLightTileCountX(m_RenderTargets->m_Size.x);
-        const uint32_t tilesY = GetLightTileCountY(m_RenderTargets->m_Size.y);
-        const uint32_t rootConstants[3] = {tilesX, tilesY, (uint32_t)m_Scene.GetLights().size()};
-        m_CommandList->setPushConstants(rootConstants, sizeof(rootConstants));
-
-        // Dispatch enough thread groups to cover the entire viewport.
-        {
-            const int threadsX = 8;
-            const int threadsY = 4;
-            m_CommandList->dispatch((m_RenderTargets->m_Size.x+(threadsX-1))/threadsX, (m_RenderTargets->m_Size.y+(threadsY-1))/threadsY, 1);
-        }
-        m_CommandList->endMarker();
-    }
-    
     void PopulateDeferredShadingWorkGraph()
     {
         m_CommandList->beginMarker("Deferred Shading Work Graph");
+        m_Renderer.BeginPhase(m_CommandList, TiledDeferredRenderer::Phase::Shading);
 
         // Work graph resource bindings. These are regular bindings applied on the compute state.
+        // The work graph reads the same resources as the deferred shading pass, so it shares its binding set.
         nvrhi::ComputeState state;
-        state.pipeline = m_AnimateLightsPSO; // This is ignored. It's just a PSO to allow Donut establish the bindings below.
-        state.bindings = { m_BindingSets[(int)ScenePass::WorkGraph] };
+        state.pipeline = m_Renderer.GetShadePipeline(); // This is ignored. It's just a PSO to allow Donut establish the bindings below.
+        state.bindings = { m_Renderer.GetShadingBindingSet() };
         m_CommandList->setComputeState(state);
 
-        const uint32_t rootConstants[3] = {(uint32_t)m_Scene.GetLights().size(), 0, 0};
+        const uint32_t rootConstants[3] = {(uint32_t)m_Renderer.GetScene().GetLights().size(), 0, 0};
         m_CommandList->setPushConstants(rootConstants, sizeof(rootConstants));
 
         // Set the work graph program.
@@ -787,14 +286,10 @@ public:
 
         m_InitWorkGraphBackingMemory = false; // Memory initialized, no need to redo it again in subsequent frames.
 
+        m_Renderer.EndPhase(m_CommandList, TiledDeferredRenderer::Phase::Shading);
         m_CommandList->endMarker();
     }
 
-    void BackBufferResizing() override
-    { 
-        m_RenderTargets = nullptr;
-    }
-
     void Animate(float fElapsedTimeSeconds) override
     {
         if (!m_UI.Paused)
@@ -804,7 +299,7 @@ public:
         }
         else m_TimeDiffThisFrame = 0.0f;
 
-        bool resetAnim = m_ForceResetAnimation || m_UI.ResetAnim;
+        bool resetAnim = m_Renderer.IsAnimationResetPending() || m_UI.ResetAnim;
         if (resetAnim)
             m_TimeInSeconds = m_TimeDiffThisFrame = 0.0f;
 
@@ -814,9 +309,8 @@ public:
             m_InitWorkGraphBackingMemory = true;
         }
 
-        // Update UI info.
-        m_UI.GPUFrameTime = GetLastValidQueryTimer(m_FrameTimers);
-        m_UI.GPUShadingTime = GetLastValidQueryTimer(m_ShadingTimers);
+        if ((int)m_CurrentPreset != m_UI.ScenePreset)
+            CreateScene((Scene::Preset)m_UI.ScenePreset, Scene::GetPresetParams((Scene::Preset)m_UI.ScenePreset));
 
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
     }
@@ -826,66 +320,66 @@ public:
         // This is the back buffer. At the end of the frame, the results are copied to it for display.
         const auto& fbinfo = framebuffer->getFramebufferInfo();
 
-        // First frame or window resize. This is where the bulk of the loading occurs.
-        if (!m_RenderTargets || m_RenderTargets->IsUpdateRequired(int2(fbinfo.width, fbinfo.height)))
+        // Update UI info from the GPU timings and readbacks of an earlier frame.
+        TiledDeferredRenderer::FrameTimings timings;
+        if (m_Renderer.BeginFrame(timings))
         {
-            m_RenderTargets = std::make_unique<RenderTargets>(GetDevice(), int2(fbinfo.width, fbinfo.height));
-
-            LoadScenePipelines(m_RenderTargets->m_FrameBufferGB, framebuffer);
-            LoadWorkGraphPipelines(m_RenderTargets->m_FrameBufferGB);
+            // The work graph replaces both light culling and deferred shading, so the compute dispatches report their sum.
+            const float lightCullingTime = timings.phaseTimes[(int)TiledDeferredRenderer::Phase::LightCulling];
+            m_UI.GPUFrameTime = timings.phaseTimes[(int)TiledDeferredRenderer::Phase::Frame];
+            m_UI.GPUShadingTime = timings.phaseTimes[(int)TiledDeferredRenderer::Phase::Shading] + max(lightCullingTime, 0.0f);
         }
+        m_UI.VisibleObjectCount = m_Renderer.GetVisibleObjectCount();
+        m_UI.LightListSize = m_Renderer.GetLightListSize();
+        m_UI.LightListCapacity = m_Renderer.GetLightListCapacity();
 
-        // Reset GPU timers.
-        GetDevice()->resetTimerQuery(m_FrameTimers[m_NextTimerToUse]);
-        GetDevice()->resetTimerQuery(m_ShadingTimers[m_NextTimerToUse]);
+        // First frame, window resize or new scene. This is where the bulk of the loading occurs.
+        // The work graph's dispatch grid depends on the viewport size, so it is recreated along with the renderer's pipelines.
+        if (m_Renderer.UpdateRenderTargets(int2(fbinfo.width, fbinfo.height)))
+            LoadWorkGraphPipelines();
 
         // Begin recording the command list for this frame.
         m_CommandList->open();
 
-        m_CommandList->beginTimerQuery(m_FrameTimers[m_NextTimerToUse]);
+        m_Renderer.BeginPhase(m_CommandList, TiledDeferredRenderer::Phase::Frame);
 
         // Update scene constants used by all the passes to follow in this frame.
-        UpdateSceneConstants();
+        m_Renderer.UpdateSceneConstants(m_CommandList, m_TimeInSeconds);
 
         // Animation compute passes.
-        PopulateAnimationPass();
+        m_Renderer.PopulateAnimationPass(m_CommandList, m_TimeInSeconds, m_TimeDiffThisFrame, m_UI.ResetAnim);
+
+        // Object culling pass, writing the indirect draws of the g-buffer pass.
+        m_Renderer.PopulateObjectCullingPass(m_CommandList, m_UI.FrustumCulling);
 
         // G-buffer fill pass.
-        PopulateGBufferPass();
+        m_Renderer.PopulateGBufferPass(m_CommandList);
 
         if (m_CurrentTechnique == Techniques::Dispatch)
         {
-            m_CommandList->beginTimerQuery(m_ShadingTimers[m_NextTimerToUse]);
-
             // Light culling pass.
-            PopulateLightCullingPass();
+            m_Renderer.PopulateLightCullingPass(m_CommandList);
 
             // Deferred shading pass.
-            PopulateDeferredShadingPass();
-
-            m_CommandList->endTimerQuery(m_ShadingTimers[m_NextTimerToUse]);
+            m_Renderer.PopulateDeferredShadingPass(m_CommandList);
         }
 
         if (m_CurrentTechnique == Techniques::WorkGraphBroadcastingLaunch)
         {
-            m_CommandList->beginTimerQuery(m_ShadingTimers[m_NextTimerToUse]);
-
             // Deferred shading work graph pass.
             PopulateDeferredShadingWorkGraph();
-
-            m_CommandList->endTimerQuery(m_ShadingTimers[m_NextTimerToUse]);
         }
 
         // Copy the final shaded results from the LDR buffer to the back buffer for display.
-        m_CommandList->copyTexture(framebuffer->getDesc().colorAttachments[0].texture, nvrhi::TextureSlice(), m_RenderTargets->m_LDRBuffer, nvrhi::TextureSlice());
+        m_CommandList->copyTexture(framebuffer->getDesc().colorAttachments[0].texture, nvrhi::TextureSlice(), m_Renderer.GetRenderTargets()->m_LDRBuffer, nvrhi::TextureSlice());
 
-        m_CommandList->endTimerQuery(m_FrameTimers[m_NextTimerToUse]);
+        m_Renderer.EndPhase(m_CommandList, TiledDeferredRenderer::Phase::Frame);
 
         // Done with this frame.
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
 
-        m_NextTimerToUse = (m_NextTimerToUse+1) % QueuedFramesCount;
+        m_Renderer.EndFrame();
     }
 };
 
@@ -924,13 +418,22 @@ protected:
             "Compute Dispatches"
         };
 
+        const char *presetNames[(int)Scene::Preset::SP_COUNT];
+        for (int i=0;i<(int)Scene::Preset::SP_COUNT;i++)
+            presetNames[i] = Scene::GetPresetName((Scene::Preset)i);
+
         ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
         ImGui::Begin("Options/Stats", 0, ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Combo("Current Technique", &m_UI.CurrentTechnique, techniqueNames, sizeof(techniqueNames)/sizeof(techniqueNames[0]));
+        ImGui::Combo("Scene Preset", &m_UI.ScenePreset, presetNames, (int)Scene::Preset::SP_COUNT);
         ImGui::Checkbox("Pause Animation", &m_UI.Paused);
+        ImGui::Checkbox("Frustum Culling", &m_UI.FrustumCulling);
         m_UI.ResetAnim = ImGui::Button("Reset Animation");
         ImGui::Text("Frame Time (GPU): %.3f ms", m_UI.GPUFrameTime);
         ImGui::Text("Shading Time (GPU): %.3f ms", m_UI.GPUShadingTime);
+        ImGui::Text("Visible Objects: %u / %u", m_UI.VisibleObjectCount, m_UI.ObjectCount);
+        ImGui::Text("Lights: %u", m_UI.LightCount);
+        ImGui::Text("Light List Entries: %u (capacity %u)", m_UI.LightListSize, m_UI.LightListCapacity);
         ImGui::End();
     }
 };
@@ -953,6 +456,12 @@ int main(int __argc, const char** __argv)
         return -1;
     }
 
+    // Scene scale can be controlled from the command line. See Scene::ParseCommandLine for the available options.
+    Scene::Preset scenePreset = Scene::Preset::SP_Default;
+    Scene::ScaleParams sceneParams;
+    if (!Scene::ParseCommandLine(__argc, __argv, scenePreset, sceneParams))
+        return 1;
+
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
@@ -971,7 +480,8 @@ int main(int __argc, const char** __argv)
     
     {
         UIData uiData;
-        WorkGraphs example(deviceManager, uiData);
+        uiData.ScenePreset = (int)scenePreset;
+        WorkGraphs example(deviceManager, uiData, sceneParams);
         UIRenderer ui(deviceManager, uiData);
         if (example.Init() && ui.Init())
         {
@@ -31,6 +31,7 @@
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/ConsoleInterpreter.h>
 #include <donut/engine/ConsoleObjects.h>
+#include <donut/engine/DescriptorTableManager.h>
 #include <donut/engine/FramebufferFactory.h>
 #include <donut/engine/Scene.h>
 #include <donut/engine/ShaderFactory.h>
@@ -63,6 +64,13 @@
 #include <taskflow/taskflow.hpp>
 #endif
 
+#include "animation_evaluator.h"
+#include "flat_draw_strategy.h"
+#include "gpu_timer_ring.h"
+#include "SsaoVariantsPass.h"
+#include "PostProcessPass.h"
+#include "StereoGBufferPass.h"
+
 using namespace donut;
 using namespace donut::math;
 using namespace donut::app;
@@ -142,12 +150,15 @@ public:
         desc.debugName = "TemporalFeedback2";
         TemporalFeedback2 = device->createTexture(desc);
 
+        // Typeless so that the post-processing pass can write sRGB encoded values through a UNORM view
         desc.format = nvrhi::Format::SRGBA8_UNORM;
-        desc.isUAV = false;
+        desc.isTypeless = true;
+        desc.isUAV = true;
         desc.debugName = "LdrColor";
         LdrColor = device->createTexture(desc);
 
         desc.format = nvrhi::Format::R8_UNORM;
+        desc.isTypeless = false;
         desc.isUAV = true;
         desc.debugName = "AmbientOcclusion";
         AmbientOcclusion = device->createTexture(desc);
@@ -240,17 +251,27 @@ struct UIData
 	bool                                ShowConsole = false;
     bool                                UseDeferredShading = true;
     bool                                Stereo = false;
+    bool                                InstancedStereo = true;
     bool                                EnableSsao = true;
+    enum SsaoMode                       SsaoMode = SsaoMode::FullResolution;
     SsaoParameters                      SsaoParams;
+    float                               SsaoTimes[int(SsaoMode::Count)] = {};
     ToneMappingParameters               ToneMappingParams;
     TemporalAntiAliasingParameters      TemporalAntiAliasingParams;
     SkyParameters                       SkyParams;
     enum AntiAliasingMode               AntiAliasingMode = AntiAliasingMode::TEMPORAL;
     enum TemporalAntiAliasingJitter     TemporalAntiAliasingJitter = TemporalAntiAliasingJitter::MSAA;
+    bool                                EnableDynamicResolution = false;
+    float                               TargetGpuTime = 16.f;
+    float                               RenderScale = 1.f;
+    float                               FrameGpuTime = 0.f;
     bool                                EnableVsync = true;
     bool                                ShaderReoladRequested = false;
     bool                                EnableProceduralSky = true;
     bool                                EnableBloom = true;
+    bool                                EnableFusedPostProcessing = true;
+    bool                                FusedLuminanceHistogram = true;
+    float                               PostProcessTimes[2] = {}; // Separate passes, fused pass
     float                               BloomSigma = 32.f;
     float                               BloomAlpha = 0.05f;
     bool                                EnableTranslucency = true;
@@ -269,6 +290,15 @@ struct UIData
     std::shared_ptr<SceneGraphNode>     SelectedNode;
     std::string                         ScreenshotFileName;
     std::shared_ptr<SceneCamera>        ActiveSceneCamera;
+    uint32_t                            StaticSceneFrames = 0;
+    size_t                              AnimationChannelsWritten = 0;
+    size_t                              MovedNodesVisited = 0;
+    size_t                              MovedInstances = 0;
+    size_t                              OpaqueBoundsUpdated = 0;
+    size_t                              OpaqueItemsVisible = 0;
+    size_t                              OpaqueItemsTotal = 0;
+    uint32_t                            StereoDraws = 0;
+    uint32_t                            StereoEyeDraws = 0;
 };
 
 class FeatureDemo : public ApplicationBase
@@ -287,7 +317,8 @@ private:
     std::shared_ptr<CascadedShadowMap>  m_ShadowMap;
     std::shared_ptr<FramebufferFactory> m_ShadowFramebuffer;
     std::shared_ptr<DepthPass>          m_ShadowDepthPass;
-    std::shared_ptr<InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
+    std::shared_ptr<FlatDrawList>       m_OpaqueDrawList;
+    std::shared_ptr<FlatOpaqueDrawStrategy> m_OpaqueDrawStrategy;
     std::shared_ptr<TransparentDrawStrategy> m_TransparentDrawStrategy;
     std::unique_ptr<RenderTargets>      m_RenderTargets;
     std::shared_ptr<ForwardShadingPass> m_ForwardPass;
@@ -297,14 +328,20 @@ private:
     std::unique_ptr<TemporalAntiAliasingPass> m_TemporalAntiAliasingPass;
     std::unique_ptr<BloomPass>          m_BloomPass;
     std::unique_ptr<ToneMappingPass>    m_ToneMappingPass;
-    std::unique_ptr<SsaoPass>           m_SsaoPass;
+    std::unique_ptr<PostProcessPass>    m_PostProcessPass;
+    std::unique_ptr<SsaoVariantsPass>   m_SsaoPass;
+    std::unique_ptr<StereoGBufferPass>  m_StereoGBufferPass;
     std::shared_ptr<LightProbeProcessingPass> m_LightProbePass;
     std::unique_ptr<MaterialIDPass>     m_MaterialIDPass;
     std::unique_ptr<PixelReadbackPass>  m_PixelReadbackPass;
     std::unique_ptr<MipMapGenPass>      m_MipMapGenPass;
 
+    nvrhi::BindingLayoutHandle          m_BindlessLayout;
+    std::shared_ptr<DescriptorTableManager> m_DescriptorTable;
+
     std::shared_ptr<IView>              m_View;
     std::shared_ptr<IView>              m_ViewPrevious;
+    std::shared_ptr<PlanarView>         m_UpscaledView;
     
     nvrhi::CommandListHandle            m_CommandList;
     bool                                m_PreviousViewsValid = false;
@@ -322,7 +359,24 @@ private:
     nvrhi::TextureHandle                m_LightProbeDiffuseTexture;
     nvrhi::TextureHandle                m_LightProbeSpecularTexture;
 
+    bool                                m_OpaqueDrawListValid = false;
+
+    GpuTimerRing<SsaoMode>              m_SsaoTimers; // Tagged with the SSAO mode
+    bool                                m_SsaoHistoryValid = false;
+    GpuTimerRing<bool>                  m_PostProcessTimers; // Tagged with whether the fused pass was used
+
+    // Dynamic resolution: the scene is rendered into the top left part of the render targets, with the viewport
+    // scaled to keep the GPU frame time near the target, and TAA upsamples it to the window.
+    static constexpr float c_MinResolutionScale = 0.5f;
+    static constexpr float c_ResolutionScaleStep = 0.05f;
+    GpuTimerRing<float>                 m_FrameTimers; // Tagged with the render scale of the frame
+    bool                                m_DynamicResolutionActive = false;
+    float                               m_ResolutionScale = 1.f;
+    float                               m_RenderScale = 1.f;
     float                               m_WallclockTime = 0.f;
+    AnimationEvaluator                  m_AnimationEvaluator;
+    std::vector<float>                  m_AnimationTimes;
+    std::vector<SceneGraphNode*>        m_MovedNodes; // Nodes written by the animations since the last scene refresh
     
     UIData&                             m_ui;
 
@@ -337,9 +391,11 @@ public:
 
         std::filesystem::path mediaDir = app::GetDirectoryWithExecutable().parent_path() / "media";
         std::filesystem::path frameworkShaderDir = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        std::filesystem::path appShaderDir = app::GetDirectoryWithExecutable() / "shaders/feature_demo" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 
         m_RootFs->mount("/media", mediaDir);
         m_RootFs->mount("/shaders/donut", frameworkShaderDir);
+        m_RootFs->mount("/shaders/app", appShaderDir);
 
         m_NativeFs = std::make_shared<NativeFileSystem>();
 
@@ -352,12 +408,33 @@ public:
                 "Please make sure that folder contains valid scene files.", m_SceneDir.generic_string().c_str());
         }
         
-        m_TextureCache = std::make_shared<TextureCache>(GetDevice(), m_NativeFs, nullptr);
+        // The instanced stereo G-buffer pass reads the scene through bindless descriptors, which D3D11 doesn't have
+        if (GetDevice()->getGraphicsAPI() != nvrhi::GraphicsAPI::D3D11)
+        {
+            nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+            bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+            bindlessLayoutDesc.firstSlot = 0;
+            bindlessLayoutDesc.maxCapacity = 1024;
+            bindlessLayoutDesc.registerSpaces = {
+                nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
+                nvrhi::BindingLayoutItem::Texture_SRV(2)
+            };
+            m_BindlessLayout = GetDevice()->createBindlessLayout(bindlessLayoutDesc);
+
+            m_DescriptorTable = std::make_shared<DescriptorTableManager>(GetDevice(), m_BindlessLayout);
+        }
+
+        m_TextureCache = std::make_shared<TextureCache>(GetDevice(), m_NativeFs, m_DescriptorTable);
 
         m_ShaderFactory = std::make_shared<ShaderFactory>(GetDevice(), m_RootFs, "/shaders");
         m_CommonPasses = std::make_shared<CommonRenderPasses>(GetDevice(), m_ShaderFactory);
 
-        m_OpaqueDrawStrategy = std::make_shared<InstancedOpaqueDrawStrategy>();
+        m_SsaoTimers.Init(GetDevice());
+        m_FrameTimers.Init(GetDevice());
+        m_PostProcessTimers.Init(GetDevice());
+
+        m_OpaqueDrawList = std::make_shared<FlatDrawList>();
+        m_OpaqueDrawStrategy = std::make_shared<FlatOpaqueDrawStrategy>(m_OpaqueDrawList);
         m_TransparentDrawStrategy = std::make_shared<TransparentDrawStrategy>();
 
 
@@ -526,19 +603,30 @@ public:
 
         if(m_ToneMappingPass)
             m_ToneMappingPass->AdvanceFrame(fElapsedTimeSeconds);
+        if (m_PostProcessPass)
+            m_PostProcessPass->AdvanceFrame(fElapsedTimeSeconds);
         
         if (IsSceneLoaded() && m_ui.EnableAnimations)
         {
             m_WallclockTime += fElapsedTimeSeconds;
 
-            for (const auto& anim : m_Scene->GetSceneGraph()->GetAnimations())
+            const auto& animations = m_Scene->GetSceneGraph()->GetAnimations();
+            m_AnimationTimes.resize(animations.size());
+            for (size_t index = 0; index < animations.size(); ++index)
             {
-                float duration = anim->GetDuration();
+                float duration = animations[index]->GetDuration();
                 float integral;
-                float animationTime = std::modf(m_WallclockTime / duration, &integral) * duration;
-                (void)anim->Apply(animationTime);
+                m_AnimationTimes[index] = std::modf(m_WallclockTime / duration, &integral) * duration;
             }
+
+            m_AnimationEvaluator.Evaluate(m_AnimationTimes);
+            m_ui.AnimationChannelsWritten = m_AnimationEvaluator.GetLastWrittenChannelCount();
+
+            const auto& writtenNodes = m_AnimationEvaluator.GetLastWrittenNodes();
+            m_MovedNodes.insert(m_MovedNodes.end(), writtenNodes.begin(), writtenNodes.end());
         }
+        else
+            m_ui.AnimationChannelsWritten = 0;
     }
 
 
@@ -553,6 +641,10 @@ public:
         m_SunLight.reset();
         m_ui.SelectedMaterial = nullptr;
         m_ui.SelectedNode = nullptr;
+        m_AnimationEvaluator.SetAnimations({});
+        m_MovedNodes.clear();
+        m_OpaqueDrawList->Clear();
+        m_OpaqueDrawListValid = false;
 
         for (auto probe : m_LightProbes)
         {
@@ -565,7 +657,7 @@ public:
         using namespace std::chrono;
 
         std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(),
-            *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+            *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTable, nullptr);
 
         auto startTime = high_resolution_clock::now();
 
@@ -590,6 +682,7 @@ public:
         m_Scene->FinishedLoading(GetFrameIndex());
 
         m_WallclockTime = 0.f;
+        m_AnimationEvaluator.SetAnimations(m_Scene->GetSceneGraph()->GetAnimations());
         m_PreviousViewsValid = false;
 
         for (auto light : m_Scene->GetSceneGraph()->GetLights())
@@ -658,6 +751,11 @@ public:
         return m_ui.Stereo;
     }
 
+    bool IsInstancedStereoAvailable() const
+    {
+        return m_BindlessLayout != nullptr;
+    }
+
     std::shared_ptr<TextureCache> GetTextureCache()
     {
         return m_TextureCache;
@@ -668,6 +766,37 @@ public:
         return m_Scene;
     }
 
+    void InvalidateOpaqueDrawList()
+    {
+        m_OpaqueDrawListValid = false;
+    }
+
+    void UpdateResolutionScale()
+    {
+        float measuredRenderScale;
+        if (m_FrameTimers.Harvest(GetFrameIndex(), m_ui.FrameGpuTime, measuredRenderScale))
+        {
+            // The cost of most passes follows the pixel count, so the scale of each axis follows the square root
+            // of the time ratio. Shrinking is fast to absorb load spikes, growing is slow to avoid oscillations.
+            float desiredScale = measuredRenderScale * sqrtf(m_ui.TargetGpuTime / std::max(m_ui.FrameGpuTime, 0.01f));
+            float rate = desiredScale < m_ResolutionScale ? 0.5f : 0.1f;
+            m_ResolutionScale = clamp(lerp(m_ResolutionScale, desiredScale, rate), c_MinResolutionScale, 1.f);
+        }
+
+        // Dynamic resolution needs TAA to upsample, and a planar view
+        m_DynamicResolutionActive = m_ui.EnableDynamicResolution && m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL && !IsStereo();
+        if (!m_DynamicResolutionActive)
+            m_ResolutionScale = 1.f;
+
+        // Steps keep the viewport stable between small adjustments, the temporal SSAO history does not survive a change
+        float renderScale = std::round(m_ResolutionScale / c_ResolutionScaleStep) * c_ResolutionScaleStep;
+        if (renderScale != m_RenderScale)
+            m_SsaoHistoryValid = false;
+
+        m_RenderScale = renderScale;
+        m_ui.RenderScale = renderScale;
+    }
+
     bool SetupView()
     {
         float2 renderTargetSize = float2(m_RenderTargets->GetSize());
@@ -750,18 +879,40 @@ public:
 
             float4x4 projection = perspProjD3DStyleReverse(verticalFov, renderTargetSize.x / renderTargetSize.y, zNear);
 
-            planarView->SetViewport(nvrhi::Viewport(renderTargetSize.x, renderTargetSize.y));
+            // Scaling both axes keeps the aspect ratio, so the scaled viewport uses the same projection
+            float2 renderSize = max(round(renderTargetSize * m_RenderScale), float2(1.f));
+
+            planarView->SetViewport(nvrhi::Viewport(renderSize.x, renderSize.y));
             planarView->SetPixelOffset(pixelOffset);
 
             planarView->SetMatrices(viewMatrix, projection);
             planarView->UpdateCache();
 
-            m_ThirdPersonCamera.SetView(*planarView);
+            if (!m_UpscaledView)
+                m_UpscaledView = std::make_shared<PlanarView>();
+
+            m_UpscaledView->SetViewport(nvrhi::Viewport(renderTargetSize.x, renderTargetSize.y));
+            m_UpscaledView->SetMatrices(viewMatrix, projection);
+            m_UpscaledView->UpdateCache();
+
+            m_ThirdPersonCamera.SetView(*m_UpscaledView);
 
             if (topologyChanged)
             {
                 *std::static_pointer_cast<PlanarView>(m_ViewPrevious) = *std::static_pointer_cast<PlanarView>(m_View);
             }
+            else
+            {
+                // Motion vectors are measured in the pixels of the current viewport, so the previous view is moved
+                // to it when the render resolution changes. The TAA history stays valid, it has the output resolution.
+                auto previousView = std::static_pointer_cast<PlanarView>(m_ViewPrevious);
+                nvrhi::Rect previousExtent = previousView->GetViewExtent();
+                if (previousExtent.maxX != int(renderSize.x) || previousExtent.maxY != int(renderSize.y))
+                {
+                    previousView->SetViewport(nvrhi::Viewport(renderSize.x, renderSize.y));
+                    previousView->UpdateCache();
+                }
+            }
         }
         
         return topologyChanged;
@@ -782,6 +933,9 @@ public:
         m_GBufferPass = std::make_unique<GBufferFillPass>(GetDevice(), m_CommonPasses);
         m_GBufferPass->Init(*m_ShaderFactory, GBufferParams);
 
+        if (m_BindlessLayout)
+            m_StereoGBufferPass = std::make_unique<StereoGBufferPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_BindlessLayout, motionVectorStencilMask);
+
         GBufferParams.enableMotionVectors = false;
         m_MaterialIDPass = std::make_unique<MaterialIDPass>(GetDevice(), m_CommonPasses);
         m_MaterialIDPass->Init(*m_ShaderFactory, GBufferParams);
@@ -810,7 +964,9 @@ public:
 
         if (m_RenderTargets->GetSampleCount() == 1)
         {
-            m_SsaoPass = std::make_unique<SsaoPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->Depth, m_RenderTargets->GBufferNormals, m_RenderTargets->AmbientOcclusion);
+            m_SsaoPass = std::make_unique<SsaoVariantsPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->Depth,
+                m_RenderTargets->GBufferNormals, m_RenderTargets->MotionVectors, m_RenderTargets->AmbientOcclusion);
+            m_SsaoHistoryValid = false;
         }
 
         m_LightProbePass = std::make_shared<LightProbeProcessingPass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
@@ -827,6 +983,9 @@ public:
 
         m_BloomPass = std::make_unique<BloomPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->ResolvedFramebuffer, *m_View);
 
+        nvrhi::BufferHandle postProcessExposureBuffer = m_PostProcessPass ? m_PostProcessPass->GetExposureBuffer() : nullptr;
+        m_PostProcessPass = std::make_unique<PostProcessPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->LdrColor, postProcessExposureBuffer);
+
         m_PreviousViewsValid = false;
     }
 
@@ -847,8 +1006,42 @@ public:
         nvrhi::Viewport windowViewport = nvrhi::Viewport(float(windowWidth), float(windowHeight));
         nvrhi::Viewport renderViewport = windowViewport;
 
+        // The engine's scene refresh propagates the transforms and rewrites the instance buffer when anything moved.
+        // The flat draw list below updates only the bounds of the items under the nodes that moved.
+        const auto& sceneGraph = m_Scene->GetSceneGraph();
+        const bool structureChanged = sceneGraph->HasPendingStructureChanges();
+        const bool transformsChanged = sceneGraph->HasPendingTransformChanges();
+        if (structureChanged || transformsChanged)
+            m_ui.StaticSceneFrames = 0;
+        else
+            ++m_ui.StaticSceneFrames;
+
         m_Scene->RefreshSceneGraph(GetFrameIndex());
 
+        // All opaque views of the frame (shadow cascades, G-buffer or forward, material IDs) walk the same flat list
+        if (!m_OpaqueDrawListValid || structureChanged)
+        {
+            m_OpaqueDrawList->Build(sceneGraph->GetRootNode().get());
+            m_OpaqueDrawListValid = true;
+        }
+        else if (transformsChanged)
+        {
+            // The animations are the only source of transform changes in the demo, so only the draw items under the
+            // nodes they wrote need new bounds. Any other change updates all of them.
+            if (!m_MovedNodes.empty())
+                m_OpaqueDrawList->UpdateBounds(m_MovedNodes);
+            else
+                m_OpaqueDrawList->UpdateBounds();
+        }
+
+        if (structureChanged || transformsChanged)
+        {
+            m_ui.MovedNodesVisited = m_OpaqueDrawList->GetLastVisitedNodeCount();
+            m_ui.MovedInstances = m_OpaqueDrawList->GetLastDirtyInstances().size();
+            m_ui.OpaqueBoundsUpdated = m_OpaqueDrawList->GetLastUpdatedItemCount();
+        }
+        m_MovedNodes.clear();
+
         bool exposureResetRequired = false;
         
         {
@@ -876,6 +1069,8 @@ public:
                 needNewPasses = true;
             }
 
+            UpdateResolutionScale();
+
             if (SetupView())
             {
                 needNewPasses = true;
@@ -895,8 +1090,17 @@ public:
             m_ui.ShaderReoladRequested = false;
         }
 
+        // The eyes of a stereo view see nearly the same items, so the main view is culled once for all of its child
+        // views. The instanced stereo G-buffer pass draws each visible item into the eyes that see it in one draw,
+        // and the other passes reuse the result for each eye.
+        m_OpaqueDrawStrategy->CullForViews(*m_View);
+        m_ui.OpaqueItemsVisible = m_OpaqueDrawStrategy->GetSharedVisibleItemCount();
+        m_ui.OpaqueItemsTotal = m_OpaqueDrawList->GetItemCount();
+
         m_CommandList->open();
 
+        m_FrameTimers.Begin(m_CommandList);
+
         m_Scene->RefreshBuffers(m_CommandList, GetFrameIndex());
 
         nvrhi::ITexture* framebufferTexture = framebuffer->getDesc().colorAttachments[0].texture;
@@ -953,7 +1157,10 @@ public:
         m_RenderTargets->Clear(m_CommandList);
 
         if (exposureResetRequired)
+        {
             m_ToneMappingPass->ResetExposure(m_CommandList, 0.5f);
+            m_PostProcessPass->ResetExposure(m_CommandList, 0.5f);
+        }
 
         ForwardShadingPass::Context forwardContext;
 
@@ -962,26 +1169,59 @@ public:
             m_ForwardPass->PrepareLights(forwardContext, m_CommandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
         }
 
+        m_ui.StereoDraws = 0;
+        m_ui.StereoEyeDraws = 0;
+
         if (m_ui.UseDeferredShading)
         {
-            GBufferFillPass::Context gbufferContext;
+            std::shared_ptr<StereoPlanarView> stereoView = std::dynamic_pointer_cast<StereoPlanarView>(m_View);
+            std::shared_ptr<StereoPlanarView> stereoViewPrevious = std::dynamic_pointer_cast<StereoPlanarView>(m_ViewPrevious);
 
-            RenderCompositeView(m_CommandList,
-                m_View.get(), m_ViewPrevious.get(), 
-                *m_RenderTargets->GBufferFramebuffer, 
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy,
-                *m_GBufferPass,
-                gbufferContext,
-                "GBufferFill",
-                m_ui.EnableMaterialEvents);
+            if (stereoView && stereoViewPrevious && m_StereoGBufferPass && m_ui.InstancedStereo)
+            {
+                m_StereoGBufferPass->Render(m_CommandList, *stereoView, *stereoViewPrevious,
+                    m_RenderTargets->GBufferFramebuffer->GetFramebuffer(*stereoView), *m_Scene,
+                    m_DescriptorTable->GetDescriptorTable(), *m_OpaqueDrawList, *m_OpaqueDrawStrategy);
+
+                m_ui.StereoDraws = m_StereoGBufferPass->GetLastDrawCount();
+                m_ui.StereoEyeDraws = m_StereoGBufferPass->GetLastEyeDrawCount();
+            }
+            else
+            {
+                GBufferFillPass::Context gbufferContext;
+
+                RenderCompositeView(m_CommandList,
+                    m_View.get(), m_ViewPrevious.get(), 
+                    *m_RenderTargets->GBufferFramebuffer, 
+                    m_Scene->GetSceneGraph()->GetRootNode(),
+                    *m_OpaqueDrawStrategy,
+                    *m_GBufferPass,
+                    gbufferContext,
+                    "GBufferFill",
+                    m_ui.EnableMaterialEvents);
+            }
 
             nvrhi::ITexture* ambientOcclusionTarget = nullptr;
             if (m_ui.EnableSsao && m_SsaoPass)
             {
-                m_SsaoPass->Render(m_CommandList, m_ui.SsaoParams, *m_View);
+                float ssaoTime;
+                SsaoMode ssaoTimeMode;
+                if (m_SsaoTimers.Harvest(GetFrameIndex(), ssaoTime, ssaoTimeMode))
+                    m_ui.SsaoTimes[int(ssaoTimeMode)] = ssaoTime;
+
+                // The accumulated occlusion can only be reprojected when the previous frame's view and
+                // occlusion are both valid, which requires TAA to be maintaining the previous view.
+                const bool historyValid = m_SsaoHistoryValid && m_PreviousViewsValid;
+
+                m_SsaoTimers.Begin(m_CommandList);
+                m_SsaoPass->Render(m_CommandList, m_ui.SsaoMode, m_ui.SsaoParams, *m_View, historyValid);
+                m_SsaoTimers.End(m_CommandList, m_ui.SsaoMode);
+
+                m_SsaoHistoryValid = m_ui.SsaoMode == SsaoMode::Temporal;
                 ambientOcclusionTarget = m_RenderTargets->AmbientOcclusion;
             }
+            else
+                m_SsaoHistoryValid = false;
 
             DeferredLightingPass::Inputs deferredInputs;
             deferredInputs.SetGBuffer(*m_RenderTargets);
@@ -1034,7 +1274,8 @@ public:
                     "MaterialID - Translucent");
             }
 
-            m_PixelReadbackPass->Capture(m_CommandList, m_PickPosition);
+            // The material IDs are rendered at the scaled resolution
+            m_PixelReadbackPass->Capture(m_CommandList, uint2(float2(m_PickPosition) * m_RenderScale));
         }
 
         if (m_ui.EnableProceduralSky)
@@ -1055,6 +1296,19 @@ public:
 
         nvrhi::ITexture* finalHdrColor = m_RenderTargets->HdrColor;
 
+        // Passes after TAA see the whole render targets, TAA upsamples into them when the resolution is scaled
+        const IView& outputView = m_DynamicResolutionActive ? *m_UpscaledView : *m_View;
+
+        // The fused post-processing pass composites bloom itself
+        const bool separateBloom = m_ui.EnableBloom && !m_ui.EnableFusedPostProcessing;
+
+        // Measured from the resolve, which is common to both paths, as the separate bloom pass runs right after it
+        float postProcessTime;
+        bool postProcessTimeFused;
+        if (m_PostProcessTimers.Harvest(GetFrameIndex(), postProcessTime, postProcessTimeFused))
+            m_ui.PostProcessTimes[postProcessTimeFused ? 1 : 0] = postProcessTime;
+        m_PostProcessTimers.Begin(m_CommandList);
+
         if (m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL)
         {
             if (m_PreviousViewsValid)
@@ -1062,13 +1316,13 @@ public:
                 m_TemporalAntiAliasingPass->RenderMotionVectors(m_CommandList, *m_View, *m_ViewPrevious);
             }
 
-            m_TemporalAntiAliasingPass->TemporalResolve(m_CommandList, m_ui.TemporalAntiAliasingParams, m_PreviousViewsValid, *m_View, *m_View);
+            m_TemporalAntiAliasingPass->TemporalResolve(m_CommandList, m_ui.TemporalAntiAliasingParams, m_PreviousViewsValid, *m_View, outputView);
 
             finalHdrColor = m_RenderTargets->ResolvedColor;
             
-            if (m_ui.EnableBloom)
+            if (separateBloom)
             {
-                m_BloomPass->Render(m_CommandList, m_RenderTargets->ResolvedFramebuffer, *m_View, m_RenderTargets->ResolvedColor, m_ui.BloomSigma, m_ui.BloomAlpha);
+                m_BloomPass->Render(m_CommandList, m_RenderTargets->ResolvedFramebuffer, outputView, m_RenderTargets->ResolvedColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
             m_PreviousViewsValid = true;
         }
@@ -1084,7 +1338,7 @@ public:
                 finalHdrFramebuffer = m_RenderTargets->ResolvedFramebuffer;
             }
 
-            if (m_ui.EnableBloom)
+            if (separateBloom)
             {
                 m_BloomPass->Render(m_CommandList, finalHdrFramebuffer, *m_View, finalHdrColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
@@ -1098,7 +1352,16 @@ public:
             toneMappingParams.eyeAdaptationSpeedUp = 0.f;
             toneMappingParams.eyeAdaptationSpeedDown = 0.f;
         }
-        m_ToneMappingPass->SimpleRender(m_CommandList, toneMappingParams, *m_View, finalHdrColor);
+
+        if (m_ui.EnableFusedPostProcessing)
+        {
+            m_PostProcessPass->Render(m_CommandList, toneMappingParams, outputView, finalHdrColor,
+                m_ui.EnableBloom, m_ui.BloomSigma, m_ui.BloomAlpha, m_ui.FusedLuminanceHistogram);
+        }
+        else
+            m_ToneMappingPass->SimpleRender(m_CommandList, toneMappingParams, outputView, finalHdrColor);
+
+        m_PostProcessTimers.End(m_CommandList, m_ui.EnableFusedPostProcessing);
         
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->LdrColor, &m_BindingCache);
 
@@ -1128,6 +1391,8 @@ public:
             }
         }
 
+        m_FrameTimers.End(m_CommandList, m_RenderScale);
+
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
 
@@ -1453,6 +1718,17 @@ protected:
         double frameTime = GetDeviceManager()->GetAverageFrameTimeSeconds();
         if (frameTime > 0.0)
             ImGui::Text("%.3f ms/frame (%.1f FPS)", frameTime * 1e3, 1.0 / frameTime);
+        if (m_ui.StaticSceneFrames > 0)
+            ImGui::Text("Scene static for %u frames", m_ui.StaticSceneFrames);
+        else
+        {
+            ImGui::Text("Scene updated: %d animation channels written", int(m_ui.AnimationChannelsWritten));
+            ImGui::Text("Moved: %d nodes visited, %d instances, %d of %d draw bounds updated", int(m_ui.MovedNodesVisited),
+                int(m_ui.MovedInstances), int(m_ui.OpaqueBoundsUpdated), int(m_ui.OpaqueItemsTotal));
+        }
+        ImGui::Text("Opaque geometry: %d of %d visible", int(m_ui.OpaqueItemsVisible), int(m_ui.OpaqueItemsTotal));
+        if (m_ui.StereoDraws > 0)
+            ImGui::Text("Instanced stereo G-buffer: %u draws into %u eyes", m_ui.StereoDraws, m_ui.StereoEyeDraws);
 
         const std::string sceneDir = m_app->GetSceneDir().generic_string();
         
@@ -1486,6 +1762,11 @@ protected:
         if (m_ui.AntiAliasingMode >= AntiAliasingMode::MSAA_2X)
             m_ui.UseDeferredShading = false; // Deferred shading doesn't work with MSAA
         ImGui::Checkbox("Stereo", &m_ui.Stereo);
+        if (m_ui.Stereo && m_ui.UseDeferredShading && m_app->IsInstancedStereoAvailable())
+        {
+            ImGui::SameLine();
+            ImGui::Checkbox("Instanced", &m_ui.InstancedStereo);
+        }
         ImGui::Checkbox("Animations", &m_ui.EnableAnimations);
 
         if (ImGui::BeginCombo("Camera (T)", m_ui.ActiveSceneCamera ? m_ui.ActiveSceneCamera->GetName().c_str()
@@ -1515,6 +1796,14 @@ protected:
         
         ImGui::Combo("AA Mode", (int*)&m_ui.AntiAliasingMode, "None\0TemporalAA\0MSAA 2x\0MSAA 4x\0MSAA 8x\0");
         ImGui::Combo("TAA Camera Jitter", (int*)&m_ui.TemporalAntiAliasingJitter, "MSAA\0Halton\0R2\0White Noise\0");
+        ImGui::Checkbox("Dynamic Resolution", &m_ui.EnableDynamicResolution);
+        if (m_ui.EnableDynamicResolution)
+        {
+            ImGui::SliderFloat("Target GPU Time (ms)", &m_ui.TargetGpuTime, 2.f, 50.f);
+            if (m_ui.AntiAliasingMode != AntiAliasingMode::TEMPORAL || m_ui.Stereo)
+                ImGui::Text("Dynamic resolution needs TemporalAA and a mono view");
+            ImGui::Text("Render scale %.0f%%, GPU frame time %.2f ms", m_ui.RenderScale * 100.f, m_ui.FrameGpuTime);
+        }
         
         ImGui::SliderFloat("Ambient Intensity", &m_ui.AmbientIntensity, 0.f, 1.f);
 
@@ -1535,7 +1824,19 @@ protected:
             ImGui::SliderFloat("Horizon Size", &m_ui.SkyParams.horizonSize, 0.f, 90.f);
         }
         ImGui::Checkbox("Enable SSAO", &m_ui.EnableSsao);
+        if (m_ui.EnableSsao)
+        {
+            ImGui::Combo("SSAO Mode", (int*)&m_ui.SsaoMode, "Full Resolution\0Half Resolution\0Temporal\0");
+            ImGui::Text("SSAO GPU time: full %.3f ms, half %.3f ms, temporal %.3f ms",
+                m_ui.SsaoTimes[int(SsaoMode::FullResolution)],
+                m_ui.SsaoTimes[int(SsaoMode::HalfResolution)],
+                m_ui.SsaoTimes[int(SsaoMode::Temporal)]);
+        }
         ImGui::Checkbox("Enable Bloom", &m_ui.EnableBloom);
+        ImGui::Checkbox("Fused Post-Processing", &m_ui.EnableFusedPostProcessing);
+        if (m_ui.EnableFusedPostProcessing)
+            ImGui::Checkbox("Fused Luminance Histogram", &m_ui.FusedLuminanceHistogram);
+        ImGui::Text("Resolve and post-processing GPU time: separate %.3f ms, fused %.3f ms", m_ui.PostProcessTimes[0], m_ui.PostProcessTimes[1]);
         ImGui::DragFloat("Bloom Sigma", &m_ui.BloomSigma, 0.01f, 0.1f, 100.f);
         ImGui::DragFloat("Bloom Alpha", &m_ui.BloomAlpha, 0.01f, 0.01f, 1.0f);
         ImGui::Checkbox("Enable Shadows", &m_ui.EnableShadows);
@@ -1609,6 +1910,10 @@ protected:
 
             if (previousDomain != material->domain)
                 m_app->GetScene()->GetSceneGraph()->GetRootNode()->InvalidateContent();
+
+            // The draw list caches the domain and cull mode of the materials
+            if (material->dirty)
+                m_app->InvalidateOpaqueDrawList();
             
             ImGui::End();
         }
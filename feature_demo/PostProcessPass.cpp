@@ -0,0 +1,365 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PostProcessPass.h"
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <nvrhi/utils.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace donut;
+using namespace donut::math;
+
+#include "postprocess_cb.h"
+
+// Range of the luminance histogram, in log2 units
+static const float c_MinLogLuminance = -10.f;
+static const float c_MaxLogLuminance = 4.f;
+
+// The constants are written before each dispatch, up to about ten times per frame
+static const uint32_t c_ConstantBufferVersions = 64;
+
+PostProcessPass::PostProcessPass(
+    nvrhi::IDevice* device,
+    std::shared_ptr<engine::ShaderFactory> shaderFactory,
+    std::shared_ptr<engine::CommonRenderPasses> commonPasses,
+    nvrhi::ITexture* output,
+    nvrhi::IBuffer* exposureBufferOverride)
+    : m_Device(device)
+    , m_CommonPasses(commonPasses)
+    , m_BindingCache(device)
+    , m_Output(output)
+{
+    const nvrhi::TextureDesc& outputDesc = output->getDesc();
+    switch (outputDesc.format)
+    {
+    case nvrhi::Format::SRGBA8_UNORM: m_OutputViewFormat = nvrhi::Format::RGBA8_UNORM; break;
+    case nvrhi::Format::SBGRA8_UNORM: m_OutputViewFormat = nvrhi::Format::BGRA8_UNORM; break;
+    default: m_OutputViewFormat = outputDesc.format;
+    }
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.format = nvrhi::Format::R32_UINT;
+    bufferDesc.canHaveTypedViews = true;
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+
+    if (exposureBufferOverride)
+        m_ExposureBuffer = exposureBufferOverride;
+    else
+    {
+        bufferDesc.byteSize = sizeof(uint32_t);
+        bufferDesc.debugName = "PostProcessExposure";
+        m_ExposureBuffer = device->createBuffer(bufferDesc);
+    }
+
+    bufferDesc.byteSize = sizeof(uint32_t) * POSTPROCESS_HISTOGRAM_BINS;
+    bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    bufferDesc.debugName = "PostProcessHistogram";
+    m_HistogramBuffer = device->createBuffer(bufferDesc);
+
+    nvrhi::TextureDesc textureDesc;
+    textureDesc.width = outputDesc.width;
+    textureDesc.height = outputDesc.height;
+    textureDesc.format = nvrhi::Format::RGBA16_FLOAT;
+    textureDesc.isUAV = true;
+    textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    textureDesc.keepInitialState = true;
+
+    for (uint32_t level = 0; level < c_BloomLevels; level++)
+    {
+        textureDesc.width = (textureDesc.width + 1) / 2;
+        textureDesc.height = (textureDesc.height + 1) / 2;
+        textureDesc.debugName = "BloomLevel" + std::to_string(level);
+        m_BloomLevels[level] = device->createTexture(textureDesc);
+    }
+
+    textureDesc.debugName = "BloomBlurTemp";
+    m_BloomBlurTemp = device->createTexture(textureDesc);
+
+    m_Constants = device->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PostProcessConstants), "PostProcessConstants", c_ConstantBufferVersions));
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(1)
+    };
+    m_HistogramBindingLayout = device->createBindingLayout(layoutDesc);
+
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(1),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(2)
+    };
+    m_ExposureBindingLayout = device->createBindingLayout(layoutDesc);
+
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::Texture_UAV(3)
+    };
+    m_BloomBindingLayout = device->createBindingLayout(layoutDesc);
+
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(1),
+        nvrhi::BindingLayoutItem::TypedBuffer_SRV(2),
+        nvrhi::BindingLayoutItem::Sampler(0),
+        nvrhi::BindingLayoutItem::Texture_UAV(0),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(1)
+    };
+    m_PostProcessBindingLayout = device->createBindingLayout(layoutDesc);
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_HistogramBuffer),
+        nvrhi::BindingSetItem::TypedBuffer_UAV(2, m_ExposureBuffer)
+    };
+    m_ExposureBindingSet = device->createBindingSet(bindingSetDesc, m_ExposureBindingLayout);
+
+    for (uint32_t level = 0; level < c_BloomLevels - 1; level++)
+    {
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+            nvrhi::BindingSetItem::Texture_SRV(0, m_BloomLevels[level]),
+            nvrhi::BindingSetItem::Texture_UAV(3, m_BloomLevels[level + 1])
+        };
+        m_BloomDownsampleBindingSets[level] = device->createBindingSet(bindingSetDesc, m_BloomBindingLayout);
+    }
+
+    nvrhi::ITexture* smallestLevel = m_BloomLevels[c_BloomLevels - 1];
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, smallestLevel),
+        nvrhi::BindingSetItem::Texture_UAV(3, m_BloomBlurTemp)
+    };
+    m_BloomBlurBindingSets[0] = device->createBindingSet(bindingSetDesc, m_BloomBindingLayout);
+
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, m_BloomBlurTemp),
+        nvrhi::BindingSetItem::Texture_UAV(3, smallestLevel)
+    };
+    m_BloomBlurBindingSets[1] = device->createBindingSet(bindingSetDesc, m_BloomBindingLayout);
+
+    const char* shaderPath = "/shaders/app/postprocess.hlsl";
+
+    nvrhi::ComputePipelineDesc pipelineDesc;
+    pipelineDesc.bindingLayouts = { m_HistogramBindingLayout };
+    pipelineDesc.CS = shaderFactory->CreateShader(shaderPath, "histogram_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_HistogramPipeline = device->createComputePipeline(pipelineDesc);
+
+    pipelineDesc.bindingLayouts = { m_ExposureBindingLayout };
+    pipelineDesc.CS = shaderFactory->CreateShader(shaderPath, "exposure_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_ExposurePipeline = device->createComputePipeline(pipelineDesc);
+
+    pipelineDesc.bindingLayouts = { m_BloomBindingLayout };
+    pipelineDesc.CS = shaderFactory->CreateShader(shaderPath, "bloom_downsample_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_BloomDownsamplePipeline = device->createComputePipeline(pipelineDesc);
+
+    pipelineDesc.CS = shaderFactory->CreateShader(shaderPath, "bloom_blur_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_BloomBlurPipeline = device->createComputePipeline(pipelineDesc);
+
+    pipelineDesc.bindingLayouts = { m_PostProcessBindingLayout };
+    for (int fusedHistogram = 0; fusedHistogram < 2; fusedHistogram++)
+    {
+        for (int bloom = 0; bloom < 2; bloom++)
+        {
+            std::vector<engine::ShaderMacro> defines = {
+                { "FUSED_HISTOGRAM", fusedHistogram ? "1" : "0" },
+                { "BLOOM", bloom ? "1" : "0" }
+            };
+            pipelineDesc.CS = shaderFactory->CreateShader(shaderPath, "postprocess_cs", &defines, nvrhi::ShaderType::Compute);
+            m_PostProcessPipelines[fusedHistogram][bloom] = device->createComputePipeline(pipelineDesc);
+        }
+    }
+}
+
+void PostProcessPass::Render(nvrhi::ICommandList* commandList, const render::ToneMappingParameters& params,
+    const engine::ICompositeView& compositeView, nvrhi::ITexture* source,
+    bool enableBloom, float bloomSigma, float bloomAlpha, bool fusedHistogram)
+{
+    commandList->beginMarker("PostProcess");
+
+    // Every later use of the histogram is preceded by exposure_cs, which clears it
+    if (!m_HistogramCleared)
+    {
+        commandList->clearBufferUInt(m_HistogramBuffer, 0);
+        m_HistogramCleared = true;
+    }
+
+    const float logLuminanceScale = 1.f / (c_MaxLogLuminance - c_MinLogLuminance);
+
+    PostProcessConstants constants = {};
+    constants.bloomAlpha = bloomAlpha;
+    constants.exposureScale = exp2f(params.exposureBias);
+    constants.whitePointInvSquared = 1.f / (params.whitePoint * params.whitePoint);
+    constants.logLuminanceScale = logLuminanceScale;
+    constants.logLuminanceBias = -c_MinLogLuminance * logLuminanceScale;
+    constants.histogramLowPercentile = params.histogramLowPercentile;
+    constants.histogramHighPercentile = std::max(params.histogramLowPercentile, params.histogramHighPercentile);
+    constants.eyeAdaptationSpeedUp = params.eyeAdaptationSpeedUp;
+    constants.eyeAdaptationSpeedDown = params.eyeAdaptationSpeedDown;
+    constants.minAdaptedLuminance = params.minAdaptedLuminance;
+    constants.maxAdaptedLuminance = params.maxAdaptedLuminance;
+    constants.frameTime = m_FrameTime;
+
+    const nvrhi::TextureDesc& smallestLevelDesc = m_BloomLevels[c_BloomLevels - 1]->getDesc();
+    constants.bloomUvScale = 1.f / (float2(float(smallestLevelDesc.width), float(smallestLevelDesc.height)) * float(1 << c_BloomLevels));
+
+    const uint32_t numViews = compositeView.GetNumChildViews(engine::ViewType::PLANAR);
+
+    nvrhi::ComputeState state;
+
+    if (!fusedHistogram)
+    {
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+            nvrhi::BindingSetItem::Texture_SRV(0, source),
+            nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_HistogramBuffer)
+        };
+
+        state.pipeline = m_HistogramPipeline;
+        state.bindings = { m_BindingCache.GetOrCreateBindingSet(bindingSetDesc, m_HistogramBindingLayout) };
+
+        for (uint32_t viewIndex = 0; viewIndex < numViews; viewIndex++)
+        {
+            const nvrhi::Rect extent = compositeView.GetChildView(engine::ViewType::PLANAR, viewIndex)->GetViewExtent();
+            constants.viewOrigin = uint2(extent.minX, extent.minY);
+            constants.viewSize = uint2(extent.width(), extent.height());
+            commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+            commandList->setComputeState(state);
+            commandList->dispatch(div_ceil(constants.viewSize.x, POSTPROCESS_GROUP_SIZE), div_ceil(constants.viewSize.y, POSTPROCESS_GROUP_SIZE));
+        }
+    }
+
+    // With the fused histogram, this adapts to the histogram of the previous frame
+    commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+    state.pipeline = m_ExposurePipeline;
+    state.bindings = { m_ExposureBindingSet };
+    commandList->setComputeState(state);
+    commandList->dispatch(1);
+
+    if (enableBloom)
+    {
+        // The blur runs on the smallest level, the sigma is given in full resolution pixels
+        constants.bloomSigma = bloomSigma / float(1 << c_BloomLevels);
+        RenderBloom(commandList, source, constants);
+    }
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, source),
+        nvrhi::BindingSetItem::Texture_SRV(1, m_BloomLevels[c_BloomLevels - 1]),
+        nvrhi::BindingSetItem::TypedBuffer_SRV(2, m_ExposureBuffer),
+        nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler),
+        nvrhi::BindingSetItem::Texture_UAV(0, m_Output, m_OutputViewFormat),
+        nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_HistogramBuffer)
+    };
+
+    state.pipeline = m_PostProcessPipelines[fusedHistogram ? 1 : 0][enableBloom ? 1 : 0];
+    state.bindings = { m_BindingCache.GetOrCreateBindingSet(bindingSetDesc, m_PostProcessBindingLayout) };
+
+    for (uint32_t viewIndex = 0; viewIndex < numViews; viewIndex++)
+    {
+        const nvrhi::Rect extent = compositeView.GetChildView(engine::ViewType::PLANAR, viewIndex)->GetViewExtent();
+        constants.viewOrigin = uint2(extent.minX, extent.minY);
+        constants.viewSize = uint2(extent.width(), extent.height());
+        commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+        commandList->setComputeState(state);
+        commandList->dispatch(div_ceil(constants.viewSize.x, POSTPROCESS_GROUP_SIZE), div_ceil(constants.viewSize.y, POSTPROCESS_GROUP_SIZE));
+    }
+
+    commandList->endMarker();
+}
+
+void PostProcessPass::RenderBloom(nvrhi::ICommandList* commandList, nvrhi::ITexture* source, PostProcessConstants constants)
+{
+    commandList->beginMarker("Bloom");
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, source),
+        nvrhi::BindingSetItem::Texture_UAV(3, m_BloomLevels[0])
+    };
+
+    // The levels cover the whole source, which is as large as the output
+    const nvrhi::TextureDesc& sourceDesc = m_Output->getDesc();
+    constants.sourceSize = uint2(sourceDesc.width, sourceDesc.height);
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_BloomDownsamplePipeline;
+
+    for (uint32_t level = 0; level < c_BloomLevels; level++)
+    {
+        const nvrhi::TextureDesc& levelDesc = m_BloomLevels[level]->getDesc();
+        constants.destSize = uint2(levelDesc.width, levelDesc.height);
+        commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+        state.bindings = { level == 0
+            ? m_BindingCache.GetOrCreateBindingSet(bindingSetDesc, m_BloomBindingLayout)
+            : m_BloomDownsampleBindingSets[level - 1] };
+        commandList->setComputeState(state);
+        commandList->dispatch(div_ceil(constants.destSize.x, BLOOM_GROUP_SIZE), div_ceil(constants.destSize.y, BLOOM_GROUP_SIZE));
+
+        constants.sourceSize = constants.destSize;
+    }
+
+    state.pipeline = m_BloomBlurPipeline;
+
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        constants.blurDirection = pass == 0 ? int2(1, 0) : int2(0, 1);
+        commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+        state.bindings = { m_BloomBlurBindingSets[pass] };
+        commandList->setComputeState(state);
+        commandList->dispatch(div_ceil(constants.destSize.x, BLOOM_GROUP_SIZE), div_ceil(constants.destSize.y, BLOOM_GROUP_SIZE));
+    }
+
+    commandList->endMarker();
+}
+
+void PostProcessPass::AdvanceFrame(float frameTime)
+{
+    m_FrameTime = frameTime;
+}
+
+void PostProcessPass::ResetExposure(nvrhi::ICommandList* commandList, float adaptedLuminance)
+{
+    uint32_t value;
+    memcpy(&value, &adaptedLuminance, sizeof(value));
+    commandList->clearBufferUInt(m_ExposureBuffer, value);
+}
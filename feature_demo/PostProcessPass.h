@@ -0,0 +1,95 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/BindingCache.h>
+#include <donut/engine/View.h>
+#include <donut/render/ToneMappingPasses.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+
+namespace donut::engine
+{
+    class ShaderFactory;
+    class CommonRenderPasses;
+}
+
+struct PostProcessConstants;
+
+// Post-processing of the resolved HDR color in compute: bloom composite, exposure, tone mapping and sRGB encoding
+// run as one pass over the view, which reads the HDR color once and writes the LDR color once. Bloom is blurred at
+// 1/8 resolution beforehand. The luminance histogram that drives exposure is accumulated either by a separate pass
+// over the HDR color, or by the fused pass itself, in which case the exposure lags the image by one frame.
+class PostProcessPass
+{
+public:
+    // The output must be an sRGB texture that is created typeless with UAV support. It is written through a UNORM view.
+    PostProcessPass(
+        nvrhi::IDevice* device,
+        std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
+        std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses,
+        nvrhi::ITexture* output,
+        nvrhi::IBuffer* exposureBufferOverride = nullptr);
+
+    void Render(nvrhi::ICommandList* commandList, const donut::render::ToneMappingParameters& params,
+        const donut::engine::ICompositeView& compositeView, nvrhi::ITexture* source,
+        bool enableBloom, float bloomSigma, float bloomAlpha, bool fusedHistogram);
+
+    void AdvanceFrame(float frameTime);
+    void ResetExposure(nvrhi::ICommandList* commandList, float adaptedLuminance);
+
+    [[nodiscard]] nvrhi::IBuffer* GetExposureBuffer() const { return m_ExposureBuffer; }
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::CommonRenderPasses> m_CommonPasses;
+    donut::engine::BindingCache m_BindingCache;
+
+    nvrhi::ITexture* m_Output;
+    nvrhi::Format m_OutputViewFormat;
+    nvrhi::BufferHandle m_ExposureBuffer;
+    nvrhi::BufferHandle m_HistogramBuffer;
+    bool m_HistogramCleared = false;
+    float m_FrameTime = 0.f;
+
+    static const uint32_t c_BloomLevels = 3;
+    nvrhi::TextureHandle m_BloomLevels[c_BloomLevels];
+    nvrhi::TextureHandle m_BloomBlurTemp;
+
+    nvrhi::BufferHandle m_Constants;
+    nvrhi::BindingLayoutHandle m_HistogramBindingLayout;
+    nvrhi::BindingLayoutHandle m_ExposureBindingLayout;
+    nvrhi::BindingLayoutHandle m_BloomBindingLayout;
+    nvrhi::BindingLayoutHandle m_PostProcessBindingLayout;
+    nvrhi::BindingSetHandle m_ExposureBindingSet;
+    nvrhi::BindingSetHandle m_BloomDownsampleBindingSets[c_BloomLevels - 1]; // Level i to i + 1, level 0 depends on the source
+    nvrhi::BindingSetHandle m_BloomBlurBindingSets[2];
+
+    nvrhi::ComputePipelineHandle m_HistogramPipeline;
+    nvrhi::ComputePipelineHandle m_ExposurePipeline;
+    nvrhi::ComputePipelineHandle m_BloomDownsamplePipeline;
+    nvrhi::ComputePipelineHandle m_BloomBlurPipeline;
+    nvrhi::ComputePipelineHandle m_PostProcessPipelines[2][2]; // [fusedHistogram][bloom]
+
+    void RenderBloom(nvrhi::ICommandList* commandList, nvrhi::ITexture* source, PostProcessConstants constants);
+};
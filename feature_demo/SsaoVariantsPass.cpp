@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SsaoVariantsPass.h"
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <nvrhi/utils.h>
+
+using namespace donut;
+using namespace donut::math;
+
+#include "ssao_variants_cb.h"
+
+// Weight of the current frame in the temporally accumulated occlusion
+static const float c_TemporalAlpha = 0.1f;
+
+SsaoVariantsPass::SsaoVariantsPass(
+    nvrhi::IDevice* device,
+    std::shared_ptr<engine::ShaderFactory> shaderFactory,
+    std::shared_ptr<engine::CommonRenderPasses> commonPasses,
+    nvrhi::ITexture* gbufferDepth,
+    nvrhi::ITexture* gbufferNormals,
+    nvrhi::ITexture* motionVectors,
+    nvrhi::ITexture* destination)
+    : m_Device(device)
+    , m_Destination(destination)
+{
+    const nvrhi::TextureDesc& depthDesc = gbufferDepth->getDesc();
+    const uint2 fullSize = uint2(depthDesc.width, depthDesc.height);
+    const uint2 halfSize = (fullSize + 1u) / 2u;
+
+    m_FullResolutionPass = std::make_unique<render::SsaoPass>(device, shaderFactory, commonPasses, gbufferDepth, gbufferNormals, destination);
+
+    nvrhi::TextureDesc desc;
+    desc.width = halfSize.x;
+    desc.height = halfSize.y;
+    desc.isUAV = true;
+    desc.initialState = nvrhi::ResourceStates::ShaderResource;
+    desc.keepInitialState = true;
+
+    desc.format = nvrhi::Format::R32_FLOAT;
+    desc.debugName = "SsaoHalfDepth";
+    m_HalfDepth = device->createTexture(desc);
+
+    desc.format = gbufferNormals->getDesc().format;
+    desc.debugName = "SsaoHalfNormals";
+    m_HalfNormals = device->createTexture(desc);
+
+    desc.format = destination->getDesc().format;
+    desc.debugName = "SsaoHalfOcclusion";
+    m_HalfOcclusion = device->createTexture(desc);
+
+    desc.width = fullSize.x;
+    desc.height = fullSize.y;
+    desc.isUAV = false;
+    desc.debugName = "SsaoHistory";
+    m_History = device->createTexture(desc);
+
+    m_HalfResolutionPass = std::make_unique<render::SsaoPass>(device, shaderFactory, commonPasses, m_HalfDepth, m_HalfNormals, m_HalfOcclusion);
+
+    m_Constants = device->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(SsaoVariantsConstants), "SsaoVariantsConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, gbufferDepth),
+        nvrhi::BindingSetItem::Texture_SRV(1, gbufferNormals),
+        nvrhi::BindingSetItem::Texture_UAV(0, m_HalfDepth),
+        nvrhi::BindingSetItem::Texture_UAV(1, m_HalfNormals)
+    };
+    nvrhi::utils::CreateBindingSetAndLayout(device, nvrhi::ShaderType::Compute, 0, bindingSetDesc, m_DownsampleBindingLayout, m_DownsampleBindingSet);
+
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_Constants),
+        nvrhi::BindingSetItem::Texture_SRV(0, gbufferDepth),
+        nvrhi::BindingSetItem::Texture_SRV(2, m_HalfDepth),
+        nvrhi::BindingSetItem::Texture_SRV(3, m_HalfOcclusion),
+        nvrhi::BindingSetItem::Texture_SRV(4, m_History),
+        nvrhi::BindingSetItem::Texture_SRV(5, motionVectors ? motionVectors : commonPasses->m_BlackTexture.Get()),
+        nvrhi::BindingSetItem::Texture_UAV(2, destination)
+    };
+    nvrhi::utils::CreateBindingSetAndLayout(device, nvrhi::ShaderType::Compute, 0, bindingSetDesc, m_UpsampleBindingLayout, m_UpsampleBindingSet);
+
+    nvrhi::ComputePipelineDesc pipelineDesc;
+    pipelineDesc.bindingLayouts = { m_DownsampleBindingLayout };
+    pipelineDesc.CS = shaderFactory->CreateShader("/shaders/app/ssao_variants.hlsl", "downsample_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_DownsamplePipeline = device->createComputePipeline(pipelineDesc);
+
+    std::vector<engine::ShaderMacro> defines = { { "TEMPORAL", "0" } };
+    pipelineDesc.bindingLayouts = { m_UpsampleBindingLayout };
+    pipelineDesc.CS = shaderFactory->CreateShader("/shaders/app/ssao_variants.hlsl", "upsample_cs", &defines, nvrhi::ShaderType::Compute);
+    m_UpsamplePipeline = device->createComputePipeline(pipelineDesc);
+
+    defines = { { "TEMPORAL", "1" } };
+    pipelineDesc.CS = shaderFactory->CreateShader("/shaders/app/ssao_variants.hlsl", "upsample_cs", &defines, nvrhi::ShaderType::Compute);
+    m_TemporalUpsamplePipeline = device->createComputePipeline(pipelineDesc);
+}
+
+void SsaoVariantsPass::Render(nvrhi::ICommandList* commandList, SsaoMode mode, const render::SsaoParameters& params,
+    const engine::IView& view, bool historyValid)
+{
+    const engine::PlanarView* planarView = dynamic_cast<const engine::PlanarView*>(&view);
+
+    if (mode == SsaoMode::FullResolution || !planarView)
+    {
+        m_FullResolutionPass->Render(commandList, params, view);
+        return;
+    }
+
+    commandList->beginMarker("SsaoHalfResolution");
+
+    // The view may cover only part of the textures when the render resolution is scaled
+    const nvrhi::Rect viewExtent = planarView->GetViewExtent();
+    const uint2 fullSize = uint2(viewExtent.maxX, viewExtent.maxY);
+    const uint2 halfSize = (fullSize + 1u) / 2u;
+
+    // Same camera and jitter as the full resolution view, on a viewport of half the size
+    m_HalfResolutionView.SetViewport(nvrhi::Viewport(float(halfSize.x), float(halfSize.y)));
+    m_HalfResolutionView.SetMatrices(planarView->GetViewMatrix(), planarView->GetProjectionMatrix(false));
+    m_HalfResolutionView.SetPixelOffset(planarView->GetPixelOffset() * 0.5f);
+    m_HalfResolutionView.UpdateCache();
+
+    const float4x4 projection = planarView->GetProjectionMatrix(false);
+
+    SsaoVariantsConstants constants = {};
+    constants.depthToViewZ = float2(projection.row3.z, projection.row2.z);
+    constants.halfSize = halfSize;
+    constants.fullSize = fullSize;
+    constants.temporalAlpha = c_TemporalAlpha;
+    constants.historyValid = historyValid ? 1 : 0;
+    commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_DownsamplePipeline;
+    state.bindings = { m_DownsampleBindingSet };
+    commandList->setComputeState(state);
+    commandList->dispatch(div_ceil(halfSize.x, SSAO_VARIANTS_GROUP_SIZE), div_ceil(halfSize.y, SSAO_VARIANTS_GROUP_SIZE));
+
+    m_HalfResolutionPass->Render(commandList, params, m_HalfResolutionView);
+
+    state.pipeline = mode == SsaoMode::Temporal ? m_TemporalUpsamplePipeline : m_UpsamplePipeline;
+    state.bindings = { m_UpsampleBindingSet };
+    commandList->setComputeState(state);
+    commandList->dispatch(div_ceil(fullSize.x, SSAO_VARIANTS_GROUP_SIZE), div_ceil(fullSize.y, SSAO_VARIANTS_GROUP_SIZE));
+
+    if (mode == SsaoMode::Temporal)
+        commandList->copyTexture(m_History, nvrhi::TextureSlice(), m_Destination, nvrhi::TextureSlice());
+
+    commandList->endMarker();
+}
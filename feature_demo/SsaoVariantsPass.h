@@ -0,0 +1,87 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/View.h>
+#include <donut/render/SsaoPass.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+
+namespace donut::engine
+{
+    class ShaderFactory;
+    class CommonRenderPasses;
+}
+
+enum class SsaoMode
+{
+    FullResolution,
+    HalfResolution,
+    Temporal,
+
+    Count
+};
+
+// Runs SsaoPass at full resolution, or at half resolution followed by a depth aware upsample, optionally accumulated
+// over frames with the G-buffer motion vectors. The half resolution modes evaluate a quarter of the pixels.
+// They need a planar view, and fall back to full resolution for other views, such as stereo views.
+class SsaoVariantsPass
+{
+public:
+    SsaoVariantsPass(
+        nvrhi::IDevice* device,
+        std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
+        std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses,
+        nvrhi::ITexture* gbufferDepth,
+        nvrhi::ITexture* gbufferNormals,
+        nvrhi::ITexture* motionVectors,
+        nvrhi::ITexture* destination);
+
+    // Writes the occlusion of the view into the destination texture. historyValid must be false when the previous
+    // frame's occlusion does not match the motion vectors, e.g. after a camera cut, a resize or a change of the view's
+    // viewport. The viewport must start at the origin and may be smaller than the textures.
+    void Render(nvrhi::ICommandList* commandList, SsaoMode mode, const donut::render::SsaoParameters& params,
+        const donut::engine::IView& view, bool historyValid);
+
+private:
+    nvrhi::DeviceHandle m_Device;
+
+    std::unique_ptr<donut::render::SsaoPass> m_FullResolutionPass;
+    std::unique_ptr<donut::render::SsaoPass> m_HalfResolutionPass;
+    donut::engine::PlanarView m_HalfResolutionView;
+
+    nvrhi::TextureHandle m_HalfDepth;
+    nvrhi::TextureHandle m_HalfNormals;
+    nvrhi::TextureHandle m_HalfOcclusion;
+    nvrhi::TextureHandle m_History;
+    nvrhi::ITexture* m_Destination;
+
+    nvrhi::BufferHandle m_Constants;
+    nvrhi::BindingLayoutHandle m_DownsampleBindingLayout;
+    nvrhi::BindingSetHandle m_DownsampleBindingSet;
+    nvrhi::BindingLayoutHandle m_UpsampleBindingLayout;
+    nvrhi::BindingSetHandle m_UpsampleBindingSet;
+    nvrhi::ComputePipelineHandle m_DownsamplePipeline;
+    nvrhi::ComputePipelineHandle m_UpsamplePipeline;
+    nvrhi::ComputePipelineHandle m_TemporalUpsamplePipeline;
+};
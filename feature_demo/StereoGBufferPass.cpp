@@ -0,0 +1,173 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "StereoGBufferPass.h"
+#include "flat_draw_strategy.h"
+#include "instanced_views.h"
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/View.h>
+#include <nvrhi/utils.h>
+
+using namespace donut;
+using namespace donut::math;
+
+#include "stereo_gbuffer_cb.h"
+
+StereoGBufferPass::StereoGBufferPass(
+    nvrhi::IDevice* device,
+    std::shared_ptr<engine::ShaderFactory> shaderFactory,
+    std::shared_ptr<engine::CommonRenderPasses> commonPasses,
+    nvrhi::IBindingLayout* bindlessLayout,
+    uint32_t stencilWriteMask)
+    : m_Device(device)
+    , m_CommonPasses(commonPasses)
+    , m_StencilWriteMask(stencilWriteMask)
+    , m_BindlessLayout(bindlessLayout)
+{
+    m_VertexShader = shaderFactory->CreateShader("/shaders/app/stereo_gbuffer.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
+    m_GeometryShader = shaderFactory->CreateShader("/shaders/app/stereo_gbuffer.hlsl", "gs_main", nullptr, nvrhi::ShaderType::Geometry);
+
+    std::vector<engine::ShaderMacro> defines = { { "ALPHA_TESTED", "0" } };
+    m_PixelShader = shaderFactory->CreateShader("/shaders/app/stereo_gbuffer.hlsl", "ps_main", &defines, nvrhi::ShaderType::Pixel);
+
+    defines = { { "ALPHA_TESTED", "1" } };
+    m_AlphaTestedPixelShader = shaderFactory->CreateShader("/shaders/app/stereo_gbuffer.hlsl", "ps_main", &defines, nvrhi::ShaderType::Pixel);
+
+    m_Constants = device->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(StereoGBufferConstants), "StereoGBufferConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+    // The binding set is created on the first Render, when the scene buffers are known
+    m_BindingLayout = device->createBindingLayout(GetInstancedViewsBindingLayoutDesc());
+}
+
+void StereoGBufferPass::CreatePipelines(nvrhi::IFramebuffer* framebuffer, bool frontCounterClockwise, bool reverseDepth)
+{
+    nvrhi::GraphicsPipelineDesc pipelineDesc;
+    pipelineDesc.VS = m_VertexShader;
+    pipelineDesc.GS = m_GeometryShader;
+    pipelineDesc.primType = nvrhi::PrimitiveType::TriangleList;
+    pipelineDesc.bindingLayouts = { m_BindingLayout, m_BindlessLayout };
+    pipelineDesc.renderState.rasterState.frontCounterClockwise = frontCounterClockwise;
+
+    nvrhi::DepthStencilState& depthStencilState = pipelineDesc.renderState.depthStencilState;
+    depthStencilState.depthTestEnable = true;
+    depthStencilState.depthWriteEnable = true;
+    depthStencilState.depthFunc = reverseDepth ? nvrhi::ComparisonFunc::GreaterOrEqual : nvrhi::ComparisonFunc::LessOrEqual;
+
+    // Marks the pixels that have motion vectors, like the stencil write of GBufferFillPass
+    if (m_StencilWriteMask)
+    {
+        depthStencilState.stencilEnable = true;
+        depthStencilState.stencilRefValue = uint8_t(m_StencilWriteMask);
+        depthStencilState.stencilWriteMask = uint8_t(m_StencilWriteMask);
+        depthStencilState.frontFaceStencil.passOp = nvrhi::StencilOp::Replace;
+        depthStencilState.backFaceStencil.passOp = nvrhi::StencilOp::Replace;
+    }
+
+    for (int doubleSided = 0; doubleSided < 2; doubleSided++)
+    {
+        pipelineDesc.renderState.rasterState.cullMode = doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+
+        pipelineDesc.PS = m_PixelShader;
+        m_Pipelines[doubleSided][0] = m_Device->createGraphicsPipeline(pipelineDesc, framebuffer);
+
+        pipelineDesc.PS = m_AlphaTestedPixelShader;
+        m_Pipelines[doubleSided][1] = m_Device->createGraphicsPipeline(pipelineDesc, framebuffer);
+    }
+
+    m_FramebufferInfo = framebuffer->getFramebufferInfo();
+    m_FrontCounterClockwise = frontCounterClockwise;
+    m_ReverseDepth = reverseDepth;
+}
+
+void StereoGBufferPass::Render(nvrhi::ICommandList* commandList,
+    const engine::StereoPlanarView& view,
+    const engine::StereoPlanarView& viewPrevious,
+    nvrhi::IFramebuffer* framebuffer,
+    const engine::Scene& scene,
+    nvrhi::IDescriptorTable* descriptorTable,
+    const FlatDrawList& drawList,
+    const FlatOpaqueDrawStrategy& drawStrategy)
+{
+    // The scene buffers are recreated when they grow
+    if (!m_BindingSet
+        || m_InstanceBuffer != scene.GetInstanceBuffer()
+        || m_GeometryBuffer != scene.GetGeometryBuffer()
+        || m_MaterialBuffer != scene.GetMaterialBuffer())
+    {
+        m_InstanceBuffer = scene.GetInstanceBuffer();
+        m_GeometryBuffer = scene.GetGeometryBuffer();
+        m_MaterialBuffer = scene.GetMaterialBuffer();
+
+        const nvrhi::BindingSetDesc bindingSetDesc = GetInstancedViewsBindingSetDesc(m_Constants, scene, m_CommonPasses->m_AnisotropicWrapSampler);
+        m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+    }
+
+    const bool frontCounterClockwise = !view.LeftView.IsMirrored();
+    const bool reverseDepth = view.LeftView.IsReverseDepth();
+    if (!m_Pipelines[0][0]
+        || !(m_FramebufferInfo == framebuffer->getFramebufferInfo())
+        || m_FrontCounterClockwise != frontCounterClockwise
+        || m_ReverseDepth != reverseDepth)
+    {
+        CreatePipelines(framebuffer, frontCounterClockwise, reverseDepth);
+    }
+
+    commandList->beginMarker("StereoGBufferFill");
+
+    StereoGBufferConstants constants = {};
+    view.LeftView.FillPlanarViewConstants(constants.view[0]);
+    view.RightView.FillPlanarViewConstants(constants.view[1]);
+    viewPrevious.LeftView.FillPlanarViewConstants(constants.viewPrev[0]);
+    viewPrevious.RightView.FillPlanarViewConstants(constants.viewPrev[1]);
+    commandList->writeBuffer(m_Constants, &constants, sizeof(constants));
+
+    nvrhi::GraphicsState state;
+    state.framebuffer = framebuffer;
+    state.bindings = { m_BindingSet, descriptorTable };
+
+    // Viewport i is the viewport of eye i, selected by the geometry shader
+    for (const engine::PlanarView* eyeView : { &view.LeftView, &view.RightView })
+    {
+        const nvrhi::ViewportState eyeViewport = eyeView->GetViewportState();
+        state.viewport.addViewport(eyeViewport.viewports[0]);
+        state.viewport.addScissorRect(eyeViewport.scissorRects[0]);
+    }
+
+    // Child view i of the stereo view is eye i
+    const InstancedViewsDrawStats stats = DrawInstancedViews(commandList, state, drawList,
+        drawStrategy.GetSharedVisibleItems(), drawStrategy.GetSharedViewMasks(),
+        [this](const render::DrawItem& item)
+        {
+            const bool doubleSided = item.cullMode == nvrhi::RasterCullMode::None;
+            const bool alphaTested = item.material->domain == engine::MaterialDomain::AlphaTested;
+            return m_Pipelines[doubleSided ? 1 : 0][alphaTested ? 1 : 0].Get();
+        });
+
+    m_DrawCount = stats.drawCount;
+    m_EyeDrawCount = stats.viewDrawCount;
+
+    commandList->endMarker();
+}
@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <memory>
+
+namespace donut::engine
+{
+    class ShaderFactory;
+    class CommonRenderPasses;
+    class Scene;
+    class StereoPlanarView;
+}
+
+class FlatDrawList;
+class FlatOpaqueDrawStrategy;
+
+// Fills the G-buffer for both eyes of a stereo view in one pass over the draw list with DrawInstancedViews: every item
+// is drawn once, with one instance per eye that sees it, sent to the eye's viewport. The per-eye GBufferFillPass walks
+// the list and binds the geometry twice. The scene must be loaded with the descriptor table whose layout is passed
+// here, and the pass is not available on D3D11.
+class StereoGBufferPass
+{
+public:
+    StereoGBufferPass(
+        nvrhi::IDevice* device,
+        std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
+        std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses,
+        nvrhi::IBindingLayout* bindlessLayout,
+        uint32_t stencilWriteMask);
+
+    // Draws the items that the last CullForViews of drawStrategy found visible in the eyes of view, each only into
+    // the eyes that see it. drawStrategy must have been culled with view. viewPrevious is the view of the previous
+    // frame, for the motion vectors.
+    void Render(nvrhi::ICommandList* commandList,
+        const donut::engine::StereoPlanarView& view,
+        const donut::engine::StereoPlanarView& viewPrevious,
+        nvrhi::IFramebuffer* framebuffer,
+        const donut::engine::Scene& scene,
+        nvrhi::IDescriptorTable* descriptorTable,
+        const FlatDrawList& drawList,
+        const FlatOpaqueDrawStrategy& drawStrategy);
+
+    // Number of draws issued by the last Render, and the number of eyes they were drawn into
+    uint32_t GetLastDrawCount() const { return m_DrawCount; }
+    uint32_t GetLastEyeDrawCount() const { return m_EyeDrawCount; }
+
+private:
+    void CreatePipelines(nvrhi::IFramebuffer* framebuffer, bool frontCounterClockwise, bool reverseDepth);
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::CommonRenderPasses> m_CommonPasses;
+    uint32_t m_StencilWriteMask;
+
+    nvrhi::ShaderHandle m_VertexShader;
+    nvrhi::ShaderHandle m_GeometryShader;
+    nvrhi::ShaderHandle m_PixelShader;
+    nvrhi::ShaderHandle m_AlphaTestedPixelShader;
+    nvrhi::BufferHandle m_Constants;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::BindingLayoutHandle m_BindlessLayout;
+    nvrhi::BindingSetHandle m_BindingSet;
+
+    // The scene buffers that m_BindingSet was created with
+    nvrhi::BufferHandle m_InstanceBuffer;
+    nvrhi::BufferHandle m_GeometryBuffer;
+    nvrhi::BufferHandle m_MaterialBuffer;
+
+    // Indexed by [double sided][alpha tested], created for the framebuffer and view state below
+    nvrhi::GraphicsPipelineHandle m_Pipelines[2][2];
+    nvrhi::FramebufferInfo m_FramebufferInfo;
+    bool m_FrontCounterClockwise = false;
+    bool m_ReverseDepth = false;
+
+    uint32_t m_DrawCount = 0;
+    uint32_t m_EyeDrawCount = 0;
+};
@@ -0,0 +1,217 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include "postprocess_cb.h"
+
+#if POSTPROCESS_GROUP_SIZE * POSTPROCESS_GROUP_SIZE != POSTPROCESS_HISTOGRAM_BINS
+#error "Each thread of a postprocess_cs group must own one histogram bin"
+#endif
+
+ConstantBuffer<PostProcessConstants> g_Const : register(b0);
+
+Texture2D<float4> t_Source : register(t0);
+Texture2D<float4> t_Bloom : register(t1);
+Buffer<uint> t_Exposure : register(t2);
+SamplerState s_Linear : register(s0);
+
+RWTexture2D<float4> u_Output : register(u0);
+RWBuffer<uint> u_Histogram : register(u1);
+RWBuffer<uint> u_Exposure : register(u2);
+RWTexture2D<float4> u_BloomDest : register(u3);
+
+static const float3 c_LuminanceWeights = float3(0.2126, 0.7152, 0.0722);
+static const float c_MiddleGray = 0.18;
+
+groupshared uint s_Histogram[POSTPROCESS_HISTOGRAM_BINS];
+
+uint GetHistogramBin(float3 color)
+{
+    float logLuminance = log2(max(dot(color, c_LuminanceWeights), 1e-10));
+    return uint(saturate(logLuminance * g_Const.logLuminanceScale + g_Const.logLuminanceBias) * (POSTPROCESS_HISTOGRAM_BINS - 1));
+}
+
+float GetBinLogLuminance(uint bin)
+{
+    return (float(bin) / (POSTPROCESS_HISTOGRAM_BINS - 1) - g_Const.logLuminanceBias) / g_Const.logLuminanceScale;
+}
+
+// Exposure and extended Reinhard on the luminance, which keeps the hue of saturated highlights
+float3 ToneMap(float3 color)
+{
+    float adaptedLuminance = asfloat(t_Exposure[0]);
+    color *= g_Const.exposureScale * c_MiddleGray / adaptedLuminance;
+
+    float luminance = dot(color, c_LuminanceWeights);
+    float mappedLuminance = luminance * (1.0 + luminance * g_Const.whitePointInvSquared) / (1.0 + luminance);
+    return saturate(color * (mappedLuminance / max(luminance, 1e-6)));
+}
+
+float3 EncodeSrgb(float3 color)
+{
+    return lerp(color * 12.92, 1.055 * pow(color, 1.0 / 2.4) - 0.055, step(0.0031308, color));
+}
+
+void ClearGroupHistogram(uint threadIndex)
+{
+    s_Histogram[threadIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+}
+
+void FlushGroupHistogram(uint threadIndex)
+{
+    GroupMemoryBarrierWithGroupSync();
+    uint count = s_Histogram[threadIndex];
+    if (count != 0)
+        InterlockedAdd(u_Histogram[threadIndex], count);
+}
+
+// Luminance histogram of the view, for when it is not accumulated by postprocess_cs
+[numthreads(POSTPROCESS_GROUP_SIZE, POSTPROCESS_GROUP_SIZE, 1)]
+void histogram_cs(uint2 pixel : SV_DispatchThreadID, uint threadIndex : SV_GroupIndex)
+{
+    ClearGroupHistogram(threadIndex);
+
+    if (all(pixel < g_Const.viewSize))
+        InterlockedAdd(s_Histogram[GetHistogramBin(t_Source[pixel + g_Const.viewOrigin].rgb)], 1);
+
+    FlushGroupHistogram(threadIndex);
+}
+
+// Adapts the exposure towards the average luminance between the histogram percentiles, and clears the histogram
+// for the next frame. Runs as a single group.
+[numthreads(POSTPROCESS_HISTOGRAM_BINS, 1, 1)]
+void exposure_cs(uint bin : SV_GroupIndex)
+{
+    s_Histogram[bin] = u_Histogram[bin];
+    u_Histogram[bin] = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    if (bin != 0)
+        return;
+
+    uint total = 0;
+    for (uint i = 0; i < POSTPROCESS_HISTOGRAM_BINS; i++)
+        total += s_Histogram[i];
+
+    float low = float(total) * g_Const.histogramLowPercentile;
+    float high = float(total) * g_Const.histogramHighPercentile;
+    float counted = 0;
+    float logLuminanceSum = 0;
+    float weightSum = 0;
+
+    for (uint j = 0; j < POSTPROCESS_HISTOGRAM_BINS; j++)
+    {
+        float count = float(s_Histogram[j]);
+        float weight = min(counted + count, high) - max(counted, low);
+        counted += count;
+
+        if (weight > 0)
+        {
+            logLuminanceSum += GetBinLogLuminance(j) * weight;
+            weightSum += weight;
+        }
+    }
+
+    // Nothing was rendered, keep the current exposure
+    if (weightSum <= 0)
+        return;
+
+    float targetLuminance = clamp(exp2(logLuminanceSum / weightSum), g_Const.minAdaptedLuminance, g_Const.maxAdaptedLuminance);
+    float adaptedLuminance = asfloat(u_Exposure[0]);
+    float speed = targetLuminance > adaptedLuminance ? g_Const.eyeAdaptationSpeedUp : g_Const.eyeAdaptationSpeedDown;
+    adaptedLuminance = lerp(targetLuminance, adaptedLuminance, exp(-g_Const.frameTime * speed));
+
+    u_Exposure[0] = asuint(adaptedLuminance);
+}
+
+// Halves the resolution of a bloom level with a box filter
+[numthreads(BLOOM_GROUP_SIZE, BLOOM_GROUP_SIZE, 1)]
+void bloom_downsample_cs(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Const.destSize))
+        return;
+
+    float4 sum = 0;
+
+    [unroll]
+    for (uint i = 0; i < 4; i++)
+        sum += t_Source[min(pixel * 2 + uint2(i & 1, i >> 1), g_Const.sourceSize - 1)];
+
+    u_BloomDest[pixel] = sum * 0.25;
+}
+
+// One direction of a separable Gaussian blur of the smallest bloom level
+[numthreads(BLOOM_GROUP_SIZE, BLOOM_GROUP_SIZE, 1)]
+void bloom_blur_cs(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Const.destSize))
+        return;
+
+    float sigma = max(g_Const.bloomSigma, 0.5);
+    int radius = min(int(ceil(sigma * 3.0)), BLOOM_MAX_BLUR_RADIUS);
+
+    float4 sum = 0;
+    float weightSum = 0;
+
+    for (int i = -radius; i <= radius; i++)
+    {
+        int2 samplePixel = clamp(int2(pixel) + g_Const.blurDirection * i, 0, int2(g_Const.destSize) - 1);
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+        sum += t_Source[samplePixel] * weight;
+        weightSum += weight;
+    }
+
+    u_BloomDest[pixel] = sum / weightSum;
+}
+
+// Bloom composite, exposure, tone mapping and sRGB encoding of the view in one pass: the HDR color is read once,
+// and the LDR color written once. The fused variant also accumulates the luminance histogram for the next frame.
+[numthreads(POSTPROCESS_GROUP_SIZE, POSTPROCESS_GROUP_SIZE, 1)]
+void postprocess_cs(uint2 pixel : SV_DispatchThreadID, uint threadIndex : SV_GroupIndex)
+{
+#if FUSED_HISTOGRAM
+    ClearGroupHistogram(threadIndex);
+#endif
+
+    if (all(pixel < g_Const.viewSize))
+    {
+        uint2 position = pixel + g_Const.viewOrigin;
+        float3 color = t_Source[position].rgb;
+
+#if BLOOM
+        float3 bloom = t_Bloom.SampleLevel(s_Linear, (float2(position) + 0.5) * g_Const.bloomUvScale, 0).rgb;
+        color = lerp(color, bloom, g_Const.bloomAlpha);
+#endif
+
+#if FUSED_HISTOGRAM
+        InterlockedAdd(s_Histogram[GetHistogramBin(color)], 1);
+#endif
+
+        u_Output[position] = float4(EncodeSrgb(ToneMap(color)), 1.0);
+    }
+
+#if FUSED_HISTOGRAM
+    FlushGroupHistogram(threadIndex);
+#endif
+}
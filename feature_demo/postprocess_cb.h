@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef POSTPROCESS_CB_H
+#define POSTPROCESS_CB_H
+
+#define POSTPROCESS_GROUP_SIZE 16
+#define POSTPROCESS_HISTOGRAM_BINS 256 // Equal to the number of threads in a group, each thread owns one bin
+#define BLOOM_GROUP_SIZE 8
+#define BLOOM_MAX_BLUR_RADIUS 32
+
+struct PostProcessConstants
+{
+    uint2 viewOrigin;
+    uint2 viewSize;
+
+    uint2 sourceSize; // Bloom passes: extent of the source level
+    uint2 destSize; // Bloom passes: extent of the destination level
+
+    float2 bloomUvScale; // Maps full resolution pixel centers to bloom texture coordinates
+    int2 blurDirection;
+
+    float bloomSigma; // In pixels of the blurred level
+    float bloomAlpha;
+    float exposureScale;
+    float whitePointInvSquared;
+
+    float logLuminanceScale; // Maps log2 luminance to histogram bins
+    float logLuminanceBias;
+    float histogramLowPercentile;
+    float histogramHighPercentile;
+
+    float eyeAdaptationSpeedUp;
+    float eyeAdaptationSpeedDown;
+    float minAdaptedLuminance;
+    float maxAdaptedLuminance;
+
+    float frameTime;
+};
+
+#endif // POSTPROCESS_CB_H
@@ -0,0 +1,151 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include "ssao_variants_cb.h"
+
+ConstantBuffer<SsaoVariantsConstants> g_Const : register(b0);
+
+// downsample_cs
+Texture2D<float> t_Depth : register(t0);
+Texture2D<float4> t_Normals : register(t1);
+RWTexture2D<float> u_HalfDepth : register(u0);
+RWTexture2D<float4> u_HalfNormals : register(u1);
+
+// upsample_cs, also reads t_Depth
+Texture2D<float> t_HalfDepth : register(t2);
+Texture2D<float> t_HalfOcclusion : register(t3);
+Texture2D<float> t_History : register(t4);
+Texture2D<float4> t_MotionVectors : register(t5);
+RWTexture2D<float> u_Occlusion : register(u2);
+
+// Relative depth difference at which an upsampling tap loses half of its weight
+static const float c_DepthTolerance = 0.02;
+
+float GetViewZ(float depth)
+{
+    return g_Const.depthToViewZ.x / (depth - g_Const.depthToViewZ.y);
+}
+
+// Keeps one full resolution sample of each 2x2 quad, the closest one, so that the depth and the normal
+// seen by SSAO belong to the same surface. Averaging them would create surfaces that do not exist.
+[numthreads(SSAO_VARIANTS_GROUP_SIZE, SSAO_VARIANTS_GROUP_SIZE, 1)]
+void downsample_cs(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Const.halfSize))
+        return;
+
+    float closestDepth = -1.0;
+    uint2 closestPixel = pixel * 2;
+
+    [unroll]
+    for (uint i = 0; i < 4; i++)
+    {
+        uint2 samplePixel = min(pixel * 2 + uint2(i & 1, i >> 1), g_Const.fullSize - 1);
+        float depth = t_Depth[samplePixel];
+
+        // Reverse Z: larger is closer
+        if (depth > closestDepth)
+        {
+            closestDepth = depth;
+            closestPixel = samplePixel;
+        }
+    }
+
+    u_HalfDepth[pixel] = closestDepth;
+    u_HalfNormals[pixel] = t_Normals[closestPixel];
+}
+
+// Upsamples the half resolution occlusion with bilinear weights scaled down for the taps whose depth differs
+// from the full resolution pixel, so that occlusion does not bleed across depth discontinuities. The temporal
+// variant then blends the result with the occlusion of the previous frame, reprojected with the motion vectors.
+[numthreads(SSAO_VARIANTS_GROUP_SIZE, SSAO_VARIANTS_GROUP_SIZE, 1)]
+void upsample_cs(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Const.fullSize))
+        return;
+
+    float depth = t_Depth[pixel];
+    if (depth <= 0)
+    {
+        // Sky
+        u_Occlusion[pixel] = 1.0;
+        return;
+    }
+
+    float viewZ = GetViewZ(depth);
+
+    float2 halfPosition = (float2(pixel) + 0.5) * 0.5 - 0.5;
+    int2 basePixel = int2(floor(halfPosition));
+    float2 fraction = halfPosition - float2(basePixel);
+
+    float bilinearWeights[4] = {
+        (1.0 - fraction.x) * (1.0 - fraction.y),
+        fraction.x * (1.0 - fraction.y),
+        (1.0 - fraction.x) * fraction.y,
+        fraction.x * fraction.y
+    };
+
+    float occlusion = 0;
+    float totalWeight = 0;
+    float minOcclusion = 1.0;
+    float maxOcclusion = 0.0;
+    float nearestOcclusion = 1.0;
+    float nearestDifference = 1e30;
+
+    [unroll]
+    for (uint i = 0; i < 4; i++)
+    {
+        int2 samplePixel = clamp(basePixel + int2(i & 1, i >> 1), 0, int2(g_Const.halfSize) - 1);
+        float sampleOcclusion = t_HalfOcclusion[samplePixel];
+        float difference = abs(GetViewZ(t_HalfDepth[samplePixel]) - viewZ) / viewZ;
+
+        float weight = bilinearWeights[i] * c_DepthTolerance / (c_DepthTolerance + difference);
+        occlusion += sampleOcclusion * weight;
+        totalWeight += weight;
+
+        minOcclusion = min(minOcclusion, sampleOcclusion);
+        maxOcclusion = max(maxOcclusion, sampleOcclusion);
+
+        if (difference < nearestDifference)
+        {
+            nearestDifference = difference;
+            nearestOcclusion = sampleOcclusion;
+        }
+    }
+
+    // All taps are on other surfaces: take the closest in depth rather than a blend of wrong values
+    occlusion = totalWeight > 1e-4 ? occlusion / totalWeight : nearestOcclusion;
+
+#if TEMPORAL
+    float2 previousPosition = float2(pixel) + 0.5 + t_MotionVectors[pixel].xy;
+    if (g_Const.historyValid != 0 && all(previousPosition >= 0) && all(previousPosition < float2(g_Const.fullSize)))
+    {
+        // Clamping to the range of the current taps rejects the history of disoccluded pixels
+        float history = clamp(t_History[int2(previousPosition)], minOcclusion, maxOcclusion);
+        occlusion = lerp(history, occlusion, g_Const.temporalAlpha);
+    }
+#endif
+
+    u_Occlusion[pixel] = occlusion;
+}
@@ -0,0 +1,98 @@
+/*
+* Copyright (c) 2014-2022, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma pack_matrix(row_major)
+
+#define INSTANCED_VIEWS_VIEWPORTS 1
+
+#include <donut/shaders/scene_material.hlsli>
+#include <donut/shaders/motion_vectors.hlsli>
+#include "../examples/instanced_views/instanced_views.hlsli"
+#include "stereo_gbuffer_cb.h"
+
+ConstantBuffer<StereoGBufferConstants> g_Const : register(b0);
+
+// Every instance of a draw is the same geometry instance, seen by the next eye in the draw's view list,
+// and gs_main routes it to the viewport of that eye
+void vs_main(
+    in uint i_vertexID : SV_VertexID,
+    in uint i_instanceID : SV_InstanceID,
+    out InstancedViewVertex o_vertex)
+{
+    float3 worldSpacePosition = LoadInstancedViewVertex(i_vertexID, i_instanceID, o_vertex);
+
+    o_vertex.position = mul(float4(worldSpacePosition, 1.0), g_Const.view[o_vertex.view].matWorldToClip);
+}
+
+float4 SampleMaterialTexture(int textureIndex, float2 uv)
+{
+    Texture2D materialTexture = t_BindlessTextures[NonUniformResourceIndex(textureIndex)];
+    return materialTexture.Sample(s_MaterialSampler, uv);
+}
+
+// Writes the same channels as the G-buffer fill pass of the engine, so that the deferred passes read either
+void ps_main(
+    in InstancedViewVertex i_vertex,
+    in bool i_isFrontFace : SV_IsFrontFace,
+    out float4 o_channel0 : SV_Target0,
+    out float4 o_channel1 : SV_Target1,
+    out float4 o_channel2 : SV_Target2,
+    out float4 o_channel3 : SV_Target3,
+    out float3 o_motion : SV_Target4)
+{
+    MaterialConstants material = t_MaterialConstants[i_vertex.material];
+
+    MaterialTextureSample textures = DefaultMaterialTextures();
+    if ((material.flags & MaterialFlags_UseBaseOrDiffuseTexture) != 0 && material.baseOrDiffuseTextureIndex >= 0)
+        textures.baseOrDiffuse = SampleMaterialTexture(material.baseOrDiffuseTextureIndex, i_vertex.uv);
+    if ((material.flags & MaterialFlags_UseMetalRoughOrSpecularTexture) != 0 && material.metalRoughOrSpecularTextureIndex >= 0)
+        textures.metalRoughOrSpecular = SampleMaterialTexture(material.metalRoughOrSpecularTextureIndex, i_vertex.uv);
+    if ((material.flags & MaterialFlags_UseNormalTexture) != 0 && material.normalTextureIndex >= 0)
+        textures.normal = SampleMaterialTexture(material.normalTextureIndex, i_vertex.uv);
+    if ((material.flags & MaterialFlags_UseEmissiveTexture) != 0 && material.emissiveTextureIndex >= 0)
+        textures.emissive = SampleMaterialTexture(material.emissiveTextureIndex, i_vertex.uv);
+    if ((material.flags & MaterialFlags_UseOcclusionTexture) != 0 && material.occlusionTextureIndex >= 0)
+        textures.occlusion = SampleMaterialTexture(material.occlusionTextureIndex, i_vertex.uv);
+    if ((material.flags & MaterialFlags_UseOpacityTexture) != 0 && material.opacityTextureIndex >= 0)
+        textures.opacity = SampleMaterialTexture(material.opacityTextureIndex, i_vertex.uv);
+
+    MaterialSample surface = EvaluateSceneMaterial(normalize(i_vertex.normal), i_vertex.tangent, material, textures);
+
+#if ALPHA_TESTED
+    clip(surface.opacity - material.alphaCutoff);
+#endif
+
+    if (!i_isFrontFace)
+        surface.shadingNormal = -surface.shadingNormal;
+
+    o_channel0.xyz = surface.diffuseAlbedo;
+    o_channel0.w = surface.opacity;
+    o_channel1.xyz = surface.specularF0;
+    o_channel1.w = surface.occlusion;
+    o_channel2.xyz = surface.shadingNormal;
+    o_channel2.w = surface.roughness;
+    o_channel3.xyz = surface.emissiveColor;
+    o_channel3.w = 0;
+
+    o_motion = GetMotionVector(i_vertex.position.xyz, i_vertex.prevWorldPosition, g_Const.view[i_vertex.view], g_Const.viewPrev[i_vertex.view]);
+}